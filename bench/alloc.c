@@ -0,0 +1,61 @@
+// LD_PRELOAD allocation counter for benchmarks. Every malloc, calloc,
+// realloc and aligned allocation is counted and forwarded to glibc; the
+// totals go to stderr when the process exits, as one line bench/run.sh
+// looks for.
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size);
+void *calloc(size_t count, size_t size);
+void *realloc(void *ptr, size_t size);
+void *aligned_alloc(size_t alignment, size_t size);
+int posix_memalign(void **ptr, size_t alignment, size_t size);
+
+static _Atomic uint64_t alloc_calls;
+static _Atomic uint64_t alloc_bytes;
+
+static void count(size_t size) {
+  atomic_fetch_add_explicit(&alloc_calls, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&alloc_bytes, size, memory_order_relaxed);
+}
+
+void *malloc(size_t size) {
+  count(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count_, size_t size) {
+  count(count_ * size);
+  return __libc_calloc(count_, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  count(size);
+  return __libc_realloc(ptr, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  count(size);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  count(size);
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr ? 0 : ENOMEM;
+}
+
+__attribute__((destructor)) static void report(void) {
+  fprintf(stderr, "Allocations: %llu calls, %llu bytes\n",
+          (unsigned long long)atomic_load(&alloc_calls),
+          (unsigned long long)atomic_load(&alloc_bytes));
+}
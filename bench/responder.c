@@ -0,0 +1,456 @@
+// Simulated network for benchmarks: a TUN device that owns one prefix and
+// answers pings and TCP SYNs for a deterministic subset of its addresses,
+// with a fixed RTT, optional jitter and optional loss. Every decision is a
+// hash of the packet and the seed, so runs see the same network no matter
+// how probes are ordered or threaded.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "addr.h"
+#include "clock.h"
+#include "icmp.h"
+
+#define RESPONDER_DEFAULT_DEV "nibench0"
+#define RESPONDER_DEFAULT_NET "10.250.0.0/16"
+#define RESPONDER_DEFAULT_DENSITY 0.25
+#define RESPONDER_DEFAULT_RTT_US 200
+#define RESPONDER_MAX_PORTS 8
+#define RESPONDER_TXQUEUE_LEN 16384
+
+// Replies waiting out their RTT, kept as a binary heap on due time
+#define RESPONDER_QUEUE_LEN 65536
+#define RESPONDER_PACKET_LEN 64
+
+// Longest sleep with nothing queued, so signals are noticed
+#define RESPONDER_IDLE_NS (100 * NS_PER_MS)
+
+typedef struct {
+  uint64_t due_ns;
+  uint16_t len;
+  uint8_t packet[RESPONDER_PACKET_LEN];
+} pending_t;
+
+typedef struct {
+  uint32_t net;
+  uint32_t mask;
+  double density;
+  double loss;
+  uint32_t rtt_us;
+  uint32_t jitter_us;
+  uint32_t seed;
+  uint16_t ports[RESPONDER_MAX_PORTS]; // open; the rest answer RST
+  int port_count;
+
+  pending_t *queue;
+  size_t queued;
+
+  uint64_t requests;
+  uint64_t replies;
+  uint64_t dropped;
+} responder_t;
+
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int sig) {
+  (void)sig;
+  stopping = 1;
+}
+
+// splitmix64 finaliser: a fixed, well-mixed hash of everything a
+// decision depends on
+static uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static double unit(uint64_t hash) {
+  return (double)(hash >> 11) / (double)(1ULL << 53);
+}
+
+static int host_alive(const responder_t *sim, uint32_t addr) {
+  return unit(mix((uint64_t)sim->seed << 32 | addr)) < sim->density;
+}
+
+// Loss and jitter are drawn per probe, keyed by what makes it unique
+static uint64_t probe_hash(const responder_t *sim, uint32_t addr,
+                           uint32_t key) {
+  return mix(mix((uint64_t)sim->seed << 32 | addr) ^ key);
+}
+
+static void queue_push(responder_t *sim, const uint8_t *packet, size_t len,
+                       uint64_t due_ns) {
+  if (sim->queued == RESPONDER_QUEUE_LEN || len > RESPONDER_PACKET_LEN) {
+    sim->dropped++;
+    return;
+  }
+
+  size_t i = sim->queued++;
+  while (i > 0 && sim->queue[(i - 1) / 2].due_ns > due_ns) {
+    sim->queue[i] = sim->queue[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  sim->queue[i].due_ns = due_ns;
+  sim->queue[i].len = (uint16_t)len;
+  memcpy(sim->queue[i].packet, packet, len);
+}
+
+static void queue_pop(responder_t *sim) {
+  pending_t last = sim->queue[--sim->queued];
+  size_t i = 0;
+
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= sim->queued)
+      break;
+    if (child + 1 < sim->queued &&
+        sim->queue[child + 1].due_ns < sim->queue[child].due_ns)
+      child++;
+    if (sim->queue[child].due_ns >= last.due_ns)
+      break;
+    sim->queue[i] = sim->queue[child];
+    i = child;
+  }
+  if (sim->queued > 0)
+    sim->queue[i] = last;
+}
+
+// Turn the request's IP header around in place
+static void reply_ip(struct iphdr *ip, size_t len) {
+  uint32_t src = ip->saddr;
+  ip->saddr = ip->daddr;
+  ip->daddr = src;
+  ip->ttl = 64;
+  ip->tot_len = htons((uint16_t)len);
+  ip->check = 0;
+  ip->check = icmp_checksum(ip, (size_t)ip->ihl * 4);
+}
+
+static size_t answer_icmp(uint8_t *packet, size_t len, size_t offset,
+                          uint32_t *key) {
+  if (len < offset + sizeof(struct icmphdr))
+    return 0;
+
+  struct icmphdr icmp;
+  memcpy(&icmp, packet + offset, sizeof(icmp));
+  if (icmp.type != ICMP_ECHO)
+    return 0;
+  *key = (uint32_t)icmp.un.echo.id << 16 | icmp.un.echo.sequence;
+
+  icmp.type = ICMP_ECHOREPLY;
+  icmp.checksum = 0;
+  memcpy(packet + offset, &icmp, sizeof(icmp));
+  icmp.checksum = icmp_checksum(packet + offset, len - offset);
+  memcpy(packet + offset, &icmp, sizeof(icmp));
+  return len;
+}
+
+// SYN-ACK from an open port, RST from a closed one; everything after the
+// handshake is ignored
+static size_t answer_tcp(const responder_t *sim, uint8_t *packet, size_t len,
+                         size_t offset, uint32_t *key) {
+  if (len < offset + sizeof(struct tcphdr))
+    return 0;
+
+  struct tcphdr tcp;
+  memcpy(&tcp, packet + offset, sizeof(tcp));
+  if (!tcp.syn || tcp.ack)
+    return 0;
+  *key = ntohl(tcp.seq) ^ (uint32_t)tcp.dest << 16;
+
+  int open = 0;
+  for (int i = 0; i < sim->port_count; ++i)
+    open |= sim->ports[i] == ntohs(tcp.dest);
+
+  struct tcphdr out = {.source = tcp.dest,
+                       .dest = tcp.source,
+                       .ack_seq = htonl(ntohl(tcp.seq) + 1),
+                       .doff = sizeof(out) / 4,
+                       .ack = 1};
+  if (open) {
+    out.seq = htonl((uint32_t)mix(*key));
+    out.syn = 1;
+    out.window = htons(65535);
+  } else {
+    out.rst = 1;
+  }
+
+  const struct iphdr *ip = (const struct iphdr *)packet;
+  uint8_t pseudo[12 + sizeof(out)];
+  memcpy(pseudo, &ip->daddr, 4);
+  memcpy(pseudo + 4, &ip->saddr, 4);
+  pseudo[8] = 0;
+  pseudo[9] = IPPROTO_TCP;
+  pseudo[10] = 0;
+  pseudo[11] = sizeof(out);
+  memcpy(pseudo + 12, &out, sizeof(out));
+  out.check = icmp_checksum(pseudo, sizeof(pseudo));
+
+  memcpy(packet + offset, &out, sizeof(out));
+  return offset + sizeof(out);
+}
+
+// Queue the answer to one packet read from the device, if it gets one
+static void handle(responder_t *sim, uint8_t *packet, size_t len,
+                   uint64_t now) {
+  if (len < sizeof(struct iphdr))
+    return;
+
+  struct iphdr *ip = (struct iphdr *)packet;
+  size_t offset = (size_t)ip->ihl * 4;
+  uint32_t dst = ntohl(ip->daddr);
+  if (ip->version != 4 || (dst & sim->mask) != sim->net ||
+      offset < sizeof(*ip) || len < offset)
+    return;
+
+  sim->requests++;
+  if (!host_alive(sim, dst))
+    return;
+
+  uint32_t key = 0;
+  size_t out_len = 0;
+  if (ip->protocol == IPPROTO_ICMP)
+    out_len = answer_icmp(packet, len, offset, &key);
+  else if (ip->protocol == IPPROTO_TCP)
+    out_len = answer_tcp(sim, packet, len, offset, &key);
+  if (out_len == 0)
+    return;
+
+  uint64_t hash = probe_hash(sim, dst, key);
+  if (unit(hash) < sim->loss) {
+    sim->dropped++;
+    return;
+  }
+
+  uint64_t delay_us = sim->rtt_us;
+  if (sim->jitter_us)
+    delay_us += mix(hash) % (sim->jitter_us + 1);
+
+  reply_ip(ip, out_len);
+  queue_push(sim, packet, out_len, now + delay_us * 1000);
+}
+
+// Send every reply whose RTT has elapsed
+static void flush_due(responder_t *sim, int fd, uint64_t now) {
+  while (sim->queued > 0 && sim->queue[0].due_ns <= now) {
+    if (write(fd, sim->queue[0].packet, sim->queue[0].len) ==
+        (ssize_t)sim->queue[0].len)
+      sim->replies++;
+    else
+      sim->dropped++;
+    queue_pop(sim);
+  }
+}
+
+// Create the TUN device, give it the prefix's last address and bring it
+// up, so the kernel routes the rest of the prefix into it
+static int open_tun(const char *name, uint32_t net, uint32_t mask) {
+  int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    perror("/dev/net/tun");
+    return -1;
+  }
+
+  struct ifreq ifr = {.ifr_flags = IFF_TUN | IFF_NO_PI};
+  snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", name);
+  if (ioctl(fd, TUNSETIFF, &ifr) != 0) {
+    perror("TUNSETIFF");
+    close(fd);
+    return -1;
+  }
+
+  int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in *sin = (struct sockaddr_in *)&ifr.ifr_addr;
+  sin->sin_family = AF_INET;
+
+  sin->sin_addr.s_addr = htonl(net | (~mask - 1));
+  int rc = ioctl(sock, SIOCSIFADDR, &ifr);
+  sin->sin_addr.s_addr = htonl(mask);
+  rc = rc ? rc : ioctl(sock, SIOCSIFNETMASK, &ifr);
+  // Room for a whole burst of probes while the responder catches up
+  ifr.ifr_qlen = RESPONDER_TXQUEUE_LEN;
+  rc = rc ? rc : ioctl(sock, SIOCSIFTXQLEN, &ifr);
+  rc = rc ? rc : ioctl(sock, SIOCGIFFLAGS, &ifr);
+  ifr.ifr_flags |= IFF_UP | IFF_RUNNING;
+  rc = rc ? rc : ioctl(sock, SIOCSIFFLAGS, &ifr);
+  close(sock);
+
+  if (rc != 0) {
+    perror(name);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int parse_net(const char *text, uint32_t *net, uint32_t *mask) {
+  char buf[IP_STR_LEN + 4];
+  char *slash;
+  uint32_t addr;
+
+  if (strlen(text) >= sizeof(buf))
+    return -1;
+  strcpy(buf, text);
+  slash = strchr(buf, '/');
+  if (!slash)
+    return -1;
+  *slash = '\0';
+
+  int len = atoi(slash + 1);
+  if (addr_parse(buf, &addr) != 0 || len < 8 || len > 30)
+    return -1;
+  *mask = 0xffffffffu << (32 - len);
+  *net = addr & *mask;
+  return 0;
+}
+
+static int parse_ports(char *text, responder_t *sim) {
+  sim->port_count = 0;
+  for (char *save, *item = strtok_r(text, ",", &save); item;
+       item = strtok_r(NULL, ",", &save)) {
+    int port = atoi(item);
+    if (sim->port_count == RESPONDER_MAX_PORTS || port < 1 || port > 65535)
+      return -1;
+    sim->ports[sim->port_count++] = (uint16_t)port;
+  }
+  return 0;
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --dev NAME       TUN device to create (default %s)\n"
+          "  --net CIDR       prefix it answers for (default %s)\n"
+          "  --density F      fraction of addresses alive (default %.2f)\n"
+          "  --loss F         fraction of replies dropped (default 0)\n"
+          "  --rtt-us N       reply delay (default %d)\n"
+          "  --jitter-us N    extra uniform delay up to N (default 0)\n"
+          "  --seed N         picks which hosts are alive (default 1)\n"
+          "  --ports LIST     open TCP ports, others reset (default 80)\n",
+          program, RESPONDER_DEFAULT_DEV, RESPONDER_DEFAULT_NET,
+          RESPONDER_DEFAULT_DENSITY, RESPONDER_DEFAULT_RTT_US);
+}
+
+int main(int argc, char **argv) {
+  static const struct option options[] = {
+      {"dev", required_argument, NULL, 'd'},
+      {"net", required_argument, NULL, 'n'},
+      {"density", required_argument, NULL, 'D'},
+      {"loss", required_argument, NULL, 'l'},
+      {"rtt-us", required_argument, NULL, 'r'},
+      {"jitter-us", required_argument, NULL, 'j'},
+      {"seed", required_argument, NULL, 's'},
+      {"ports", required_argument, NULL, 'p'},
+      {NULL, 0, NULL, 0}};
+  responder_t sim = {.density = RESPONDER_DEFAULT_DENSITY,
+                     .rtt_us = RESPONDER_DEFAULT_RTT_US,
+                     .seed = 1,
+                     .ports = {80},
+                     .port_count = 1};
+  const char *dev = RESPONDER_DEFAULT_DEV;
+  const char *net = RESPONDER_DEFAULT_NET;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+    case 'd':
+      dev = optarg;
+      break;
+    case 'n':
+      net = optarg;
+      break;
+    case 'D':
+      sim.density = atof(optarg);
+      break;
+    case 'l':
+      sim.loss = atof(optarg);
+      break;
+    case 'r':
+      sim.rtt_us = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'j':
+      sim.jitter_us = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      sim.seed = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      if (parse_ports(optarg, &sim) != 0) {
+        fprintf(stderr, "Invalid port list: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (parse_net(net, &sim.net, &sim.mask) != 0) {
+    fprintf(stderr, "Invalid prefix (expected A.B.C.D/8-30): %s\n", net);
+    return EXIT_FAILURE;
+  }
+
+  sim.queue = malloc(RESPONDER_QUEUE_LEN * sizeof(sim.queue[0]));
+  if (!sim.queue)
+    return EXIT_FAILURE;
+
+  int fd = open_tun(dev, sim.net, sim.mask);
+  if (fd < 0) {
+    free(sim.queue);
+    return EXIT_FAILURE;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  fprintf(stderr, "Responder up on %s for %s\n", dev, net);
+
+  uint8_t packet[ICMP_RECV_LEN];
+  while (!stopping) {
+    // Sleep until the next reply is due, to the nanosecond
+    uint64_t now = monotonic_ns();
+    uint64_t wait_ns = RESPONDER_IDLE_NS;
+    if (sim.queued > 0)
+      wait_ns = sim.queue[0].due_ns <= now ? 0 : sim.queue[0].due_ns - now;
+
+    struct timespec wait = {.tv_sec = (time_t)(wait_ns / NS_PER_SEC),
+                            .tv_nsec = (long)(wait_ns % NS_PER_SEC)};
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (ppoll(&pfd, 1, &wait, NULL) < 0 && errno != EINTR)
+      break;
+
+    now = monotonic_ns();
+    for (;;) {
+      ssize_t len = read(fd, packet, sizeof(packet));
+      if (len <= 0)
+        break;
+      handle(&sim, packet, (size_t)len, now);
+    }
+    flush_due(&sim, fd, monotonic_ns());
+  }
+
+  fprintf(stderr, "Responder: %llu requests, %llu replies, %llu dropped\n",
+          (unsigned long long)sim.requests, (unsigned long long)sim.replies,
+          (unsigned long long)sim.dropped);
+  close(fd);
+  free(sim.queue);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+#!/usr/bin/env bash
+# Benchmark every probe backend and worker count against the simulated
+# responder, then compare with a stored baseline.
+#
+# Usage: bench/run.sh BUILD_DIR [BASELINE]
+#
+# Writes BUILD_DIR/bench/results.tsv. With BENCH_RECORD=1 the results
+# become the new BASELINE; otherwise any row that regressed past the
+# tolerance is reported and the script exits 1. Needs root for the TUN
+# device and the raw-socket backends.
+
+set -eu
+
+build=${1:?build directory}
+baseline=${2:-}
+
+backends=${BENCH_BACKENDS:-icmp icmp-uring tcp syn}
+workers=${BENCH_WORKERS:-1 4 0}
+runs=${BENCH_RUNS:-3}
+targets=${BENCH_TARGETS:-10.250.0.0/18}
+rate=${BENCH_RATE:-100000}
+timeout_ms=${BENCH_TIMEOUT_MS:-200}
+tolerance=${BENCH_TOLERANCE:-10}
+latency_tolerance=${BENCH_LATENCY_TOLERANCE:-50}
+responder_args=${BENCH_RESPONDER_ARGS:---density 0.25 --rtt-us 200}
+
+scanner=$build/release/network_info
+responder=$build/bench/responder
+alloc=$build/bench/alloc.so
+results=$build/bench/results.tsv
+dev=nibench0
+
+if [ "$(id -u)" -ne 0 ]; then
+  echo "bench: needs root for the TUN responder" >&2
+  exit 2
+fi
+
+# shellcheck disable=SC2086
+"$responder" --dev "$dev" --net 10.250.0.0/16 $responder_args &
+responder_pid=$!
+trap 'kill "$responder_pid" 2>/dev/null; wait "$responder_pid" 2>/dev/null' EXIT
+
+for _ in $(seq 50); do
+  [ -d "/sys/class/net/$dev" ] && break
+  sleep 0.1
+done
+
+# One scan; prints "probes_per_s cpu_us_per_probe allocs_per_probe
+# rtt_p99_ms rtt_max_ms replies"
+run_once() {
+  local backend=$1 count=$2 log
+  local args=(-t "$targets" -T "$timeout_ms" -r "$rate" -f ndjson
+              --ports 80,443)
+  case $backend in
+  icmp-uring) args+=(--io-uring) ;;
+  *) args+=(--probe "$backend") ;;
+  esac
+  [ "$count" -gt 0 ] && args+=(-c "$count")
+
+  log=$(mktemp)
+  local TIMEFORMAT='%U %S'
+  local cpu
+  cpu=$( { time LD_PRELOAD="$alloc" "$scanner" "${args[@]}" \
+             >/dev/null 2>"$log"; } 2>&1 )
+
+  awk -v cpu="$cpu" '
+    /^Throughput:/ { pps = $4 }
+    /^Probes:/     { sent = $2 + $4; replies = $6 }
+    /^RTT:/        { p99 = $9; max = $12 }
+    /^Allocations:/ { allocs = $2 }
+    END {
+      split(cpu, t, " ")
+      printf "%s %.3f %.3f %s %s %s\n", pps,
+             sent ? (t[1] + t[2]) * 1e6 / sent : 0,
+             sent ? allocs / sent : 0, p99, max, replies
+    }' "$log"
+  rm -f "$log"
+}
+
+printf 'backend\tworkers\tprobes_per_s\tcpu_us_per_probe\tallocs_per_probe\trtt_p99_ms\trtt_max_ms\treplies\n' \
+  >"$results"
+for backend in $backends; do
+  for count in $workers; do
+    best=""
+    for _ in $(seq "$runs"); do
+      line=$(run_once "$backend" "$count")
+      if [ -z "$best" ] ||
+         awk -v a="${line%% *}" -v b="${best%% *}" 'BEGIN { exit !(a > b) }'
+      then
+        best=$line
+      fi
+    done
+    printf '%s\t%s\t%s\n' "$backend" "$count" "${best// /$'\t'}" \
+      >>"$results"
+  done
+done
+
+if command -v column >/dev/null; then
+  column -t "$results"
+else
+  cat "$results"
+fi
+
+if [ -z "$baseline" ]; then
+  exit 0
+fi
+if [ "${BENCH_RECORD:-0}" = 1 ]; then
+  cp "$results" "$baseline"
+  echo "Baseline recorded in $baseline"
+  exit 0
+fi
+if [ ! -f "$baseline" ]; then
+  echo "No baseline at $baseline; record one with make bench-baseline"
+  exit 0
+fi
+
+# Throughput may not drop, and CPU, allocations and latency may not grow,
+# by more than the tolerance; replies must match exactly since the
+# responder's network is deterministic
+awk -F '\t' -v tol="$tolerance" -v lat="$latency_tolerance" '
+  function worse(name, now, was, limit, higher_is_better) {
+    if (was == 0)
+      return
+    change = (now - was) * 100 / was
+    if (higher_is_better ? change < -limit : change > limit) {
+      printf "REGRESSION %s/%s %s: %s -> %s (%+.1f%%)\n", \
+             $1, $2, name, was, now, change
+      failed = 1
+    }
+  }
+  FNR == 1 { next }
+  NR == FNR { key[$1 "/" $2] = $0; next }
+  ($1 "/" $2) in key {
+    split(key[$1 "/" $2], b, "\t")
+    worse("probes/s", $3, b[3], tol, 1)
+    worse("cpu/probe", $4, b[4], tol, 0)
+    worse("allocs/probe", $5, b[5], tol, 0)
+    worse("rtt p99", $6, b[6], lat, 0)
+    if ($8 != b[8]) {
+      printf "REGRESSION %s/%s replies: %s -> %s\n", $1, $2, b[8], $8
+      failed = 1
+    }
+  }
+  END { if (!failed) print "No regressions against the baseline"; exit failed }
+' "$baseline" "$results"
@@ -0,0 +1,21 @@
+#ifndef NETWORK_INFO_ADDR_H
+#define NETWORK_INFO_ADDR_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+// Addresses are carried as host-order uint32_t from input to probe and
+// only turned into dotted strings when printed
+#define IP_STR_LEN 16
+
+#define IPV4(a, b, c, d)                                                       \
+  ((uint32_t)(a) << 24 | (uint32_t)(b) << 16 | (uint32_t)(c) << 8 |            \
+   (uint32_t)(d))
+
+int addr_parse(const char *text, uint32_t *addr);
+char *addr_format(uint32_t addr, char *buf);
+
+// Network byte order for the socket layer
+static inline in_addr_t addr_to_net(uint32_t addr) { return htonl(addr); }
+
+#endif
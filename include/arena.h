@@ -0,0 +1,31 @@
+#ifndef NETWORK_INFO_ARENA_H
+#define NETWORK_INFO_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every arena allocation starts on its own cache line
+#define ARENA_ALIGN 64
+
+// Per-scan bump allocator over one anonymous mapping. The mapping is
+// reserved for the scan's worst case up front, but the kernel only backs
+// the pages that are touched, so sparse tables cost nothing where they
+// stay empty. Memory comes back zeroed and is all released at once.
+// Allocation is not thread-safe; a scan takes everything it needs while
+// it is set up, before any worker runs.
+typedef struct {
+  uint8_t *base;
+  size_t capacity;
+  size_t used;
+} arena_t;
+
+// Bytes to reserve for one allocation of size, alignment included
+static inline size_t arena_span(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+int arena_init(arena_t *arena, size_t capacity);
+void *arena_alloc(arena_t *arena, size_t size);
+void arena_destroy(arena_t *arena);
+
+#endif
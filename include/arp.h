@@ -0,0 +1,49 @@
+#ifndef NETWORK_INFO_ARP_H
+#define NETWORK_INFO_ARP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iface.h"
+#include "probe.h"
+#include "ratelimit.h"
+
+// Packet ring geometry; frames only ever hold one ARP packet each
+#define ARP_FRAME_SIZE 256
+#define ARP_BLOCK_SIZE 4096
+#define ARP_RING_BLOCKS 16
+#define ARP_RING_FRAMES (ARP_BLOCK_SIZE / ARP_FRAME_SIZE * ARP_RING_BLOCKS)
+
+// Requests queued on the TX ring before the kernel is kicked to send them
+#define ARP_TX_BATCH 64
+
+// Hosts on the link answer in well under a millisecond; anything still
+// silent this long after the last request is not there
+#define ARP_MAX_WAIT_MS 250
+
+// One on-link target; index is the caller's, handed back with its result,
+// and the rest is the sweep's own progress, reset when it starts
+typedef struct {
+  uint32_t addr;
+  size_t index;
+  uint64_t sent_ns; // last request, 0 until one went out
+  uint8_t done;     // its result was reported
+} arp_target_t;
+
+// Called once per target: reply is NULL when it did not answer. Replies
+// carry the ARP round trip, or no RTT for neighbour table hits.
+typedef void (*arp_result_fn)(void *ctx, size_t index,
+                              const probe_reply_t *reply);
+
+typedef struct {
+  uint64_t requests;
+  uint64_t replies;
+  uint64_t neighbors; // answered from the kernel's neighbour table
+} arp_stats_t;
+
+int arp_available(void);
+int arp_sweep(const iface_t *iface, arp_target_t *targets, size_t count,
+              int wait_ms, int rounds, token_bucket_t *bucket,
+              arp_result_fn on_result, void *ctx, arp_stats_t *stats);
+
+#endif
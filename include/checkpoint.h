@@ -0,0 +1,64 @@
+#ifndef NETWORK_INFO_CHECKPOINT_H
+#define NETWORK_INFO_CHECKPOINT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "probe.h"
+#include "results.h"
+
+// Checkpoint file: a 128-byte header, a bitmap of targets whose result is
+// final, then one result_detail_t per target. The detail array is left
+// sparse on disk; only pages around results take space.
+#define CHECKPOINT_MAGIC "NICP"
+#define CHECKPOINT_VERSION 1
+
+// How often the mapping is flushed to disk while a scan runs
+#define CHECKPOINT_SYNC_MS 5000
+
+typedef struct {
+  char magic[4];
+  uint16_t version;
+  uint16_t header_len;
+  uint32_t order;       // scan_order_t of the attempt that wrote it
+  uint32_t complete;    // the last attempt got through its whole plan
+  uint64_t fingerprint; // of the compiled target set
+  uint64_t total;       // targets in the scan, one bit each
+  uint64_t seed;        // permutation seed of the last attempt
+  _Atomic uint64_t positions; // length of the last attempt's walk
+  _Atomic uint64_t cursor;    // positions it had claimed
+  _Atomic uint64_t done;      // targets with a final result
+  _Atomic uint64_t responders;
+  uint64_t synced_s; // unix time of the last flush
+  uint32_t attempts; // scans that have written to the file
+  uint16_t shard;    // slice of the last attempt, from 0
+  uint16_t shards;   // slices the scan was split into, 1 for none
+  uint8_t reserved[40];
+} checkpoint_header_t;
+
+// An open checkpoint, mapped shared so every result reaches the page cache
+// as it is recorded and survives the process being killed
+typedef struct {
+  int fd;
+  checkpoint_header_t *header;
+  size_t map_len;
+  _Atomic uint64_t *done;
+  result_detail_t *details;
+  pthread_t thread;
+  _Atomic int running;
+} checkpoint_t;
+
+int checkpoint_open(checkpoint_t *checkpoint, const char *path,
+                    uint64_t fingerprint, uint64_t total, int resume,
+                    int overwrite);
+void checkpoint_close(checkpoint_t *checkpoint, int complete);
+int checkpoint_map(checkpoint_t *checkpoint, const char *path);
+void checkpoint_unmap(checkpoint_t *checkpoint);
+void checkpoint_record(checkpoint_t *checkpoint, size_t index,
+                       const probe_reply_t *reply);
+int checkpoint_done(const checkpoint_t *checkpoint, size_t index);
+int checkpoint_reply(const checkpoint_t *checkpoint, size_t index,
+                     probe_reply_t *reply);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef NETWORK_INFO_CLI_H
+#define NETWORK_INFO_CLI_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpus.h"
+#include "monitor.h"
+#include "output.h"
+#include "probe.h"
+#include "state.h"
+#include "telemetry.h"
+#include "timeouts.h"
+
+// Upper bound for --concurrency
+#define CLI_MAX_CONCURRENCY 1024
+
+// Upper bound for the shard count of --shard
+#define CLI_MAX_SHARDS 4096
+
+// Scan modes, numbered as in the interactive menu
+typedef enum {
+  SCAN_MODE_NONE = 0,
+  SCAN_MODE_COMMON = 1,
+  SCAN_MODE_FULL = 2,
+  SCAN_MODE_SUBNET = 3,
+  SCAN_MODE_QUICK = 4,
+  SCAN_MODE_CUSTOM = 5
+} scan_mode_t;
+
+// Send order of a scan's targets
+typedef enum {
+  SCAN_ORDER_SEQUENTIAL = 0, // address order, one /24 after another
+  SCAN_ORDER_RANDOM = 1      // seeded permutation across every /24
+} scan_order_t;
+
+// Everything a run needs, from the command line or the menu
+typedef struct {
+  scan_mode_t mode;
+  const char *targets; // custom target list
+  uint32_t subnet;     // /24 base for the single subnet mode
+  int first_host;
+  int last_host;
+  int concurrency; // stream workers; 0 picks a default from the CPU count
+  int cpus[CPUS_MAX]; // cores that each run a pinned probe engine
+  int cpu_count;      // 0 for one engine on whichever core is free
+  output_format_t format;
+  int flush_ms;         // writer flush interval
+  const char *baseline; // single-worker rate file for speedup figures
+  telemetry_config_t telemetry;
+  probe_config_t probe;
+  int io_uring; // ICMP through io_uring, falling back to plain sockets
+  int adaptive_timeout; // learn per-subnet deadlines from responders
+  int timeout_margin_ms;
+  retry_policy_t retry_policy;
+  const char *state_path; // host-state cache updated by every scan
+  int rescan;             // plan probes from the state file
+  const char *checkpoint_path; // results saved as they arrive, for resume
+  int resume;                  // continue the scan saved in the checkpoint
+  int overwrite;               // start over even from an unfinished one
+  state_policy_t rescan_policy;
+  int arp; // sweep directly attached subnets with ARP
+  int static_lists; // common mode scans the built-in ranges, not discovery
+  scan_order_t order;
+  uint64_t seed; // permutation seed for random order
+  int seed_set;  // otherwise one is drawn per run
+  int shard_index; // this instance's slice of the permutation, from 0
+  int shard_count; // instances splitting the scan, 1 for none
+  int merge;                // merge result files instead of scanning
+  char *const *merge_paths; // the files, from the rest of the command line
+  int merge_count;
+  int daemon;     // cycle over the targets until stopped, reporting changes
+  int interval_s; // length of one daemon cycle
+  int window;     // cycles a host must miss before it is reported down
+  int rdns;              // name responders with PTR lookups
+  const char *rdns_cache; // names kept across runs
+  const char *resolver;   // nameserver instead of resolv.conf's
+  int ipv6; // sweep IPv6 links with all-nodes echoes and the NDP table
+  int interactive; // no mode given: fall back to the menu
+  int help;
+} cli_options_t;
+
+int cli_parse(int argc, char **argv, cli_options_t *options);
+void cli_usage(FILE *out, const char *program);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef NETWORK_INFO_CLOCK_H
+#define NETWORK_INFO_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define NS_PER_SEC UINT64_C(1000000000)
+#define NS_PER_MS UINT64_C(1000000)
+
+// Monotonic nanoseconds, the time base for pacing, deadlines and RTTs
+static inline uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// Sleep for a duration given in nanoseconds
+static inline void sleep_ns(uint64_t ns) {
+  struct timespec pause = {.tv_sec = (time_t)(ns / NS_PER_SEC),
+                           .tv_nsec = (long)(ns % NS_PER_SEC)};
+  nanosleep(&pause, NULL);
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef NETWORK_INFO_CPUS_H
+#define NETWORK_INFO_CPUS_H
+
+#include <pthread.h>
+
+// Most cores --cpus may select; each gets its own probe engine
+#define CPUS_MAX 256
+
+int cpus_parse(const char *text, int *cpus, int max);
+int cpus_pin(pthread_t thread, int cpu);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef NETWORK_INFO_DISCOVER_H
+#define NETWORK_INFO_DISCOVER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "iface.h"
+#include "targets.h"
+
+// Most prefixes a discovery pass collects
+#define DISCOVER_MAX_PREFIXES 256
+
+// Broader prefixes are never swept whole: an interface's is narrowed to
+// the block around our address, a route's is left out
+#define DISCOVER_MIN_PREFIX_LEN 16
+
+typedef enum {
+  DISCOVER_LINK = 0, // configured on a local interface
+  DISCOVER_ROUTE = 1 // reachable through the main routing table
+} discover_source_t;
+
+// One reachable prefix and where it was learned
+typedef struct {
+  uint32_t net;
+  int len;
+  uint32_t gateway; // next hop of a route, 0 when directly reachable
+  int ifindex;
+  discover_source_t source;
+  int clipped; // an interface prefix narrowed to DISCOVER_MIN_PREFIX_LEN
+  int skipped; // a route too broad to sweep
+} discover_prefix_t;
+
+int discover_prefixes(discover_prefix_t *prefixes, int max);
+int discover_targets(target_set_t *targets, FILE *log);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef NETWORK_INFO_ENCODE_H
+#define NETWORK_INFO_ENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "output.h"
+
+// Longest encoding of a single record in any format, a hostname included
+#define ENCODE_RECORD_MAX 512
+
+// Binary stream: a 32-byte header ("NIRB", version, record length and the
+// scan's target fingerprint, seed, slice and order) and then fixed-width
+// big-endian host records. The header is the encoding of the scan's
+// OUTPUT_BEGIN record, so a merge can tell which scan a file belongs to.
+#define ENCODE_BINARY_MAGIC "NIRB"
+#define ENCODE_BINARY_VERSION 2
+#define ENCODE_BINARY_HEADER_LEN 32
+#define ENCODE_BINARY_RECORD_LEN 24
+
+// Binary record flags
+#define ENCODE_FLAG_DETAIL 0x01 // rtt_us (and ttl for ICMP, SYN) is meaningful
+#define ENCODE_FLAG_LINK 0x02   // answered by ARP or the neighbour table
+#define ENCODE_FLAG_TCP 0x04    // answered a TCP connect or SYN probe
+
+size_t encode_header(output_format_t format, int hostnames, char *buf,
+                     size_t cap);
+size_t encode_record(output_format_t format, const output_record_t *record,
+                     uint64_t unix_ns, char *buf, size_t cap);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef NETWORK_INFO_HISTOGRAM_H
+#define NETWORK_INFO_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear buckets over microseconds: values below 16 get a bucket each,
+// every power of two above is split into 16 linear sub-buckets, so any
+// recorded value is known to within ~6% across the full uint32_t range
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_COUNT (1u << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+// Lock-free RTT histogram; any thread may record or merge into it
+typedef struct {
+  _Atomic uint64_t counts[HISTOGRAM_BUCKETS];
+  _Atomic uint64_t total;
+  _Atomic uint32_t max_us;
+} rtt_histogram_t;
+
+// Quantiles pulled out of a histogram for reporting
+typedef struct {
+  uint64_t count;
+  uint32_t p50_us;
+  uint32_t p90_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+} rtt_summary_t;
+
+void histogram_reset(rtt_histogram_t *hist);
+void histogram_record(rtt_histogram_t *hist, uint32_t us);
+void histogram_merge(rtt_histogram_t *into, const rtt_histogram_t *from);
+uint32_t histogram_quantile(const rtt_histogram_t *hist, double quantile);
+void histogram_summarize(const rtt_histogram_t *hist, rtt_summary_t *summary);
+
+#endif
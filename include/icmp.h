@@ -0,0 +1,48 @@
+#ifndef NETWORK_INFO_ICMP_H
+#define NETWORK_INFO_ICMP_H
+
+#include <netinet/in.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+// Echo request layout: 8-byte ICMP header followed by the send time as a
+// big-endian nanosecond count
+#define ICMP_PAYLOAD_LEN 8
+#define ICMP_ECHO_LEN (8 + ICMP_PAYLOAD_LEN)
+#define ICMP_RECV_LEN 1500
+
+// Room for one IP_TTL control message per received datagram
+#define ICMP_CMSG_LEN 32
+
+// One ICMP socket, either raw or the unprivileged datagram flavour
+typedef struct {
+  int sockfd;
+  int raw;        // 1 for SOCK_RAW (replies carry the IP header)
+  uint16_t ident; // echo identifier, kernel-assigned for SOCK_DGRAM
+} icmp_socket_t;
+
+// Echo request prebuilt once per socket. A probe copies it and patches the
+// sequence number and send time, updating the checksum incrementally.
+typedef struct {
+  alignas(8) uint8_t packet[ICMP_ECHO_LEN];
+} icmp_template_t;
+
+// Socket level helpers
+int icmp_open(icmp_socket_t *sock, unsigned int lane);
+void icmp_close(icmp_socket_t *sock);
+uint16_t icmp_checksum(const void *data, size_t len);
+size_t icmp_build_echo(uint8_t *buf, size_t cap, uint16_t ident, uint16_t seq);
+uint16_t icmp_checksum_adjust(uint16_t check, uint16_t old_word,
+                              uint16_t new_word);
+void icmp_template_init(icmp_template_t *tpl, uint16_t ident);
+void icmp_template_fill(const icmp_template_t *tpl, uint8_t *buf,
+                        uint16_t seq, uint64_t sent_ns);
+int icmp_send_echo(const icmp_socket_t *sock, const icmp_template_t *tpl,
+                   in_addr_t dst, uint16_t seq, uint64_t sent_ns);
+int icmp_parse_reply(const icmp_socket_t *sock, const uint8_t *buf,
+                     size_t len, uint16_t *seq, uint8_t *ttl);
+uint8_t icmp_cmsg_ttl(struct msghdr *msg);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef NETWORK_INFO_IFACE_H
+#define NETWORK_INFO_IFACE_H
+
+#include <net/if.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Most IPv4 addresses we track across all interfaces
+#define IFACE_MAX 32
+
+// One IPv4 address configured on a local interface, with the prefix it
+// makes directly reachable
+typedef struct {
+  char name[IF_NAMESIZE];
+  int ifindex;
+  uint32_t addr; // our address on the link, host order
+  uint32_t mask;
+  uint8_t mac[6];
+  int arp; // broadcast link that resolves neighbours with ARP
+} iface_t;
+
+int iface_list(iface_t *ifaces, int max);
+const iface_t *iface_for_addr(const iface_t *ifaces, int count,
+                              uint32_t addr);
+
+#endif
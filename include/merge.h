@@ -0,0 +1,15 @@
+#ifndef NETWORK_INFO_MERGE_H
+#define NETWORK_INFO_MERGE_H
+
+#include <stdio.h>
+
+#include "output.h"
+#include "targets.h"
+
+// How many responders a merge reads before it grows its table
+#define MERGE_INITIAL_HOSTS 4096
+
+int merge_results(char *const *paths, int count, const target_set_t *targets,
+                  output_format_t format, FILE *console);
+
+#endif
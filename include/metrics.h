@@ -0,0 +1,56 @@
+#ifndef NETWORK_INFO_METRICS_H
+#define NETWORK_INFO_METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "probe.h"
+
+// Wall time of a scan, split where the work changes hands
+typedef enum {
+  PHASE_TARGETS = 0,  // compiling and splitting the target set
+  PHASE_SENDING = 1,  // first probe until the last stream worker is done
+  PHASE_DRAINING = 2, // last first-attempt send until the last result
+  PHASE_OUTPUT = 3,   // flushing queued output after the last result
+  PHASE_COUNT
+} scan_phase_t;
+
+// Counters and timings for one scan, all from the monotonic clock
+typedef struct {
+  uint64_t phase_ns[PHASE_COUNT];
+  uint64_t hosts;
+  uint64_t responders;
+  uint64_t probes;
+  uint64_t retransmits;
+  uint64_t replies;
+  uint64_t timeouts;
+  uint64_t rate_stalls;
+  int workers;
+} scan_metrics_t;
+
+// Engine counters at the start of a scan, summed over every engine, to
+// report per-scan deltas
+typedef struct {
+  uint64_t probes;
+  uint64_t retransmits;
+  uint64_t replies;
+  uint64_t timeouts;
+  uint64_t rate_stalls;
+} metrics_engine_mark_t;
+
+void metrics_reset(scan_metrics_t *metrics);
+void metrics_engine_mark(const probe_engine_t *engines, int count,
+                         metrics_engine_mark_t *mark);
+void metrics_engine_delta(scan_metrics_t *metrics,
+                          const probe_engine_t *engines, int count,
+                          const metrics_engine_mark_t *mark);
+uint64_t metrics_elapsed_ns(const scan_metrics_t *metrics);
+double metrics_host_rate(const scan_metrics_t *metrics);
+
+int metrics_load_baseline(const char *path, double *hosts_per_sec);
+int metrics_save_baseline(const char *path, double hosts_per_sec);
+
+void metrics_print(FILE *out, const scan_metrics_t *metrics,
+                   double baseline_rate);
+
+#endif
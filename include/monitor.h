@@ -0,0 +1,44 @@
+#ifndef NETWORK_INFO_MONITOR_H
+#define NETWORK_INFO_MONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "probe.h"
+#include "state.h"
+
+// Daemon defaults: one cycle over the targets a minute, and a host that
+// misses this many cycles in a row is reported down
+#define MONITOR_DEFAULT_INTERVAL_S 60
+#define MONITOR_MAX_INTERVAL_S 86400
+#define MONITOR_DEFAULT_WINDOW 3
+#define MONITOR_MAX_WINDOW 32
+
+// Sliding view of one monitored host; 16 bytes
+typedef struct {
+  uint32_t history;   // one bit per recent cycle, newest lowest, set if up
+  uint32_t srtt_us;   // smoothed RTT, 0 until it has answered
+  uint32_t rttvar_us; // smoothed RTT deviation
+  uint8_t cycles;     // cycles recorded, saturating at the window
+  uint8_t up;         // state last reported, or assumed on the first cycle
+  uint16_t reserved;
+} monitor_host_t;
+
+// Every host of a daemon's target set, by stream index. Each host is
+// recorded once per cycle by whichever thread resolved it, so only the up
+// count is shared.
+typedef struct {
+  monitor_host_t *hosts;
+  size_t count;
+  int window;
+  _Atomic size_t up;
+} monitor_t;
+
+int monitor_init(monitor_t *monitor, arena_t *arena, size_t count,
+                 int window);
+void monitor_destroy(monitor_t *monitor);
+state_change_t monitor_record(monitor_t *monitor, size_t index,
+                              const probe_reply_t *reply);
+
+#endif
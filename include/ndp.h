@@ -0,0 +1,64 @@
+#ifndef NETWORK_INFO_NDP_H
+#define NETWORK_INFO_NDP_H
+
+#include <net/if.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "probe.h"
+#include "ratelimit.h"
+
+// Most IPv6 links swept, and addresses of ours each one is solicited from
+#define NDP_MAX_LINKS 32
+#define NDP_MAX_SOURCES 8
+
+// A /64 can't be swept address by address, so a link's hosts are whatever
+// answers an all-nodes echo or sits in the neighbour table; this bounds
+// how many one sweep keeps track of
+#define NDP_MAX_HOSTS (1u << 20)
+
+// All-nodes replies from a busy link trickle in over a few milliseconds;
+// anything still silent this long after the last request is not coming
+#define NDP_MAX_WAIT_MS 500
+
+// One IPv6 link: an interface that is up and does multicast, and the
+// addresses we hold on it, the link-local one first
+typedef struct {
+  char name[IF_NAMESIZE];
+  int ifindex;
+  struct in6_addr sources[NDP_MAX_SOURCES];
+  int source_count;
+} ndp_link_t;
+
+// One host found on a link
+typedef struct {
+  struct in6_addr addr;
+  uint32_t rtt_us; // first echo reply's round trip
+  uint8_t mac[6];
+  uint8_t has_mac;  // the neighbour table knows its link-layer address
+  uint8_t hops;     // hop limit its reply arrived with
+  uint8_t via;      // PROBE_VIA_MCAST, PROBE_VIA_ICMP or PROBE_VIA_NEIGH
+  uint8_t answered; // replied to one of our echo requests
+  uint8_t known;    // in the neighbour table, worth a unicast echo
+  uint8_t alive;    // confirmed by the kernel recently enough to trust
+} ndp_host_t;
+
+// Called once per host found, after its link's sweep
+typedef void (*ndp_host_fn)(void *ctx, const ndp_link_t *link,
+                            const ndp_host_t *host);
+
+typedef struct {
+  uint64_t solicits;  // echo requests to all-nodes
+  uint64_t echoes;    // unicast echo requests to neighbour entries
+  uint64_t replies;   // echo replies read
+  uint64_t neighbors; // hosts only the neighbour table vouched for
+  uint64_t hosts;     // hosts reported
+} ndp_stats_t;
+
+int ndp_links(const char *device, ndp_link_t *links, int max);
+int ndp_sweep(const ndp_link_t *link, int wait_ms, int rounds,
+              token_bucket_t *bucket, ndp_host_fn on_host, void *ctx,
+              ndp_stats_t *stats);
+
+#endif
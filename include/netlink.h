@@ -0,0 +1,20 @@
+#ifndef NETWORK_INFO_NETLINK_H
+#define NETWORK_INFO_NETLINK_H
+
+#include <linux/netlink.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Dump replies are read in chunks of this size
+#define NETLINK_BUF_LEN 16384
+
+// Longest family header a dump request carries (struct rtmsg)
+#define NETLINK_REQUEST_MAX 16
+
+// Called for every message of a dump, in order
+typedef void (*netlink_msg_fn)(const struct nlmsghdr *msg, void *ctx);
+
+int netlink_dump(uint16_t type, const void *header, size_t header_len,
+                 netlink_msg_fn on_msg, void *ctx);
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef NETWORK_INFO_OUTPUT_H
+#define NETWORK_INFO_OUTPUT_H
+
+#include <stdint.h>
+
+#include "rdns.h"
+
+// Records each producing thread can queue before it has to wait for the
+// writer; a power of two so ring positions wrap with a mask
+#define OUTPUT_RING_SIZE 8192
+#define OUTPUT_RING_MASK (OUTPUT_RING_SIZE - 1)
+
+// Formatted output is written in blocks of this size
+#define OUTPUT_BUFFER_LEN 65536
+
+#define OUTPUT_DEFAULT_FLUSH_MS 100
+
+// With --rdns the writer holds up to this many records, in order, while
+// their names are looked up, and waits this long on the resolver between
+// passes; a power of two
+#define OUTPUT_PENDING_SIZE 65536
+#define OUTPUT_PENDING_MASK (OUTPUT_PENDING_SIZE - 1)
+#define OUTPUT_RDNS_WAIT_MS 10
+
+// Stream encodings selectable with --format
+typedef enum {
+  OUTPUT_TEXT = 0,
+  OUTPUT_NDJSON = 1,
+  OUTPUT_CSV = 2,
+  OUTPUT_BINARY = 3
+} output_format_t;
+
+typedef enum {
+  OUTPUT_SCANNING = 0, // a subnet's first probe is going out
+  OUTPUT_HOST = 1,     // one responder
+  OUTPUT_SUBNET = 2,   // a subnet's summary, after its hosts
+  OUTPUT_CHANGE = 3,   // a host answered or stopped answering since last run
+                       // or, in a daemon, over its window
+  OUTPUT_HOST6 = 4,    // one IPv6 host found on a link
+  OUTPUT_BEGIN = 5     // a scan's target set and slice, before its hosts
+} output_kind_t;
+
+// Compact result record, encoded only on the writer thread
+typedef struct {
+  uint64_t timestamp_ns; // monotonic, stamped by output_emit
+  const char *hostname; // PTR name filled in by the writer with --rdns, ""
+                        // for none; NULL without --rdns
+  const char *link; // interface the host was found on (OUTPUT_HOST6),
+                    // valid until output_flush returns
+  uint32_t addr;      // host, first scanned address or subnet base
+  uint32_t last_addr; // last scanned address (OUTPUT_SCANNING)
+  uint32_t rtt_us; // reply RTT, or a daemon's smoothed RTT (OUTPUT_CHANGE)
+  uint32_t count; // responders (OUTPUT_SUBNET)
+  uint32_t p50_us; // subnet RTT quantiles (OUTPUT_SUBNET)
+  uint32_t p90_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+  uint64_t fingerprint; // of the compiled target set (OUTPUT_BEGIN)
+  uint64_t seed;        // permutation seed (OUTPUT_BEGIN)
+  uint16_t shard;       // slice scanned, from 0, of shards (OUTPUT_BEGIN)
+  uint16_t shards;
+  int32_t subnet_id;
+  uint8_t kind;
+  uint8_t ttl;
+  uint8_t has_detail; // rtt_us and ttl are meaningful
+  uint8_t up;         // state after the change (OUTPUT_CHANGE)
+  uint8_t via;        // how the host answered, PROBE_VIA_* (OUTPUT_HOST,
+                      // OUTPUT_HOST6)
+  uint8_t addr6[16];  // IPv6 host, network order (OUTPUT_HOST6)
+  uint8_t mac[6];     // its link-layer address (OUTPUT_HOST6)
+  uint8_t has_mac;
+  uint8_t order; // scan_order_t (OUTPUT_BEGIN)
+} output_record_t;
+
+// Single-producer single-consumer ring owned by one producing thread
+typedef struct output_ring {
+  _Alignas(64) _Atomic uint64_t head; // advanced by the writer
+  _Alignas(64) _Atomic uint64_t tail; // advanced by the producer
+  struct output_ring *next;
+  output_record_t records[OUTPUT_RING_SIZE];
+} output_ring_t;
+
+int output_start(int flush_ms, output_format_t format, rdns_t *resolver);
+void output_stop(void);
+void output_emit(const output_record_t *record);
+void output_flush(void);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef NETWORK_INFO_PERMUTE_H
+#define NETWORK_INFO_PERMUTE_H
+
+#include <stdint.h>
+
+// Largest index space a permutation covers: every IPv4 address
+#define PERMUTE_MAX_SIZE (UINT64_C(1) << 32)
+
+// Stateless bijection over the indices [0, size). Random order walks the
+// cyclic group (Z/pZ)* for the smallest prime p above size: position k is
+// start * generator^k mod p, and index value - 1. Values past size are
+// skipped, so walking positions 0 to positions - 1 visits every index
+// exactly once. Sequential order is the identity. Either way a walk can
+// resume from any position given the same size and seed.
+typedef struct {
+  uint64_t size;
+  uint64_t seed;
+  uint64_t prime; // 0 for sequential order
+  uint64_t generator;
+  uint64_t start;
+} permute_t;
+
+int permute_init(permute_t *perm, uint64_t size, uint64_t seed);
+void permute_sequential(permute_t *perm, uint64_t size);
+uint64_t permute_positions(const permute_t *perm);
+uint64_t permute_seek(const permute_t *perm, uint64_t position);
+
+// Index of a walk value, or UINT64_MAX for a value to skip
+static inline uint64_t permute_index(const permute_t *perm, uint64_t value) {
+  uint64_t index = perm->prime ? value - 1 : value;
+  return index < perm->size ? index : UINT64_MAX;
+}
+
+// Walk value of the next position. The prime stays below 2^33, so a
+// product is split to fit 64 bits.
+static inline uint64_t permute_step(const permute_t *perm, uint64_t value) {
+  if (!perm->prime)
+    return value + 1;
+  uint64_t high = value * (perm->generator >> 16) % perm->prime;
+  return ((high << 16) + value * (perm->generator & 0xffff)) % perm->prime;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef NETWORK_INFO_POOL_H
+#define NETWORK_INFO_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Initial capacity of each worker's deque; grows on demand
+#define POOL_DEQUE_INITIAL 64
+
+typedef void (*pool_task_fn)(void *arg);
+
+typedef struct {
+  pool_task_fn fn;
+  void *arg;
+} pool_task_t;
+
+// Per-worker double-ended queue: the owner pushes and pops at the tail,
+// idle workers steal from the head
+typedef struct {
+  pthread_mutex_t lock;
+  pool_task_t *tasks;
+  size_t capacity;
+  size_t head;
+  size_t count;
+} pool_deque_t;
+
+// Persistent work-stealing thread pool. Busy workers only ever lock
+// deques; mutex and condition are for parking idle ones.
+typedef struct {
+  pthread_t *threads;
+  int thread_count;
+  int active_threads;
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+
+  pool_deque_t *deques;
+  pthread_cond_t idle;
+  _Atomic size_t queued; // tasks sitting on some deque
+  _Atomic int sleeping;  // workers parked on condition
+  _Atomic size_t outstanding;
+  _Atomic unsigned int next_deque;
+  int shutdown;
+} thread_pool_t;
+
+int init_thread_pool(thread_pool_t *pool, int max_threads);
+void cleanup_thread_pool(thread_pool_t *pool);
+int thread_pool_submit(thread_pool_t *pool, pool_task_fn fn, void *arg);
+void thread_pool_wait(thread_pool_t *pool);
+int thread_pool_worker_id(const thread_pool_t *pool);
+int thread_pool_pin(thread_pool_t *pool, const int *cpus, int count);
+
+#endif
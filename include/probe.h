@@ -0,0 +1,260 @@
+#ifndef NETWORK_INFO_PROBE_H
+#define NETWORK_INFO_PROBE_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ratelimit.h"
+
+// In-flight table size; a power of two so the slot is the low bits of seq
+#define PROBE_INFLIGHT_SLOTS 16384
+#define PROBE_SLOT_MASK (PROBE_INFLIGHT_SLOTS - 1)
+
+// Timer wheel geometry: 4096 ticks of 1ms covers deadlines up to 4s in one
+// lap; longer deadlines just go round again
+#define PROBE_WHEEL_SLOTS 4096
+#define PROBE_WHEEL_TICK_MS 1
+
+// Jobs with an adaptive timeout policy are first checked this soon after
+// sending, then at doubling intervals until their deadline
+#define PROBE_FIRST_CHECK_MS 2
+
+// Replies drained per recvmmsg call
+#define PROBE_RECV_BATCH 64
+
+// Default per-probe deadline and how many times an unanswered target is
+// sent again before it counts as a timeout
+#define PROBE_DEFAULT_TIMEOUT_MS 1000
+#define PROBE_DEFAULT_RETRIES 0
+#define PROBE_MAX_RETRIES 10
+
+// Default sender pacing, shared by every sending thread, and how many
+// tokens may pile up while senders are idle
+#define PROBE_DEFAULT_PPS 20000
+#define PROBE_DEFAULT_BURST 64
+
+// Targets a stream worker claims from the host stream at a time
+#define PROBE_CHUNK_SIZE 64
+
+// Targets handed to a backend at once by probe_engine_send_batch, never
+// more than the token bucket's burst
+#define PROBE_SEND_BATCH 32
+
+#define PROBE_NO_SLOT UINT32_MAX
+#define PROBE_SLOT_BUSY (UINT32_MAX - 1)
+
+// TCP backends try every port of a small set; a host is alive as soon as
+// one of them accepts or refuses the connection
+#define PROBE_MAX_PORTS 8
+#define PROBE_DEFAULT_PORTS {22, 80, 443, 445}
+#define PROBE_DEFAULT_PORT_COUNT 4
+
+typedef struct probe_job probe_job_t;
+typedef struct probe_engine probe_engine_t;
+
+// One way of putting probes on the wire and hearing back. The engine owns
+// the slot table, deadlines, retries and pacing; a backend sends for a
+// claimed slot and hands answers to probe_engine_deliver.
+typedef struct {
+  const char *name;
+  int per_port; // sends one packet per configured port, paced as such
+  // Open sockets; may lower *max_inflight when each probe holds them
+  int (*open)(probe_engine_t *engine, int *max_inflight);
+  void (*close)(probe_engine_t *engine);
+  // Send the probe of a pending slot; called from any sending thread
+  int (*send)(probe_engine_t *engine, uint32_t slot);
+  // Optional: send several pending slots in one go, returning how many
+  // leading ones went out; the engine fails the next and retries the rest
+  int (*send_batch)(probe_engine_t *engine, const uint32_t *slots,
+                    int count);
+  // Wait up to timeout_ms for answers; receiver thread only
+  void (*poll)(probe_engine_t *engine, int timeout_ms);
+  // Optional: the slot was resolved, drop whatever it still holds
+  void (*release)(probe_engine_t *engine, uint32_t slot);
+} probe_backend_t;
+
+extern const probe_backend_t probe_backend_icmp;
+extern const probe_backend_t probe_backend_icmp_uring;
+extern const probe_backend_t probe_backend_tcp_connect;
+extern const probe_backend_t probe_backend_tcp_syn;
+
+// Engine tuning; see probe_config_defaults
+typedef struct {
+  int timeout_ms;
+  int retries;      // extra attempts per unanswered target
+  int max_pps;      // <= 0 disables the token bucket
+  int burst;        // tokens banked while idle
+  int max_inflight; // hard cap on unanswered probes
+  int adaptive;     // let the AIMD controller shrink the in-flight window
+  const probe_backend_t *backend;
+  uint16_t ports[PROBE_MAX_PORTS]; // TCP backends only
+  int port_count;
+  const char *device; // interface every probe socket is bound to, or NULL
+  int cpu;  // core the receiver and retrier are pinned to, or -1
+  int lane; // index among engines run side by side; keeps sockets apart
+} probe_config_t;
+
+// How a reply was obtained
+enum {
+  PROBE_VIA_ICMP = 0,  // echo reply; rtt_us and ttl are known
+  PROBE_VIA_ARP = 1,   // ARP reply on a local link; no TTL
+  PROBE_VIA_NEIGH = 2, // kernel neighbour table; neither RTT nor TTL
+  PROBE_VIA_TCP = 3,   // TCP connect accepted or refused; no TTL
+  PROBE_VIA_SYN = 4,   // SYN-ACK or RST to a raw SYN; rtt_us and ttl known
+  PROBE_VIA_MCAST = 5  // IPv6 reply to an all-nodes echo; rtt_us and ttl
+                       // (the hop limit) known
+};
+
+// What the engine learned from an answered probe
+typedef struct {
+  uint32_t rtt_us;
+  uint8_t ttl;
+  uint8_t via;
+} probe_reply_t;
+
+// Called once per target, in completion order; reply is NULL when the
+// target timed out or could not be sent to
+typedef void (*probe_result_fn)(probe_job_t *job, size_t index,
+                                const probe_reply_t *reply);
+
+// Optional per-target policy a job can install; both hooks run on the
+// engine's receiver thread and must not block
+typedef struct {
+  // Current deadline for a target in microseconds, or 0 to use the
+  // engine's timeout. May shrink as replies teach the caller more.
+  uint32_t (*timeout_us)(probe_job_t *job, size_t index);
+  // Whether an unanswered target may spend one of its retries
+  int (*should_retry)(probe_job_t *job, size_t index);
+} probe_policy_t;
+
+// A set of targets, identified by index, sent and waited on as a unit
+struct probe_job {
+  size_t count;
+  probe_result_fn on_result;
+  void *ctx;
+  const probe_policy_t *policy; // NULL for fixed timeouts and retries
+  _Atomic size_t remaining;
+  pthread_mutex_t mutex;
+  pthread_cond_t done;
+};
+
+// Per-slot lifecycle in the in-flight table
+enum {
+  PROBE_SLOT_FREE = 0,
+  PROBE_SLOT_PENDING = 1,
+  PROBE_SLOT_RESOLVED = 2
+};
+
+// One outstanding probe, keyed by (addr, seq). A pending slot sits in a
+// doubly linked wheel bucket so it can leave the wheel the moment it is
+// resolved; a free one sits on the free list instead.
+typedef struct {
+  _Atomic int state;
+  in_addr_t addr;
+  uint16_t seq;
+  uint32_t wheel_next;
+  uint32_t wheel_prev;
+  uint32_t wheel_bucket; // PROBE_NO_SLOT when not on the wheel
+  uint32_t free_next;
+  uint64_t deadline_tick;
+  uint64_t sent_ns;
+  probe_job_t *job;
+  size_t index;
+  uint8_t attempt;
+} probe_slot_t;
+
+// A timed-out target waiting to be sent again
+typedef struct {
+  probe_job_t *job;
+  size_t index;
+  in_addr_t addr;
+  uint8_t attempt;
+} probe_retry_t;
+
+// A timed-out target whose result the receiver has yet to deliver
+typedef struct {
+  probe_job_t *job;
+  size_t index;
+} probe_expired_t;
+
+// Asynchronous probe pipeline: any thread may send through the shared
+// token bucket, one receiver collects answers from the backend, expires
+// deadlines on a timer wheel and steers the in-flight window, one retrier
+// resends timeouts
+struct probe_engine {
+  const probe_backend_t *backend;
+  void *backend_state;
+  uint16_t ports[PROBE_MAX_PORTS];
+  int port_count;
+  const char *device;
+  int cpu;
+  int lane;
+  int timeout_ms;
+  int retries;
+  token_bucket_t bucket;
+  int batch; // most targets per send_batch call
+
+  pthread_t receiver;
+  _Atomic int running;
+
+  // In-flight table and timer wheel, both guarded by wheel_mutex
+  pthread_mutex_t wheel_mutex;
+  pthread_cond_t slot_freed;
+  probe_slot_t slots[PROBE_INFLIGHT_SLOTS];
+  uint32_t wheel[PROBE_WHEEL_SLOTS];
+  uint64_t wheel_tick;
+  uint32_t free_head; // oldest free slot, reused first
+  uint32_t free_tail;
+  int window_waiters;
+
+  // Timeouts found by one wheel pass, delivered once wheel_mutex is
+  // dropped; receiver only
+  probe_expired_t expired[PROBE_INFLIGHT_SLOTS];
+  size_t expired_count;
+
+  // Congestion control, updated by the receiver only
+  aimd_controller_t aimd;
+  int adaptive;
+  _Atomic int window;
+  _Atomic int inflight;
+
+  // Retransmissions are queued by the receiver and sent by their own
+  // thread so the receiver never blocks on the token bucket
+  pthread_t retrier;
+  pthread_mutex_t retry_mutex;
+  pthread_cond_t retry_ready;
+  probe_retry_t retry_queue[PROBE_INFLIGHT_SLOTS];
+  size_t retry_head;
+  _Atomic size_t retry_count; // written under retry_mutex, read anywhere
+
+  _Atomic uint64_t sent;
+  _Atomic uint64_t retransmits;
+  _Atomic uint64_t replies;
+  _Atomic uint64_t timeouts;
+  _Atomic uint64_t send_errors;
+};
+
+void probe_config_defaults(probe_config_t *config);
+const probe_backend_t *probe_backend_find(const char *name);
+int probe_engine_start(probe_engine_t *engine, const probe_config_t *config);
+int probe_bind_device(const probe_engine_t *engine, int fd);
+void probe_engine_stop(probe_engine_t *engine);
+void probe_engine_deliver(probe_engine_t *engine, uint16_t seq,
+                          in_addr_t addr, uint64_t now_ns,
+                          probe_reply_t *reply);
+void probe_engine_restart(probe_engine_t *engine, uint16_t seq);
+
+int probe_job_init(probe_job_t *job, size_t count, probe_result_fn on_result,
+                   void *ctx);
+void probe_job_destroy(probe_job_t *job);
+int probe_engine_send(probe_engine_t *engine, probe_job_t *job, size_t index,
+                      in_addr_t addr);
+void probe_engine_send_batch(probe_engine_t *engine, probe_job_t *job,
+                             const size_t *indexes, const in_addr_t *addrs,
+                             size_t count);
+void probe_job_abandon(probe_job_t *job, size_t count);
+void probe_job_wait(probe_job_t *job);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef NETWORK_INFO_RATELIMIT_H
+#define NETWORK_INFO_RATELIMIT_H
+
+#include <stdint.h>
+
+// Senders this close to their token just go; sleeping costs more
+#define RATELIMIT_SLACK_NS 1000000ULL
+
+// AIMD controller tuning. A period whose reply ratio falls below
+// AIMD_LOSS_FACTOR of the running baseline is treated as loss.
+#define AIMD_PERIOD_MS 100
+#define AIMD_MIN_SAMPLES 32
+#define AIMD_INCREASE 256
+#define AIMD_MIN_WINDOW 256
+#define AIMD_LOSS_FACTOR 0.5
+#define AIMD_BASELINE_WEIGHT 0.25
+
+// Packets-per-second token bucket, kept as a GCRA "theoretical arrival
+// time" so any number of senders can take tokens with one CAS
+typedef struct {
+  _Atomic uint64_t tat_ns;
+  _Atomic uint64_t interval_ns;
+  _Atomic uint64_t burst_ns;
+  _Atomic uint64_t stalls;
+} token_bucket_t;
+
+// Additive-increase / multiplicative-decrease controller for the number of
+// unanswered probes allowed in flight
+typedef struct {
+  int window;
+  int min_window;
+  int max_window;
+  double baseline_ratio;
+  uint64_t last_replies;
+  uint64_t last_resolved;
+  uint64_t last_update_ns;
+  uint64_t decreases;
+} aimd_controller_t;
+
+void token_bucket_init(token_bucket_t *bucket, int pps, int burst);
+void token_bucket_set_rate(token_bucket_t *bucket, int pps, int burst);
+void token_bucket_acquire(token_bucket_t *bucket);
+void token_bucket_acquire_n(token_bucket_t *bucket, unsigned int count);
+
+void aimd_init(aimd_controller_t *aimd, int initial, int max_window);
+int aimd_update(aimd_controller_t *aimd, uint64_t now_ns, uint64_t replies,
+                uint64_t resolved);
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef NETWORK_INFO_RDNS_H
+#define NETWORK_INFO_RDNS_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+// Nameservers taken from /etc/resolv.conf, as the stub resolver does
+#define RDNS_RESOLV_CONF "/etc/resolv.conf"
+#define RDNS_MAX_SERVERS 3
+
+// PTR queries outstanding at once; a power of two, since a query's slot
+// is the low bits of its DNS ID
+#define RDNS_INFLIGHT 256
+#define RDNS_SLOT_MASK (RDNS_INFLIGHT - 1)
+
+// Queries sent or replies read per sendmmsg/recvmmsg
+#define RDNS_BATCH 64
+
+// Each try waits this long, and a name is given up after this many tries,
+// rotating through the servers
+#define RDNS_TIMEOUT_MS 1000
+#define RDNS_ATTEMPTS 3
+
+// Cache lifetimes: answers keep their TTL within these bounds, names that
+// do not exist are kept for the negative TTL, and lookups that failed are
+// retried after the failure TTL and never written to disk
+#define RDNS_MIN_TTL_S 60
+#define RDNS_MAX_TTL_S 604800
+#define RDNS_NEGATIVE_TTL_S 3600
+#define RDNS_FAILURE_TTL_S 60
+
+// Longest name, and the space reserved for every name a run can learn
+#define RDNS_NAME_LEN 256
+#define RDNS_NAME_SPACE ((size_t)256 << 20)
+
+// Where an address's lookup stands
+typedef enum {
+  RDNS_ENTRY_EMPTY = 0, // free hash slot
+  RDNS_ENTRY_UNKNOWN,   // known address, never looked up
+  RDNS_ENTRY_QUEUED,    // waiting for a slot or its answer
+  RDNS_ENTRY_DONE
+} rdns_entry_state_t;
+
+// One cached address; name stays valid until rdns_close
+typedef struct {
+  uint32_t addr;
+  uint32_t expires_s; // Unix time the answer goes stale
+  const char *name;   // NULL when the address has no usable PTR record
+  uint8_t state;      // RDNS_ENTRY_*
+  uint8_t persist;    // an answer from a server, saved to the cache file
+} rdns_entry_t;
+
+// One PTR query on the wire
+typedef struct {
+  uint64_t sent_ns;
+  uint32_t addr;
+  uint16_t id;
+  uint8_t attempts;
+  uint8_t server;
+  uint8_t used;
+} rdns_query_t;
+
+typedef struct {
+  uint64_t lookups;  // addresses asked for
+  uint64_t cached;   // answered from the cache
+  uint64_t queries;  // datagrams sent, retries included
+  uint64_t named;    // lookups that ended with a name
+  uint64_t failed;   // lookups no server answered
+} rdns_stats_t;
+
+// Asynchronous reverse resolver. Lookups are answered from an address
+// hash table or queued; queued addresses go out in batches as slots free
+// up, on one non-blocking UDP socket. Single-threaded: its owner drives it
+// with rdns_poll.
+typedef struct {
+  int fd;
+  struct sockaddr_in servers[RDNS_MAX_SERVERS];
+  int server_count;
+  const char *cache_path; // NULL for a cache that lives only in memory
+  rdns_entry_t *entries;  // open addressing on the address
+  size_t capacity;
+  size_t count;
+  uint32_t *waiting; // addresses queued for a free slot, oldest first
+  size_t waiting_head;
+  size_t waiting_count;
+  size_t waiting_capacity;
+  rdns_query_t queries[RDNS_INFLIGHT];
+  int inflight;
+  uint64_t random;
+  arena_t names;
+  rdns_stats_t stats;
+} rdns_t;
+
+int rdns_open(rdns_t *rdns, const char *server, const char *cache_path);
+void rdns_close(rdns_t *rdns);
+int rdns_lookup(rdns_t *rdns, uint32_t addr, const char **name);
+int rdns_result(const rdns_t *rdns, uint32_t addr, const char **name);
+void rdns_poll(rdns_t *rdns, int wait_ms);
+int rdns_busy(const rdns_t *rdns);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef NETWORK_INFO_RESULTS_H
+#define NETWORK_INFO_RESULTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "probe.h"
+
+// Per-responder detail; rtt_us is 0 until filled in
+typedef struct {
+  uint32_t rtt_us;
+  uint8_t ttl;
+  uint8_t via; // PROBE_VIA_* of the reply
+  uint8_t valid;
+} result_detail_t;
+
+// Reply details are kept in blocks of RESULT_BLOCK_SIZE indices, taken
+// only for blocks with a responder
+#define RESULT_BLOCK_BITS 8
+#define RESULT_BLOCK_SIZE (1u << RESULT_BLOCK_BITS)
+// Detail blocks are mapped this many at a time
+#define RESULT_CHUNK_BLOCKS 64
+
+// Liveness bitmap, one bit per scanned index, plus reply details for the
+// responders. The bitmap and one block pointer per RESULT_BLOCK_SIZE
+// indices live in the scan's arena. Detail blocks are handed out from
+// chunks that are mapped the first time a receiver needs one, so a sparse
+// sweep reserves and touches memory only in proportion to its responders.
+typedef struct {
+  _Atomic uint64_t *alive;
+  size_t bits;
+  size_t words;
+  _Atomic(result_detail_t *) *blocks;
+  size_t block_count;
+  _Atomic(result_detail_t *) *chunks;
+  size_t chunk_count;
+  _Atomic size_t next_block;
+} result_store_t;
+
+size_t result_store_span(size_t bits);
+int result_store_init(result_store_t *store, size_t bits, arena_t *arena);
+void result_store_clear(result_store_t *store);
+void result_store_destroy(result_store_t *store);
+void result_store_mark(result_store_t *store, size_t index,
+                       const probe_reply_t *reply);
+int result_store_alive(const result_store_t *store, size_t index);
+size_t result_store_count(const result_store_t *store, size_t lo, size_t hi);
+size_t result_store_next(const result_store_t *store, size_t from, size_t hi);
+const result_detail_t *result_store_detail(const result_store_t *store,
+                                           size_t index);
+
+#endif
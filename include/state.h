@@ -0,0 +1,82 @@
+#ifndef NETWORK_INFO_STATE_H
+#define NETWORK_INFO_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "probe.h"
+
+// State file: a 64-byte header followed by one block per /24 ever scanned,
+// appended in first-seen order and found again through an in-memory index
+#define STATE_MAGIC "NIHS"
+#define STATE_VERSION 1
+#define STATE_BLOCK_HOSTS 256
+
+// Blocks the file grows by when it runs out of room
+#define STATE_GROW_BLOCKS 64
+
+// Rescan defaults: a host that missed this many scans in a row counts as
+// long dead, and long-dead hosts are probed once every this many runs
+#define STATE_DEFAULT_DEAD_AFTER 3
+#define STATE_DEFAULT_DEAD_SAMPLE 8
+#define STATE_MAX_DEAD 10000
+
+// What the last scans learned about one address; 16 bytes
+typedef struct {
+  uint32_t last_alive;  // unix seconds of the last reply, 0 if none yet
+  uint32_t last_probed; // unix seconds of the last probe, 0 if never
+  uint32_t rtt_us;      // RTT of the last reply
+  uint16_t dead_streak; // consecutive probes without a reply
+  uint8_t up;           // answered its last probe
+  uint8_t reserved;
+} host_state_t;
+
+// Every address of one /24, indexed by its low byte
+typedef struct {
+  uint32_t prefix; // address >> 8
+  uint32_t reserved[3];
+  host_state_t hosts[STATE_BLOCK_HOSTS];
+} state_block_t;
+
+typedef struct {
+  char magic[4];
+  uint16_t version;
+  uint16_t header_len;
+  uint32_t block_count;
+  uint32_t runs; // scans recorded so far, drives down-sampling
+  uint8_t reserved[48];
+} state_header_t;
+
+// An open state file, mapped shared so updates reach disk without writes
+typedef struct {
+  int fd;
+  state_header_t *header; // start of the mapping
+  size_t map_len;
+  uint32_t capacity; // blocks the mapping has room for
+  uint32_t *index;   // open-addressed prefix -> block number + 1
+  uint32_t index_mask;
+} state_file_t;
+
+// Which long-dead hosts a rescan still probes
+typedef struct {
+  int dead_after;  // misses before a host counts as long dead
+  int dead_sample; // probe 1 in N runs; 0 never probes them again
+} state_policy_t;
+
+typedef enum {
+  STATE_SAME = 0,
+  STATE_CAME_UP = 1,
+  STATE_WENT_DOWN = 2
+} state_change_t;
+
+int state_open(state_file_t *state, const char *path);
+void state_close(state_file_t *state);
+void state_begin_run(state_file_t *state);
+int state_reserve(state_file_t *state, uint32_t prefix);
+state_block_t *state_block(const state_file_t *state, uint32_t block);
+int state_should_probe(const state_file_t *state, const host_state_t *host,
+                       uint32_t addr, const state_policy_t *policy);
+state_change_t state_record(host_state_t *host, const probe_reply_t *reply,
+                            uint32_t now);
+
+#endif
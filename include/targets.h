@@ -0,0 +1,54 @@
+#ifndef NETWORK_INFO_TARGETS_H
+#define NETWORK_INFO_TARGETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+// Longest single spec we accept; target-file lines may be any length
+#define TARGET_SPEC_LEN 128
+
+// Deepest chain of @file includes followed, the outermost file included
+#define TARGET_MAX_INCLUDE_DEPTH 8
+
+// Inclusive range of host-order addresses
+typedef struct {
+  uint32_t first;
+  uint32_t last;
+} target_range_t;
+
+// Most ranges one set holds, a /8 of single addresses, and how many its
+// first reservation has room for; it doubles from there as needed
+#define TARGET_SET_MAX_RANGES (1u << 24)
+#define TARGET_SET_INITIAL_RANGES 1024
+
+// Interval set of targets. Ranges may overlap until target_set_compile()
+// sorts, merges and subtracts exclusions; afterwards they are disjoint and
+// ascending.
+typedef struct {
+  arena_t arena;
+  target_range_t *ranges;
+  size_t count;
+  size_t capacity;
+} target_set_t;
+
+void target_set_init(target_set_t *set);
+void target_set_destroy(target_set_t *set);
+int target_set_add(target_set_t *set, uint32_t first, uint32_t last);
+int target_set_compile(target_set_t *set, const target_set_t *exclude);
+uint64_t target_set_size(const target_set_t *set);
+uint64_t target_set_fingerprint(const target_set_t *set);
+
+// Parse one spec: "10.0.0.0/12", "10.1.0.0-10.1.3.255", or "192.168.1.7"
+int target_parse_range(const char *spec, target_range_t *range,
+                       int hosts_only);
+
+// Parse a list of specs separated by commas or whitespace. Entries starting
+// with '!' go to exclude, entries starting with '@' name a file of specs.
+int target_parse_list(const char *list, target_set_t *include,
+                      target_set_t *exclude);
+int target_parse_file(const char *path, target_set_t *include,
+                      target_set_t *exclude);
+
+#endif
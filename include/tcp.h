@@ -0,0 +1,56 @@
+#ifndef NETWORK_INFO_TCP_H
+#define NETWORK_INFO_TCP_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// SYN layout: 20-byte TCP header followed by one MSS option, as a normal
+// stack would send; some filters drop option-less SYNs
+#define TCP_SYN_LEN 24
+#define TCP_SYN_MSS 1460
+#define TCP_SYN_WINDOW 64240
+#define TCP_RECV_LEN 256
+
+// SYNs to on-link addresses sit in the socket's send buffer until ARP
+// gives up on them, and each host gets one per port, so the default
+// buffer runs out within a /24
+#define TCP_SYN_SNDBUF (4 << 20)
+
+// Source ports raw SYNs are sent from, high in the ephemeral range
+#define TCP_SYN_PORT_MIN 61000
+#define TCP_SYN_PORT_SPAN 4000
+
+// Per-/24 source address lookups kept for SYN checksums; a power of two
+// of at least 65536 covers a /8 without collisions
+#define TCP_ROUTE_CACHE_SLOTS 65536
+
+// Raw TCP socket for SYN probing. Initial sequence numbers hide the probe
+// behind a per-run secret so only real answers to our SYNs match.
+typedef struct {
+  int sockfd;
+  uint16_t sport;
+  uint32_t secret;
+  const char *device; // interface source addresses are looked up on
+} tcp_syn_socket_t;
+
+// What a SYN-ACK or RST to one of our SYNs carried
+typedef struct {
+  in_addr_t from;
+  uint16_t port; // the probed port, in host order
+  uint32_t cookie; // our initial sequence number, secret removed
+  uint8_t ttl;
+} tcp_answer_t;
+
+int tcp_syn_open(tcp_syn_socket_t *sock, const char *device,
+                 unsigned int lane);
+void tcp_syn_close(tcp_syn_socket_t *sock);
+int tcp_route_source(in_addr_t dst, const char *device, in_addr_t *src);
+size_t tcp_build_syn(uint8_t *buf, size_t cap, in_addr_t src, in_addr_t dst,
+                     uint16_t sport, uint16_t dport, uint32_t seq);
+int tcp_send_syn(const tcp_syn_socket_t *sock, in_addr_t dst, uint16_t dport,
+                 uint32_t cookie);
+int tcp_parse_answer(const tcp_syn_socket_t *sock, const uint8_t *buf,
+                     size_t len, tcp_answer_t *answer);
+
+#endif
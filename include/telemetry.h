@@ -0,0 +1,61 @@
+#ifndef NETWORK_INFO_TELEMETRY_H
+#define NETWORK_INFO_TELEMETRY_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// Default /metrics bind address when only a port is given, and how often
+// statsd gets a push
+#define TELEMETRY_DEFAULT_BIND "127.0.0.1"
+#define TELEMETRY_DEFAULT_INTERVAL_MS 1000
+#define TELEMETRY_PREFIX "network_info"
+
+// Largest /metrics page or statsd datagram we build
+#define TELEMETRY_BUFFER_LEN 4096
+
+// One lock-free reading of every exported counter and gauge
+typedef struct {
+  uint64_t hosts_scanned;
+  uint64_t responders;
+  uint64_t subnets_scanned;
+  uint64_t probes_sent;
+  uint64_t retransmits;
+  uint64_t replies;
+  uint64_t timeouts;
+  uint64_t send_errors;
+  uint64_t rate_stalls;
+  uint64_t monitor_cycles;
+  int64_t active_workers;
+  int64_t inflight;
+  int64_t window;
+  int64_t send_queue;
+  int64_t retry_queue;
+  int64_t hosts_up;
+} telemetry_sample_t;
+
+// Fills a sample from atomics only; called on the telemetry thread
+typedef void (*telemetry_sample_fn)(telemetry_sample_t *sample);
+
+typedef struct {
+  const char *listen; // "[ADDR:]PORT" for the HTTP exporter, or NULL
+  const char *statsd; // "HOST:PORT" to push to, or NULL
+  int interval_ms;
+} telemetry_config_t;
+
+typedef struct {
+  int http_fd;
+  int statsd_fd;
+  int interval_ms;
+  telemetry_sample_fn sample;
+  pthread_t thread;
+  _Atomic int running;
+} telemetry_t;
+
+int telemetry_start(telemetry_t *telemetry, const telemetry_config_t *config,
+                    telemetry_sample_fn sample);
+void telemetry_stop(telemetry_t *telemetry);
+size_t telemetry_format_prometheus(const telemetry_sample_t *sample,
+                                   char *buf, size_t cap);
+
+#endif
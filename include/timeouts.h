@@ -0,0 +1,33 @@
+#ifndef NETWORK_INFO_TIMEOUTS_H
+#define NETWORK_INFO_TIMEOUTS_H
+
+#include <stdint.h>
+
+// Replies a subnet needs before its own RTTs override the fixed timeout
+#define TIMEOUT_MIN_SAMPLES 3
+
+// Slack added on top of the learned p99 unless half the p99 is larger
+#define TIMEOUT_DEFAULT_MARGIN_MS 5
+#define TIMEOUT_MAX_MARGIN_MS 1000
+
+// Which unanswered targets are worth retrying
+typedef enum {
+  RETRY_POLICY_ALL = 0, // every target, as many times as configured
+  RETRY_POLICY_LIVE = 1 // only targets in subnets that answered at all
+} retry_policy_t;
+
+// Running view of one subnet's responders, cheap enough to update from the
+// probe receiver. A /24 holds at most 254 samples, so its p99 is its
+// slowest reply and only the maximum needs keeping.
+typedef struct {
+  _Atomic uint32_t max_us;
+  _Atomic uint32_t samples;
+} rtt_profile_t;
+
+void rtt_profile_init(rtt_profile_t *profile);
+void rtt_profile_record(rtt_profile_t *profile, uint32_t rtt_us);
+uint32_t rtt_profile_samples(const rtt_profile_t *profile);
+uint32_t rtt_profile_deadline_us(const rtt_profile_t *profile,
+                                 uint32_t margin_us);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef NETWORK_INFO_URING_H
+#define NETWORK_INFO_URING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal io_uring wrapper over the raw syscalls: one submission and one
+// completion ring mapped into the process, and provided buffer rings for
+// multishot receives
+
+typedef struct {
+  int fd;
+  int sqpoll; // a kernel thread drains the SQ, submits need no syscall
+
+  _Atomic uint32_t *sq_head;
+  _Atomic uint32_t *sq_tail;
+  _Atomic uint32_t *sq_flags;
+  uint32_t sq_mask;
+  uint32_t *sq_array;
+  struct io_uring_sqe *sqes;
+  uint32_t sq_local_tail; // SQEs handed out, published on submit
+
+  _Atomic uint32_t *cq_head;
+  _Atomic uint32_t *cq_tail;
+  uint32_t cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void *rings; // SQ and CQ share one mapping (IORING_FEAT_SINGLE_MMAP)
+  size_t rings_len;
+  size_t sqes_len;
+} uring_t;
+
+// A ring of equally sized buffers the kernel picks from for each receive
+typedef struct {
+  struct io_uring_buf_ring *ring;
+  size_t ring_len;
+  uint8_t *bufs;
+  size_t buf_len;
+  uint32_t count; // a power of two
+  uint16_t group;
+  uint16_t tail;
+} uring_bufs_t;
+
+int uring_open(uring_t *ring, uint32_t entries, int sqpoll_idle_ms);
+void uring_close(uring_t *ring);
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+int uring_submit(uring_t *ring);
+int uring_wait(uring_t *ring, int timeout_ms);
+struct io_uring_cqe *uring_peek(uring_t *ring);
+void uring_cqe_seen(uring_t *ring);
+
+int uring_bufs_register(uring_t *ring, uring_bufs_t *bufs, uint16_t group,
+                        uint32_t count, size_t buf_len);
+void uring_bufs_unregister(uring_t *ring, uring_bufs_t *bufs);
+uint8_t *uring_bufs_get(const uring_bufs_t *bufs, uint16_t id);
+void uring_bufs_recycle(uring_bufs_t *bufs, uint16_t id);
+
+#endif
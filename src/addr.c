@@ -0,0 +1,21 @@
+#include "addr.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+
+// Parse a dotted quad into a host-order address
+int addr_parse(const char *text, uint32_t *addr) {
+  struct in_addr parsed;
+  if (inet_pton(AF_INET, text, &parsed) != 1)
+    return -1;
+
+  *addr = ntohl(parsed.s_addr);
+  return 0;
+}
+
+// Format into buf, which must hold at least IP_STR_LEN bytes
+char *addr_format(uint32_t addr, char *buf) {
+  snprintf(buf, IP_STR_LEN, "%u.%u.%u.%u", addr >> 24, (addr >> 16) & 0xff,
+           (addr >> 8) & 0xff, addr & 0xff);
+  return buf;
+}
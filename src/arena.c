@@ -0,0 +1,39 @@
+#include "arena.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+
+// Reserve capacity bytes. MAP_NORESERVE keeps a large reservation from
+// being charged against overcommit before it is used. Returns -1 with
+// errno set.
+int arena_init(arena_t *arena, size_t capacity) {
+  *arena = (arena_t){0};
+  capacity = arena_span(capacity ? capacity : 1);
+
+  void *base = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED)
+    return -1;
+  arena->base = base;
+  arena->capacity = capacity;
+  return 0;
+}
+
+// Take size zeroed bytes, or NULL once the reservation is used up
+void *arena_alloc(arena_t *arena, size_t size) {
+  size_t span = arena_span(size);
+  if (span > arena->capacity - arena->used) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  void *ptr = arena->base + arena->used;
+  arena->used += span;
+  return ptr;
+}
+
+void arena_destroy(arena_t *arena) {
+  if (arena->base)
+    munmap(arena->base, arena->capacity);
+  *arena = (arena_t){0};
+}
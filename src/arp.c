@@ -0,0 +1,378 @@
+#include "arp.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "netlink.h"
+
+// Ethernet header plus an IPv4 ARP body, padded to the minimum frame
+#define ARP_PACKET_LEN 42
+#define ARP_FRAME_LEN 60
+
+#define ARP_OP_REQUEST 1
+#define ARP_OP_REPLY 2
+
+// Where frame data starts in a TPACKET_V2 TX slot: right after the slot
+// header, rounded up to TPACKET_ALIGNMENT
+#define ARP_TX_OFFSET                                                          \
+  ((sizeof(struct tpacket2_hdr) + TPACKET_ALIGNMENT - 1) /                     \
+   TPACKET_ALIGNMENT * TPACKET_ALIGNMENT)
+
+// Neighbour entries the kernel has confirmed recently enough to trust
+#define ARP_NUD_ALIVE (NUD_REACHABLE | NUD_PERMANENT)
+
+// An AF_PACKET socket with mmap'd RX and TX rings, bound to one interface
+typedef struct {
+  int fd;
+  uint8_t *map;
+  size_t map_len;
+  uint8_t *rx;
+  uint8_t *tx;
+  unsigned int rx_next;
+  unsigned int tx_next;
+  unsigned int tx_queued;
+} arp_ring_t;
+
+// Progress of one sweep, shared by the reply handler
+typedef struct {
+  const iface_t *iface;
+  arp_target_t *targets;
+  size_t count;
+  size_t answered;
+  arp_result_fn on_result;
+  void *ctx;
+  arp_stats_t *stats;
+} arp_sweep_t;
+
+static uint16_t get_be16(const uint8_t *in) {
+  return (uint16_t)(in[0] << 8 | in[1]);
+}
+
+static uint32_t get_be32(const uint8_t *in) {
+  return (uint32_t)in[0] << 24 | (uint32_t)in[1] << 16 |
+         (uint32_t)in[2] << 8 | in[3];
+}
+
+static void put_be16(uint8_t *out, uint16_t value) {
+  out[0] = (uint8_t)(value >> 8);
+  out[1] = (uint8_t)value;
+}
+
+static void put_be32(uint8_t *out, uint32_t value) {
+  put_be16(out, (uint16_t)(value >> 16));
+  put_be16(out + 2, (uint16_t)value);
+}
+
+// Ring slot status words are shared with the kernel
+static uint32_t frame_status(const struct tpacket2_hdr *hdr) {
+  uint32_t status = *(const volatile uint32_t *)&hdr->tp_status;
+  atomic_thread_fence(memory_order_acquire);
+  return status;
+}
+
+static void frame_release(struct tpacket2_hdr *hdr, uint32_t status) {
+  atomic_thread_fence(memory_order_release);
+  *(volatile uint32_t *)&hdr->tp_status = status;
+}
+
+// Broadcast "who has target, tell us" from our address on the interface
+static void arp_build_request(uint8_t *frame, const iface_t *iface,
+                              uint32_t target) {
+  memset(frame, 0, ARP_FRAME_LEN);
+  memset(frame, 0xff, 6);
+  memcpy(frame + 6, iface->mac, 6);
+  put_be16(frame + 12, ETH_P_ARP);
+
+  put_be16(frame + 14, 1);       // Ethernet
+  put_be16(frame + 16, ETH_P_IP);
+  frame[18] = 6;
+  frame[19] = 4;
+  put_be16(frame + 20, ARP_OP_REQUEST);
+  memcpy(frame + 22, iface->mac, 6);
+  put_be32(frame + 28, iface->addr);
+  put_be32(frame + 38, target);
+}
+
+// Sender address of an ARP reply meant for us, or 0
+static uint32_t arp_parse_reply(const uint8_t *frame, size_t len,
+                                const iface_t *iface) {
+  if (len < ARP_PACKET_LEN || get_be16(frame + 12) != ETH_P_ARP ||
+      get_be16(frame + 16) != ETH_P_IP || frame[18] != 6 || frame[19] != 4 ||
+      get_be16(frame + 20) != ARP_OP_REPLY ||
+      get_be32(frame + 38) != iface->addr)
+    return 0;
+  return get_be32(frame + 28);
+}
+
+static int arp_ring_open(arp_ring_t *ring, int ifindex) {
+  int version = TPACKET_V2;
+  struct tpacket_req req = {.tp_block_size = ARP_BLOCK_SIZE,
+                            .tp_block_nr = ARP_RING_BLOCKS,
+                            .tp_frame_size = ARP_FRAME_SIZE,
+                            .tp_frame_nr = ARP_RING_FRAMES};
+  struct sockaddr_ll local = {.sll_family = AF_PACKET,
+                              .sll_protocol = htons(ETH_P_ARP),
+                              .sll_ifindex = ifindex};
+
+  *ring = (arp_ring_t){.fd = -1};
+  ring->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ARP));
+  if (ring->fd < 0)
+    return -1;
+
+  if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version,
+                 sizeof(version)) != 0 ||
+      setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) !=
+          0 ||
+      setsockopt(ring->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) !=
+          0)
+    goto fail;
+
+  // The RX ring comes first in the mapping, the TX ring right after it
+  size_t ring_len = (size_t)ARP_BLOCK_SIZE * ARP_RING_BLOCKS;
+  ring->map_len = 2 * ring_len;
+  ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   ring->fd, 0);
+  if (ring->map == MAP_FAILED) {
+    ring->map = NULL;
+    goto fail;
+  }
+  ring->rx = ring->map;
+  ring->tx = ring->map + ring_len;
+
+  if (bind(ring->fd, (const struct sockaddr *)&local, sizeof(local)) != 0)
+    goto fail_map;
+  return 0;
+
+fail_map:
+  munmap(ring->map, ring->map_len);
+  ring->map = NULL;
+fail:
+  close(ring->fd);
+  ring->fd = -1;
+  return -1;
+}
+
+static void arp_ring_close(arp_ring_t *ring) {
+  if (ring->map)
+    munmap(ring->map, ring->map_len);
+  if (ring->fd >= 0)
+    close(ring->fd);
+  *ring = (arp_ring_t){.fd = -1};
+}
+
+// Hand every queued TX frame to the kernel; blocks until they are sent
+static void arp_ring_kick(arp_ring_t *ring) {
+  if (ring->tx_queued == 0)
+    return;
+  send(ring->fd, NULL, 0, 0);
+  ring->tx_queued = 0;
+}
+
+// Copy one frame into the next TX slot, flushing the ring if it is full.
+// Returns -1 when the slot is still owned by the kernel.
+static int arp_ring_queue(arp_ring_t *ring, const uint8_t *frame) {
+  struct tpacket2_hdr *hdr =
+      (struct tpacket2_hdr *)(void *)(ring->tx +
+                                      ring->tx_next * ARP_FRAME_SIZE);
+
+  if (frame_status(hdr) != TP_STATUS_AVAILABLE) {
+    arp_ring_kick(ring);
+    if (frame_status(hdr) != TP_STATUS_AVAILABLE)
+      return -1;
+  }
+
+  memcpy((uint8_t *)hdr + ARP_TX_OFFSET, frame, ARP_FRAME_LEN);
+  hdr->tp_len = ARP_FRAME_LEN;
+  frame_release(hdr, TP_STATUS_SEND_REQUEST);
+
+  ring->tx_next = (ring->tx_next + 1) % ARP_RING_FRAMES;
+  if (++ring->tx_queued >= ARP_TX_BATCH)
+    arp_ring_kick(ring);
+  return 0;
+}
+
+// Position of addr in the sweep's ascending target list, or count
+static size_t arp_find(const arp_sweep_t *sweep, uint32_t addr) {
+  size_t lo = 0;
+  size_t hi = sweep->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (sweep->targets[mid].addr < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < sweep->count && sweep->targets[lo].addr == addr ? lo
+                                                              : sweep->count;
+}
+
+// Report one target as answered, exactly once
+static void arp_answer(arp_sweep_t *sweep, size_t i,
+                       const probe_reply_t *reply) {
+  if (sweep->targets[i].done)
+    return;
+  sweep->targets[i].done = 1;
+  sweep->answered++;
+  sweep->on_result(sweep->ctx, sweep->targets[i].index, reply);
+}
+
+// Consume every filled RX slot
+static void arp_ring_drain(arp_ring_t *ring, arp_sweep_t *sweep) {
+  for (;;) {
+    struct tpacket2_hdr *hdr =
+        (struct tpacket2_hdr *)(void *)(ring->rx +
+                                        ring->rx_next * ARP_FRAME_SIZE);
+    if (!(frame_status(hdr) & TP_STATUS_USER))
+      break;
+
+    uint32_t addr = arp_parse_reply((const uint8_t *)hdr + hdr->tp_mac,
+                                    hdr->tp_snaplen, sweep->iface);
+    size_t i = addr ? arp_find(sweep, addr) : sweep->count;
+    const arp_target_t *target = &sweep->targets[i];
+    if (i < sweep->count && target->sent_ns && !target->done) {
+      probe_reply_t reply = {
+          .rtt_us = (uint32_t)((monotonic_ns() - target->sent_ns) / 1000),
+          .via = PROBE_VIA_ARP};
+      sweep->stats->replies++;
+      arp_answer(sweep, i, &reply);
+    }
+
+    frame_release(hdr, TP_STATUS_KERNEL);
+    ring->rx_next = (ring->rx_next + 1) % ARP_RING_FRAMES;
+  }
+}
+
+// One neighbour entry: settle it if it is a target the kernel has
+// confirmed on this link
+static void arp_neighbor(const struct nlmsghdr *msg, void *ctx) {
+  arp_sweep_t *sweep = ctx;
+  if (msg->nlmsg_type != RTM_NEWNEIGH)
+    return;
+
+  const struct ndmsg *ndm = NLMSG_DATA(msg);
+  if (ndm->ndm_ifindex != sweep->iface->ifindex ||
+      !(ndm->ndm_state & ARP_NUD_ALIVE))
+    return;
+
+  unsigned int attr_len = (unsigned int)RTM_PAYLOAD(msg);
+  uint32_t addr = 0;
+  int has_lladdr = 0;
+  for (const struct rtattr *attr = RTM_RTA(ndm); RTA_OK(attr, attr_len);
+       attr = RTA_NEXT(attr, attr_len)) {
+    if (attr->rta_type == NDA_DST && RTA_PAYLOAD(attr) == 4)
+      addr = get_be32(RTA_DATA(attr));
+    else if (attr->rta_type == NDA_LLADDR)
+      has_lladdr = 1;
+  }
+
+  size_t i = addr && has_lladdr ? arp_find(sweep, addr) : sweep->count;
+  if (i < sweep->count && !sweep->targets[i].done) {
+    probe_reply_t reply = {.via = PROBE_VIA_NEIGH};
+    sweep->stats->neighbors++;
+    arp_answer(sweep, i, &reply);
+  }
+}
+
+// Settle targets the kernel already knows to be reachable on the link, so
+// they are not asked again
+static void arp_read_neighbors(arp_sweep_t *sweep) {
+  struct ndmsg request = {.ndm_family = AF_INET};
+  netlink_dump(RTM_GETNEIGH, &request, sizeof(request), arp_neighbor, sweep);
+}
+
+// Wait up to wait_ms for replies, returning early once everyone answered
+static void arp_collect(arp_ring_t *ring, arp_sweep_t *sweep, int wait_ms) {
+  uint64_t deadline = monotonic_ns() + (uint64_t)wait_ms * NS_PER_MS;
+  struct pollfd pfd = {.fd = ring->fd, .events = POLLIN};
+
+  arp_ring_drain(ring, sweep);
+  while (sweep->answered < sweep->count) {
+    uint64_t now = monotonic_ns();
+    if (now >= deadline)
+      break;
+    int left = (int)((deadline - now + NS_PER_MS - 1) / NS_PER_MS);
+    if (poll(&pfd, 1, left) < 0 && errno != EINTR)
+      break;
+    arp_ring_drain(ring, sweep);
+  }
+}
+
+// Whether this process may open the packet sockets a sweep needs
+int arp_available(void) {
+  int fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ARP));
+  if (fd < 0)
+    return 0;
+  close(fd);
+  return 1;
+}
+
+// Resolve targets on one local link: neighbour table first, then rounds of
+// batched ARP requests paced by bucket, each followed by up to wait_ms of
+// listening. targets must be sorted by address and carry the sweep's
+// progress. Every target gets exactly one on_result call. Returns -1 if
+// the link could not be used, in which case the unresolved targets are
+// reported unanswered.
+int arp_sweep(const iface_t *iface, arp_target_t *targets, size_t count,
+              int wait_ms, int rounds, token_bucket_t *bucket,
+              arp_result_fn on_result, void *ctx, arp_stats_t *stats) {
+  arp_sweep_t sweep = {.iface = iface,
+                       .targets = targets,
+                       .count = count,
+                       .on_result = on_result,
+                       .ctx = ctx,
+                       .stats = stats};
+  arp_ring_t ring;
+  uint8_t frame[ARP_FRAME_LEN];
+  int status = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    targets[i].sent_ns = 0;
+    targets[i].done = 0;
+  }
+  arp_read_neighbors(&sweep);
+
+  if (arp_ring_open(&ring, iface->ifindex) != 0) {
+    fprintf(stderr, "Cannot open packet ring on %s: %s\n", iface->name,
+            strerror(errno));
+    status = -1;
+    goto finish;
+  }
+
+  for (int round = 0; round < rounds && sweep.answered < count; ++round) {
+    for (size_t i = 0; i < count; ++i) {
+      if (targets[i].done)
+        continue;
+      if (bucket)
+        token_bucket_acquire(bucket);
+      arp_build_request(frame, iface, targets[i].addr);
+      if (arp_ring_queue(&ring, frame) != 0)
+        continue;
+      targets[i].sent_ns = monotonic_ns();
+      stats->requests++;
+      if (ring.tx_queued == 0)
+        arp_ring_drain(&ring, &sweep);
+    }
+    arp_ring_kick(&ring);
+    arp_collect(&ring, &sweep, wait_ms);
+  }
+  arp_ring_close(&ring);
+
+finish:
+  for (size_t i = 0; i < count; ++i) {
+    if (!targets[i].done)
+      on_result(ctx, targets[i].index, NULL);
+  }
+  return status;
+}
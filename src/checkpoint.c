@@ -0,0 +1,272 @@
+#include "checkpoint.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clock.h"
+
+#define WORD_BITS 64
+
+static_assert(sizeof(checkpoint_header_t) == 128,
+              "checkpoint header layout changed");
+
+static size_t bitmap_words(uint64_t total) {
+  return (size_t)((total + WORD_BITS - 1) / WORD_BITS);
+}
+
+static size_t checkpoint_file_len(uint64_t total) {
+  return sizeof(checkpoint_header_t) + bitmap_words(total) * sizeof(uint64_t) +
+         (size_t)total * sizeof(result_detail_t);
+}
+
+// Point the bitmap and details into a mapping of the whole file
+static void checkpoint_layout(checkpoint_t *checkpoint, void *map,
+                              size_t len, uint64_t total) {
+  checkpoint->header = map;
+  checkpoint->map_len = len;
+  checkpoint->done = (_Atomic uint64_t *)(checkpoint->header + 1);
+  checkpoint->details =
+      (result_detail_t *)(checkpoint->done + bitmap_words(total));
+}
+
+static int checkpoint_valid(const checkpoint_header_t *header,
+                            const char *path) {
+  if (memcmp(header->magic, CHECKPOINT_MAGIC, 4) == 0 &&
+      header->version == CHECKPOINT_VERSION &&
+      header->header_len == sizeof(checkpoint_header_t))
+    return 1;
+  fprintf(stderr, "%s is not a version %d checkpoint\n", path,
+          CHECKPOINT_VERSION);
+  return 0;
+}
+
+// Write the header's progress and flush every dirty page
+static void checkpoint_sync(checkpoint_t *checkpoint) {
+  checkpoint->header->synced_s = (uint64_t)time(NULL);
+  msync(checkpoint->header, checkpoint->map_len, MS_SYNC);
+}
+
+// Flush thread: bounds what a crash of the whole machine can lose. Killing
+// just the process loses nothing; the page cache already has it all.
+static void *checkpoint_thread(void *arg) {
+  checkpoint_t *checkpoint = arg;
+  uint64_t next_sync = monotonic_ns() + CHECKPOINT_SYNC_MS * NS_PER_MS;
+
+  while (atomic_load(&checkpoint->running)) {
+    // Wake every 100ms so closing is prompt
+    sleep_ns(100 * NS_PER_MS);
+    if (monotonic_ns() >= next_sync) {
+      checkpoint_sync(checkpoint);
+      next_sync = monotonic_ns() + CHECKPOINT_SYNC_MS * NS_PER_MS;
+    }
+  }
+  return NULL;
+}
+
+// Whether fd holds a checkpoint whose last attempt stopped short of its
+// plan, so starting over would throw its results away
+static int checkpoint_unfinished(int fd, const char *path) {
+  checkpoint_header_t header;
+
+  if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+      memcmp(header.magic, CHECKPOINT_MAGIC, 4) != 0 || header.complete)
+    return 0;
+
+  fprintf(stderr,
+          "%s holds an unfinished scan (%llu of %llu targets done); "
+          "continue it with --resume or start over with --overwrite\n",
+          path, (unsigned long long)atomic_load(&header.done),
+          (unsigned long long)header.total);
+  return 1;
+}
+
+// Open the checkpoint of a scan over total targets whose compiled target
+// set hashes to fingerprint. A fresh scan starts the file over, but only
+// replaces an unfinished checkpoint when overwrite is set; resume insists
+// on a checkpoint of the same targets and keeps its results. Returns -1
+// after printing a diagnostic.
+int checkpoint_open(checkpoint_t *checkpoint, const char *path,
+                    uint64_t fingerprint, uint64_t total, int resume,
+                    int overwrite) {
+  size_t len = checkpoint_file_len(total);
+  struct stat st;
+
+  *checkpoint = (checkpoint_t){.fd = -1};
+  checkpoint->fd =
+      open(path, resume ? O_RDWR | O_CLOEXEC : O_RDWR | O_CREAT | O_CLOEXEC,
+           0644);
+  if (checkpoint->fd < 0 || fstat(checkpoint->fd, &st) != 0) {
+    fprintf(stderr, "Cannot open checkpoint %s: %s\n", path,
+            strerror(errno));
+    goto fail;
+  }
+
+  if (resume && (size_t)st.st_size != len) {
+    fprintf(stderr, "%s is not a checkpoint of these targets\n", path);
+    goto fail;
+  }
+  if (!resume && !overwrite && checkpoint_unfinished(checkpoint->fd, path))
+    goto fail;
+  if (!resume && (ftruncate(checkpoint->fd, 0) != 0 ||
+                  ftruncate(checkpoint->fd, (off_t)len) != 0)) {
+    fprintf(stderr, "Cannot size checkpoint %s: %s\n", path,
+            strerror(errno));
+    goto fail;
+  }
+
+  void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   checkpoint->fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Cannot map checkpoint %s: %s\n", path, strerror(errno));
+    goto fail;
+  }
+  checkpoint_layout(checkpoint, map, len, total);
+
+  checkpoint_header_t *header = checkpoint->header;
+  if (!resume) {
+    memcpy(header->magic, CHECKPOINT_MAGIC, 4);
+    header->version = CHECKPOINT_VERSION;
+    header->header_len = sizeof(checkpoint_header_t);
+    header->fingerprint = fingerprint;
+    header->total = total;
+  } else if (!checkpoint_valid(header, path)) {
+    goto fail_map;
+  } else if (header->fingerprint != fingerprint || header->total != total) {
+    fprintf(stderr, "%s is not a checkpoint of these targets\n", path);
+    goto fail_map;
+  }
+  header->attempts++;
+
+  atomic_store(&checkpoint->running, 1);
+  if (pthread_create(&checkpoint->thread, NULL, checkpoint_thread,
+                     checkpoint) != 0) {
+    fprintf(stderr, "Cannot start the checkpoint thread\n");
+    goto fail_map;
+  }
+  return 0;
+
+fail_map:
+  munmap(checkpoint->header, checkpoint->map_len);
+  checkpoint->header = NULL;
+fail:
+  if (checkpoint->fd >= 0)
+    close(checkpoint->fd);
+  checkpoint->fd = -1;
+  return -1;
+}
+
+// Stop the flush thread, note whether the scan got through every target it
+// planned and flush one last time
+void checkpoint_close(checkpoint_t *checkpoint, int complete) {
+  if (!checkpoint->header)
+    return;
+
+  atomic_store(&checkpoint->running, 0);
+  pthread_join(checkpoint->thread, NULL);
+
+  checkpoint->header->complete = (uint32_t)complete;
+  checkpoint_sync(checkpoint);
+  munmap(checkpoint->header, checkpoint->map_len);
+  close(checkpoint->fd);
+  *checkpoint = (checkpoint_t){.fd = -1};
+}
+
+// Map an existing checkpoint read-only, to take its results without
+// scanning. Returns -1 after printing a diagnostic.
+int checkpoint_map(checkpoint_t *checkpoint, const char *path) {
+  struct stat st;
+
+  *checkpoint = (checkpoint_t){.fd = open(path, O_RDONLY | O_CLOEXEC)};
+  if (checkpoint->fd < 0 || fstat(checkpoint->fd, &st) != 0) {
+    fprintf(stderr, "Cannot open checkpoint %s: %s\n", path,
+            strerror(errno));
+    goto fail;
+  }
+  if ((size_t)st.st_size < sizeof(checkpoint_header_t)) {
+    fprintf(stderr, "%s is not a version %d checkpoint\n", path,
+            CHECKPOINT_VERSION);
+    goto fail;
+  }
+
+  size_t len = (size_t)st.st_size;
+  void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, checkpoint->fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Cannot map checkpoint %s: %s\n", path, strerror(errno));
+    goto fail;
+  }
+
+  const checkpoint_header_t *header = map;
+  if (!checkpoint_valid(header, path)) {
+    munmap(map, len);
+    goto fail;
+  }
+  if (len != checkpoint_file_len(header->total)) {
+    fprintf(stderr, "%s is truncated\n", path);
+    munmap(map, len);
+    goto fail;
+  }
+  checkpoint_layout(checkpoint, map, len, header->total);
+  return 0;
+
+fail:
+  if (checkpoint->fd >= 0)
+    close(checkpoint->fd);
+  checkpoint->fd = -1;
+  return -1;
+}
+
+// Unmap a checkpoint opened with checkpoint_map
+void checkpoint_unmap(checkpoint_t *checkpoint) {
+  if (!checkpoint->header)
+    return;
+  munmap(checkpoint->header, checkpoint->map_len);
+  close(checkpoint->fd);
+  *checkpoint = (checkpoint_t){.fd = -1};
+}
+
+// Record a target's final result; reply is NULL for a timeout. The detail
+// is written before the done bit that makes it count.
+void checkpoint_record(checkpoint_t *checkpoint, size_t index,
+                       const probe_reply_t *reply) {
+  if (index >= checkpoint->header->total)
+    return;
+
+  if (reply)
+    checkpoint->details[index] = (result_detail_t){.rtt_us = reply->rtt_us,
+                                                   .ttl = reply->ttl,
+                                                   .via = reply->via,
+                                                   .valid = 1};
+
+  uint64_t bit = 1ULL << (index % WORD_BITS);
+  if (atomic_fetch_or(&checkpoint->done[index / WORD_BITS], bit) & bit)
+    return;
+  atomic_fetch_add(&checkpoint->header->done, 1);
+  if (reply)
+    atomic_fetch_add(&checkpoint->header->responders, 1);
+}
+
+int checkpoint_done(const checkpoint_t *checkpoint, size_t index) {
+  uint64_t word = atomic_load(&checkpoint->done[index / WORD_BITS]);
+  return (int)((word >> (index % WORD_BITS)) & 1);
+}
+
+// The reply a finished target got, if it answered. Returns 0 and fills
+// reply for a responder, -1 for a timeout.
+int checkpoint_reply(const checkpoint_t *checkpoint, size_t index,
+                     probe_reply_t *reply) {
+  const result_detail_t *detail = &checkpoint->details[index];
+  if (!detail->valid)
+    return -1;
+
+  *reply = (probe_reply_t){
+      .rtt_us = detail->rtt_us, .ttl = detail->ttl, .via = detail->via};
+  return 0;
+}
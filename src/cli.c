@@ -0,0 +1,792 @@
+#include "cli.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <net/if.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "addr.h"
+
+// Long-only options
+enum {
+  OPT_HOSTS = 256,
+  OPT_FLUSH_INTERVAL,
+  OPT_BASELINE,
+  OPT_METRICS_LISTEN,
+  OPT_STATSD,
+  OPT_TELEMETRY_INTERVAL,
+  OPT_ADAPTIVE_TIMEOUT,
+  OPT_TIMEOUT_MARGIN,
+  OPT_RETRY_POLICY,
+  OPT_STATE,
+  OPT_RESCAN,
+  OPT_DEAD_AFTER,
+  OPT_DEAD_SAMPLE,
+  OPT_ARP,
+  OPT_STATIC_LISTS,
+  OPT_PROBE,
+  OPT_PORTS,
+  OPT_IO_URING,
+  OPT_ORDER,
+  OPT_SEED,
+  OPT_CHECKPOINT,
+  OPT_RESUME,
+  OPT_OVERWRITE,
+  OPT_INTERFACE,
+  OPT_SHARD,
+  OPT_MERGE,
+  OPT_DAEMON,
+  OPT_INTERVAL,
+  OPT_WINDOW,
+  OPT_CPUS,
+  OPT_RDNS,
+  OPT_RDNS_CACHE,
+  OPT_RESOLVER,
+  OPT_IPV6
+};
+
+static const struct option long_options[] = {
+    {"mode", required_argument, NULL, 'm'},
+    {"targets", required_argument, NULL, 't'},
+    {"subnet", required_argument, NULL, 's'},
+    {"hosts", required_argument, NULL, OPT_HOSTS},
+    {"timeout", required_argument, NULL, 'T'},
+    {"rate", required_argument, NULL, 'r'},
+    {"concurrency", required_argument, NULL, 'c'},
+    {"cpus", required_argument, NULL, OPT_CPUS},
+    {"retries", required_argument, NULL, 'R'},
+    {"adaptive-timeout", no_argument, NULL, OPT_ADAPTIVE_TIMEOUT},
+    {"timeout-margin", required_argument, NULL, OPT_TIMEOUT_MARGIN},
+    {"retry-policy", required_argument, NULL, OPT_RETRY_POLICY},
+    {"probe", required_argument, NULL, OPT_PROBE},
+    {"ports", required_argument, NULL, OPT_PORTS},
+    {"io-uring", no_argument, NULL, OPT_IO_URING},
+    {"state", required_argument, NULL, OPT_STATE},
+    {"rescan", no_argument, NULL, OPT_RESCAN},
+    {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+    {"resume", no_argument, NULL, OPT_RESUME},
+    {"overwrite", no_argument, NULL, OPT_OVERWRITE},
+    {"dead-after", required_argument, NULL, OPT_DEAD_AFTER},
+    {"dead-sample", required_argument, NULL, OPT_DEAD_SAMPLE},
+    {"arp", no_argument, NULL, OPT_ARP},
+    {"static-lists", no_argument, NULL, OPT_STATIC_LISTS},
+    {"order", required_argument, NULL, OPT_ORDER},
+    {"seed", required_argument, NULL, OPT_SEED},
+    {"shard", required_argument, NULL, OPT_SHARD},
+    {"interface", required_argument, NULL, OPT_INTERFACE},
+    {"merge", no_argument, NULL, OPT_MERGE},
+    {"daemon", no_argument, NULL, OPT_DAEMON},
+    {"interval", required_argument, NULL, OPT_INTERVAL},
+    {"window", required_argument, NULL, OPT_WINDOW},
+    {"rdns", no_argument, NULL, OPT_RDNS},
+    {"rdns-cache", required_argument, NULL, OPT_RDNS_CACHE},
+    {"resolver", required_argument, NULL, OPT_RESOLVER},
+    {"ipv6", no_argument, NULL, OPT_IPV6},
+    {"format", required_argument, NULL, 'f'},
+    {"flush-interval", required_argument, NULL, OPT_FLUSH_INTERVAL},
+    {"baseline", required_argument, NULL, OPT_BASELINE},
+    {"metrics-listen", required_argument, NULL, OPT_METRICS_LISTEN},
+    {"statsd", required_argument, NULL, OPT_STATSD},
+    {"telemetry-interval", required_argument, NULL, OPT_TELEMETRY_INTERVAL},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}};
+
+static const char *const mode_names[] = {
+    [SCAN_MODE_COMMON] = "common", [SCAN_MODE_FULL] = "full",
+    [SCAN_MODE_SUBNET] = "subnet", [SCAN_MODE_QUICK] = "quick",
+    [SCAN_MODE_CUSTOM] = "custom"};
+
+static const char *const format_names[] = {[OUTPUT_TEXT] = "text",
+                                           [OUTPUT_NDJSON] = "ndjson",
+                                           [OUTPUT_CSV] = "csv",
+                                           [OUTPUT_BINARY] = "binary"};
+
+static const char *const retry_policy_names[] = {
+    [RETRY_POLICY_ALL] = "all", [RETRY_POLICY_LIVE] = "live"};
+
+static const char *const order_names[] = {
+    [SCAN_ORDER_SEQUENTIAL] = "sequential", [SCAN_ORDER_RANDOM] = "random"};
+
+// Parse a decimal integer in [min, max]
+static int parse_int(const char *text, int min, int max, int *value) {
+  char *end;
+  errno = 0;
+  long parsed = strtol(text, &end, 10);
+  if (errno != 0 || end == text || *end != '\0' || parsed < min ||
+      parsed > max)
+    return -1;
+
+  *value = (int)parsed;
+  return 0;
+}
+
+// Parse an unsigned 64-bit decimal integer
+static int parse_u64(const char *text, uint64_t *value) {
+  char *end;
+  errno = 0;
+  unsigned long long parsed = strtoull(text, &end, 10);
+  if (errno != 0 || end == text || *end != '\0' || text[0] == '-')
+    return -1;
+
+  *value = parsed;
+  return 0;
+}
+
+// "I/N": this instance is shard I of N, counting from 1
+static int parse_shard(const char *text, int *index, int *count) {
+  char buf[16];
+  char *slash;
+
+  if (strlen(text) >= sizeof(buf))
+    return -1;
+  strcpy(buf, text);
+
+  slash = strchr(buf, '/');
+  if (!slash)
+    return -1;
+  *slash = '\0';
+
+  if (parse_int(slash + 1, 1, CLI_MAX_SHARDS, count) != 0 ||
+      parse_int(buf, 1, *count, index) != 0)
+    return -1;
+  --*index;
+  return 0;
+}
+
+static int parse_order(const char *text, scan_order_t *order) {
+  for (size_t i = 0; i < sizeof(order_names) / sizeof(order_names[0]); ++i) {
+    if (strcmp(text, order_names[i]) == 0) {
+      *order = (scan_order_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int parse_retry_policy(const char *text, retry_policy_t *policy) {
+  for (size_t i = 0;
+       i < sizeof(retry_policy_names) / sizeof(retry_policy_names[0]); ++i) {
+    if (strcmp(text, retry_policy_names[i]) == 0) {
+      *policy = (retry_policy_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Comma-separated TCP ports, at most PROBE_MAX_PORTS and none twice
+static int parse_ports(const char *text, probe_config_t *probe) {
+  char buf[PROBE_MAX_PORTS * 6];
+  int count = 0;
+
+  if (strlen(text) >= sizeof(buf))
+    return -1;
+  strcpy(buf, text);
+
+  for (char *save, *item = strtok_r(buf, ",", &save); item;
+       item = strtok_r(NULL, ",", &save)) {
+    int port;
+    if (count == PROBE_MAX_PORTS || parse_int(item, 1, 65535, &port) != 0)
+      return -1;
+    for (int i = 0; i < count; ++i) {
+      if (probe->ports[i] == port)
+        return -1;
+    }
+    probe->ports[count++] = (uint16_t)port;
+  }
+
+  if (count == 0)
+    return -1;
+  probe->port_count = count;
+  return 0;
+}
+
+// Accept a menu number or a mode name
+static int parse_mode(const char *text, scan_mode_t *mode) {
+  int number;
+  if (parse_int(text, SCAN_MODE_COMMON, SCAN_MODE_CUSTOM, &number) == 0) {
+    *mode = (scan_mode_t)number;
+    return 0;
+  }
+
+  for (int i = SCAN_MODE_COMMON; i <= SCAN_MODE_CUSTOM; ++i) {
+    if (strcmp(text, mode_names[i]) == 0) {
+      *mode = (scan_mode_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int parse_format(const char *text, output_format_t *format) {
+  for (size_t i = 0; i < sizeof(format_names) / sizeof(format_names[0]);
+       ++i) {
+    if (strcmp(text, format_names[i]) == 0) {
+      *format = (output_format_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// "192.168.1" or "192.168.1.0", reduced to its /24
+static int parse_subnet(const char *text, uint32_t *subnet) {
+  char network[IP_STR_LEN + 2];
+  uint32_t addr;
+
+  if (addr_parse(text, &addr) != 0) {
+    snprintf(network, sizeof(network), "%s.0", text);
+    if (addr_parse(network, &addr) != 0)
+      return -1;
+  }
+
+  *subnet = addr & 0xffffff00u;
+  return 0;
+}
+
+// "FIRST-LAST" host numbers within a /24
+static int parse_hosts(const char *text, int *first, int *last) {
+  char buf[16];
+  char *dash;
+
+  if (strlen(text) >= sizeof(buf))
+    return -1;
+  strcpy(buf, text);
+
+  dash = strchr(buf, '-');
+  if (!dash)
+    return -1;
+  *dash = '\0';
+
+  if (parse_int(buf, 1, 254, first) != 0 ||
+      parse_int(dash + 1, 1, 254, last) != 0 || *last < *first)
+    return -1;
+  return 0;
+}
+
+// Fill options from argv. With no mode, targets or subnet on the command
+// line the caller falls back to the interactive menu, keeping any tuning
+// flags that were given. Returns -1 after printing a diagnostic.
+int cli_parse(int argc, char **argv, cli_options_t *options) {
+  *options = (cli_options_t){.first_host = 1,
+                             .last_host = 254,
+                             .flush_ms = OUTPUT_DEFAULT_FLUSH_MS,
+                             .timeout_margin_ms = TIMEOUT_DEFAULT_MARGIN_MS,
+                             .rescan_policy = {STATE_DEFAULT_DEAD_AFTER,
+                                               STATE_DEFAULT_DEAD_SAMPLE},
+                             .shard_count = 1,
+                             .interval_s = MONITOR_DEFAULT_INTERVAL_S,
+                             .window = MONITOR_DEFAULT_WINDOW,
+                             .telemetry.interval_ms =
+                                 TELEMETRY_DEFAULT_INTERVAL_MS};
+  probe_config_defaults(&options->probe);
+
+  int have_subnet = 0;
+  int have_cycle = 0;
+  int opt;
+
+  opterr = 0;
+  optind = 1;
+  while ((opt = getopt_long(argc, argv, ":m:t:s:T:r:c:R:f:h", long_options,
+                            NULL)) != -1) {
+    switch (opt) {
+    case 'm':
+      if (parse_mode(optarg, &options->mode) != 0) {
+        fprintf(stderr, "Unknown mode: %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case 't':
+      options->targets = optarg;
+      break;
+
+    case 's':
+      if (parse_subnet(optarg, &options->subnet) != 0) {
+        fprintf(stderr, "Invalid subnet base: %s\n", optarg);
+        return -1;
+      }
+      have_subnet = 1;
+      break;
+
+    case OPT_HOSTS:
+      if (parse_hosts(optarg, &options->first_host, &options->last_host) !=
+          0) {
+        fprintf(stderr, "Invalid host range (expected 1-254): %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case 'T':
+      if (parse_int(optarg, 1, INT_MAX, &options->probe.timeout_ms) != 0) {
+        fprintf(stderr, "Invalid timeout: %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case 'r':
+      if (parse_int(optarg, 0, INT_MAX, &options->probe.max_pps) != 0) {
+        fprintf(stderr, "Invalid rate: %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case 'c':
+      if (parse_int(optarg, 1, CLI_MAX_CONCURRENCY,
+                    &options->concurrency) != 0) {
+        fprintf(stderr, "Invalid concurrency (1-%d): %s\n",
+                CLI_MAX_CONCURRENCY, optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_CPUS:
+      options->cpu_count = cpus_parse(optarg, options->cpus, CPUS_MAX);
+      if (options->cpu_count < 0) {
+        fprintf(stderr, "Invalid CPU list (up to %d of the CPUs this "
+                        "process may use): %s\n",
+                CPUS_MAX, optarg);
+        return -1;
+      }
+      break;
+
+    case 'R':
+      if (parse_int(optarg, 0, PROBE_MAX_RETRIES, &options->probe.retries) !=
+          0) {
+        fprintf(stderr, "Invalid retries (0-%d): %s\n", PROBE_MAX_RETRIES,
+                optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_ADAPTIVE_TIMEOUT:
+      options->adaptive_timeout = 1;
+      break;
+
+    case OPT_TIMEOUT_MARGIN:
+      if (parse_int(optarg, 0, TIMEOUT_MAX_MARGIN_MS,
+                    &options->timeout_margin_ms) != 0) {
+        fprintf(stderr, "Invalid timeout margin (0-%d): %s\n",
+                TIMEOUT_MAX_MARGIN_MS, optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_RETRY_POLICY:
+      if (parse_retry_policy(optarg, &options->retry_policy) != 0) {
+        fprintf(stderr, "Unknown retry policy: %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_PROBE:
+      options->probe.backend = probe_backend_find(optarg);
+      if (!options->probe.backend) {
+        fprintf(stderr, "Unknown probe method: %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_PORTS:
+      if (parse_ports(optarg, &options->probe) != 0) {
+        fprintf(stderr, "Invalid port list (up to %d ports, 1-65535): %s\n",
+                PROBE_MAX_PORTS, optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_IO_URING:
+      options->io_uring = 1;
+      break;
+
+    case OPT_STATE:
+      options->state_path = optarg;
+      break;
+
+    case OPT_RESCAN:
+      options->rescan = 1;
+      break;
+
+    case OPT_CHECKPOINT:
+      options->checkpoint_path = optarg;
+      break;
+
+    case OPT_RESUME:
+      options->resume = 1;
+      break;
+
+    case OPT_OVERWRITE:
+      options->overwrite = 1;
+      break;
+
+    case OPT_ARP:
+      options->arp = 1;
+      break;
+
+    case OPT_STATIC_LISTS:
+      options->static_lists = 1;
+      break;
+
+    case OPT_ORDER:
+      if (parse_order(optarg, &options->order) != 0) {
+        fprintf(stderr, "Unknown send order: %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_SEED:
+      if (parse_u64(optarg, &options->seed) != 0) {
+        fprintf(stderr, "Invalid seed: %s\n", optarg);
+        return -1;
+      }
+      options->seed_set = 1;
+      break;
+
+    case OPT_SHARD:
+      if (parse_shard(optarg, &options->shard_index,
+                      &options->shard_count) != 0) {
+        fprintf(stderr, "Invalid shard (expected I/N, 1 <= I <= N <= %d): "
+                        "%s\n",
+                CLI_MAX_SHARDS, optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_INTERFACE:
+      if (strlen(optarg) >= IF_NAMESIZE || if_nametoindex(optarg) == 0) {
+        fprintf(stderr, "Unknown interface: %s\n", optarg);
+        return -1;
+      }
+      options->probe.device = optarg;
+      break;
+
+    case OPT_MERGE:
+      options->merge = 1;
+      break;
+
+    case OPT_DAEMON:
+      options->daemon = 1;
+      break;
+
+    case OPT_INTERVAL:
+      if (parse_int(optarg, 1, MONITOR_MAX_INTERVAL_S,
+                    &options->interval_s) != 0) {
+        fprintf(stderr, "Invalid interval (1-%d seconds): %s\n",
+                MONITOR_MAX_INTERVAL_S, optarg);
+        return -1;
+      }
+      have_cycle = 1;
+      break;
+
+    case OPT_WINDOW:
+      if (parse_int(optarg, 1, MONITOR_MAX_WINDOW, &options->window) != 0) {
+        fprintf(stderr, "Invalid window (1-%d cycles): %s\n",
+                MONITOR_MAX_WINDOW, optarg);
+        return -1;
+      }
+      have_cycle = 1;
+      break;
+
+    case OPT_RDNS:
+      options->rdns = 1;
+      break;
+
+    case OPT_RDNS_CACHE:
+      options->rdns_cache = optarg;
+      break;
+
+    case OPT_RESOLVER:
+      options->resolver = optarg;
+      break;
+
+    case OPT_IPV6:
+      options->ipv6 = 1;
+      break;
+
+    case OPT_DEAD_AFTER:
+      if (parse_int(optarg, 1, STATE_MAX_DEAD,
+                    &options->rescan_policy.dead_after) != 0) {
+        fprintf(stderr, "Invalid dead-after count (1-%d): %s\n",
+                STATE_MAX_DEAD, optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_DEAD_SAMPLE:
+      if (parse_int(optarg, 0, STATE_MAX_DEAD,
+                    &options->rescan_policy.dead_sample) != 0) {
+        fprintf(stderr, "Invalid dead-sample interval (0-%d): %s\n",
+                STATE_MAX_DEAD, optarg);
+        return -1;
+      }
+      break;
+
+    case 'f':
+      if (parse_format(optarg, &options->format) != 0) {
+        fprintf(stderr, "Unknown output format: %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_FLUSH_INTERVAL:
+      if (parse_int(optarg, 1, INT_MAX, &options->flush_ms) != 0) {
+        fprintf(stderr, "Invalid flush interval: %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case OPT_BASELINE:
+      options->baseline = optarg;
+      break;
+
+    case OPT_METRICS_LISTEN:
+      options->telemetry.listen = optarg;
+      break;
+
+    case OPT_STATSD:
+      options->telemetry.statsd = optarg;
+      break;
+
+    case OPT_TELEMETRY_INTERVAL:
+      if (parse_int(optarg, 1, INT_MAX, &options->telemetry.interval_ms) !=
+          0) {
+        fprintf(stderr, "Invalid telemetry interval: %s\n", optarg);
+        return -1;
+      }
+      break;
+
+    case 'h':
+      options->help = 1;
+      return 0;
+
+    case ':':
+      fprintf(stderr, "Option %s needs a value\n", argv[optind - 1]);
+      return -1;
+
+    default:
+      fprintf(stderr, "Unknown option: %s\n", argv[optind - 1]);
+      return -1;
+    }
+  }
+
+  if ((options->rdns_cache || options->resolver) && !options->rdns) {
+    fprintf(stderr, "--rdns-cache and --resolver only apply to --rdns\n");
+    return -1;
+  }
+
+  if (options->rdns &&
+      (options->merge || options->format == OUTPUT_BINARY)) {
+    fprintf(stderr, "--rdns names hosts in text, ndjson and csv scan "
+                    "output, not --format binary or --merge\n");
+    return -1;
+  }
+
+  if (options->ipv6 && (options->merge || options->daemon ||
+                        options->format == OUTPUT_BINARY)) {
+    fprintf(stderr, "--ipv6 sweeps links once per run; it cannot be "
+                    "combined with --merge, --daemon or --format binary\n");
+    return -1;
+  }
+
+  if (options->merge) {
+    if (optind == argc) {
+      fprintf(stderr, "--merge needs at least one result file\n");
+      return -1;
+    }
+    options->merge_paths = argv + optind;
+    options->merge_count = argc - optind;
+    return 0;
+  }
+
+  if (optind < argc) {
+    fprintf(stderr, "Unexpected argument: %s\n", argv[optind]);
+    return -1;
+  }
+
+  // Targets or a subnet imply their mode
+  if (options->mode == SCAN_MODE_NONE && options->targets)
+    options->mode = SCAN_MODE_CUSTOM;
+  if (options->mode == SCAN_MODE_NONE && have_subnet)
+    options->mode = SCAN_MODE_SUBNET;
+
+  if (options->mode == SCAN_MODE_CUSTOM && !options->targets) {
+    fprintf(stderr, "Mode custom needs --targets\n");
+    return -1;
+  }
+  if (options->mode == SCAN_MODE_SUBNET && !have_subnet) {
+    fprintf(stderr, "Mode subnet needs --subnet\n");
+    return -1;
+  }
+
+  if (options->io_uring) {
+    if (options->probe.backend != &probe_backend_icmp) {
+      fprintf(stderr, "--io-uring only applies to --probe icmp\n");
+      return -1;
+    }
+    options->probe.backend = &probe_backend_icmp_uring;
+  }
+
+  if (options->seed_set && options->order != SCAN_ORDER_RANDOM) {
+    fprintf(stderr, "--seed only applies to --order random\n");
+    return -1;
+  }
+
+  // Shards only partition the scan when every collector builds the same
+  // target list; discovered networks differ from host to host
+  if (options->shard_count > 1 &&
+      (options->mode == SCAN_MODE_NONE ||
+       (options->mode == SCAN_MODE_COMMON && !options->static_lists))) {
+    fprintf(stderr, "--shard needs the same targets on every shard: give "
+                    "--targets, --subnet, or --static-lists for mode "
+                    "common\n");
+    return -1;
+  }
+
+  if (options->shard_count > 1 && options->order == SCAN_ORDER_RANDOM &&
+      !options->seed_set) {
+    fprintf(stderr, "--shard with --order random needs --seed, the same "
+                    "on every shard\n");
+    return -1;
+  }
+
+  if (options->rescan && !options->state_path) {
+    fprintf(stderr, "--rescan needs --state\n");
+    return -1;
+  }
+
+  if (options->resume && !options->checkpoint_path) {
+    fprintf(stderr, "--resume needs --checkpoint\n");
+    return -1;
+  }
+
+  if (options->overwrite && (!options->checkpoint_path || options->resume)) {
+    fprintf(stderr, "--overwrite needs --checkpoint and cannot be combined "
+                    "with --resume\n");
+    return -1;
+  }
+
+  if (have_cycle && !options->daemon) {
+    fprintf(stderr, "--interval and --window only apply to --daemon\n");
+    return -1;
+  }
+
+  if (options->daemon && (options->checkpoint_path || options->rescan)) {
+    fprintf(stderr, "--daemon keeps its own state; it cannot be combined "
+                    "with --checkpoint or --rescan\n");
+    return -1;
+  }
+
+  // A daemon writes only change records, which CSV and binary rows have
+  // no form for
+  if (options->daemon && (options->format == OUTPUT_CSV ||
+                          options->format == OUTPUT_BINARY)) {
+    fprintf(stderr, "--daemon reports changes in text or ndjson; it cannot "
+                    "be combined with --format csv or binary\n");
+    return -1;
+  }
+
+  // --ipv6 on its own sweeps the links without an IPv4 scan
+  options->interactive = options->mode == SCAN_MODE_NONE && !options->ipv6;
+  return 0;
+}
+
+void cli_usage(FILE *out, const char *program) {
+  fprintf(out,
+          "Usage: %s [options]\n"
+          "       %s --merge [-t LIST] [-f FORMAT] FILE...\n"
+          "Without a mode, targets, subnet or --ipv6 the interactive menu "
+          "is shown.\n"
+          "\n"
+          "  -m, --mode MODE        1-5 or common, full, subnet, quick, "
+          "custom\n"
+          "  -t, --targets LIST     CIDR blocks, ranges, !exclusions, @files "
+          "(custom)\n"
+          "  -s, --subnet A.B.C     /24 to scan (subnet)\n"
+          "      --hosts FIRST-LAST host range within the subnet "
+          "(default 1-254)\n"
+          "  -T, --timeout MS       per-probe timeout (default %d)\n"
+          "  -r, --rate PPS         packets per second, 0 = unlimited "
+          "(default %d)\n"
+          "  -c, --concurrency N    stream worker threads (default 4x "
+          "cores)\n"
+          "      --cpus LIST        run one pinned probe engine per CPU, "
+          "e.g. 0-7,16 or all\n"
+          "  -R, --retries N        resends per unanswered host, 0-%d "
+          "(default %d)\n"
+          "      --adaptive-timeout  end waits at each subnet's learned "
+          "p99 plus a margin\n"
+          "      --timeout-margin MS  minimum margin above the p99 "
+          "(default %d)\n"
+          "      --retry-policy POLICY  retry all unanswered hosts or "
+          "only live subnets (default all)\n"
+          "      --probe METHOD     icmp, tcp (connect) or syn (raw, needs "
+          "CAP_NET_RAW) (default icmp)\n"
+          "      --ports LIST       TCP ports tried per host, up to %d "
+          "(default 22,80,443,445)\n"
+          "      --io-uring         send and receive ICMP through io_uring "
+          "(Linux 6.0+)\n"
+          "      --state FILE       keep per-host state across runs and "
+          "report up/down changes\n"
+          "      --rescan           probe from the state file: live hosts "
+          "first, long-dead ones sampled\n"
+          "      --checkpoint FILE  save results as they arrive so the scan "
+          "can be resumed\n"
+          "      --resume           continue the scan saved in the "
+          "checkpoint, same targets\n"
+          "      --overwrite        start the checkpoint over even if it "
+          "holds an unfinished scan\n"
+          "      --dead-after N     misses before a host is long dead "
+          "(default %d)\n"
+          "      --dead-sample N    probe long-dead hosts every Nth run, "
+          "0 = never (default %d)\n"
+          "      --arp              sweep directly attached subnets with "
+          "ARP instead of ICMP\n"
+          "      --static-lists     common mode scans the built-in private "
+          "ranges, not discovered ones\n"
+          "      --order ORDER      sequential, or random to spread probes "
+          "over every /24 (default sequential)\n"
+          "      --seed N           random order seed, to repeat or resume "
+          "a scan (default: drawn per run)\n"
+          "      --shard I/N        scan only slice I of N of the target "
+          "permutation\n"
+          "      --interface IFACE  send and receive probes only through "
+          "IFACE\n"
+          "      --merge FILE...    combine binary results or checkpoints "
+          "into one report\n"
+          "      --daemon           keep probing the targets and report "
+          "only hosts going up or down\n"
+          "      --interval SEC     seconds each daemon cycle is spread "
+          "over (default %d)\n"
+          "      --window N         missed cycles before a host is down, "
+          "1-%d (default %d)\n"
+          "      --rdns             look up responders' PTR names while "
+          "scanning\n"
+          "      --rdns-cache FILE  keep names across runs, for as long as "
+          "their TTL\n"
+          "      --resolver ADDR[:PORT]  nameserver for --rdns (default: "
+          "from %s)\n"
+          "      --ipv6             find IPv6 hosts on every link (or "
+          "--interface) after the scan\n"
+          "  -f, --format FORMAT    text, ndjson, csv or binary "
+          "(default text)\n"
+          "      --flush-interval MS  how often output is written "
+          "(default %d)\n"
+          "      --baseline FILE    record (with -c 1) or compare against "
+          "a single-worker rate\n"
+          "      --metrics-listen [ADDR:]PORT  serve Prometheus /metrics "
+          "(default address %s)\n"
+          "      --statsd HOST:PORT  push gauges to statsd over UDP\n"
+          "      --telemetry-interval MS  statsd push interval "
+          "(default %d)\n"
+          "  -h, --help             show this help\n",
+          program, program, PROBE_DEFAULT_TIMEOUT_MS, PROBE_DEFAULT_PPS,
+          PROBE_MAX_RETRIES, PROBE_DEFAULT_RETRIES, TIMEOUT_DEFAULT_MARGIN_MS,
+          PROBE_MAX_PORTS,
+          STATE_DEFAULT_DEAD_AFTER, STATE_DEFAULT_DEAD_SAMPLE,
+          MONITOR_DEFAULT_INTERVAL_S, MONITOR_MAX_WINDOW,
+          MONITOR_DEFAULT_WINDOW, RDNS_RESOLV_CONF,
+          OUTPUT_DEFAULT_FLUSH_MS,
+          TELEMETRY_DEFAULT_BIND, TELEMETRY_DEFAULT_INTERVAL_MS);
+}
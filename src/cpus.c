@@ -0,0 +1,72 @@
+#include "cpus.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Parse a non-negative CPU number, leaving *end after it
+static int parse_cpu(const char *text, char **end) {
+  errno = 0;
+  long cpu = strtol(text, end, 10);
+  if (errno != 0 || *end == text || cpu < 0 || cpu >= CPU_SETSIZE)
+    return -1;
+  return (int)cpu;
+}
+
+// "all", or comma-separated CPUs and FIRST-LAST ranges, in the order given.
+// Every CPU must be one this process may run on, and none may repeat.
+// Returns how many were stored in cpus, or -1.
+int cpus_parse(const char *text, int *cpus, int max) {
+  cpu_set_t allowed;
+  cpu_set_t seen;
+  int count = 0;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return -1;
+  CPU_ZERO(&seen);
+
+  if (strcmp(text, "all") == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE && count < max; ++cpu) {
+      if (CPU_ISSET((size_t)cpu, &allowed))
+        cpus[count++] = cpu;
+    }
+    return count > 0 ? count : -1;
+  }
+
+  for (const char *p = text;; ++p) {
+    char *end;
+    int first = parse_cpu(p, &end);
+    int last = first;
+    if (first >= 0 && *end == '-')
+      last = parse_cpu(end + 1, &end);
+    if (first < 0 || last < first || (*end != ',' && *end != '\0'))
+      return -1;
+
+    for (int cpu = first; cpu <= last; ++cpu) {
+      if (count == max || !CPU_ISSET((size_t)cpu, &allowed) ||
+          CPU_ISSET((size_t)cpu, &seen))
+        return -1;
+      CPU_SET((size_t)cpu, &seen);
+      cpus[count++] = cpu;
+    }
+
+    p = end;
+    if (*p == '\0')
+      return count;
+  }
+}
+
+// Keep a thread on one CPU. Returns -1 with errno set.
+int cpus_pin(pthread_t thread, int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET((size_t)cpu, &set);
+
+  int rc = pthread_setaffinity_np(thread, sizeof(set), &set);
+  if (rc != 0) {
+    errno = rc;
+    return -1;
+  }
+  return 0;
+}
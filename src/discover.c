@@ -0,0 +1,158 @@
+#include "discover.h"
+
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <stdbit.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "addr.h"
+#include "netlink.h"
+
+typedef struct {
+  discover_prefix_t *prefixes;
+  int count;
+  int max;
+} discover_list_t;
+
+static uint32_t prefix_mask(int len) {
+  return len == 0 ? 0 : ~0u << (32 - len);
+}
+
+static uint32_t get_be32(const uint8_t *in) {
+  return (uint32_t)in[0] << 24 | (uint32_t)in[1] << 16 |
+         (uint32_t)in[2] << 8 | in[3];
+}
+
+// Space that is never worth probing: "this network", loopback,
+// link-local and everything from multicast up
+static int reserved_prefix(uint32_t net) {
+  return (net >> 24) == 0 || (net >> 24) == 127 ||
+         (net >> 16) == IPV4(169, 254, 0, 0) >> 16 || net >= IPV4(224, 0, 0, 0);
+}
+
+static void list_add(discover_list_t *list, discover_prefix_t prefix) {
+  for (int i = 0; i < list->count; ++i) {
+    if (list->prefixes[i].net == prefix.net &&
+        list->prefixes[i].len == prefix.len)
+      return;
+  }
+  if (list->count < list->max)
+    list->prefixes[list->count++] = prefix;
+}
+
+// One route of the dump: keep unicast routes of the main table that are
+// narrower than the default route
+static void discover_route(const struct nlmsghdr *msg, void *ctx) {
+  discover_list_t *list = ctx;
+  if (msg->nlmsg_type != RTM_NEWROUTE)
+    return;
+
+  const struct rtmsg *rtm = NLMSG_DATA(msg);
+  if (rtm->rtm_family != AF_INET || rtm->rtm_type != RTN_UNICAST ||
+      rtm->rtm_dst_len == 0)
+    return;
+
+  discover_prefix_t prefix = {.len = rtm->rtm_dst_len,
+                              .source = DISCOVER_ROUTE};
+  unsigned int table = rtm->rtm_table;
+  unsigned int attr_len = (unsigned int)RTM_PAYLOAD(msg);
+  for (const struct rtattr *attr = RTM_RTA(rtm); RTA_OK(attr, attr_len);
+       attr = RTA_NEXT(attr, attr_len)) {
+    if (attr->rta_type == RTA_DST && RTA_PAYLOAD(attr) == 4)
+      prefix.net = get_be32(RTA_DATA(attr));
+    else if (attr->rta_type == RTA_GATEWAY && RTA_PAYLOAD(attr) == 4)
+      prefix.gateway = get_be32(RTA_DATA(attr));
+    else if (attr->rta_type == RTA_OIF && RTA_PAYLOAD(attr) == 4)
+      memcpy(&prefix.ifindex, RTA_DATA(attr), sizeof(int));
+    else if (attr->rta_type == RTA_TABLE && RTA_PAYLOAD(attr) == 4)
+      memcpy(&table, RTA_DATA(attr), sizeof(table));
+  }
+
+  prefix.net &= prefix_mask(prefix.len);
+  if (table != RT_TABLE_MAIN || reserved_prefix(prefix.net))
+    return;
+  prefix.skipped = prefix.len < DISCOVER_MIN_PREFIX_LEN;
+  list_add(list, prefix);
+}
+
+// Collect the prefixes this host can reach: every interface's own prefix,
+// then the main table's routes. Returns how many were found, or -1 when
+// the interfaces cannot be listed.
+int discover_prefixes(discover_prefix_t *prefixes, int max) {
+  discover_list_t list = {.prefixes = prefixes, .max = max};
+  iface_t ifaces[IFACE_MAX];
+
+  int count = iface_list(ifaces, IFACE_MAX);
+  if (count < 0)
+    return -1;
+
+  for (int i = 0; i < count; ++i) {
+    int len = (int)stdc_leading_ones(ifaces[i].mask);
+    discover_prefix_t prefix = {.ifindex = ifaces[i].ifindex,
+                                .source = DISCOVER_LINK};
+    if (len < DISCOVER_MIN_PREFIX_LEN) {
+      len = DISCOVER_MIN_PREFIX_LEN;
+      prefix.clipped = 1;
+    }
+    prefix.len = len;
+    prefix.net = ifaces[i].addr & prefix_mask(len);
+    if (!reserved_prefix(prefix.net))
+      list_add(&list, prefix);
+  }
+
+  struct rtmsg request = {.rtm_family = AF_INET};
+  netlink_dump(RTM_GETROUTE, &request, sizeof(request), discover_route,
+               &list);
+  return list.count;
+}
+
+// Add the hosts of every reachable prefix to targets, logging each prefix
+// and why any was narrowed or left out. Returns the prefixes added, -1 on
+// failure.
+int discover_targets(target_set_t *targets, FILE *log) {
+  discover_prefix_t prefixes[DISCOVER_MAX_PREFIXES];
+  int added = 0;
+
+  int count = discover_prefixes(prefixes, DISCOVER_MAX_PREFIXES);
+  if (count < 0)
+    return -1;
+
+  for (int i = 0; i < count; ++i) {
+    const discover_prefix_t *prefix = &prefixes[i];
+    char net[IP_STR_LEN];
+    char via[IP_STR_LEN];
+    char ifname[IF_NAMESIZE] = "?";
+    if (prefix->ifindex > 0)
+      if_indextoname((unsigned int)prefix->ifindex, ifname);
+    addr_format(prefix->net, net);
+
+    if (prefix->skipped) {
+      fprintf(log, "  %s/%d on %s: broader than /%d, not swept (pass it "
+                   "with --targets)\n",
+              net, prefix->len, ifname, DISCOVER_MIN_PREFIX_LEN);
+      continue;
+    }
+
+    if (prefix->source == DISCOVER_LINK)
+      fprintf(log, "  %s/%d on %s%s\n", net, prefix->len, ifname,
+              prefix->clipped ? " (narrowed around our address)" : "");
+    else if (prefix->gateway)
+      fprintf(log, "  %s/%d via %s on %s\n", net, prefix->len,
+              addr_format(prefix->gateway, via), ifname);
+    else
+      fprintf(log, "  %s/%d route on %s\n", net, prefix->len, ifname);
+
+    // Leave out network and broadcast addresses where the prefix has them
+    uint32_t first = prefix->net;
+    uint32_t last = prefix->net | ~prefix_mask(prefix->len);
+    if (prefix->len <= 30) {
+      first++;
+      last--;
+    }
+    if (target_set_add(targets, first, last) != 0)
+      return -1;
+    added++;
+  }
+  return added;
+}
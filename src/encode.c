@@ -0,0 +1,442 @@
+#include "encode.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "addr.h"
+#include "clock.h"
+#include "probe.h"
+
+// Every reporting unit is a /24
+#define ENCODE_SUBNET_MASK 0xffffff00u
+
+// An address and a bracketed name, or an NDJSON hostname member
+#define ENCODE_LABEL_LEN 288
+
+// IPv6 hosts are reported under their /64, the prefix length of every
+// SLAAC link; "aa:bb:cc:dd:ee:ff" and its terminator
+#define ENCODE_SUBNET6_BYTES 8
+#define ENCODE_MAC_LEN 18
+
+static const char *const via_names[] = {[PROBE_VIA_ICMP] = "icmp",
+                                        [PROBE_VIA_ARP] = "arp",
+                                        [PROBE_VIA_NEIGH] = "neigh",
+                                        [PROBE_VIA_TCP] = "tcp",
+                                        [PROBE_VIA_SYN] = "syn",
+                                        [PROBE_VIA_MCAST] = "mcast"};
+
+static const char *via_name(uint8_t via) {
+  return via < sizeof(via_names) / sizeof(via_names[0]) ? via_names[via]
+                                                        : "icmp";
+}
+
+// Only replies that arrive with an IP header we can see carry a TTL
+static int via_has_ttl(uint8_t via) {
+  return via == PROBE_VIA_ICMP || via == PROBE_VIA_SYN ||
+         via == PROBE_VIA_MCAST;
+}
+
+// An IPv6 host's address and the base of its /64
+static void host6_format(const output_record_t *record,
+                         char ip[INET6_ADDRSTRLEN],
+                         char subnet[INET6_ADDRSTRLEN]) {
+  uint8_t prefix[16] = {0};
+  memcpy(prefix, record->addr6, ENCODE_SUBNET6_BYTES);
+  inet_ntop(AF_INET6, record->addr6, ip, INET6_ADDRSTRLEN);
+  inet_ntop(AF_INET6, prefix, subnet, INET6_ADDRSTRLEN);
+}
+
+static const char *mac_format(const output_record_t *record,
+                              char buf[ENCODE_MAC_LEN]) {
+  const uint8_t *mac = record->mac;
+  snprintf(buf, ENCODE_MAC_LEN, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0],
+           mac[1], mac[2], mac[3], mac[4], mac[5]);
+  return buf;
+}
+
+// Address for text lines, with its name after it when one was found
+static const char *host_label(const output_record_t *record,
+                              char buf[ENCODE_LABEL_LEN]) {
+  char ip[IP_STR_LEN];
+  addr_format(record->addr, ip);
+  if (record->hostname && *record->hostname)
+    snprintf(buf, ENCODE_LABEL_LEN, "%s [%s]", ip, record->hostname);
+  else
+    snprintf(buf, ENCODE_LABEL_LEN, "%s", ip);
+  return buf;
+}
+
+// NDJSON member for the name; null when none was found, left out without
+// --rdns. Names are checked to be plain hostname characters.
+static const char *hostname_member(const output_record_t *record,
+                                   char buf[ENCODE_LABEL_LEN]) {
+  if (!record->hostname)
+    return "";
+  if (!*record->hostname)
+    return ",\"hostname\":null";
+  snprintf(buf, ENCODE_LABEL_LEN, ",\"hostname\":\"%s\"", record->hostname);
+  return buf;
+}
+
+// snprintf result clamped to what actually landed in buf
+static size_t encoded_len(int len, size_t cap) {
+  if (len < 0)
+    return 0;
+  return (size_t)len < cap ? (size_t)len : cap - 1;
+}
+
+static void put_be16(uint8_t *out, uint16_t value) {
+  out[0] = (uint8_t)(value >> 8);
+  out[1] = (uint8_t)value;
+}
+
+static void put_be32(uint8_t *out, uint32_t value) {
+  put_be16(out, (uint16_t)(value >> 16));
+  put_be16(out + 2, (uint16_t)value);
+}
+
+static void put_be64(uint8_t *out, uint64_t value) {
+  put_be32(out, (uint32_t)(value >> 32));
+  put_be32(out + 4, (uint32_t)value);
+}
+
+static size_t encode_text(const output_record_t *record, char *buf,
+                          size_t cap) {
+  char ip[IP_STR_LEN];
+  char last[IP_STR_LEN];
+  char host[ENCODE_LABEL_LEN];
+  char ip6[INET6_ADDRSTRLEN];
+  char subnet6[INET6_ADDRSTRLEN];
+  char mac[ENCODE_MAC_LEN + 2];
+  int len = 0;
+
+  switch (record->kind) {
+  case OUTPUT_SCANNING:
+    len = snprintf(buf, cap, "[Subnet %d] Scanning %s-%s...\n",
+                   record->subnet_id, addr_format(record->addr, ip),
+                   addr_format(record->last_addr, last));
+    break;
+
+  case OUTPUT_HOST:
+    if (record->has_detail && !via_has_ttl(record->via))
+      len = snprintf(buf, cap,
+                     "[Subnet %d] ✓ Host alive: %s (%.3f ms, %s)\n",
+                     record->subnet_id, host_label(record, host),
+                     record->rtt_us / 1000.0, via_name(record->via));
+    else if (record->has_detail && record->via == PROBE_VIA_SYN)
+      len = snprintf(buf, cap,
+                     "[Subnet %d] ✓ Host alive: %s (%.3f ms, ttl %u, syn)\n",
+                     record->subnet_id, host_label(record, host),
+                     record->rtt_us / 1000.0, record->ttl);
+    else if (record->has_detail)
+      len = snprintf(buf, cap,
+                     "[Subnet %d] ✓ Host alive: %s (%.3f ms, ttl %u)\n",
+                     record->subnet_id, host_label(record, host),
+                     record->rtt_us / 1000.0, record->ttl);
+    else if (record->via == PROBE_VIA_NEIGH)
+      len = snprintf(buf, cap,
+                     "[Subnet %d] ✓ Host alive: %s (neighbour table)\n",
+                     record->subnet_id, host_label(record, host));
+    else
+      len = snprintf(buf, cap, "[Subnet %d] ✓ Host alive: %s\n",
+                     record->subnet_id, host_label(record, host));
+    break;
+
+  case OUTPUT_SUBNET:
+    addr_format(record->addr, ip);
+    if (record->count > 0)
+      len = snprintf(buf, cap,
+                     "[Subnet %d] → %u responders found in %s/24 "
+                     "(p50 %.3f ms, p99 %.3f ms)\n",
+                     record->subnet_id, record->count, ip,
+                     record->p50_us / 1000.0, record->p99_us / 1000.0);
+    else
+      len = snprintf(buf, cap, "[Subnet %d] (no responses in %s/24)\n",
+                     record->subnet_id, ip);
+    break;
+
+  case OUTPUT_CHANGE:
+    if (record->has_detail)
+      len = snprintf(buf, cap, "[Subnet %d] %s %s (srtt %.3f ms)\n",
+                     record->subnet_id,
+                     record->up ? "↑ Host came up:" : "↓ Host went down:",
+                     host_label(record, host), record->rtt_us / 1000.0);
+    else
+      len = snprintf(buf, cap, "[Subnet %d] %s %s\n", record->subnet_id,
+                     record->up ? "↑ Host came up:" : "↓ Host went down:",
+                     host_label(record, host));
+    break;
+
+  case OUTPUT_HOST6:
+    host6_format(record, ip6, subnet6);
+    mac[0] = '\0';
+    if (record->has_mac) {
+      char lladdr[ENCODE_MAC_LEN];
+      snprintf(mac, sizeof(mac), ", %s", mac_format(record, lladdr));
+    }
+    if (record->has_detail)
+      len = snprintf(buf, cap,
+                     "[%s] ✓ Host alive: %s (%.3f ms, hop limit %u, %s%s)\n",
+                     record->link, ip6, record->rtt_us / 1000.0, record->ttl,
+                     via_name(record->via), mac);
+    else
+      len = snprintf(buf, cap, "[%s] ✓ Host alive: %s (neighbour table%s)\n",
+                     record->link, ip6, mac);
+    break;
+  }
+
+  return encoded_len(len, cap);
+}
+
+// One JSON object per line; hosts, state changes and subnet summaries,
+// told apart by type. IPv6 hosts add their link and link-layer address.
+static size_t encode_ndjson(const output_record_t *record, uint64_t unix_ns,
+                            char *buf, size_t cap) {
+  char ip[IP_STR_LEN];
+  char subnet[IP_STR_LEN];
+  char name[ENCODE_LABEL_LEN];
+  char ip6[INET6_ADDRSTRLEN];
+  char subnet6[INET6_ADDRSTRLEN];
+  char mac[ENCODE_MAC_LEN + 2];
+  unsigned long long sec = unix_ns / NS_PER_SEC;
+  unsigned long usec = (unsigned long)(unix_ns % NS_PER_SEC / 1000);
+  int len = 0;
+
+  addr_format(record->addr & ENCODE_SUBNET_MASK, subnet);
+
+  switch (record->kind) {
+  case OUTPUT_HOST:
+    addr_format(record->addr, ip);
+    if (record->has_detail && via_has_ttl(record->via))
+      len = snprintf(buf, cap,
+                     "{\"type\":\"host\",\"ts\":%llu.%06lu,\"addr\":\"%s\","
+                     "\"subnet\":\"%s/24\",\"subnet_id\":%d,"
+                     "\"rtt_ms\":%.3f,\"ttl\":%u,\"via\":\"%s\"%s}\n",
+                     sec, usec, ip, subnet, record->subnet_id,
+                     record->rtt_us / 1000.0, record->ttl,
+                     via_name(record->via),
+                     hostname_member(record, name));
+    else if (record->has_detail)
+      len = snprintf(buf, cap,
+                     "{\"type\":\"host\",\"ts\":%llu.%06lu,\"addr\":\"%s\","
+                     "\"subnet\":\"%s/24\",\"subnet_id\":%d,"
+                     "\"rtt_ms\":%.3f,\"ttl\":null,\"via\":\"%s\"%s}\n",
+                     sec, usec, ip, subnet, record->subnet_id,
+                     record->rtt_us / 1000.0, via_name(record->via),
+                     hostname_member(record, name));
+    else
+      len = snprintf(buf, cap,
+                     "{\"type\":\"host\",\"ts\":%llu.%06lu,\"addr\":\"%s\","
+                     "\"subnet\":\"%s/24\",\"subnet_id\":%d,"
+                     "\"rtt_ms\":null,\"ttl\":null,\"via\":\"%s\"%s}\n",
+                     sec, usec, ip, subnet, record->subnet_id,
+                     via_name(record->via),
+                     hostname_member(record, name));
+    break;
+
+  case OUTPUT_SUBNET:
+    if (record->count > 0)
+      len = snprintf(buf, cap,
+                     "{\"type\":\"subnet\",\"ts\":%llu.%06lu,"
+                     "\"subnet\":\"%s/24\",\"subnet_id\":%d,"
+                     "\"responders\":%u,\"rtt_p50_ms\":%.3f,"
+                     "\"rtt_p90_ms\":%.3f,\"rtt_p99_ms\":%.3f,"
+                     "\"rtt_max_ms\":%.3f}\n",
+                     sec, usec, subnet, record->subnet_id, record->count,
+                     record->p50_us / 1000.0, record->p90_us / 1000.0,
+                     record->p99_us / 1000.0, record->max_us / 1000.0);
+    else
+      len = snprintf(buf, cap,
+                     "{\"type\":\"subnet\",\"ts\":%llu.%06lu,"
+                     "\"subnet\":\"%s/24\",\"subnet_id\":%d,"
+                     "\"responders\":0}\n",
+                     sec, usec, subnet, record->subnet_id);
+    break;
+
+  case OUTPUT_CHANGE:
+    if (record->has_detail)
+      len = snprintf(buf, cap,
+                     "{\"type\":\"change\",\"ts\":%llu.%06lu,\"addr\":\"%s\","
+                     "\"subnet\":\"%s/24\",\"subnet_id\":%d,"
+                     "\"state\":\"%s\",\"srtt_ms\":%.3f%s}\n",
+                     sec, usec, addr_format(record->addr, ip), subnet,
+                     record->subnet_id, record->up ? "up" : "down",
+                     record->rtt_us / 1000.0, hostname_member(record, name));
+    else
+      len = snprintf(buf, cap,
+                     "{\"type\":\"change\",\"ts\":%llu.%06lu,\"addr\":\"%s\","
+                     "\"subnet\":\"%s/24\",\"subnet_id\":%d,"
+                     "\"state\":\"%s\"%s}\n",
+                     sec, usec, addr_format(record->addr, ip), subnet,
+                     record->subnet_id, record->up ? "up" : "down",
+                     hostname_member(record, name));
+    break;
+
+  case OUTPUT_HOST6:
+    host6_format(record, ip6, subnet6);
+    if (record->has_mac) {
+      char lladdr[ENCODE_MAC_LEN];
+      snprintf(mac, sizeof(mac), "\"%s\"", mac_format(record, lladdr));
+    } else {
+      snprintf(mac, sizeof(mac), "null");
+    }
+    if (record->has_detail)
+      len = snprintf(buf, cap,
+                     "{\"type\":\"host\",\"ts\":%llu.%06lu,\"addr\":\"%s\","
+                     "\"subnet\":\"%s/64\",\"subnet_id\":%d,"
+                     "\"rtt_ms\":%.3f,\"ttl\":%u,\"via\":\"%s\","
+                     "\"mac\":%s,\"link\":\"%s\"%s}\n",
+                     sec, usec, ip6, subnet6, record->subnet_id,
+                     record->rtt_us / 1000.0, record->ttl,
+                     via_name(record->via), mac, record->link,
+                     hostname_member(record, name));
+    else
+      len = snprintf(buf, cap,
+                     "{\"type\":\"host\",\"ts\":%llu.%06lu,\"addr\":\"%s\","
+                     "\"subnet\":\"%s/64\",\"subnet_id\":%d,"
+                     "\"rtt_ms\":null,\"ttl\":null,\"via\":\"%s\","
+                     "\"mac\":%s,\"link\":\"%s\"%s}\n",
+                     sec, usec, ip6, subnet6, record->subnet_id,
+                     via_name(record->via), mac, record->link,
+                     hostname_member(record, name));
+    break;
+
+  default:
+    break;
+  }
+
+  return encoded_len(len, cap);
+}
+
+// Host rows only, IPv6 ones included; empty rtt/ttl columns when the reply
+// did not carry them
+static size_t encode_csv(const output_record_t *record, uint64_t unix_ns,
+                         char *buf, size_t cap) {
+  char ip[INET6_ADDRSTRLEN];
+  char subnet[INET6_ADDRSTRLEN + 3];
+  int len;
+
+  if (record->kind == OUTPUT_HOST6) {
+    char base[INET6_ADDRSTRLEN];
+    host6_format(record, ip, base);
+    snprintf(subnet, sizeof(subnet), "%s/64", base);
+  } else if (record->kind == OUTPUT_HOST) {
+    char base[IP_STR_LEN];
+    addr_format(record->addr, ip);
+    addr_format(record->addr & ENCODE_SUBNET_MASK, base);
+    snprintf(subnet, sizeof(subnet), "%s/24", base);
+  } else {
+    return 0;
+  }
+
+  unsigned long long sec = unix_ns / NS_PER_SEC;
+  unsigned long usec = (unsigned long)(unix_ns % NS_PER_SEC / 1000);
+
+  // With --rdns every row has a hostname cell, empty for no name
+  const char *sep = record->hostname ? "," : "";
+  const char *name = record->hostname ? record->hostname : "";
+
+  if (record->has_detail && via_has_ttl(record->via))
+    len = snprintf(buf, cap, "%llu.%06lu,%s,%s,%d,%.3f,%u%s%s\n", sec,
+                   usec, ip, subnet, record->subnet_id,
+                   record->rtt_us / 1000.0, record->ttl, sep, name);
+  else if (record->has_detail)
+    len = snprintf(buf, cap, "%llu.%06lu,%s,%s,%d,%.3f,%s%s\n", sec, usec,
+                   ip, subnet, record->subnet_id, record->rtt_us / 1000.0,
+                   sep, name);
+  else
+    len = snprintf(buf, cap, "%llu.%06lu,%s,%s,%d,,%s%s\n", sec, usec, ip,
+                   subnet, record->subnet_id, sep, name);
+
+  return encoded_len(len, cap);
+}
+
+// Header layout: "NIRB", u16 version, u16 record length, u64 target
+// fingerprint, u64 seed, u16 shard (from 0), u16 shards, u8 order,
+// 3 bytes reserved
+static size_t encode_binary_header(const output_record_t *record,
+                                   char *buf, size_t cap) {
+  uint8_t *out = (uint8_t *)buf;
+
+  if (cap < ENCODE_BINARY_HEADER_LEN)
+    return 0;
+
+  memcpy(out, ENCODE_BINARY_MAGIC, 4);
+  put_be16(out + 4, ENCODE_BINARY_VERSION);
+  put_be16(out + 6, ENCODE_BINARY_RECORD_LEN);
+  put_be64(out + 8, record->fingerprint);
+  put_be64(out + 16, record->seed);
+  put_be16(out + 24, record->shard);
+  put_be16(out + 26, record->shards);
+  out[28] = record->order;
+  memset(out + 29, 0, 3);
+  return ENCODE_BINARY_HEADER_LEN;
+}
+
+// Layout: u64 unix ns, u32 addr, u32 subnet id, u32 rtt us, u8 ttl,
+// u8 flags, u16 reserved
+static size_t encode_binary(const output_record_t *record, uint64_t unix_ns,
+                            char *buf, size_t cap) {
+  uint8_t *out = (uint8_t *)buf;
+
+  if (record->kind == OUTPUT_BEGIN)
+    return encode_binary_header(record, buf, cap);
+  if (record->kind != OUTPUT_HOST || cap < ENCODE_BINARY_RECORD_LEN)
+    return 0;
+
+  put_be64(out, unix_ns);
+  put_be32(out + 8, record->addr);
+  put_be32(out + 12, (uint32_t)record->subnet_id);
+  put_be32(out + 16, record->has_detail ? record->rtt_us : 0);
+  out[20] = record->has_detail ? record->ttl : 0;
+  out[21] = (uint8_t)((record->has_detail ? ENCODE_FLAG_DETAIL : 0) |
+                      (record->via == PROBE_VIA_ARP ||
+                               record->via == PROBE_VIA_NEIGH
+                           ? ENCODE_FLAG_LINK
+                           : 0) |
+                      (record->via == PROBE_VIA_TCP ||
+                               record->via == PROBE_VIA_SYN
+                           ? ENCODE_FLAG_TCP
+                           : 0));
+  put_be16(out + 22, 0);
+  return ENCODE_BINARY_RECORD_LEN;
+}
+
+// Stream preamble written once before the first record; hostnames adds
+// the CSV column that --rdns fills. The binary header waits for the
+// scan's OUTPUT_BEGIN record instead.
+size_t encode_header(output_format_t format, int hostnames, char *buf,
+                     size_t cap) {
+  const char *csv_header =
+      hostnames ? "timestamp,addr,subnet,subnet_id,rtt_ms,ttl,hostname\n"
+                : "timestamp,addr,subnet,subnet_id,rtt_ms,ttl\n";
+
+  switch (format) {
+  case OUTPUT_CSV:
+    if (cap <= strlen(csv_header))
+      return 0;
+    memcpy(buf, csv_header, strlen(csv_header));
+    return strlen(csv_header);
+
+  default:
+    return 0;
+  }
+}
+
+// Encode one record into buf; returns the bytes written, 0 when the format
+// has no representation for this kind of record
+size_t encode_record(output_format_t format, const output_record_t *record,
+                     uint64_t unix_ns, char *buf, size_t cap) {
+  switch (format) {
+  case OUTPUT_NDJSON:
+    return encode_ndjson(record, unix_ns, buf, cap);
+  case OUTPUT_CSV:
+    return encode_csv(record, unix_ns, buf, cap);
+  case OUTPUT_BINARY:
+    return encode_binary(record, unix_ns, buf, cap);
+  case OUTPUT_TEXT:
+  default:
+    return encode_text(record, buf, cap);
+  }
+}
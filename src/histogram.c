@@ -0,0 +1,94 @@
+#include "histogram.h"
+
+#include <stdatomic.h>
+#include <stdbit.h>
+
+static unsigned int bucket_index(uint32_t us) {
+  if (us < HISTOGRAM_SUB_COUNT)
+    return us;
+
+  unsigned int shift = stdc_bit_width(us) - 1 - HISTOGRAM_SUB_BITS;
+  return (shift + 1) * HISTOGRAM_SUB_COUNT +
+         ((us >> shift) & (HISTOGRAM_SUB_COUNT - 1));
+}
+
+// Midpoint of a bucket, the value reported for anything that landed in it
+static uint32_t bucket_value(unsigned int index) {
+  if (index < HISTOGRAM_SUB_COUNT)
+    return index;
+
+  unsigned int shift = index / HISTOGRAM_SUB_COUNT - 1;
+  uint64_t low = (uint64_t)(HISTOGRAM_SUB_COUNT + index % HISTOGRAM_SUB_COUNT)
+                 << shift;
+  return (uint32_t)(low + ((1ULL << shift) >> 1));
+}
+
+void histogram_reset(rtt_histogram_t *hist) {
+  for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    atomic_store_explicit(&hist->counts[i], 0, memory_order_relaxed);
+  atomic_store(&hist->total, 0);
+  atomic_store(&hist->max_us, 0);
+}
+
+void histogram_record(rtt_histogram_t *hist, uint32_t us) {
+  atomic_fetch_add_explicit(&hist->counts[bucket_index(us)], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&hist->total, 1, memory_order_relaxed);
+
+  uint32_t max = atomic_load_explicit(&hist->max_us, memory_order_relaxed);
+  while (us > max && !atomic_compare_exchange_weak(&hist->max_us, &max, us))
+    ;
+}
+
+// Fold one histogram into another, touching only non-empty buckets
+void histogram_merge(rtt_histogram_t *into, const rtt_histogram_t *from) {
+  uint64_t total = atomic_load(&from->total);
+  if (total == 0)
+    return;
+
+  for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+    uint64_t count =
+        atomic_load_explicit(&from->counts[i], memory_order_relaxed);
+    if (count)
+      atomic_fetch_add_explicit(&into->counts[i], count, memory_order_relaxed);
+  }
+  atomic_fetch_add(&into->total, total);
+
+  uint32_t from_max = atomic_load(&from->max_us);
+  uint32_t max = atomic_load(&into->max_us);
+  while (from_max > max &&
+         !atomic_compare_exchange_weak(&into->max_us, &max, from_max))
+    ;
+}
+
+// Value at the given quantile (0..1), 0 for an empty histogram
+uint32_t histogram_quantile(const rtt_histogram_t *hist, double quantile) {
+  uint64_t total = atomic_load(&hist->total);
+  if (total == 0)
+    return 0;
+
+  uint64_t rank = (uint64_t)(quantile * (double)total + 0.5);
+  if (rank < 1)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+    seen += atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+    if (seen >= rank) {
+      // Never report more than was actually observed
+      uint32_t value = bucket_value(i);
+      uint32_t max = atomic_load(&hist->max_us);
+      return value < max ? value : max;
+    }
+  }
+  return atomic_load(&hist->max_us);
+}
+
+void histogram_summarize(const rtt_histogram_t *hist,
+                         rtt_summary_t *summary) {
+  summary->count = atomic_load(&hist->total);
+  summary->p50_us = histogram_quantile(hist, 0.50);
+  summary->p90_us = histogram_quantile(hist, 0.90);
+  summary->p99_us = histogram_quantile(hist, 0.99);
+  summary->max_us = atomic_load(&hist->max_us);
+}
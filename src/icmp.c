@@ -0,0 +1,199 @@
+#include "icmp.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/filter.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Have the kernel drop everything but echo replies to this socket's
+// identifier. A raw socket otherwise gets a copy of every ICMP packet the
+// host receives, so several of them would each wake for all the replies.
+static void icmp_steer(const icmp_socket_t *sock) {
+  struct sock_filter code[] = {
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0), // X = IP header length
+      BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),  // ICMP type
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHOREPLY, 0, 3),
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4), // echo identifier
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, sock->ident, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, UINT32_MAX),
+      BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog prog = {.len = sizeof(code) / sizeof(code[0]),
+                            .filter = code};
+
+  // Without the filter icmp_parse_reply still rejects them, just later
+  setsockopt(sock->sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+             sizeof(prog));
+}
+
+// Open a raw ICMP socket, falling back to the unprivileged datagram socket
+// permitted by net.ipv4.ping_group_range. Sockets of one process opened
+// with different lanes get different identifiers.
+int icmp_open(icmp_socket_t *sock, unsigned int lane) {
+  sock->sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+  if (sock->sockfd >= 0) {
+    sock->raw = 1;
+    sock->ident = (uint16_t)(((unsigned int)getpid() + lane) & 0xffff);
+    icmp_steer(sock);
+    return 0;
+  }
+
+  if (errno != EPERM && errno != EACCES)
+    return -1;
+
+  sock->sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+  if (sock->sockfd < 0)
+    return -1;
+  sock->raw = 0;
+
+  int on = 1;
+  setsockopt(sock->sockfd, IPPROTO_IP, IP_RECVTTL, &on, sizeof(on));
+
+  // The kernel rewrites the echo identifier to the socket's bound "port"
+  struct sockaddr_in local = {.sin_family = AF_INET};
+  socklen_t local_len = sizeof(local);
+  if (bind(sock->sockfd, (struct sockaddr *)&local, sizeof(local)) != 0 ||
+      getsockname(sock->sockfd, (struct sockaddr *)&local, &local_len) != 0) {
+    close(sock->sockfd);
+    sock->sockfd = -1;
+    return -1;
+  }
+  sock->ident = ntohs(local.sin_port);
+  return 0;
+}
+
+void icmp_close(icmp_socket_t *sock) {
+  if (sock->sockfd >= 0) {
+    close(sock->sockfd);
+    sock->sockfd = -1;
+  }
+}
+
+// RFC 1071 internet checksum
+uint16_t icmp_checksum(const void *data, size_t len) {
+  const uint8_t *bytes = data;
+  uint32_t sum = 0;
+
+  for (; len > 1; bytes += 2, len -= 2)
+    sum += (uint32_t)(bytes[0] << 8 | bytes[1]);
+  if (len)
+    sum += (uint32_t)(bytes[0] << 8);
+
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  return htons((uint16_t)~sum);
+}
+
+// Build an echo request into buf, returning its length or 0 if it won't fit
+size_t icmp_build_echo(uint8_t *buf, size_t cap, uint16_t ident,
+                       uint16_t seq) {
+  if (cap < ICMP_ECHO_LEN)
+    return 0;
+
+  memset(buf, 0, ICMP_ECHO_LEN);
+  struct icmphdr *hdr = (struct icmphdr *)buf;
+  hdr->type = ICMP_ECHO;
+  hdr->code = 0;
+  hdr->un.echo.id = htons(ident);
+  hdr->un.echo.sequence = htons(seq);
+  hdr->checksum = icmp_checksum(buf, ICMP_ECHO_LEN);
+
+  return ICMP_ECHO_LEN;
+}
+
+// RFC 1624 incremental update: the checksum after one 16-bit word changed,
+// HC' = ~(~HC + ~m + m'). Checksum and words are in network byte order.
+uint16_t icmp_checksum_adjust(uint16_t check, uint16_t old_word,
+                              uint16_t new_word) {
+  uint32_t sum = (uint32_t)(uint16_t)~ntohs(check) +
+                 (uint32_t)(uint16_t)~ntohs(old_word) + ntohs(new_word);
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return htons((uint16_t)~sum);
+}
+
+// Build the echo request every probe of a socket starts from: sequence
+// number and send time zero, checksummed once
+void icmp_template_init(icmp_template_t *tpl, uint16_t ident) {
+  icmp_build_echo(tpl->packet, sizeof(tpl->packet), ident, 0);
+}
+
+// Copy the template into buf and patch in one probe's sequence number and
+// send time. The template's words are zero, so each patched word adds to
+// the checksum without having to take the old value out.
+void icmp_template_fill(const icmp_template_t *tpl, uint8_t *buf,
+                        uint16_t seq, uint64_t sent_ns) {
+  memcpy(buf, tpl->packet, ICMP_ECHO_LEN);
+
+  uint16_t words[1 + ICMP_PAYLOAD_LEN / 2] = {htons(seq)};
+  for (size_t i = 1; i < sizeof(words) / sizeof(words[0]); ++i)
+    words[i] = htons((uint16_t)(sent_ns >> (64 - 16 * i)));
+
+  struct icmphdr *hdr = (struct icmphdr *)buf;
+  uint16_t check = hdr->checksum;
+  for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+    check = icmp_checksum_adjust(check, 0, words[i]);
+
+  hdr->un.echo.sequence = words[0];
+  memcpy(buf + sizeof(*hdr), &words[1], ICMP_PAYLOAD_LEN);
+  hdr->checksum = check;
+}
+
+int icmp_send_echo(const icmp_socket_t *sock, const icmp_template_t *tpl,
+                   in_addr_t dst, uint16_t seq, uint64_t sent_ns) {
+  alignas(struct icmphdr) uint8_t packet[ICMP_ECHO_LEN];
+  icmp_template_fill(tpl, packet, seq, sent_ns);
+
+  struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = dst};
+  ssize_t sent = sendto(sock->sockfd, packet, sizeof(packet), 0,
+                        (struct sockaddr *)&addr, sizeof(addr));
+  return sent == (ssize_t)sizeof(packet) ? 0 : -1;
+}
+
+// Validate an incoming datagram as an echo reply addressed to this socket.
+// Returns 0 and stores the sequence number on a match, -1 otherwise. The
+// TTL is only known here for raw sockets; datagram sockets report 0 and
+// deliver it as IP_TTL ancillary data instead.
+int icmp_parse_reply(const icmp_socket_t *sock, const uint8_t *buf,
+                     size_t len, uint16_t *seq, uint8_t *ttl) {
+  size_t offset = 0;
+
+  *ttl = 0;
+  if (sock->raw) {
+    if (len < sizeof(struct iphdr))
+      return -1;
+    offset = (size_t)(buf[0] & 0x0f) * 4;
+    *ttl = buf[offsetof(struct iphdr, ttl)];
+  }
+
+  if (len < offset + sizeof(struct icmphdr))
+    return -1;
+
+  struct icmphdr hdr;
+  memcpy(&hdr, buf + offset, sizeof(hdr));
+  if (hdr.type != ICMP_ECHOREPLY || ntohs(hdr.un.echo.id) != sock->ident)
+    return -1;
+
+  *seq = ntohs(hdr.un.echo.sequence);
+  return 0;
+}
+
+// TTL from IP_RECVTTL ancillary data, for sockets without IP headers
+uint8_t icmp_cmsg_ttl(struct msghdr *msg) {
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg;
+       cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TTL) {
+      int ttl;
+      memcpy(&ttl, CMSG_DATA(cmsg), sizeof(ttl));
+      return (uint8_t)ttl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include "iface.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <linux/if_packet.h>
+#include <stdio.h>
+#include <string.h>
+
+// Fill ifaces with every IPv4 address on an interface that is up, skipping
+// loopback. Returns how many were found, -1 after printing a diagnostic.
+int iface_list(iface_t *ifaces, int max) {
+  struct ifaddrs *list;
+  int count = 0;
+
+  if (getifaddrs(&list) != 0) {
+    fprintf(stderr, "Cannot list interfaces: %s\n", strerror(errno));
+    return -1;
+  }
+
+  for (struct ifaddrs *ifa = list; ifa && count < max; ifa = ifa->ifa_next) {
+    if (!ifa->ifa_addr || !ifa->ifa_netmask ||
+        ifa->ifa_addr->sa_family != AF_INET || !(ifa->ifa_flags & IFF_UP) ||
+        (ifa->ifa_flags & IFF_LOOPBACK))
+      continue;
+
+    iface_t *iface = &ifaces[count++];
+    memset(iface, 0, sizeof(*iface));
+    snprintf(iface->name, sizeof(iface->name), "%s", ifa->ifa_name);
+    iface->ifindex = (int)if_nametoindex(ifa->ifa_name);
+    iface->addr =
+        ntohl(((const struct sockaddr_in *)(const void *)ifa->ifa_addr)
+                  ->sin_addr.s_addr);
+    iface->mask =
+        ntohl(((const struct sockaddr_in *)(const void *)ifa->ifa_netmask)
+                  ->sin_addr.s_addr);
+    iface->arp = (ifa->ifa_flags & IFF_BROADCAST) &&
+                 !(ifa->ifa_flags & (IFF_NOARP | IFF_POINTOPOINT));
+  }
+
+  // Link-layer addresses come as separate AF_PACKET entries
+  for (struct ifaddrs *ifa = list; ifa; ifa = ifa->ifa_next) {
+    if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_PACKET)
+      continue;
+    const struct sockaddr_ll *ll =
+        (const struct sockaddr_ll *)(const void *)ifa->ifa_addr;
+    for (int i = 0; i < count; ++i) {
+      if (strcmp(ifaces[i].name, ifa->ifa_name) == 0 && ll->sll_halen == 6)
+        memcpy(ifaces[i].mac, ll->sll_addr, 6);
+    }
+  }
+
+  freeifaddrs(list);
+  return count;
+}
+
+// The interface whose prefix holds addr, or NULL when it is off-link
+const iface_t *iface_for_addr(const iface_t *ifaces, int count,
+                              uint32_t addr) {
+  for (int i = 0; i < count; ++i) {
+    if ((addr & ifaces[i].mask) == (ifaces[i].addr & ifaces[i].mask))
+      return &ifaces[i];
+  }
+  return NULL;
+}
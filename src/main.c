@@ -2,12 +2,14 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdalign.h>
 #include <stdatomic.h>
 #include <stdbit.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/random.h>
 #include <sys/socket.h>
 #include <sys/sysinfo.h>
 #include <sys/types.h>
@@ -15,476 +17,1786 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "addr.h"
+#include "arena.h"
+#include "arp.h"
+#include "checkpoint.h"
+#include "clock.h"
+#include "cli.h"
+#include "discover.h"
+#include "histogram.h"
+#include "iface.h"
+#include "merge.h"
+#include "metrics.h"
+#include "monitor.h"
+#include "ndp.h"
+#include "output.h"
+#include "permute.h"
+#include "pool.h"
+#include "probe.h"
+#include "rdns.h"
+#include "results.h"
+#include "state.h"
+#include "targets.h"
+#include "telemetry.h"
+#include "timeouts.h"
+
 // Dynamic thread configuration based on system capabilities
 #define MAX_PING_THREADS 128
-#define MAX_SUBNET_THREADS 16
-#define IP_STR_LEN 16
-#define CMD_LEN 64
 #define SUBNET_LEN 16
+#define TARGET_LIST_LEN 512
 
-// Thread pool structure for better resource management
-typedef struct {
-  pthread_t *threads;
-  int thread_count;
-  int active_threads;
-  pthread_mutex_t mutex;
-  pthread_cond_t condition;
-} thread_pool_t;
-
-// Enhanced task structure with better alignment
-typedef struct {
-  alignas(64) char ip[IP_STR_LEN];
-  _Atomic int alive;
-  _Atomic int processed;
-} ping_task_t;
+// Results are summarized per /24 regardless of how targets were specified
+#define SUBNET_MASK 0xffffff00u
+
+// Chunks one stream task sends. A walk is cut into many such tasks, so a
+// worker that runs dry steals what another has not started.
+#define STREAM_TASK_CHUNKS 16
 
-// Subnet scanning task for parallel subnet processing
+// One /24's slice of the host stream; its summary is printed as soon as
+// its last result arrives
 typedef struct {
-  const char *subnet;
-  int start_host;
-  int end_host;
-  int *responders;
-  int thread_id;
+  uint32_t first_addr;
+  uint32_t last_addr;
+  size_t first;
+  int id;
+  _Atomic int remaining;
+  _Atomic int started;  // its first probe has been announced
+  int skipped;          // hosts a rescan left out
+  int outside;          // hosts other shards probe
+  host_state_t *state;  // its hosts in the state file, or NULL
+  rtt_profile_t rtt; // responders so far, for adaptive timeouts
 } subnet_task_t;
 
+// Targets of a stream on one directly attached link, swept with ARP;
+// capacity covers every target the link's prefix can hold
+typedef struct {
+  arp_target_t *targets;
+  size_t count;
+  size_t capacity;
+} link_sweep_t;
+
+// Global host stream: every target address in one index space that workers
+// pull chunks from, regardless of subnet boundaries. Everything it points
+// to comes from its arena.
+typedef struct {
+  arena_t arena;
+  subnet_task_t *subnets;
+  int subnet_count;
+  result_store_t results;
+  size_t total;
+  uint32_t *order; // rescan send order over indices, NULL for index order
+  size_t planned;  // targets sent through the engine, all without a plan
+  permute_t perm;  // walk over [0, planned); the cursor counts positions
+  size_t skipped;  // targets a rescan left out
+  size_t resumed;  // targets a resumed checkpoint already had results for
+  size_t abandoned; // targets a stopped scan never sent
+  size_t outside;   // targets in other shards' slices
+  uint64_t *owned;  // this shard's targets, one bit each; NULL unsharded
+  link_sweep_t links[IFACE_MAX]; // on-link targets, by local_links entry
+  _Atomic size_t cursor;
+  _Atomic size_t queued; // targets handed to the engine
+  probe_job_t job;
+  _Atomic uint64_t sends_done_ns; // when the last stream worker ran dry
+} host_stream_t;
+
 // Global atomic counters for thread-safe access
 static _Atomic int total_hosts_scanned = 0;
 static _Atomic int total_responders = 0;
 static _Atomic int subnets_scanned = 0;
-static _Atomic int active_ping_threads = 0;
 
-// Thread pool for better resource management
+// Live scan state for the telemetry exporter
+static _Atomic int active_stream_workers = 0;
+static _Atomic int64_t send_queue_depth = 0;
+
+// RTTs of every responder in the current scan, merged per subnet
+static rtt_histogram_t scan_rtt;
+
+// Send order of every scan and the seed of its permutation
+static scan_order_t scan_order = SCAN_ORDER_SEQUENTIAL;
+static uint64_t scan_seed = 0;
+
+// This instance's slice of the target permutation when the scan is split
+// across shard_count instances
+static int shard_index = 0;
+static int shard_count = 1;
+
+// Timings and counters of the most recent scan, and the single-worker
+// rate it is compared against (0 when none is recorded)
+static scan_metrics_t scan_metrics;
+static const char *baseline_path = NULL;
+static double baseline_rate = 0.0;
+
+// Asynchronous probe engines: one per --cpus core, or a single unpinned
+// one. Stream workers send through the engine of the core they are pinned
+// to, so sockets, in-flight tables, rate tokens and counters stay on one
+// core and are only summed when reported.
+static probe_engine_t *probe_engines;
+static int engine_count = 1;
+static const int *engine_cpus = NULL;
+
+// Reverse resolver of --rdns, driven by the output writer while it runs
+static rdns_t resolver;
+static int rdns_enabled = 0;
+
+// Give every engine its share of --rate; each has its own token bucket
+static void set_engine_rate(int pps, int burst) {
+  int share = pps > 0 && pps / engine_count == 0 ? 1 : pps / engine_count;
+  for (int i = 0; i < engine_count; ++i)
+    token_bucket_set_rate(&probe_engines[i].bucket, share, burst);
+}
+
+// Host-state cache shared by every scan of a run, and the rescan policy
+// applied to it when rescan is set
+static state_file_t host_state = {.fd = -1};
+static state_policy_t rescan_policy;
+static int rescan = 0;
+static uint32_t scan_started_s = 0;
+
+// Checkpoint of the current scan, when --checkpoint is given, and whether
+// the scan picks up the results already in it
+static checkpoint_t checkpoint = {.fd = -1};
+static const char *checkpoint_path = NULL;
+static int resume = 0;
+static int overwrite = 0;
+
+// Set by SIGINT or SIGTERM while a checkpointed scan or a daemon runs:
+// stream workers stop claiming chunks so everything recorded also reaches
+// the output
+static volatile sig_atomic_t scan_stopping = 0;
+static size_t targets_unsent = 0;
+
+// --daemon: how long each cycle over the targets takes, the --rate it may
+// not exceed and the sliding liveness of every host it watches. The
+// monitor's hosts are only allocated while a daemon runs.
+static int monitor_interval_s = 0;
+static int monitor_window = MONITOR_DEFAULT_WINDOW;
+static int monitor_max_pps = 0;
+static int monitor_burst = 0;
+static monitor_t monitor;
+static _Atomic uint64_t monitor_cycles = 0;
+
+// Up/down changes against the state file, or over a daemon's window, and
+// hosts a rescan skipped
+static _Atomic int hosts_came_up = 0;
+static _Atomic int hosts_went_down = 0;
+static _Atomic int hosts_skipped = 0;
+
+// Directly attached links swept with ARP instead of ICMP, and what the
+// sweeps of the current scan did
+static iface_t local_links[IFACE_MAX];
+static int local_link_count = 0;
+static arp_stats_t arp_stats;
+static size_t link_hosts = 0;
+
+// What the --ipv6 sweeps of a run did
+static ndp_stats_t ndp_stats;
+
+// Per-target timeout and retry hooks handed to the engine, and the margin
+// adaptive deadlines leave above a subnet's slowest reply
+static probe_policy_t scan_policy;
+static uint32_t timeout_margin_us = TIMEOUT_DEFAULT_MARGIN_MS * 1000;
+
+// Banners, prompts and summaries; stderr when stdout carries a
+// machine-readable format
+static FILE *console;
+
+// Persistent pool of stream workers feeding the engine
 static thread_pool_t ping_pool = {0};
-static thread_pool_t subnet_pool = {0};
+
+// Optional /metrics and statsd exporter
+static telemetry_t telemetry;
 
 // Function prototypes
 static int get_optimal_thread_count(void);
-static int init_thread_pool(thread_pool_t *pool, int max_threads);
-static void cleanup_thread_pool(thread_pool_t *pool);
-static void *ping_worker(void *arg);
-static void *subnet_worker(void *arg);
-static void scan_subnets_parallel(const char *const *subnets, int count,
-                                  const char *description);
-static void scan_all_common_private_networks_parallel(void);
-static void scan_full_class_c_range_parallel(void);
-static void scan_single_subnet_parallel(const char *base, int start_host,
-                                        int end_host);
-
-// Get optimal thread count based on system
+static subnet_task_t *subnet_for_index(host_stream_t *stream, size_t index);
+static void report_subnet(host_stream_t *stream, subnet_task_t *subnet);
+static void ping_result(probe_job_t *job, size_t index,
+                        const probe_reply_t *reply);
+static uint32_t adaptive_timeout_us(probe_job_t *job, size_t index);
+static int retry_live_subnets(probe_job_t *job, size_t index);
+static void set_scan_policy(const cli_options_t *options);
+static void stream_task(void *arg);
+static int attach_host_state(subnet_task_t *subnets, int count);
+static int link_add(link_sweep_t *link, uint32_t addr, size_t index);
+static int link_for_host(uint32_t addr);
+static int plan_stream(host_stream_t *stream);
+static int shard_stream(host_stream_t *stream);
+static void resume_target(host_stream_t *stream, subnet_task_t *subnet,
+                          size_t index);
+static size_t link_capacity(int link, size_t total);
+static size_t stream_span(int subnet_count, size_t total);
+static void link_result(void *ctx, size_t index, const probe_reply_t *reply);
+static void run_link_sweeps(host_stream_t *stream);
+static int stream_open(host_stream_t *stream, const target_set_t *targets);
+static void stream_close(host_stream_t *stream);
+static int stream_cycle(host_stream_t *stream, scan_metrics_t *metrics,
+                        uint64_t start_ns);
+static int scan_host_stream(const target_set_t *targets,
+                            scan_metrics_t *metrics, uint64_t start_ns);
+static int monitor_targets(const target_set_t *targets,
+                           const char *description);
+static void print_latency(const char *label);
+static void print_state_changes(void);
+static void print_link_sweeps(void);
+static void update_baseline(void);
+static int scan_targets(target_set_t *targets, const char *description);
+static int scan_subnets_parallel(const uint32_t *subnets, int count,
+                                 const char *description);
+static int scan_all_common_private_networks_parallel(void);
+static int scan_discovered_networks_parallel(void);
+static int scan_full_class_c_range_parallel(void);
+static int scan_single_subnet_parallel(uint32_t base, int start_host,
+                                       int end_host);
+static int scan_custom_targets(const char *list);
+static void ipv6_host(void *ctx, const ndp_link_t *link,
+                      const ndp_host_t *host);
+static int scan_ipv6_links(const char *device);
+static int prompt_options(cli_options_t *options,
+                          char targets[TARGET_LIST_LEN]);
+static int run_scan(const cli_options_t *options);
+static void sample_telemetry(telemetry_sample_t *sample);
+static void find_local_links(const char *device);
+static int merge_files(const cli_options_t *options);
+static int start_output(const cli_options_t *options);
+static void stop_output(void);
+
+// Get optimal thread count based on system, or on the cores --cpus chose
 static int get_optimal_thread_count(void) {
-  int cores = get_nprocs();
+  int cores = engine_cpus ? engine_count : get_nprocs();
   // Use more threads than cores for I/O bound operations like ping
   return cores > 0 ? cores * 4 : 64;
 }
 
-// Initialize thread pool
-static int init_thread_pool(thread_pool_t *pool, int max_threads) {
-  pool->threads = malloc(max_threads * sizeof(pthread_t));
-  if (!pool->threads)
-    return -1;
+// Map a global stream index back to its subnet
+static subnet_task_t *subnet_for_index(host_stream_t *stream, size_t index) {
+  int lo = 0;
+  int hi = stream->subnet_count - 1;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo + 1) / 2;
+    if (stream->subnets[mid].first <= index)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
 
-  pool->thread_count = max_threads;
-  pool->active_threads = 0;
+  return &stream->subnets[lo];
+}
 
-  if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
-    free(pool->threads);
-    return -1;
+// Queue one finished subnet's summary and count it. Its hosts were
+// counted as their results came in.
+static void report_subnet(host_stream_t *stream, subnet_task_t *subnet) {
+  size_t end = subnet->first + (subnet->last_addr - subnet->first_addr + 1);
+  int responders =
+      (int)result_store_count(&stream->results, subnet->first, end);
+  rtt_histogram_t subnet_rtt;
+  rtt_summary_t latency;
+
+  // Build this subnet's histogram from the stored replies, then fold it
+  // into the scan-wide one
+  histogram_reset(&subnet_rtt);
+  for (size_t i = result_store_next(&stream->results, subnet->first, end);
+       i < end; i = result_store_next(&stream->results, i + 1, end)) {
+    const result_detail_t *detail = result_store_detail(&stream->results, i);
+    if (detail && detail->via != PROBE_VIA_NEIGH)
+      histogram_record(&subnet_rtt, detail->rtt_us);
   }
+  histogram_summarize(&subnet_rtt, &latency);
+  histogram_merge(&scan_rtt, &subnet_rtt);
+
+  // A daemon reports changes only
+  if (!monitor.hosts)
+    output_emit(&(output_record_t){.kind = OUTPUT_SUBNET,
+                                   .subnet_id = subnet->id,
+                                   .addr = subnet->first_addr & SUBNET_MASK,
+                                   .count = (uint32_t)responders,
+                                   .p50_us = latency.p50_us,
+                                   .p90_us = latency.p90_us,
+                                   .p99_us = latency.p99_us,
+                                   .max_us = latency.max_us});
 
-  if (pthread_cond_init(&pool->condition, NULL) != 0) {
-    pthread_mutex_destroy(&pool->mutex);
-    free(pool->threads);
-    return -1;
+  atomic_fetch_add(&subnets_scanned, 1);
+}
+
+// Record one engine result; the subnet's last result triggers its summary
+static void ping_result(probe_job_t *job, size_t index,
+                        const probe_reply_t *reply) {
+  host_stream_t *stream = job->ctx;
+  subnet_task_t *subnet = subnet_for_index(stream, index);
+  uint32_t addr = subnet->first_addr + (uint32_t)(index - subnet->first);
+
+  result_store_mark(&stream->results, index, reply);
+  if (checkpoint.header)
+    checkpoint_record(&checkpoint, index, reply);
+  atomic_fetch_add(&total_hosts_scanned, 1);
+  if (reply)
+    atomic_fetch_add(&total_responders, 1);
+
+  // A daemon still keeps the state file, but its changes are the ones
+  // judged over the window
+  state_change_t change = STATE_SAME;
+  if (subnet->state)
+    change = state_record(&subnet->state[addr & 0xff], reply,
+                          scan_started_s);
+  if (monitor.hosts)
+    change = monitor_record(&monitor, index, reply);
+  if (change != STATE_SAME) {
+    uint32_t srtt_us = monitor.hosts ? monitor.hosts[index].srtt_us : 0;
+    atomic_fetch_add(change == STATE_CAME_UP ? &hosts_came_up
+                                             : &hosts_went_down,
+                     1);
+    output_emit(&(output_record_t){.kind = OUTPUT_CHANGE,
+                                   .subnet_id = subnet->id,
+                                   .addr = addr,
+                                   .rtt_us = srtt_us,
+                                   .has_detail = srtt_us != 0,
+                                   .up = change == STATE_CAME_UP});
   }
 
-  return 0;
+  // Responders stream out as they answer, ahead of their subnet's summary
+  if (reply && reply->via != PROBE_VIA_NEIGH)
+    rtt_profile_record(&subnet->rtt, reply->rtt_us);
+  if (reply && !monitor.hosts) {
+    output_emit(&(output_record_t){
+        .kind = OUTPUT_HOST,
+        .subnet_id = subnet->id,
+        .addr = addr,
+        .rtt_us = reply->rtt_us,
+        .ttl = reply->ttl,
+        .via = reply->via,
+        .has_detail = reply->via != PROBE_VIA_NEIGH});
+  }
+
+  if (atomic_fetch_sub(&subnet->remaining, 1) == 1)
+    report_subnet(stream, subnet);
 }
 
-// Cleanup thread pool
-static void cleanup_thread_pool(thread_pool_t *pool) {
-  if (pool->threads) {
-    free(pool->threads);
-    pool->threads = NULL;
-  }
-  pthread_mutex_destroy(&pool->mutex);
-  pthread_cond_destroy(&pool->condition);
+// Deadline for a target learned from its subnet's responders so far
+static uint32_t adaptive_timeout_us(probe_job_t *job, size_t index) {
+  subnet_task_t *subnet = subnet_for_index(job->ctx, index);
+  return rtt_profile_deadline_us(&subnet->rtt, timeout_margin_us);
 }
 
-// Enhanced ping worker with better error handling
-static void *ping_worker(void *arg) {
-  ping_task_t *task = (ping_task_t *)arg;
-  char cmd[CMD_LEN];
+// Retry only where something answered; a silent subnet is most likely
+// empty or filtered and retrying it just doubles the scan time
+static int retry_live_subnets(probe_job_t *job, size_t index) {
+  subnet_task_t *subnet = subnet_for_index(job->ctx, index);
+  return rtt_profile_samples(&subnet->rtt) > 0;
+}
 
-  atomic_fetch_add(&active_ping_threads, 1);
+// Install the hooks the chosen options call for; none means the engine's
+// fixed timeout and retry count apply to every target
+static void set_scan_policy(const cli_options_t *options) {
+  scan_policy.timeout_us =
+      options->adaptive_timeout ? adaptive_timeout_us : NULL;
+  scan_policy.should_retry =
+      options->retry_policy == RETRY_POLICY_LIVE ? retry_live_subnets : NULL;
+  timeout_margin_us = (uint32_t)options->timeout_margin_ms * 1000;
+}
+
+// Stream task: pull the next STREAM_TASK_CHUNKS chunks of permutation
+// positions off the shared cursor, so the walk goes out in order whichever
+// worker runs or steals the task. Positions the permutation skips leave a
+// chunk short.
+static void stream_task(void *arg) {
+  host_stream_t *stream = arg;
+  uint64_t positions = permute_positions(&stream->perm);
+  int worker = thread_pool_worker_id(&ping_pool);
+  probe_engine_t *engine =
+      &probe_engines[worker > 0 ? worker % engine_count : 0];
+
+  atomic_fetch_add(&active_stream_workers, 1);
+  for (int chunk = 0; chunk < STREAM_TASK_CHUNKS && !scan_stopping;
+       ++chunk) {
+    size_t start = atomic_fetch_add(&stream->cursor, PROBE_CHUNK_SIZE);
+    if (start >= positions)
+      break;
+    size_t end = start + PROBE_CHUNK_SIZE < positions
+                     ? start + PROBE_CHUNK_SIZE
+                     : (size_t)positions;
+    atomic_store(&send_queue_depth, (int64_t)(positions - end));
+    if (checkpoint.header) {
+      uint64_t claimed = atomic_load(&checkpoint.header->cursor);
+      while (claimed < end &&
+             !atomic_compare_exchange_weak(&checkpoint.header->cursor,
+                                           &claimed, end))
+        ;
+    }
+
+    size_t indexes[PROBE_CHUNK_SIZE];
+    in_addr_t addrs[PROBE_CHUNK_SIZE];
+    size_t count = 0;
+
+    subnet_task_t *subnet = stream->subnets;
+    uint64_t value = permute_seek(&stream->perm, start);
+    for (size_t i = start; i < end;
+         ++i, value = permute_step(&stream->perm, value)) {
+      uint64_t planned = permute_index(&stream->perm, value);
+      if (planned == UINT64_MAX)
+        continue;
+      size_t index = stream->order ? stream->order[planned] : planned;
+
+      // A chunk may run across into the next subnet, and a rescan's or a
+      // random order jumps between subnets
+      if (index < subnet->first ||
+          index - subnet->first > subnet->last_addr - subnet->first_addr)
+        subnet = subnet_for_index(stream, index);
+
+      uint32_t addr = subnet->first_addr + (uint32_t)(index - subnet->first);
+
+      if (!monitor.hosts &&
+          !atomic_load_explicit(&subnet->started, memory_order_relaxed) &&
+          !atomic_exchange(&subnet->started, 1))
+        output_emit(&(output_record_t){.kind = OUTPUT_SCANNING,
+                                       .subnet_id = subnet->id,
+                                       .addr = subnet->first_addr,
+                                       .last_addr = subnet->last_addr});
+
+      indexes[count] = index;
+      addrs[count++] = addr_to_net(addr);
+    }
 
-  // More efficient sprintf with compile-time checking
-  int ret = snprintf(cmd, sizeof(cmd), "ping -c 1 -W 1 %s > /dev/null 2>&1",
-                     task->ip);
-  if (ret < 0 || ret >= (int)sizeof(cmd)) {
-    atomic_store(&task->alive, 0);
-    atomic_store(&task->processed, 1);
-    atomic_fetch_sub(&active_ping_threads, 1);
-    return NULL;
+    probe_engine_send_batch(engine, &stream->job, indexes, addrs, count);
+    atomic_fetch_add(&stream->queued, count);
   }
 
-  ret = system(cmd);
-  atomic_store(&task->alive, (ret == 0) ? 1 : 0);
-  atomic_store(&task->processed, 1);
-  atomic_fetch_sub(&active_ping_threads, 1);
+  if (atomic_load(&stream->cursor) >= positions)
+    atomic_store(&send_queue_depth, 0);
+  atomic_fetch_sub(&active_stream_workers, 1);
 
-  return NULL;
+  uint64_t now = monotonic_ns();
+  uint64_t done = atomic_load(&stream->sends_done_ns);
+  while (now > done &&
+         !atomic_compare_exchange_weak(&stream->sends_done_ns, &done, now))
+    ;
 }
 
-// Parallel subnet scanner worker
-static void *subnet_worker(void *arg) {
-  subnet_task_t *subnet_task = (subnet_task_t *)arg;
+// Lay a compiled target set out as one continuous host stream split into
+// /24 reporting units, with its result store and, when sharded, this
+// shard's slice. Returns -1 after printing a diagnostic.
+static int stream_open(host_stream_t *stream, const target_set_t *targets) {
+  int count = 0;
+  for (size_t r = 0; r < targets->count; ++r)
+    count += (int)((targets->ranges[r].last >> 8) -
+                   (targets->ranges[r].first >> 8) + 1);
+
+  *stream = (host_stream_t){0};
+  if (arena_init(&stream->arena,
+                 stream_span(count, target_set_size(targets))) != 0) {
+    fprintf(stderr, "Cannot reserve scan memory: %s\n", strerror(errno));
+    return -1;
+  }
+  stream->subnets =
+      arena_alloc(&stream->arena, (size_t)count * sizeof(subnet_task_t));
+  if (!stream->subnets) {
+    fprintf(stderr, "Memory allocation failed\n");
+    arena_destroy(&stream->arena);
+    return -1;
+  }
+
+  size_t total = 0;
+  int unit = 0;
+  for (size_t r = 0; r < targets->count; ++r) {
+    uint64_t addr = targets->ranges[r].first;
+    uint64_t last = targets->ranges[r].last;
+
+    while (addr <= last) {
+      uint64_t unit_last = addr | (uint32_t)~SUBNET_MASK;
+      if (unit_last > last)
+        unit_last = last;
+
+      subnet_task_t *subnet = &stream->subnets[unit];
+      subnet->first_addr = (uint32_t)addr;
+      subnet->last_addr = (uint32_t)unit_last;
+      subnet->first = total;
+      subnet->id = ++unit;
+      subnet->state = NULL;
+      rtt_profile_init(&subnet->rtt);
+
+      total += (size_t)(unit_last - addr + 1);
+      addr = unit_last + 1;
+    }
+  }
+  stream->subnet_count = count;
+  stream->total = total;
+
+  if (host_state.header && attach_host_state(stream->subnets, count) != 0) {
+    arena_destroy(&stream->arena);
+    return -1;
+  }
+
+  if (result_store_init(&stream->results, total, &stream->arena) != 0 ||
+      (shard_count > 1 && shard_stream(stream) != 0)) {
+    fprintf(stderr, "Memory allocation failed\n");
+    arena_destroy(&stream->arena);
+    return -1;
+  }
+  return 0;
+}
 
-  printf("[Thread %d] Scanning %s.%d-%d...\n", subnet_task->thread_id,
-         subnet_task->subnet, subnet_task->start_host, subnet_task->end_host);
+// Everything a stream can take from its arena: the units, the result
+// store, a shard bitmap, a send order, every link's ARP targets and, in
+// daemon mode, the host windows. Only what a scan writes is ever backed
+// by memory.
+static size_t stream_span(int subnet_count, size_t total) {
+  size_t span = arena_span((size_t)subnet_count * sizeof(subnet_task_t)) +
+                result_store_span(total) +
+                arena_span((total + 63) / 64 * sizeof(uint64_t)) +
+                arena_span(total * sizeof(uint32_t));
+  if (monitor_interval_s)
+    span += arena_span(total * sizeof(monitor_host_t));
+  for (int i = 0; i < local_link_count; ++i)
+    span += arena_span(link_capacity(i, total) * sizeof(arp_target_t));
+  return span;
+}
 
-  int total = subnet_task->end_host - subnet_task->start_host + 1;
+// Most targets of a stream over total hosts that can be on a local link
+static size_t link_capacity(int link, size_t total) {
+  size_t prefix = (size_t)~local_links[link].mask + 1;
+  return prefix < total ? prefix : total;
+}
 
-  // Use dynamic thread count based on system capabilities
-  int ping_threads = get_optimal_thread_count();
-  if (ping_threads > MAX_PING_THREADS)
-    ping_threads = MAX_PING_THREADS;
+// Release a stream and everything it allocated
+static void stream_close(host_stream_t *stream) {
+  result_store_destroy(&stream->results);
+  arena_destroy(&stream->arena);
+}
 
-  ping_task_t *tasks =
-      aligned_alloc(alignof(ping_task_t), total * sizeof(ping_task_t));
-  if (!tasks) {
-    fprintf(stderr, "[Thread %d] Memory allocation failed\n",
-            subnet_task->thread_id);
-    *(subnet_task->responders) = 0;
-    return NULL;
+// Send every target of an open stream once and wait for the results,
+// timing each phase from start_ns into metrics. Each call starts from a
+// clear result store, keeping what the stream learned about subnet RTTs.
+// Returns the number of units scanned, -1 on failure.
+static int stream_cycle(host_stream_t *stream, scan_metrics_t *metrics,
+                        uint64_t start_ns) {
+  for (int i = 0; i < stream->subnet_count; ++i) {
+    subnet_task_t *subnet = &stream->subnets[i];
+    atomic_store(&subnet->remaining,
+                 (int)(subnet->last_addr - subnet->first_addr + 1));
+    atomic_store(&subnet->started, 0);
+    subnet->skipped = 0;
+    subnet->outside = 0;
+  }
+  stream->planned = stream->total;
+  stream->skipped = 0;
+  stream->resumed = 0;
+  stream->abandoned = 0;
+  stream->outside = 0;
+  atomic_store(&stream->cursor, 0);
+  atomic_store(&stream->queued, 0);
+  atomic_store(&stream->sends_done_ns, 0);
+  result_store_clear(&stream->results);
+
+  if ((rescan || resume || stream->owned || local_link_count > 0) &&
+      plan_stream(stream) != 0) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
   }
 
-  pthread_t *threads = malloc(ping_threads * sizeof(pthread_t));
-  if (!threads) {
-    fprintf(stderr, "[Thread %d] Thread allocation failed\n",
-            subnet_task->thread_id);
-    free(tasks);
-    *(subnet_task->responders) = 0;
-    return NULL;
+  if (scan_order == SCAN_ORDER_RANDOM)
+    permute_init(&stream->perm, stream->planned, scan_seed);
+  else
+    permute_sequential(&stream->perm, stream->planned);
+  if (checkpoint.header) {
+    checkpoint.header->order = scan_order;
+    checkpoint.header->seed = scan_seed;
+    checkpoint.header->shard = (uint16_t)shard_index;
+    checkpoint.header->shards = (uint16_t)shard_count;
+    atomic_store(&checkpoint.header->positions,
+                 permute_positions(&stream->perm));
+    atomic_store(&checkpoint.header->cursor, 0);
   }
 
-  int responders = 0;
-  int idx = 0;
+  if (probe_job_init(&stream->job, stream->planned, ping_result, stream) !=
+      0) {
+    fprintf(stderr, "Probe job setup failed\n");
+    return -1;
+  }
+  if (scan_policy.timeout_us || scan_policy.should_retry)
+    stream->job.policy = &scan_policy;
+
+  uint64_t send_ns = monotonic_ns();
+  metrics->phase_ns[PHASE_TARGETS] = send_ns - start_ns;
+
+  // One task per run of chunks, spread over every worker's deque; no batch
+  // barriers. Whatever could not be queued is sent from here.
+  uint64_t span = (uint64_t)PROBE_CHUNK_SIZE * STREAM_TASK_CHUNKS;
+  uint64_t tasks = (permute_positions(&stream->perm) + span - 1) / span;
+  uint64_t submitted = 0;
+  for (; submitted < tasks; ++submitted) {
+    if (thread_pool_submit(&ping_pool, stream_task, stream) != 0)
+      break;
+  }
+  for (uint64_t i = submitted; i < tasks; ++i)
+    stream_task(stream);
+  run_link_sweeps(stream);
+
+  // A stopped scan leaves the rest of the walk unsent
+  thread_pool_wait(&ping_pool);
+  stream->abandoned = stream->planned - atomic_load(&stream->queued);
+  probe_job_abandon(&stream->job, stream->abandoned);
+  probe_job_wait(&stream->job);
+  uint64_t done_ns = monotonic_ns();
+
+  // Sending ends with the last first-attempt send; retries and replies
+  // still outstanding after that count as draining
+  uint64_t sends_done = atomic_load(&stream->sends_done_ns);
+  if (sends_done < send_ns || sends_done > done_ns)
+    sends_done = done_ns;
+  metrics->phase_ns[PHASE_SENDING] = sends_done - send_ns;
+  metrics->phase_ns[PHASE_DRAINING] = done_ns - sends_done;
+  metrics->hosts = stream->total - stream->skipped - stream->resumed -
+                   stream->abandoned - stream->outside;
+  targets_unsent = stream->abandoned;
+  metrics->responders =
+      result_store_count(&stream->results, 0, stream->total);
+  metrics->workers = submitted ? ping_pool.thread_count : 1;
+  probe_job_destroy(&stream->job);
+
+  // Units wholly in other shards' slices were not scanned here
+  int scanned = stream->subnet_count;
+  for (int i = 0; i < stream->subnet_count; ++i) {
+    const subnet_task_t *subnet = &stream->subnets[i];
+    if (subnet->outside ==
+        (int)(subnet->last_addr - subnet->first_addr + 1))
+      scanned--;
+  }
+  return scanned;
+}
 
-  // Parallel ping execution with dynamic batching
-  for (int i = subnet_task->start_host; i <= subnet_task->end_host;) {
-    int batch = 0;
+// Scan a compiled target set once as one continuous host stream.
+// Returns the number of units scanned, -1 on failure.
+static int scan_host_stream(const target_set_t *targets,
+                            scan_metrics_t *metrics, uint64_t start_ns) {
+  host_stream_t stream;
+  if (stream_open(&stream, targets) != 0)
+    return -1;
 
-    // Fill batch with optimal thread count
-    for (; batch < ping_threads && i <= subnet_task->end_host;
-         ++batch, ++i, ++idx) {
-      int ret = snprintf(tasks[idx].ip, sizeof(tasks[idx].ip), "%s.%d",
-                         subnet_task->subnet, i);
-      if (ret < 0 || ret >= (int)sizeof(tasks[idx].ip)) {
-        continue;
-      }
+  int scanned = stream_cycle(&stream, metrics, start_ns);
+  stream_close(&stream);
+  return scanned;
+}
 
-      atomic_store(&tasks[idx].alive, 0);
-      atomic_store(&tasks[idx].processed, 0);
+// Point every subnet at its block of the state file. Reserving can move
+// the mapping, so pointers are taken only once every block exists.
+static int attach_host_state(subnet_task_t *subnets, int count) {
+  for (int i = 0; i < count; ++i) {
+    if (state_reserve(&host_state, subnets[i].first_addr >> 8) < 0)
+      return -1;
+  }
+  for (int i = 0; i < count; ++i) {
+    int block = state_reserve(&host_state, subnets[i].first_addr >> 8);
+    subnets[i].state = state_block(&host_state, (uint32_t)block)->hosts;
+  }
+  return 0;
+}
 
-      if (pthread_create(&threads[batch], NULL, ping_worker, &tasks[idx]) !=
-          0) {
-        fprintf(stderr, "[Thread %d] Ping thread creation failed for %s\n",
-                subnet_task->thread_id, tasks[idx].ip);
-        atomic_store(&tasks[idx].processed, 1);
-        continue;
-      }
-    }
+// Queue one on-link target for its link's ARP sweep
+static int link_add(link_sweep_t *link, uint32_t addr, size_t index) {
+  if (link->count == link->capacity)
+    return -1;
+  link->targets[link->count++] =
+      (arp_target_t){.addr = addr, .index = index};
+  return 0;
+}
 
-    // Wait for batch completion
-    for (int j = 0; j < batch; ++j) {
-      pthread_join(threads[j], NULL);
-    }
+// The local link a subnet's host should be swept on, or -1 for ICMP. Our
+// own address never answers ARP, so it stays with ICMP.
+static int link_for_host(uint32_t addr) {
+  const iface_t *iface = iface_for_addr(local_links, local_link_count, addr);
+  if (!iface || iface->addr == addr)
+    return -1;
+  return (int)(iface - local_links);
+}
 
-    // Progress indicator for long-running subnet scans
-    if (idx % 50 == 0) {
-      printf("[Thread %d] Progress: %d/%d hosts\n", subnet_task->thread_id, idx,
-             total);
-    }
+// Mark the targets in this shard's slice of the permutation over the whole
+// stream. Every shard computes the same permutation from the target list
+// and seed alone, so the slices are disjoint and cover it without any
+// coordination, whatever each instance then plans for its own slice.
+static int shard_stream(host_stream_t *stream) {
+  permute_t perm;
+  stream->owned = arena_alloc(&stream->arena,
+                              (stream->total + 63) / 64 * sizeof(uint64_t));
+  if (!stream->owned)
+    return -1;
+
+  if (scan_order == SCAN_ORDER_RANDOM)
+    permute_init(&perm, stream->total, scan_seed);
+  else
+    permute_sequential(&perm, stream->total);
+
+  uint64_t positions = permute_positions(&perm);
+  uint64_t begin = positions * (uint64_t)shard_index / (uint64_t)shard_count;
+  uint64_t end =
+      positions * (uint64_t)(shard_index + 1) / (uint64_t)shard_count;
+  uint64_t value = permute_seek(&perm, begin);
+  for (uint64_t i = begin; i < end; ++i, value = permute_step(&perm, value)) {
+    uint64_t index = permute_index(&perm, value);
+    if (index != UINT64_MAX)
+      stream->owned[index / 64] |= 1ULL << (index % 64);
   }
+  return 0;
+}
 
-  // Collect results
-  for (int i = 0; i < total; ++i) {
-    if (atomic_load(&tasks[i].alive)) {
-      printf("[Thread %d] ✓ Host alive: %s\n", subnet_task->thread_id,
-             tasks[i].ip);
-      responders++;
+// Split a stream before sending. Hosts on a local link go to that link's
+// ARP sweep and the rest to the ICMP send order. A rescan puts hosts that
+// answered last time first and settles the ones its policy skips. A
+// resumed scan takes the results its checkpoint already has and sends
+// only the rest. Subnets left with nothing to probe are reported at once.
+// The buffers are taken from the arena once and stay with the stream for
+// a daemon's next cycle.
+static int plan_stream(host_stream_t *stream) {
+  if (!stream->order) {
+    stream->order =
+        arena_alloc(&stream->arena, stream->total * sizeof(uint32_t));
+    for (int i = 0; i < local_link_count; ++i) {
+      link_sweep_t *link = &stream->links[i];
+      link->capacity = link_capacity(i, stream->total);
+      link->targets = arena_alloc(&stream->arena,
+                                  link->capacity * sizeof(arp_target_t));
+      if (!link->targets)
+        return -1;
     }
   }
-
-  if (responders > 0) {
-    printf("[Thread %d] → %d responders found in %s\n", subnet_task->thread_id,
-           responders, subnet_task->subnet);
-  } else {
-    printf("[Thread %d] (no responses in %s)\n", subnet_task->thread_id,
-           subnet_task->subnet);
+  if (!stream->order)
+    return -1;
+  for (int i = 0; i < local_link_count; ++i)
+    stream->links[i].count = 0;
+
+  size_t planned = 0;
+  for (int pass = rescan ? 0 : 1; pass < 2; ++pass) {
+    for (int s = 0; s < stream->subnet_count; ++s) {
+      subnet_task_t *subnet = &stream->subnets[s];
+      for (uint32_t addr = subnet->first_addr; addr <= subnet->last_addr;
+           ++addr) {
+        const host_state_t *host =
+            rescan ? &subnet->state[addr & 0xff] : NULL;
+        size_t index = subnet->first + (addr - subnet->first_addr);
+        int link = local_link_count ? link_for_host(addr) : -1;
+
+        if (stream->owned &&
+            !(stream->owned[index / 64] & (1ULL << (index % 64)))) {
+          if (pass == 1) {
+            subnet->outside++;
+            stream->outside++;
+            atomic_fetch_sub(&subnet->remaining, 1);
+          }
+          continue;
+        }
+
+        if (resume && checkpoint_done(&checkpoint, index)) {
+          if (pass == 1)
+            resume_target(stream, subnet, index);
+          continue;
+        }
+
+        if (pass == 0) {
+          if (host->up && link < 0)
+            stream->order[planned++] = (uint32_t)index;
+        } else if (host && !host->up &&
+                   !state_should_probe(&host_state, host, addr,
+                                       &rescan_policy)) {
+          subnet->skipped++;
+          stream->skipped++;
+          atomic_fetch_sub(&subnet->remaining, 1);
+        } else if (link >= 0) {
+          if (link_add(&stream->links[link], addr, index) != 0)
+            return -1;
+        } else if (!host || !host->up) {
+          stream->order[planned++] = (uint32_t)index;
+        }
+      }
+    }
+  }
+  stream->planned = planned;
+
+  for (int s = 0; s < stream->subnet_count; ++s) {
+    subnet_task_t *subnet = &stream->subnets[s];
+    atomic_fetch_add(&hosts_skipped, subnet->skipped);
+    int size = (int)(subnet->last_addr - subnet->first_addr + 1);
+    if (atomic_load(&subnet->remaining) == 0 && subnet->outside < size)
+      report_subnet(stream, subnet);
   }
+  return 0;
+}
 
-  // Update global counters atomically
-  atomic_fetch_add(&total_hosts_scanned, total);
-  atomic_fetch_add(&total_responders, responders);
-  atomic_fetch_add(&subnets_scanned, 1);
+// Settle a target from the checkpoint as if its old result had just come
+// back; it is not probed, written out or folded into the state file again
+static void resume_target(host_stream_t *stream, subnet_task_t *subnet,
+                          size_t index) {
+  probe_reply_t reply;
+  if (checkpoint_reply(&checkpoint, index, &reply) == 0) {
+    result_store_mark(&stream->results, index, &reply);
+    if (reply.via != PROBE_VIA_NEIGH)
+      rtt_profile_record(&subnet->rtt, reply.rtt_us);
+    atomic_fetch_add(&total_responders, 1);
+  }
+  atomic_fetch_add(&total_hosts_scanned, 1);
+  stream->resumed++;
+  atomic_fetch_sub(&subnet->remaining, 1);
+}
 
-  *(subnet_task->responders) = responders;
+// ARP sweep results enter the stream exactly like engine results
+static void link_result(void *ctx, size_t index, const probe_reply_t *reply) {
+  host_stream_t *stream = ctx;
+  ping_result(&stream->job, index, reply);
+}
 
-  free(tasks);
-  free(threads);
-  return NULL;
+// Sweep every local link that has targets, paced by the first engine's
+// token bucket. Links answer fast, so the wait is capped well below the
+// ICMP timeout; retries become extra ARP rounds.
+static void run_link_sweeps(host_stream_t *stream) {
+  const probe_engine_t *engine = &probe_engines[0];
+  int wait_ms = engine->timeout_ms < ARP_MAX_WAIT_MS ? engine->timeout_ms
+                                                     : ARP_MAX_WAIT_MS;
+
+  for (int i = 0; i < local_link_count; ++i) {
+    link_sweep_t *link = &stream->links[i];
+    if (link->count == 0)
+      continue;
+    arp_sweep(&local_links[i], link->targets, link->count, wait_ms,
+              engine->retries + 1, &probe_engines[0].bucket, link_result,
+              stream, &arp_stats);
+    link_hosts += link->count;
+  }
 }
 
-// Enhanced parallel subnet scanning
-static void scan_subnets_parallel(const char *const *subnets, int count,
-                                  const char *description) {
-  printf("=== %s (Parallel Mode) ===\n", description);
-  printf("Scanning %d subnets with up to %d parallel threads...\n\n", count,
-         MAX_SUBNET_THREADS);
+// Up/down deltas against the state file, after scans that kept one
+static void print_state_changes(void) {
+  if (!host_state.header)
+    return;
+  fprintf(console, "Changes: %d came up, %d went down, %d skipped\n",
+          atomic_load(&hosts_came_up), atomic_load(&hosts_went_down),
+          atomic_load(&hosts_skipped));
+}
 
-  // Determine optimal number of subnet threads
-  int subnet_threads = count < MAX_SUBNET_THREADS ? count : MAX_SUBNET_THREADS;
+// What the ARP sweeps of a scan did, when any ran
+static void print_link_sweeps(void) {
+  if (link_hosts == 0)
+    return;
+  fprintf(console,
+          "ARP: %zu on-link hosts, %llu requests, %llu replies, "
+          "%llu from the neighbour table\n",
+          link_hosts, (unsigned long long)arp_stats.requests,
+          (unsigned long long)arp_stats.replies,
+          (unsigned long long)arp_stats.neighbors);
+}
 
-  pthread_t *threads = malloc(subnet_threads * sizeof(pthread_t));
-  subnet_task_t *tasks = malloc(count * sizeof(subnet_task_t));
-  int *responders_array = malloc(count * sizeof(int));
+// One line of scan-wide RTT quantiles
+static void print_latency(const char *label) {
+  rtt_summary_t latency;
+  histogram_summarize(&scan_rtt, &latency);
 
-  if (!threads || !tasks || !responders_array) {
-    fprintf(stderr, "Failed to allocate memory for parallel scanning\n");
-    free(threads);
-    free(tasks);
-    free(responders_array);
+  if (latency.count == 0) {
+    fprintf(console, "%s: no replies\n", label);
     return;
   }
+  fprintf(console,
+          "%s: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms "
+          "(%llu replies)\n",
+          label, latency.p50_us / 1000.0, latency.p90_us / 1000.0,
+          latency.p99_us / 1000.0, latency.max_us / 1000.0,
+          (unsigned long long)latency.count);
+}
 
-  // Process subnets in parallel batches
-  for (int i = 0; i < count;) {
-    int batch_size =
-        (count - i) < subnet_threads ? (count - i) : subnet_threads;
+// With --baseline, a single-worker run records its rate and any other run
+// loads it for the speedup figure
+static void update_baseline(void) {
+  baseline_rate = 0.0;
+  if (!baseline_path)
+    return;
 
-    // Create batch of subnet scanning tasks
-    for (int j = 0; j < batch_size; ++j, ++i) {
-      tasks[i].subnet = subnets[i];
-      tasks[i].start_host = 1;
-      tasks[i].end_host = 254;
-      tasks[i].responders = &responders_array[i];
-      tasks[i].thread_id = j + 1;
+  if (ping_pool.thread_count == 1) {
+    double rate = metrics_host_rate(&scan_metrics);
+    if (rate > 0.0 && metrics_save_baseline(baseline_path, rate) == 0)
+      fprintf(console, "Recorded single-worker baseline: %.1f hosts/s in %s\n",
+              rate, baseline_path);
+  } else if (metrics_load_baseline(baseline_path, &baseline_rate) != 0) {
+    fprintf(console, "No baseline in %s; record one with --concurrency 1\n",
+            baseline_path);
+    baseline_rate = 0.0;
+  }
+}
 
-      if (pthread_create(&threads[j], NULL, subnet_worker, &tasks[i]) != 0) {
-        fprintf(stderr, "Failed to create thread for subnet %s\n", subnets[i]);
-        continue;
-      }
-    }
+static void stop_scan(int sig) {
+  scan_stopping = 1;
+  signal(sig, SIG_DFL);
+}
 
-    // Wait for current batch to complete
-    for (int j = 0; j < batch_size; ++j) {
-      pthread_join(threads[j], NULL);
-    }
+// Catch the first SIGINT or SIGTERM of a checkpointed scan or a daemon to
+// stop it cleanly; the handler resets itself, so a second one kills at once
+static void catch_stop_signals(int enable) {
+  struct sigaction action = {.sa_handler = enable ? stop_scan : SIG_DFL};
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+}
+
+// Compile and scan a target set, printing a banner and the scan's metrics
+// around it. Returns -1 when the scan failed or was stopped short of its
+// targets.
+static int scan_targets(target_set_t *targets, const char *description) {
+  metrics_engine_mark_t mark;
+  metrics_reset(&scan_metrics);
+  metrics_engine_mark(probe_engines, engine_count, &mark);
+  uint64_t start_ns = monotonic_ns();
+
+  if (target_set_compile(targets, NULL) != 0) {
+    fprintf(stderr, "Failed to compile target set\n");
+    return -1;
+  }
+  if (monitor_interval_s)
+    return monitor_targets(targets, description);
+  if (checkpoint_path &&
+      checkpoint_open(&checkpoint, checkpoint_path,
+                      target_set_fingerprint(targets),
+                      target_set_size(targets), resume, overwrite) != 0)
+    return -1;
 
-    printf("Batch complete: %d/%d subnets processed\n\n", i, count);
+  // Binary output opens with this, so a merge can check which scan and
+  // slice each file holds
+  output_emit(&(output_record_t){.kind = OUTPUT_BEGIN,
+                                 .fingerprint =
+                                     target_set_fingerprint(targets),
+                                 .seed = scan_seed,
+                                 .shard = (uint16_t)shard_index,
+                                 .shards = (uint16_t)shard_count,
+                                 .order = (uint8_t)scan_order});
+
+  fprintf(console, "=== %s (Parallel Mode) ===\n", description);
+  fprintf(console,
+          "Streaming %llu hosts in %zu ranges through %d probe workers",
+          (unsigned long long)target_set_size(targets), targets->count,
+          ping_pool.thread_count);
+  if (scan_order == SCAN_ORDER_RANDOM)
+    fprintf(console, " in random order (seed %llu)",
+            (unsigned long long)scan_seed);
+  if (shard_count > 1)
+    fprintf(console, " as shard %d of %d", shard_index + 1, shard_count);
+  fprintf(console, "...\n");
+  if (resume)
+    fprintf(console, "Resuming from %s: %llu of %llu targets done "
+                     "(%llu responders)\n",
+            checkpoint_path,
+            (unsigned long long)atomic_load(&checkpoint.header->done),
+            (unsigned long long)checkpoint.header->total,
+            (unsigned long long)atomic_load(&checkpoint.header->responders));
+  fprintf(console, "\n");
+
+  histogram_reset(&scan_rtt);
+  arp_stats = (arp_stats_t){0};
+  link_hosts = 0;
+  if (host_state.header) {
+    state_begin_run(&host_state);
+    scan_started_s = (uint32_t)time(NULL);
+    atomic_store(&hosts_came_up, 0);
+    atomic_store(&hosts_went_down, 0);
+    atomic_store(&hosts_skipped, 0);
+  }
+  scan_stopping = 0;
+  targets_unsent = 0;
+  if (checkpoint.header)
+    catch_stop_signals(1);
+  int subnets = scan_host_stream(targets, &scan_metrics, start_ns);
+  output_flush();
+  if (checkpoint.header) {
+    catch_stop_signals(0);
+    checkpoint_close(&checkpoint, subnets >= 0 && !targets_unsent);
   }
+  if (subnets < 0)
+    return -1;
 
-  free(threads);
-  free(tasks);
-  free(responders_array);
+  scan_metrics.phase_ns[PHASE_OUTPUT] =
+      monotonic_ns() - start_ns - scan_metrics.phase_ns[PHASE_TARGETS] -
+      scan_metrics.phase_ns[PHASE_SENDING] -
+      scan_metrics.phase_ns[PHASE_DRAINING];
+  metrics_engine_delta(&scan_metrics, probe_engines, engine_count, &mark);
+  update_baseline();
+
+  if (targets_unsent)
+    fprintf(console,
+            "Scan stopped: %zu targets not sent; continue with --resume\n",
+            targets_unsent);
+  else
+    fprintf(console, "Scan complete: %d subnets processed\n", subnets);
+  print_latency("RTT");
+  print_state_changes();
+  print_link_sweeps();
+  metrics_print(console, &scan_metrics, baseline_rate);
+  fprintf(console, "\n");
+  return targets_unsent ? -1 : 0;
 }
 
-// Generic macro for parallel subnet scanning
-#define SCAN_SUBNET_ARRAY_PARALLEL(subnets, name)                              \
-  do {                                                                         \
-    const int count = sizeof(subnets) / sizeof(subnets[0]);                    \
-    scan_subnets_parallel(subnets, count, name);                               \
-  } while (0)
+// One line per daemon cycle: who is up, what changed and how fast it was
+static void print_cycle(uint64_t cycle, size_t total, uint64_t elapsed_ns) {
+  rtt_summary_t latency;
+  histogram_summarize(&scan_rtt, &latency);
+
+  fprintf(console, "Cycle %llu: %zu of %zu hosts up, %d came up, %d went "
+                   "down",
+          (unsigned long long)cycle, atomic_load(&monitor.up), total,
+          atomic_load(&hosts_came_up), atomic_load(&hosts_went_down));
+  if (latency.count > 0)
+    fprintf(console, ", RTT p50 %.3f ms, p99 %.3f ms", latency.p50_us / 1000.0,
+            latency.p99_us / 1000.0);
+  fprintf(console, " (%.1f s)\n", (double)elapsed_ns / (double)NS_PER_SEC);
+}
 
-// Optimized subnet arrays with better organization
-static const char *const common_class_c_subnets[] = {
-    "192.168.1",  "192.168.0",   "192.168.2",   "192.168.3",   "192.168.4",
-    "192.168.5",  "192.168.10",  "192.168.11",  "192.168.20",  "192.168.25",
-    "192.168.50", "192.168.100", "192.168.101", "192.168.200", "192.168.254"};
+// --daemon: probe a compiled target set again every interval until SIGINT
+// or SIGTERM, reporting only hosts that came up or went down. The stream,
+// its result store, the workers and the engine stay up from one cycle to
+// the next, and the send rate is lowered to spread each cycle over the
+// whole interval instead of sending it in one burst. Returns -1 if the
+// daemon could not start or a cycle failed.
+static int monitor_targets(const target_set_t *targets,
+                           const char *description) {
+  uint64_t total = target_set_size(targets);
+  host_stream_t stream;
+
+  if (stream_open(&stream, targets) != 0)
+    return -1;
+  if (monitor_init(&monitor, &stream.arena, stream.total, monitor_window) !=
+      0) {
+    fprintf(stderr, "Memory allocation failed\n");
+    stream_close(&stream);
+    return -1;
+  }
 
-static const char *const common_class_b_subnets[] = {
-    "172.16.0", "172.16.1", "172.16.2", "172.16.10", "172.17.0", "172.17.1",
-    "172.18.0", "172.19.0", "172.20.0", "172.21.0",  "172.22.0", "172.23.0",
-    "172.24.0", "172.25.0", "172.30.0", "172.31.0"};
+  // Sending leaves the last probes their timeout for every attempt
+  // before the next cycle is due. Every target may take a packet per
+  // port on each attempt, and --rate, which counts packets, stays the
+  // ceiling when the targets cannot fit the interval.
+  const probe_engine_t *engine = &probe_engines[0];
+  uint64_t attempts = (uint64_t)engine->retries + 1;
+  uint64_t wait_ms = attempts * (uint64_t)engine->timeout_ms;
+  uint64_t send_ms = (uint64_t)monitor_interval_s * 1000;
+  if (send_ms > 2 * wait_ms)
+    send_ms -= wait_ms;
+  else
+    send_ms /= 2;
+  uint64_t packets = total * attempts;
+  if (engine->backend->per_port)
+    packets *= (uint64_t)engine->port_count;
+  uint64_t pps = (packets * 1000 + send_ms - 1) / send_ms;
+  if (pps == 0)
+    pps = 1;
+  if (monitor_max_pps > 0 && pps > (uint64_t)monitor_max_pps)
+    pps = (uint64_t)monitor_max_pps;
+  set_engine_rate((int)pps, monitor_burst);
+
+  fprintf(console, "=== %s (Monitoring) ===\n", description);
+  fprintf(console,
+          "Probing %llu hosts in %zu ranges every %d s at up to %llu "
+          "packets/s",
+          (unsigned long long)total, targets->count, monitor_interval_s,
+          (unsigned long long)pps);
+  if (shard_count > 1)
+    fprintf(console, " as shard %d of %d", shard_index + 1, shard_count);
+  fprintf(console, "; down after %d missed cycles\n\n", monitor_window);
+
+  scan_stopping = 0;
+  catch_stop_signals(1);
+  uint64_t cycle = 0;
+  int status = 0;
+  while (!scan_stopping) {
+    uint64_t start_ns = monotonic_ns();
+
+    metrics_reset(&scan_metrics);
+    histogram_reset(&scan_rtt);
+    arp_stats = (arp_stats_t){0};
+    atomic_store(&hosts_came_up, 0);
+    atomic_store(&hosts_went_down, 0);
+    if (host_state.header) {
+      state_begin_run(&host_state);
+      scan_started_s = (uint32_t)time(NULL);
+    }
+
+    if (stream_cycle(&stream, &scan_metrics, start_ns) < 0) {
+      status = -1;
+      break;
+    }
+    output_flush();
+    if (targets_unsent)
+      break;
+    atomic_fetch_add(&monitor_cycles, 1);
+    print_cycle(++cycle, (size_t)total, monotonic_ns() - start_ns);
+    fflush(console);
+
+    // Wake every 100ms so a stop between cycles is prompt
+    uint64_t next_ns = start_ns + (uint64_t)monitor_interval_s * NS_PER_SEC;
+    while (!scan_stopping && monotonic_ns() < next_ns)
+      sleep_ns(100 * NS_PER_MS);
+  }
+  catch_stop_signals(0);
+
+  fprintf(console, "Monitoring stopped after %llu cycles: %zu of %llu hosts "
+                   "up\n\n",
+          (unsigned long long)cycle, atomic_load(&monitor.up),
+          (unsigned long long)total);
+  set_engine_rate(monitor_max_pps, monitor_burst);
+  monitor_destroy(&monitor);
+  stream_close(&stream);
+  return status;
+}
 
-static const char *const common_class_a_subnets[] = {
-    "10.0.0",  "10.0.1",   "10.0.2",   "10.0.10", "10.1.0",  "10.1.1",
-    "10.1.2",  "10.1.10",  "10.2.0",   "10.2.1",  "10.10.0", "10.10.1",
-    "10.20.0", "10.100.0", "10.200.0", "10.254.0"};
+// Scan hosts .1-.254 of each listed /24
+static int scan_subnets_parallel(const uint32_t *subnets, int count,
+                                 const char *description) {
+  target_set_t targets;
+  target_set_init(&targets);
+
+  for (int i = 0; i < count; ++i) {
+    if (target_set_add(&targets, subnets[i] + 1, subnets[i] + 254) != 0) {
+      fprintf(stderr, "Failed to allocate memory for parallel scanning\n");
+      target_set_destroy(&targets);
+      return -1;
+    }
+  }
 
-static void scan_all_common_private_networks_parallel(void) {
-  time_t start_time = time(NULL);
+  int status = scan_targets(&targets, description);
+  target_set_destroy(&targets);
+  return status;
+}
 
-  printf(
+#define ARRAY_LEN(array) (sizeof(array) / sizeof((array)[0]))
+
+// Common /24 network addresses, grouped by private class
+static const uint32_t common_class_c_subnets[] = {
+    IPV4(192, 168, 1, 0),   IPV4(192, 168, 0, 0),   IPV4(192, 168, 2, 0),
+    IPV4(192, 168, 3, 0),   IPV4(192, 168, 4, 0),   IPV4(192, 168, 5, 0),
+    IPV4(192, 168, 10, 0),  IPV4(192, 168, 11, 0),  IPV4(192, 168, 20, 0),
+    IPV4(192, 168, 25, 0),  IPV4(192, 168, 50, 0),  IPV4(192, 168, 100, 0),
+    IPV4(192, 168, 101, 0), IPV4(192, 168, 200, 0), IPV4(192, 168, 254, 0)};
+
+static const uint32_t common_class_b_subnets[] = {
+    IPV4(172, 16, 0, 0), IPV4(172, 16, 1, 0), IPV4(172, 16, 2, 0),
+    IPV4(172, 16, 10, 0), IPV4(172, 17, 0, 0), IPV4(172, 17, 1, 0),
+    IPV4(172, 18, 0, 0), IPV4(172, 19, 0, 0), IPV4(172, 20, 0, 0),
+    IPV4(172, 21, 0, 0), IPV4(172, 22, 0, 0), IPV4(172, 23, 0, 0),
+    IPV4(172, 24, 0, 0), IPV4(172, 25, 0, 0), IPV4(172, 30, 0, 0),
+    IPV4(172, 31, 0, 0)};
+
+static const uint32_t common_class_a_subnets[] = {
+    IPV4(10, 0, 0, 0),   IPV4(10, 0, 1, 0),   IPV4(10, 0, 2, 0),
+    IPV4(10, 0, 10, 0),  IPV4(10, 1, 0, 0),   IPV4(10, 1, 1, 0),
+    IPV4(10, 1, 2, 0),   IPV4(10, 1, 10, 0),  IPV4(10, 2, 0, 0),
+    IPV4(10, 2, 1, 0),   IPV4(10, 10, 0, 0),  IPV4(10, 10, 1, 0),
+    IPV4(10, 20, 0, 0),  IPV4(10, 100, 0, 0), IPV4(10, 200, 0, 0),
+    IPV4(10, 254, 0, 0)};
+
+static int scan_all_common_private_networks_parallel(void) {
+  fprintf(
+      console,
       "Starting PARALLEL comprehensive scan of common private networks...\n");
-  printf(
+  fprintf(
+      console,
       "System detected: %d CPU cores, using up to %d threads per operation\n",
       get_nprocs(), get_optimal_thread_count());
-  printf("This will scan the most commonly used private IP ranges in "
-         "parallel.\n\n");
+  fprintf(console, "This will scan the most commonly used private IP ranges "
+                   "in parallel.\n\n");
 
   // Reset atomic counters
   atomic_store(&total_hosts_scanned, 0);
   atomic_store(&total_responders, 0);
   atomic_store(&subnets_scanned, 0);
 
-  // Parallel scan of different network classes
-  SCAN_SUBNET_ARRAY_PARALLEL(common_class_c_subnets,
-                             "Common Class C Private Networks");
-  SCAN_SUBNET_ARRAY_PARALLEL(common_class_b_subnets,
-                             "Common Class B Private Networks");
-  SCAN_SUBNET_ARRAY_PARALLEL(common_class_a_subnets,
-                             "Common Class A Private Networks");
-
-  // Localhost scan
-  const char *const localhost[] = {"127.0.0"};
-  scan_subnets_parallel(localhost, 1, "Localhost Network");
-
-  time_t end_time = time(NULL);
-  double elapsed = difftime(end_time, start_time);
+  // Stream every class plus localhost as one scan so no group waits on the
+  // previous one to finish
+  uint32_t all_subnets[ARRAY_LEN(common_class_c_subnets) +
+                          ARRAY_LEN(common_class_b_subnets) +
+                          ARRAY_LEN(common_class_a_subnets) + 1];
+  int count = 0;
+  for (size_t i = 0; i < ARRAY_LEN(common_class_c_subnets); ++i)
+    all_subnets[count++] = common_class_c_subnets[i];
+  for (size_t i = 0; i < ARRAY_LEN(common_class_b_subnets); ++i)
+    all_subnets[count++] = common_class_b_subnets[i];
+  for (size_t i = 0; i < ARRAY_LEN(common_class_a_subnets); ++i)
+    all_subnets[count++] = common_class_a_subnets[i];
+  all_subnets[count++] = IPV4(127, 0, 0, 0);
+
+  int status = scan_subnets_parallel(
+      all_subnets, count, "Common Class C, B, A and Localhost Networks");
+  if (status != 0)
+    return status;
 
   // Load final atomic values
   int final_subnets = atomic_load(&subnets_scanned);
   int final_hosts = atomic_load(&total_hosts_scanned);
   int final_responders = atomic_load(&total_responders);
 
-  printf("========================================\n");
-  printf("        PARALLEL SCAN COMPLETE\n");
-  printf("========================================\n");
-  printf("Total subnets scanned: %d\n", final_subnets);
-  printf("Total hosts scanned: %d\n", final_hosts);
-  printf("Total responders found: %d\n", final_responders);
-  printf("Scan duration: %.0f seconds\n", elapsed);
-  printf("System cores utilized: %d\n", get_nprocs());
-  if (elapsed > 0) {
-    printf("Average rate: %.1f hosts/second\n", final_hosts / elapsed);
-    printf("Parallel efficiency: %.1fx speedup\n",
-           final_hosts / elapsed / get_nprocs());
+  fprintf(console, "========================================\n");
+  fprintf(console, "        PARALLEL SCAN COMPLETE\n");
+  fprintf(console, "========================================\n");
+  fprintf(console, "Total subnets scanned: %d\n", final_subnets);
+  fprintf(console, "Total hosts scanned: %d\n", final_hosts);
+  fprintf(console, "Total responders found: %d\n", final_responders);
+  print_latency("Round-trip time");
+  fprintf(console, "Scan duration: %.3f seconds\n",
+          (double)metrics_elapsed_ns(&scan_metrics) / (double)NS_PER_SEC);
+  fprintf(console, "System cores utilized: %d\n", get_nprocs());
+  fprintf(console, "Average rate: %.1f hosts/second\n",
+          metrics_host_rate(&scan_metrics));
+  if (baseline_rate > 0.0)
+    fprintf(console, "Speedup: %.2fx over one worker\n",
+            metrics_host_rate(&scan_metrics) / baseline_rate);
+  else
+    fprintf(console, "Speedup: no single-worker baseline recorded\n");
+  fprintf(console, "========================================\n");
+  return 0;
+}
+
+// Scan what this host can actually reach: its interfaces' prefixes and
+// the routes of the main table
+static int scan_discovered_networks_parallel(void) {
+  target_set_t targets;
+  target_set_init(&targets);
+
+  fprintf(console, "Discovering reachable networks...\n");
+  int prefixes = discover_targets(&targets, console);
+  if (prefixes < 0) {
+    fprintf(stderr, "Network discovery failed\n");
+    target_set_destroy(&targets);
+    return -1;
+  }
+  if (prefixes == 0) {
+    fprintf(console, "No reachable networks found; use --static-lists to "
+                     "scan the built-in private ranges\n");
+    target_set_destroy(&targets);
+    return 0;
   }
-  printf("========================================\n");
+  fprintf(console, "\n");
+
+  atomic_store(&total_hosts_scanned, 0);
+  atomic_store(&total_responders, 0);
+  atomic_store(&subnets_scanned, 0);
+
+  int status = scan_targets(&targets, "Discovered Networks");
+  target_set_destroy(&targets);
+  return status;
 }
 
 // Ultra-parallel full Class C range scanner
-static void scan_full_class_c_range_parallel(void) {
-  printf("=== Ultra-Parallel Full 192.168.x.x Range Scan ===\n\n");
-  printf("This will scan ALL 192.168.x.x networks (256 subnets) in parallel\n");
-  printf("Using maximum parallelization...\n\n");
+static int scan_full_class_c_range_parallel(void) {
+  fprintf(console, "=== Ultra-Parallel Full 192.168.x.x Range Scan ===\n\n");
+  fprintf(console, "This will scan ALL 192.168.x.x networks (256 subnets) "
+                   "in parallel\n");
+  fprintf(console, "Using maximum parallelization...\n\n");
 
   // Generate all 256 subnets
-  char **all_subnets = malloc(256 * sizeof(char *));
-  if (!all_subnets) {
+  uint32_t all_subnets[256];
+  for (uint32_t i = 0; i < 256; i++)
+    all_subnets[i] = IPV4(192, 168, i, 0);
+
+  return scan_subnets_parallel(all_subnets, 256, "Full 192.168.x.x Range");
+}
+
+// Single subnet scan (original functionality, now with better threading)
+static int scan_single_subnet_parallel(uint32_t base, int start_host,
+                                       int end_host) {
+  target_set_t targets;
+  target_set_init(&targets);
+
+  int status = -1;
+  if (target_set_add(&targets, base + (uint32_t)start_host,
+                     base + (uint32_t)end_host) != 0)
     fprintf(stderr, "Memory allocation failed\n");
-    return;
-  }
+  else
+    status = scan_targets(&targets, "Single Subnet");
 
-  for (int i = 0; i < 256; i++) {
-    all_subnets[i] = malloc(16);
-    if (!all_subnets[i]) {
-      // Cleanup on failure
-      for (int j = 0; j < i; j++) {
-        free(all_subnets[j]);
-      }
-      free(all_subnets);
-      return;
-    }
-    snprintf(all_subnets[i], 16, "192.168.%d", i);
+  target_set_destroy(&targets);
+  return status;
+}
+
+// Scan an arbitrary target list: CIDR blocks, ranges, '!' exclusions and
+// '@' target files, deduplicated before any probe is sent
+static int scan_custom_targets(const char *list) {
+  target_set_t include;
+  target_set_t exclude;
+  target_set_init(&include);
+  target_set_init(&exclude);
+
+  if (target_parse_list(list, &include, &exclude) != 0 ||
+      target_set_compile(&include, &exclude) != 0) {
+    target_set_destroy(&include);
+    target_set_destroy(&exclude);
+    return -1;
   }
 
-  // Cast to const for compatibility
-  const char *const *const_subnets = (const char *const *)all_subnets;
-  scan_subnets_parallel(const_subnets, 256, "Full 192.168.x.x Range");
+  int status = 0;
+  if (include.count == 0)
+    fprintf(console, "No targets left to scan\n");
+  else
+    status = scan_targets(&include, "Custom Targets");
 
-  // Cleanup
-  for (int i = 0; i < 256; i++) {
-    free(all_subnets[i]);
-  }
-  free(all_subnets);
+  target_set_destroy(&include);
+  target_set_destroy(&exclude);
+  return status;
 }
 
-// Single subnet scan (original functionality, now with better threading)
-static void scan_single_subnet_parallel(const char *base, int start_host,
-                                        int end_host) {
-  int responders = 0;
-  subnet_task_t task = {.subnet = base,
-                        .start_host = start_host,
-                        .end_host = end_host,
-                        .responders = &responders,
-                        .thread_id = 1};
-
-  subnet_worker(&task);
-}
-
-int main(void) {
-  printf("Multi-Threaded Private Network Scanner (C23 Optimized)\n");
-  printf("=====================================================\n");
-  printf("System: %d CPU cores detected\n", get_nprocs());
-  printf("Max ping threads: %d\n", get_optimal_thread_count());
-  printf("Max subnet threads: %d\n\n", MAX_SUBNET_THREADS);
-
-  printf("Select scanning mode:\n");
-  printf("1. Parallel scan of all common private networks (RECOMMENDED)\n");
-  printf("2. Ultra-parallel full 192.168.x.x range (256 subnets)\n");
-  printf("3. Single subnet scan (optimized threading)\n");
-  printf("4. Quick parallel scan (likely networks)\n");
-  printf("Enter choice (1-4): ");
+// Interactive fallback: the original menu, filling in what the command
+// line did not. Returns -1 on bad input.
+static int prompt_options(cli_options_t *options,
+                          char targets[TARGET_LIST_LEN]) {
+  fprintf(console, "Multi-Threaded Private Network Scanner (C23 Optimized)\n");
+  fprintf(console, "=====================================================\n");
+  fprintf(console, "System: %d CPU cores detected\n", get_nprocs());
+  fprintf(console, "Max ping threads: %d\n", get_optimal_thread_count());
+  fprintf(console, "\n");
+
+  fprintf(console, "Select scanning mode:\n");
+  fprintf(console,
+          "1. Parallel scan of all reachable local networks (RECOMMENDED)\n");
+  fprintf(console, "2. Ultra-parallel full 192.168.x.x range (256 subnets)\n");
+  fprintf(console, "3. Single subnet scan (optimized threading)\n");
+  fprintf(console, "4. Quick parallel scan (likely networks)\n");
+  fprintf(console, "5. Custom targets (CIDR, ranges, !exclusions, @file)\n");
+  fprintf(console, "Enter choice (1-5): ");
 
   int choice;
   if (scanf("%d", &choice) != 1) {
-    printf("Invalid input\n");
-    return EXIT_FAILURE;
+    fprintf(console, "Invalid input\n");
+    return -1;
   }
+  if (choice < SCAN_MODE_COMMON || choice > SCAN_MODE_CUSTOM) {
+    fprintf(console, "Invalid choice\n");
+    return -1;
+  }
+  options->mode = (scan_mode_t)choice;
 
-  printf("\n");
-
-  switch (choice) {
-  case 1:
-    scan_all_common_private_networks_parallel();
-    break;
-
-  case 2:
-    scan_full_class_c_range_parallel();
-    break;
+  fprintf(console, "\n");
 
-  case 3: {
+  if (options->mode == SCAN_MODE_SUBNET) {
     char base[SUBNET_LEN];
+    char network[SUBNET_LEN + 2];
+    uint32_t base_addr;
     int start, end;
 
-    printf("Enter subnet base (e.g., 192.168.1): ");
+    fprintf(console, "Enter subnet base (e.g., 192.168.1): ");
     if (scanf("%15s", base) != 1) {
-      printf("Invalid input\n");
-      return EXIT_FAILURE;
+      fprintf(console, "Invalid input\n");
+      return -1;
     }
 
-    printf("Enter start host (1-254): ");
+    // Parse the /24 prefix once; the scan itself works on integers
+    snprintf(network, sizeof(network), "%s.0", base);
+    if (addr_parse(network, &base_addr) != 0) {
+      fprintf(console, "Invalid subnet base\n");
+      return -1;
+    }
+
+    fprintf(console, "Enter start host (1-254): ");
     if (scanf("%d", &start) != 1 || start < 1 || start > 254) {
-      printf("Invalid start host\n");
-      return EXIT_FAILURE;
+      fprintf(console, "Invalid start host\n");
+      return -1;
     }
 
-    printf("Enter end host (1-254): ");
+    fprintf(console, "Enter end host (1-254): ");
     if (scanf("%d", &end) != 1 || end < 1 || end > 254 || end < start) {
-      printf("Invalid end host\n");
-      return EXIT_FAILURE;
+      fprintf(console, "Invalid end host\n");
+      return -1;
+    }
+
+    options->subnet = base_addr;
+    options->first_host = start;
+    options->last_host = end;
+    fprintf(console, "\n");
+  } else if (options->mode == SCAN_MODE_CUSTOM) {
+    fprintf(console, "Enter targets (e.g., 10.0.0.0/22,!10.0.1.0/24): ");
+    if (scanf(" %511[^\n]", targets) != 1) {
+      fprintf(console, "Invalid input\n");
+      return -1;
     }
 
-    printf("\n");
-    scan_single_subnet_parallel(base, start, end);
+    options->targets = targets;
+    fprintf(console, "\n");
+  }
+
+  return 0;
+}
+
+// IPv6 hosts go straight to the output; ctx is their link's number
+static void ipv6_host(void *ctx, const ndp_link_t *link,
+                      const ndp_host_t *host) {
+  output_record_t record = {.kind = OUTPUT_HOST6,
+                            .hostname = rdns_enabled ? "" : NULL,
+                            .link = link->name,
+                            .subnet_id = *(const int *)ctx,
+                            .rtt_us = host->rtt_us,
+                            .ttl = host->hops,
+                            .has_detail = host->via != PROBE_VIA_NEIGH,
+                            .via = host->via,
+                            .has_mac = host->has_mac};
+  memcpy(record.addr6, host->addr.s6_addr, sizeof(record.addr6));
+  memcpy(record.mac, host->mac, sizeof(record.mac));
+  output_emit(&record);
+  atomic_fetch_add(&total_responders, 1);
+}
+
+// Find the IPv6 hosts of every link, or of the --interface one. A /64 is
+// far too big to sweep address by address, so each link is asked through
+// all-nodes echoes and its neighbour table instead, paced by the first
+// engine's token bucket; retries become extra rounds as for ARP.
+static int scan_ipv6_links(const char *device) {
+  const probe_engine_t *engine = &probe_engines[0];
+  int wait_ms = engine->timeout_ms < NDP_MAX_WAIT_MS ? engine->timeout_ms
+                                                     : NDP_MAX_WAIT_MS;
+  ndp_link_t links[NDP_MAX_LINKS];
+  int count = ndp_links(device, links, NDP_MAX_LINKS);
+
+  fprintf(console, "=== IPv6 Neighbour Discovery ===\n");
+  if (count < 0)
+    return -1;
+  if (count == 0) {
+    fprintf(console, "No IPv6 links to sweep\n\n");
+    return 0;
+  }
+
+  ndp_stats = (ndp_stats_t){0};
+  uint64_t start_ns = monotonic_ns();
+  int status = 0;
+  for (int i = 0; i < count; ++i) {
+    int id = i + 1;
+    // Hosts of the link before come out ahead of this banner
+    output_flush();
+    fprintf(console, "[%s] Soliciting all-nodes from %d address%s...\n",
+            links[i].name, links[i].source_count,
+            links[i].source_count == 1 ? "" : "es");
+    if (ndp_sweep(&links[i], wait_ms, engine->retries + 1,
+                  &probe_engines[0].bucket, ipv6_host, &id, &ndp_stats) != 0)
+      status = -1;
+  }
+  output_flush();
+
+  fprintf(console,
+          "IPv6: %llu hosts on %d links in %.3f s, %llu all-nodes "
+          "requests, %llu unicast echoes, %llu replies, %llu from the "
+          "neighbour table\n\n",
+          (unsigned long long)ndp_stats.hosts, count,
+          (double)(monotonic_ns() - start_ns) / NS_PER_SEC,
+          (unsigned long long)ndp_stats.solicits,
+          (unsigned long long)ndp_stats.echoes,
+          (unsigned long long)ndp_stats.replies,
+          (unsigned long long)ndp_stats.neighbors);
+  return status;
+}
+
+// Run the selected scan mode. Returns -1 if the scan, or the IPv6 sweep
+// after it, failed.
+static int run_scan(const cli_options_t *options) {
+  int status = 0;
+
+  switch (options->mode) {
+  case SCAN_MODE_COMMON:
+    if (options->static_lists)
+      status = scan_all_common_private_networks_parallel();
+    else
+      status = scan_discovered_networks_parallel();
+    break;
+
+  case SCAN_MODE_FULL:
+    status = scan_full_class_c_range_parallel();
+    break;
+
+  case SCAN_MODE_SUBNET:
+    status = scan_single_subnet_parallel(options->subnet, options->first_host,
+                                         options->last_host);
+    break;
+
+  case SCAN_MODE_QUICK: {
+    fprintf(console, "=== Quick Parallel Scan of Likely Networks ===\n\n");
+    const uint32_t quick_subnets[] = {IPV4(192, 168, 1, 0),
+                                      IPV4(192, 168, 0, 0), IPV4(10, 0, 0, 0),
+                                      IPV4(172, 16, 0, 0)};
+    status = scan_subnets_parallel(quick_subnets, 4, "Quick Scan Networks");
     break;
   }
 
-  case 4: {
-    printf("=== Quick Parallel Scan of Likely Networks ===\n\n");
-    const char *const quick_subnets[] = {"192.168.1", "192.168.0", "10.0.0",
-                                         "172.16.0"};
-    scan_subnets_parallel(quick_subnets, 4, "Quick Scan Networks");
+  case SCAN_MODE_CUSTOM:
+    status = scan_custom_targets(options->targets);
+    break;
+
+  case SCAN_MODE_NONE:
     break;
   }
 
-  default:
-    printf("Invalid choice\n");
+  if (options->ipv6 && scan_ipv6_links(options->probe.device) != 0)
+    status = -1;
+  return status;
+}
+
+// Telemetry snapshot: plain atomic loads, nothing on the hot path waits
+static void sample_telemetry(telemetry_sample_t *sample) {
+  *sample = (telemetry_sample_t){0};
+  sample->hosts_scanned = (uint64_t)atomic_load(&total_hosts_scanned);
+  sample->responders = (uint64_t)atomic_load(&total_responders);
+  sample->subnets_scanned = (uint64_t)atomic_load(&subnets_scanned);
+  for (int i = 0; i < engine_count; ++i) {
+    probe_engine_t *engine = &probe_engines[i];
+    sample->probes_sent += atomic_load(&engine->sent);
+    sample->retransmits += atomic_load(&engine->retransmits);
+    sample->replies += atomic_load(&engine->replies);
+    sample->timeouts += atomic_load(&engine->timeouts);
+    sample->send_errors += atomic_load(&engine->send_errors);
+    sample->rate_stalls += atomic_load(&engine->bucket.stalls);
+    sample->inflight += atomic_load(&engine->inflight);
+    sample->window += atomic_load(&engine->window);
+    sample->retry_queue += (int64_t)atomic_load(&engine->retry_count);
+  }
+  sample->active_workers = atomic_load(&active_stream_workers);
+  sample->send_queue = atomic_load(&send_queue_depth);
+  sample->monitor_cycles = atomic_load(&monitor_cycles);
+  sample->hosts_up = (int64_t)atomic_load(&monitor.up);
+}
+
+// Keep the interfaces ARP sweeps can use; without packet socket access
+// every target goes through the probe engine
+static void find_local_links(const char *device) {
+  iface_t ifaces[IFACE_MAX];
+  int count = iface_list(ifaces, IFACE_MAX);
+
+  if (!arp_available()) {
+    fprintf(stderr, "ARP sweeps need CAP_NET_RAW; probing local links "
+                    "like any other\n");
+    return;
+  }
+
+  local_link_count = 0;
+  for (int i = 0; i < count; ++i) {
+    static const uint8_t no_mac[6];
+    if (device && strcmp(ifaces[i].name, device) != 0)
+      continue;
+    if (ifaces[i].arp && memcmp(ifaces[i].mac, no_mac, 6) != 0)
+      local_links[local_link_count++] = ifaces[i];
+  }
+}
+
+// Start the first engine on the chosen backend. Raw SYN probing without
+// CAP_NET_RAW drops to plain connects, as ICMP drops to datagram sockets,
+// and io_uring on kernels that lack it drops to plain socket calls.
+static int start_probe_engine(probe_engine_t *engine, probe_config_t *probe) {
+  if (probe_engine_start(engine, probe) == 0)
+    return 0;
+
+  if (probe->backend == &probe_backend_tcp_syn &&
+      (errno == EPERM || errno == EACCES)) {
+    fprintf(stderr, "SYN probing needs CAP_NET_RAW; using TCP connect\n");
+    probe->backend = &probe_backend_tcp_connect;
+    if (probe_engine_start(engine, probe) == 0)
+      return 0;
+  }
+
+  if (probe->backend == &probe_backend_icmp_uring) {
+    fprintf(stderr, "io_uring backend failed (%s); using socket I/O\n",
+            strerror(errno));
+    probe->backend = &probe_backend_icmp;
+    if (probe_engine_start(engine, probe) == 0)
+      return 0;
+  }
+
+  fprintf(stderr, "Failed to open %s probe socket: %s\n",
+          probe->backend->name, strerror(errno));
+  if (probe->backend == &probe_backend_icmp)
+    fprintf(stderr, "Run as root or allow this group in "
+                    "net.ipv4.ping_group_range, or try --probe tcp\n");
+  return -1;
+}
+
+// Start one engine per selected core, each with its own sockets and a
+// share of the rate. The first settles the backend the others use.
+static int start_probe_engines(probe_config_t *probe) {
+  int pps = probe->max_pps;
+
+  probe_engines = calloc((size_t)engine_count, sizeof(probe_engine_t));
+  if (!probe_engines) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
+  }
+  if (pps > 0)
+    probe->max_pps = pps / engine_count ? pps / engine_count : 1;
+
+  int started = 0;
+  for (; started < engine_count; ++started) {
+    probe->cpu = engine_cpus ? engine_cpus[started] : -1;
+    probe->lane = started;
+    int rc = started == 0
+                 ? start_probe_engine(&probe_engines[0], probe)
+                 : probe_engine_start(&probe_engines[started], probe);
+    if (rc != 0)
+      break;
+  }
+  probe->max_pps = pps;
+  if (started == engine_count)
+    return 0;
+
+  if (started > 0)
+    fprintf(stderr, "Failed to start probe engine %d on CPU %d: %s\n",
+            started, probe->cpu, strerror(errno));
+  while (started-- > 0)
+    probe_engine_stop(&probe_engines[started]);
+  free(probe_engines);
+  probe_engines = NULL;
+  return -1;
+}
+
+static void stop_probe_engines(void) {
+  for (int i = 0; i < engine_count; ++i)
+    probe_engine_stop(&probe_engines[i]);
+  free(probe_engines);
+  probe_engines = NULL;
+}
+
+// Start the output writer, with the reverse resolver as its enrichment
+// stage under --rdns. Returns -1 after printing a diagnostic.
+static int start_output(const cli_options_t *options) {
+  if (options->rdns) {
+    if (rdns_open(&resolver, options->resolver, options->rdns_cache) != 0)
+      return -1;
+    rdns_enabled = 1;
+  }
+  if (output_start(options->flush_ms, options->format,
+                   rdns_enabled ? &resolver : NULL) != 0) {
+    fprintf(stderr, "Failed to start the output writer\n");
+    if (rdns_enabled)
+      rdns_close(&resolver);
+    rdns_enabled = 0;
+    return -1;
+  }
+  return 0;
+}
+
+// Write out everything, names included, then save the name cache
+static void stop_output(void) {
+  output_stop();
+  if (!rdns_enabled)
+    return;
+
+  const rdns_stats_t *stats = &resolver.stats;
+  fprintf(console,
+          "Reverse DNS: %llu of %llu lookups named (%llu from cache), "
+          "%llu queries, %llu unanswered\n",
+          (unsigned long long)stats->named,
+          (unsigned long long)stats->lookups,
+          (unsigned long long)stats->cached,
+          (unsigned long long)stats->queries,
+          (unsigned long long)stats->failed);
+  rdns_close(&resolver);
+  rdns_enabled = 0;
+}
+
+// --merge: report on earlier scans' result files instead of scanning.
+// Checkpoints are read against the --targets list they were written for.
+static int merge_files(const cli_options_t *options) {
+  target_set_t include;
+  target_set_t exclude;
+  target_set_init(&include);
+  target_set_init(&exclude);
+
+  int status = EXIT_FAILURE;
+  if (options->targets &&
+      (target_parse_list(options->targets, &include, &exclude) != 0 ||
+       target_set_compile(&include, &exclude) != 0))
+    goto done;
+  if (merge_results(options->merge_paths, options->merge_count,
+                    options->targets ? &include : NULL, options->format,
+                    console) == 0)
+    status = EXIT_SUCCESS;
+
+done:
+  target_set_destroy(&include);
+  target_set_destroy(&exclude);
+  return status;
+}
+
+int main(int argc, char **argv) {
+  cli_options_t options;
+  char targets[TARGET_LIST_LEN];
+
+  if (cli_parse(argc, argv, &options) != 0) {
+    fprintf(stderr, "Try '%s --help' for usage\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (options.help) {
+    cli_usage(stdout, argv[0]);
+    return EXIT_SUCCESS;
+  }
+
+  console = options.format == OUTPUT_TEXT ? stdout : stderr;
+  if (options.merge)
+    return merge_files(&options);
+
+  baseline_path = options.baseline;
+  set_scan_policy(&options);
+  rescan = options.rescan;
+  checkpoint_path = options.checkpoint_path;
+  resume = options.resume;
+  overwrite = options.overwrite;
+  scan_order = options.order;
+  scan_seed = options.seed;
+  shard_index = options.shard_index;
+  shard_count = options.shard_count;
+  if (options.daemon) {
+    monitor_interval_s = options.interval_s;
+    monitor_window = options.window;
+    monitor_max_pps = options.probe.max_pps;
+    monitor_burst = options.probe.burst;
+  }
+  if (scan_order == SCAN_ORDER_RANDOM && !options.seed_set &&
+      getrandom(&scan_seed, sizeof(scan_seed), 0) != sizeof(scan_seed))
+    scan_seed = monotonic_ns();
+  if (options.arp)
+    find_local_links(options.probe.device);
+  rescan_policy = options.rescan_policy;
+  if (options.interactive &&
+      prompt_options(&options, targets) != 0)
+    return EXIT_FAILURE;
+
+  if (start_output(&options) != 0)
+    return EXIT_FAILURE;
+
+  if (options.cpu_count > 0) {
+    engine_cpus = options.cpus;
+    engine_count = options.cpu_count;
+  }
+  if (start_probe_engines(&options.probe) != 0) {
+    stop_output();
+    return EXIT_FAILURE;
+  }
+
+  int ping_threads = options.concurrency;
+  if (ping_threads == 0) {
+    ping_threads = get_optimal_thread_count();
+    if (ping_threads > MAX_PING_THREADS)
+      ping_threads = MAX_PING_THREADS;
+  }
+
+  if (init_thread_pool(&ping_pool, ping_threads) != 0) {
+    fprintf(stderr, "Failed to start worker threads\n");
+    stop_probe_engines();
+    stop_output();
+    return EXIT_FAILURE;
+  }
+  if (engine_cpus &&
+      thread_pool_pin(&ping_pool, engine_cpus, engine_count) != 0)
+    fprintf(stderr, "Cannot pin stream workers: %s\n", strerror(errno));
+
+  if (telemetry_start(&telemetry, &options.telemetry, sample_telemetry) !=
+      0) {
+    cleanup_thread_pool(&ping_pool);
+    stop_probe_engines();
+    stop_output();
     return EXIT_FAILURE;
   }
 
-  return EXIT_SUCCESS;
+  int status = EXIT_SUCCESS;
+  if ((options.state_path &&
+       state_open(&host_state, options.state_path) != 0) ||
+      run_scan(&options) != 0)
+    status = EXIT_FAILURE;
+
+  state_close(&host_state);
+  telemetry_stop(&telemetry);
+  cleanup_thread_pool(&ping_pool);
+  stop_probe_engines();
+  stop_output();
+  return status;
 }
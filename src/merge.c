@@ -0,0 +1,431 @@
+#include "merge.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+#include "clock.h"
+#include "encode.h"
+#include "histogram.h"
+#include "probe.h"
+
+// Every reporting unit is a /24
+#define MERGE_SUBNET_MASK 0xffffff00u
+
+// One responder as a result file recorded it
+typedef struct {
+  uint64_t unix_ns;
+  uint32_t addr;
+  uint32_t rtt_us;
+  uint8_t ttl;
+  uint8_t via;
+  uint8_t has_detail;
+} merge_host_t;
+
+typedef struct {
+  merge_host_t *hosts;
+  size_t count;
+  size_t capacity;
+} merge_table_t;
+
+// The scan a result file came from, as its header recorded it
+typedef struct {
+  uint64_t fingerprint;
+  uint64_t seed;
+  uint32_t order;
+  uint16_t shard;
+  uint16_t shards;
+} merge_scan_t;
+
+// The merged report is encoded here and written in blocks, like the
+// scan's own output
+static char merge_buffer[OUTPUT_BUFFER_LEN];
+static size_t merge_used;
+
+static int merge_add(merge_table_t *table, const merge_host_t *host) {
+  if (table->count == table->capacity) {
+    size_t capacity =
+        table->capacity ? table->capacity * 2 : MERGE_INITIAL_HOSTS;
+    merge_host_t *hosts = realloc(table->hosts, capacity * sizeof(*hosts));
+    if (!hosts) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return -1;
+    }
+    table->hosts = hosts;
+    table->capacity = capacity;
+  }
+  table->hosts[table->count++] = *host;
+  return 0;
+}
+
+static uint16_t get_be16(const uint8_t *in) {
+  return (uint16_t)(in[0] << 8 | in[1]);
+}
+
+static uint32_t get_be32(const uint8_t *in) {
+  return (uint32_t)get_be16(in) << 16 | get_be16(in + 2);
+}
+
+static uint64_t get_be64(const uint8_t *in) {
+  return (uint64_t)get_be32(in) << 32 | get_be32(in + 4);
+}
+
+// Binary records carry flags rather than the probe method; only SYN
+// answers among the TCP ones have a TTL
+static uint8_t merge_via(uint8_t flags, uint8_t ttl) {
+  if (flags & ENCODE_FLAG_LINK)
+    return flags & ENCODE_FLAG_DETAIL ? PROBE_VIA_ARP : PROBE_VIA_NEIGH;
+  if (flags & ENCODE_FLAG_TCP)
+    return ttl ? PROBE_VIA_SYN : PROBE_VIA_TCP;
+  return PROBE_VIA_ICMP;
+}
+
+// Take the scan identity and host records of a --format binary stream. A
+// scan killed while writing can leave a partial record at the end, which
+// is dropped.
+static int merge_read_binary(FILE *file, const char *path,
+                             merge_table_t *table, merge_scan_t *scan) {
+  uint8_t header[ENCODE_BINARY_HEADER_LEN];
+  uint8_t record[ENCODE_BINARY_RECORD_LEN];
+
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, ENCODE_BINARY_MAGIC, 4) != 0 ||
+      get_be16(header + 4) != ENCODE_BINARY_VERSION ||
+      get_be16(header + 6) != ENCODE_BINARY_RECORD_LEN) {
+    fprintf(stderr, "%s is not a version %d binary result file\n", path,
+            ENCODE_BINARY_VERSION);
+    return -1;
+  }
+  *scan = (merge_scan_t){.fingerprint = get_be64(header + 8),
+                         .seed = get_be64(header + 16),
+                         .shard = get_be16(header + 24),
+                         .shards = get_be16(header + 26),
+                         .order = header[28]};
+
+  size_t got;
+  while ((got = fread(record, 1, sizeof(record), file)) == sizeof(record)) {
+    uint8_t flags = record[21];
+    merge_host_t host = {.unix_ns = get_be64(record),
+                         .addr = get_be32(record + 8),
+                         .rtt_us = get_be32(record + 16),
+                         .ttl = record[20],
+                         .via = merge_via(flags, record[20]),
+                         .has_detail = (flags & ENCODE_FLAG_DETAIL) != 0};
+    if (merge_add(table, &host) != 0)
+      return -1;
+  }
+
+  if (ferror(file)) {
+    fprintf(stderr, "Cannot read %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  if (got != 0)
+    fprintf(stderr, "%s ends in a partial record; dropping it\n", path);
+  return 0;
+}
+
+// Take the responders of a checkpoint. Its indexes only mean something
+// against the target list it was written for, and it keeps no per-host
+// times, so every host gets the time of its last flush.
+static int merge_read_checkpoint(const char *path,
+                                 const target_set_t *targets,
+                                 merge_table_t *table, merge_scan_t *scan,
+                                 FILE *console) {
+  checkpoint_t checkpoint;
+
+  if (!targets) {
+    fprintf(stderr, "Merging checkpoint %s needs the --targets it scanned\n",
+            path);
+    return -1;
+  }
+  if (checkpoint_map(&checkpoint, path) != 0)
+    return -1;
+
+  const checkpoint_header_t *header = checkpoint.header;
+  if (header->fingerprint != target_set_fingerprint(targets) ||
+      header->total != target_set_size(targets)) {
+    fprintf(stderr, "%s is not a checkpoint of these targets\n", path);
+    checkpoint_unmap(&checkpoint);
+    return -1;
+  }
+  *scan = (merge_scan_t){.fingerprint = header->fingerprint,
+                         .seed = header->seed,
+                         .order = header->order,
+                         .shard = header->shard,
+                         .shards = header->shards};
+  if (!header->complete)
+    fprintf(console, "%s is of a stopped scan: %llu of %llu targets done\n",
+            path, (unsigned long long)atomic_load(&header->done),
+            (unsigned long long)header->total);
+
+  uint64_t unix_ns = header->synced_s * NS_PER_SEC;
+  size_t index = 0;
+  int rc = 0;
+  for (size_t r = 0; r < targets->count && rc == 0; ++r) {
+    const target_range_t *range = &targets->ranges[r];
+    for (uint64_t addr = range->first; addr <= range->last;
+         ++addr, ++index) {
+      probe_reply_t reply;
+      if (!checkpoint_done(&checkpoint, index) ||
+          checkpoint_reply(&checkpoint, index, &reply) != 0)
+        continue;
+
+      merge_host_t host = {.unix_ns = unix_ns,
+                           .addr = (uint32_t)addr,
+                           .rtt_us = reply.rtt_us,
+                           .ttl = reply.ttl,
+                           .via = reply.via,
+                           .has_detail = reply.via != PROBE_VIA_NEIGH};
+      if (merge_add(table, &host) != 0) {
+        rc = -1;
+        break;
+      }
+    }
+  }
+
+  checkpoint_unmap(&checkpoint);
+  return rc;
+}
+
+// Read one file of either kind, told apart by its magic
+static int merge_read(const char *path, const target_set_t *targets,
+                      merge_table_t *table, merge_scan_t *scan,
+                      FILE *console) {
+  char magic[4];
+  FILE *file = fopen(path, "rb");
+
+  if (!file) {
+    fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+      memcmp(magic, CHECKPOINT_MAGIC, 4) == 0) {
+    fclose(file);
+    return merge_read_checkpoint(path, targets, table, scan, console);
+  }
+
+  rewind(file);
+  int rc = merge_read_binary(file, path, table, scan);
+  fclose(file);
+  return rc;
+}
+
+// Address order, and the earliest answer first among copies of one host
+static int merge_compare(const void *a, const void *b) {
+  const merge_host_t *left = a;
+  const merge_host_t *right = b;
+
+  if (left->addr != right->addr)
+    return left->addr < right->addr ? -1 : 1;
+  if (left->unix_ns != right->unix_ns)
+    return left->unix_ns < right->unix_ns ? -1 : 1;
+  return 0;
+}
+
+static void merge_write(output_format_t format,
+                        const output_record_t *record, uint64_t unix_ns) {
+  if (merge_used + ENCODE_RECORD_MAX > OUTPUT_BUFFER_LEN) {
+    fwrite(merge_buffer, 1, merge_used, stdout);
+    merge_used = 0;
+  }
+  merge_used += encode_record(format, record, unix_ns,
+                              merge_buffer + merge_used,
+                              OUTPUT_BUFFER_LEN - merge_used);
+}
+
+static void merge_print_latency(FILE *console, const rtt_histogram_t *hist) {
+  rtt_summary_t latency;
+  histogram_summarize(hist, &latency);
+
+  if (latency.count == 0) {
+    fprintf(console, "RTT: no replies\n");
+    return;
+  }
+  fprintf(console,
+          "RTT: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms "
+          "(%llu replies)\n",
+          latency.p50_us / 1000.0, latency.p90_us / 1000.0,
+          latency.p99_us / 1000.0, latency.max_us / 1000.0,
+          (unsigned long long)latency.count);
+}
+
+static int merge_same_scan(const merge_scan_t *a, const merge_scan_t *b) {
+  return a->fingerprint == b->fingerprint && a->seed == b->seed &&
+         a->order == b->order && a->shards == b->shards;
+}
+
+// Shards only add up to a sweep when they are slices of one scan: the same
+// targets, order, seed and shard count. Unsharded files are whole scans
+// and may be combined freely. Returns -1 after printing a diagnostic.
+static int merge_check_scans(char *const *paths, const merge_scan_t *scans,
+                             int count) {
+  int sharded = -1;
+  for (int i = 0; i < count; ++i) {
+    if (scans[i].shards == 0 || scans[i].shard >= scans[i].shards) {
+      fprintf(stderr, "%s has a corrupt shard header\n", paths[i]);
+      return -1;
+    }
+    if (scans[i].shards > 1 && sharded < 0)
+      sharded = i;
+  }
+  if (sharded < 0)
+    return 0;
+
+  for (int i = 0; i < count; ++i) {
+    if (!merge_same_scan(&scans[i], &scans[sharded])) {
+      fprintf(stderr,
+              "%s is not a shard of the same scan as %s (targets, order, "
+              "seed or shard count differ)\n",
+              paths[i], paths[sharded]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Print the slices of a sharded scan that no file covered. Returns how
+// many there are, or -1 when that cannot be worked out.
+static int merge_missing_shards(const merge_scan_t *scans, int count) {
+  unsigned int shards = scans[0].shards;
+  if (shards <= 1)
+    return 0;
+
+  uint8_t *seen = calloc(shards, 1);
+  if (!seen) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
+  }
+  for (int i = 0; i < count; ++i)
+    seen[scans[i].shard] = 1;
+
+  int missing = 0;
+  for (unsigned int shard = 0; shard < shards; ++shard) {
+    if (seen[shard])
+      continue;
+    if (missing++)
+      fprintf(stderr, ", %u", shard + 1);
+    else
+      fprintf(stderr, "Incomplete sweep: no file for shard %u", shard + 1);
+  }
+  if (missing)
+    fprintf(stderr, " of %u\n", shards);
+  free(seen);
+  return missing;
+}
+
+// Combine the results of several scans, such as the shards of one, into a
+// single report in the given format: every responder once, in address
+// order, each /24 followed by its summary. Shards are disjoint, so a host
+// found twice means overlapping scans; its earliest answer is kept.
+// Shards of different scans are refused. When shards are missing the
+// report is still written but lists them on stderr and returns -1.
+// Returns -1 after printing a diagnostic.
+int merge_results(char *const *paths, int count, const target_set_t *targets,
+                  output_format_t format, FILE *console) {
+  merge_table_t table = {0};
+  merge_scan_t *scans = calloc((size_t)count, sizeof(*scans));
+
+  if (!scans) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
+  }
+  for (int i = 0; i < count; ++i) {
+    if (merge_read(paths[i], targets, &table, &scans[i], console) != 0) {
+      free(scans);
+      free(table.hosts);
+      return -1;
+    }
+  }
+  if (merge_check_scans(paths, scans, count) != 0) {
+    free(scans);
+    free(table.hosts);
+    return -1;
+  }
+  if (table.count > 0)
+    qsort(table.hosts, table.count, sizeof(table.hosts[0]), merge_compare);
+
+  // The merged stream is a whole scan of its own: the shards' common
+  // identity once they are all here, an unknown one otherwise
+  int missing = merge_missing_shards(scans, count);
+  output_record_t begin = {.kind = OUTPUT_BEGIN, .shard = 0, .shards = 1};
+  int same = missing == 0;
+  for (int i = 1; i < count && same; ++i)
+    same = merge_same_scan(&scans[i], &scans[0]);
+  if (same) {
+    begin.fingerprint = scans[0].fingerprint;
+    begin.seed = scans[0].seed;
+    begin.order = (uint8_t)scans[0].order;
+  }
+  free(scans);
+
+  rtt_histogram_t scan_rtt;
+  rtt_histogram_t subnet_rtt;
+  size_t responders = 0;
+  size_t duplicates = 0;
+  int subnets = 0;
+
+  histogram_reset(&scan_rtt);
+  merge_used = encode_header(format, 0, merge_buffer, OUTPUT_BUFFER_LEN);
+  merge_write(format, &begin, 0);
+  for (size_t i = 0; i < table.count;) {
+    uint32_t net = table.hosts[i].addr & MERGE_SUBNET_MASK;
+    int subnet_id = ++subnets;
+    uint32_t found = 0;
+    uint64_t last_ns = 0;
+
+    histogram_reset(&subnet_rtt);
+    for (; i < table.count &&
+           (table.hosts[i].addr & MERGE_SUBNET_MASK) == net;
+         ++i) {
+      const merge_host_t *host = &table.hosts[i];
+      if (i > 0 && host->addr == table.hosts[i - 1].addr) {
+        duplicates++;
+        continue;
+      }
+
+      merge_write(format,
+                  &(output_record_t){.kind = OUTPUT_HOST,
+                                     .subnet_id = subnet_id,
+                                     .addr = host->addr,
+                                     .rtt_us = host->rtt_us,
+                                     .ttl = host->ttl,
+                                     .via = host->via,
+                                     .has_detail = host->has_detail},
+                  host->unix_ns);
+      if (host->has_detail)
+        histogram_record(&subnet_rtt, host->rtt_us);
+      if (host->unix_ns > last_ns)
+        last_ns = host->unix_ns;
+      found++;
+    }
+
+    rtt_summary_t latency;
+    histogram_summarize(&subnet_rtt, &latency);
+    histogram_merge(&scan_rtt, &subnet_rtt);
+    merge_write(format,
+                &(output_record_t){.kind = OUTPUT_SUBNET,
+                                   .subnet_id = subnet_id,
+                                   .addr = net,
+                                   .count = found,
+                                   .p50_us = latency.p50_us,
+                                   .p90_us = latency.p90_us,
+                                   .p99_us = latency.p99_us,
+                                   .max_us = latency.max_us},
+                last_ns);
+    responders += found;
+  }
+  fwrite(merge_buffer, 1, merge_used, stdout);
+  fflush(stdout);
+  free(table.hosts);
+
+  fprintf(console, "Merged %d files: %zu responders in %d subnets", count,
+          responders, subnets);
+  if (duplicates)
+    fprintf(console, ", %zu duplicates dropped", duplicates);
+  fprintf(console, "\n");
+  merge_print_latency(console, &scan_rtt);
+  return missing == 0 ? 0 : -1;
+}
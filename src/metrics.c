@@ -0,0 +1,130 @@
+#include "metrics.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "clock.h"
+
+static const char *const phase_names[PHASE_COUNT] = {
+    [PHASE_TARGETS] = "targets",
+    [PHASE_SENDING] = "sending",
+    [PHASE_DRAINING] = "draining",
+    [PHASE_OUTPUT] = "output"};
+
+void metrics_reset(scan_metrics_t *metrics) {
+  memset(metrics, 0, sizeof(*metrics));
+}
+
+void metrics_engine_mark(const probe_engine_t *engines, int count,
+                         metrics_engine_mark_t *mark) {
+  memset(mark, 0, sizeof(*mark));
+  for (int i = 0; i < count; ++i) {
+    const probe_engine_t *engine = &engines[i];
+    mark->probes += atomic_load(&engine->sent);
+    mark->retransmits += atomic_load(&engine->retransmits);
+    mark->replies += atomic_load(&engine->replies);
+    mark->timeouts += atomic_load(&engine->timeouts);
+    mark->rate_stalls += atomic_load(&engine->bucket.stalls);
+  }
+}
+
+// Record what the engines did since mark was taken
+void metrics_engine_delta(scan_metrics_t *metrics,
+                          const probe_engine_t *engines, int count,
+                          const metrics_engine_mark_t *mark) {
+  metrics_engine_mark_t now;
+  metrics_engine_mark(engines, count, &now);
+
+  metrics->probes = now.probes - mark->probes;
+  metrics->retransmits = now.retransmits - mark->retransmits;
+  metrics->replies = now.replies - mark->replies;
+  metrics->timeouts = now.timeouts - mark->timeouts;
+  metrics->rate_stalls = now.rate_stalls - mark->rate_stalls;
+}
+
+uint64_t metrics_elapsed_ns(const scan_metrics_t *metrics) {
+  uint64_t total = 0;
+  for (int i = 0; i < PHASE_COUNT; ++i)
+    total += metrics->phase_ns[i];
+  return total;
+}
+
+// Hosts scanned per second of wall time, 0 when nothing was timed
+double metrics_host_rate(const scan_metrics_t *metrics) {
+  uint64_t elapsed = metrics_elapsed_ns(metrics);
+  if (elapsed == 0)
+    return 0.0;
+  return (double)metrics->hosts * (double)NS_PER_SEC / (double)elapsed;
+}
+
+// The baseline file holds one line: the single-worker hosts/second rate
+int metrics_load_baseline(const char *path, double *hosts_per_sec) {
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return -1;
+
+  int parsed = fscanf(file, "hosts_per_second %lf", hosts_per_sec);
+  fclose(file);
+  return parsed == 1 && *hosts_per_sec > 0.0 ? 0 : -1;
+}
+
+int metrics_save_baseline(const char *path, double hosts_per_sec) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    fprintf(stderr, "Cannot write baseline %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  fprintf(file, "hosts_per_second %.3f\n", hosts_per_sec);
+  return fclose(file) == 0 ? 0 : -1;
+}
+
+// Print a duration with a unit that keeps it readable
+static void print_duration(FILE *out, uint64_t ns) {
+  if (ns >= NS_PER_SEC)
+    fprintf(out, "%.3f s", (double)ns / (double)NS_PER_SEC);
+  else
+    fprintf(out, "%.3f ms", (double)ns / (double)NS_PER_MS);
+}
+
+static double per_second(uint64_t count, uint64_t elapsed_ns) {
+  return elapsed_ns ? (double)count * (double)NS_PER_SEC / (double)elapsed_ns
+                    : 0.0;
+}
+
+// Timing, throughput and speedup lines for one scan. A baseline_rate of 0
+// means no single-worker baseline has been recorded.
+void metrics_print(FILE *out, const scan_metrics_t *metrics,
+                   double baseline_rate) {
+  uint64_t elapsed = metrics_elapsed_ns(metrics);
+
+  fprintf(out, "Timing: ");
+  for (int i = 0; i < PHASE_COUNT; ++i) {
+    fprintf(out, "%s%s ", i ? ", " : "", phase_names[i]);
+    print_duration(out, metrics->phase_ns[i]);
+  }
+  fprintf(out, " (total ");
+  print_duration(out, elapsed);
+  fprintf(out, ")\n");
+
+  fprintf(out,
+          "Throughput: %.1f hosts/s, %.1f probes/s, %.1f replies/s "
+          "over %d workers\n",
+          per_second(metrics->hosts, elapsed),
+          per_second(metrics->probes + metrics->retransmits, elapsed),
+          per_second(metrics->replies, elapsed), metrics->workers);
+  fprintf(out,
+          "Probes: %llu sent, %llu retries, %llu replies, %llu timeouts, "
+          "%llu rate-limit stalls\n",
+          (unsigned long long)metrics->probes,
+          (unsigned long long)metrics->retransmits,
+          (unsigned long long)metrics->replies,
+          (unsigned long long)metrics->timeouts,
+          (unsigned long long)metrics->rate_stalls);
+
+  if (baseline_rate > 0.0)
+    fprintf(out, "Speedup: %.2fx over the single-worker baseline "
+                 "(%.1f hosts/s)\n",
+            metrics_host_rate(metrics) / baseline_rate, baseline_rate);
+}
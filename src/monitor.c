@@ -0,0 +1,74 @@
+#include "monitor.h"
+
+#include <stdatomic.h>
+
+// Take the hosts from the arena of the stream they are monitored over;
+// they go away with it
+int monitor_init(monitor_t *monitor, arena_t *arena, size_t count,
+                 int window) {
+  monitor->hosts = arena_alloc(arena, count * sizeof(monitor_host_t));
+  if (!monitor->hosts)
+    return -1;
+  monitor->count = count;
+  monitor->window = window;
+  atomic_store(&monitor->up, 0);
+  return 0;
+}
+
+void monitor_destroy(monitor_t *monitor) {
+  monitor->hosts = NULL;
+  monitor->count = 0;
+  atomic_store(&monitor->up, 0);
+}
+
+// Fold one reply into the smoothed RTT with the RFC 6298 gains of 1/8 for
+// the mean and 1/4 for the deviation
+static void monitor_rtt(monitor_host_t *host, uint32_t rtt_us) {
+  if (host->srtt_us == 0) {
+    host->srtt_us = rtt_us ? rtt_us : 1;
+    host->rttvar_us = rtt_us / 2;
+    return;
+  }
+
+  int64_t delta = (int64_t)rtt_us - host->srtt_us;
+  int64_t deviation = delta < 0 ? -delta : delta;
+  host->rttvar_us =
+      (uint32_t)((int64_t)host->rttvar_us +
+                 (deviation - (int64_t)host->rttvar_us) / 4);
+  host->srtt_us = (uint32_t)((int64_t)host->srtt_us + delta / 8);
+  if (host->srtt_us == 0)
+    host->srtt_us = 1;
+}
+
+// Record a host's result for this cycle; reply is NULL for a timeout. One
+// answer brings a host up, but it only goes down once every cycle of the
+// window has missed, so a single lost probe is not an outage. The first
+// cycle sets the baseline without reporting anything.
+state_change_t monitor_record(monitor_t *monitor, size_t index,
+                              const probe_reply_t *reply) {
+  if (index >= monitor->count)
+    return STATE_SAME;
+
+  monitor_host_t *host = &monitor->hosts[index];
+  uint32_t mask = monitor->window < 32 ? (1u << monitor->window) - 1
+                                       : UINT32_MAX;
+  int first = host->cycles == 0;
+
+  host->history = (host->history << 1 | (reply != NULL)) & mask;
+  if (host->cycles < monitor->window)
+    host->cycles++;
+  if (reply && reply->via != PROBE_VIA_NEIGH)
+    monitor_rtt(host, reply->rtt_us);
+
+  if (reply && !host->up) {
+    host->up = 1;
+    atomic_fetch_add(&monitor->up, 1);
+    return first ? STATE_SAME : STATE_CAME_UP;
+  }
+  if (!reply && host->up && host->history == 0) {
+    host->up = 0;
+    atomic_fetch_sub(&monitor->up, 1);
+    return STATE_WENT_DOWN;
+  }
+  return STATE_SAME;
+}
@@ -0,0 +1,581 @@
+#include "ndp.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+#include <netinet/icmp6.h>
+#include <poll.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "netlink.h"
+
+// Neighbour entries worth a unicast echo, and those the kernel confirmed
+// recently enough to report even if the host stays silent
+#define NDP_NUD_KNOWN                                                          \
+  (NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE | NUD_PERMANENT)
+#define NDP_NUD_ALIVE (NUD_REACHABLE | NUD_PERMANENT)
+
+// Echo header plus the sweep's cookie, which tells our replies from those
+// to anyone else's pings on a raw socket
+#define NDP_ECHO_LEN (sizeof(struct icmp6_hdr) + sizeof(uint64_t))
+#define NDP_PACKET_LEN 256
+
+// Every request of a sweep has its own 16-bit sequence number
+#define NDP_MAX_SENDS 65536
+
+// Target of a request sent to all-nodes rather than to one host
+#define NDP_MULTICAST SIZE_MAX
+
+#define NDP_NO_HOST SIZE_MAX
+
+// One echo request on the wire
+typedef struct {
+  uint64_t sent_ns;
+  size_t target; // host index, or NDP_MULTICAST
+} ndp_send_t;
+
+// Hosts in discovery order, with open addressing on the address over them
+typedef struct {
+  ndp_host_t *hosts;
+  size_t count;
+  size_t capacity;
+  uint32_t *index; // host + 1, 0 for a free slot
+  size_t index_size;
+} ndp_table_t;
+
+// Progress of one link's sweep
+typedef struct {
+  const ndp_link_t *link;
+  int fds[NDP_MAX_SOURCES]; // one bound to each source, -1 if unusable
+  int raw;
+  uint16_t ident; // raw sockets only
+  uint64_t cookie;
+  ndp_send_t *sends;
+  uint32_t next_seq;
+  ndp_table_t table;
+  ndp_stats_t *stats;
+} ndp_sweep_t;
+
+static const struct in6_addr ndp_all_nodes = {
+    .s6_addr = {0xff, 0x02, [15] = 0x01}};
+
+static size_t ndp_hash(const struct in6_addr *addr, size_t mask) {
+  uint64_t hi;
+  uint64_t lo;
+  memcpy(&hi, addr->s6_addr, sizeof(hi));
+  memcpy(&lo, addr->s6_addr + 8, sizeof(lo));
+  uint64_t h = (hi * 0x9e3779b97f4a7c15ull ^ lo) * 0xff51afd7ed558ccdull;
+  return (size_t)(h ^ h >> 32) & mask;
+}
+
+// Position of addr among the table's hosts, or NDP_NO_HOST
+static size_t ndp_table_find(const ndp_table_t *table,
+                             const struct in6_addr *addr) {
+  if (!table->index)
+    return NDP_NO_HOST;
+
+  size_t mask = table->index_size - 1;
+  for (size_t slot = ndp_hash(addr, mask); table->index[slot];
+       slot = (slot + 1) & mask) {
+    size_t i = table->index[slot] - 1;
+    if (memcmp(&table->hosts[i].addr, addr, sizeof(*addr)) == 0)
+      return i;
+  }
+  return NDP_NO_HOST;
+}
+
+static void ndp_table_link(ndp_table_t *table, size_t i) {
+  size_t mask = table->index_size - 1;
+  size_t slot = ndp_hash(&table->hosts[i].addr, mask);
+  while (table->index[slot])
+    slot = (slot + 1) & mask;
+  table->index[slot] = (uint32_t)(i + 1);
+}
+
+// Double the host array; the index stays at most half full
+static int ndp_table_grow(ndp_table_t *table) {
+  size_t capacity = table->capacity ? 2 * table->capacity : 256;
+  if (capacity > NDP_MAX_HOSTS)
+    return -1;
+
+  ndp_host_t *hosts = realloc(table->hosts, capacity * sizeof(ndp_host_t));
+  if (!hosts)
+    return -1;
+  table->hosts = hosts;
+
+  uint32_t *index = calloc(2 * capacity, sizeof(uint32_t));
+  if (!index)
+    return -1;
+  free(table->index);
+  table->index = index;
+  table->index_size = 2 * capacity;
+  table->capacity = capacity;
+  for (size_t i = 0; i < table->count; ++i)
+    ndp_table_link(table, i);
+  return 0;
+}
+
+// The host with this address, added if it is new; NULL once the table is
+// full. Adding may move every host.
+static ndp_host_t *ndp_table_add(ndp_table_t *table,
+                                 const struct in6_addr *addr) {
+  size_t i = ndp_table_find(table, addr);
+  if (i != NDP_NO_HOST)
+    return &table->hosts[i];
+  if (table->count == table->capacity && ndp_table_grow(table) != 0)
+    return NULL;
+
+  i = table->count++;
+  table->hosts[i] = (ndp_host_t){.addr = *addr};
+  ndp_table_link(table, i);
+  return &table->hosts[i];
+}
+
+static void ndp_table_free(ndp_table_t *table) {
+  free(table->hosts);
+  free(table->index);
+  *table = (ndp_table_t){0};
+}
+
+// Whether addr is one of our own on the link
+static int ndp_is_source(const ndp_link_t *link,
+                         const struct in6_addr *addr) {
+  for (int i = 0; i < link->source_count; ++i) {
+    if (IN6_ARE_ADDR_EQUAL(&link->sources[i], addr))
+      return 1;
+  }
+  return 0;
+}
+
+// Open one ICMPv6 socket bound to us, raw and filtered down to echo
+// replies, or the unprivileged datagram socket net.ipv4.ping_group_range
+// permits, whose echo identifier the kernel picks and checks. Ping sockets
+// ignore a source given per packet, so each of our addresses gets its own.
+static int ndp_open(ndp_sweep_t *sweep, const struct in6_addr *source) {
+  int on = 1;
+  int off = 0;
+  int hops = 1;
+  int ifindex = sweep->link->ifindex;
+  struct sockaddr_in6 local = {.sin6_family = AF_INET6,
+                               .sin6_addr = *source};
+  int fd = -1;
+
+  if (IN6_IS_ADDR_LINKLOCAL(source))
+    local.sin6_scope_id = (uint32_t)ifindex;
+
+  if (sweep->raw)
+    fd = socket(AF_INET6, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_ICMPV6);
+  if (fd >= 0) {
+    struct icmp6_filter filter;
+    ICMP6_FILTER_SETBLOCKALL(&filter);
+    ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+    setsockopt(fd, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter));
+  } else {
+    if (sweep->raw && errno != EPERM && errno != EACCES)
+      return -1;
+    sweep->raw = 0;
+    fd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_ICMPV6);
+    if (fd < 0)
+      return -1;
+  }
+
+  if (setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on, sizeof(on)) != 0 ||
+      setsockopt(fd, IPPROTO_IPV6, IPV6_RECVHOPLIMIT, &on, sizeof(on)) != 0 ||
+      setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &ifindex,
+                 sizeof(ifindex)) != 0 ||
+      setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &off,
+                 sizeof(off)) != 0 ||
+      setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops,
+                 sizeof(hops)) != 0 ||
+      bind(fd, (const struct sockaddr *)&local, sizeof(local)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// The socket a unicast echo to dst goes out of: one bound to an address
+// of the same scope when we have it
+static int ndp_fd_for(const ndp_sweep_t *sweep, const struct in6_addr *dst) {
+  int linklocal = IN6_IS_ADDR_LINKLOCAL(dst);
+  for (int i = 0; i < sweep->link->source_count; ++i) {
+    if (sweep->fds[i] >= 0 &&
+        IN6_IS_ADDR_LINKLOCAL(&sweep->link->sources[i]) == linklocal)
+      return sweep->fds[i];
+  }
+  for (int i = 0; i < sweep->link->source_count; ++i) {
+    if (sweep->fds[i] >= 0)
+      return sweep->fds[i];
+  }
+  return -1;
+}
+
+// Send one echo request out of the link on fd; link-local and multicast
+// destinations are scoped to the link, and the kernel fills in the
+// checksum
+static int ndp_send_echo(ndp_sweep_t *sweep, int fd,
+                         const struct in6_addr *dst, size_t target) {
+  if (fd < 0 || sweep->next_seq >= NDP_MAX_SENDS)
+    return -1;
+
+  uint16_t seq = (uint16_t)sweep->next_seq;
+  uint8_t packet[NDP_ECHO_LEN];
+  struct icmp6_hdr hdr = {.icmp6_type = ICMP6_ECHO_REQUEST};
+  hdr.icmp6_id = htons(sweep->ident);
+  hdr.icmp6_seq = htons(seq);
+  memcpy(packet, &hdr, sizeof(hdr));
+  memcpy(packet + sizeof(hdr), &sweep->cookie, sizeof(sweep->cookie));
+
+  struct sockaddr_in6 to = {.sin6_family = AF_INET6, .sin6_addr = *dst};
+  if (IN6_IS_ADDR_LINKLOCAL(dst) || IN6_IS_ADDR_MULTICAST(dst))
+    to.sin6_scope_id = (uint32_t)sweep->link->ifindex;
+
+  // Stamped first: a host on a veth answers before sendto returns
+  uint64_t sent_ns = monotonic_ns();
+  if (sendto(fd, packet, sizeof(packet), 0, (const struct sockaddr *)&to,
+             sizeof(to)) < 0)
+    return -1;
+  sweep->sends[seq] = (ndp_send_t){sent_ns, target};
+  sweep->next_seq++;
+  return 0;
+}
+
+// One echo reply: the first from each address marks its host answered,
+// with the RTT of the request it answered
+static void ndp_reply(ndp_sweep_t *sweep, const uint8_t *packet, size_t len,
+                      const struct sockaddr_in6 *from, struct msghdr *msg) {
+  struct icmp6_hdr hdr;
+  uint64_t cookie;
+  int ifindex = 0;
+  int hops = 0;
+
+  if (len < NDP_ECHO_LEN)
+    return;
+  memcpy(&hdr, packet, sizeof(hdr));
+  memcpy(&cookie, packet + sizeof(hdr), sizeof(cookie));
+  uint16_t seq = ntohs(hdr.icmp6_seq);
+  if (hdr.icmp6_type != ICMP6_ECHO_REPLY || cookie != sweep->cookie ||
+      (sweep->raw && ntohs(hdr.icmp6_id) != sweep->ident) ||
+      seq >= sweep->next_seq)
+    return;
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg;
+       cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level != IPPROTO_IPV6)
+      continue;
+    if (cmsg->cmsg_type == IPV6_PKTINFO) {
+      struct in6_pktinfo info;
+      memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+      ifindex = (int)info.ipi6_ifindex;
+    } else if (cmsg->cmsg_type == IPV6_HOPLIMIT) {
+      memcpy(&hops, CMSG_DATA(cmsg), sizeof(hops));
+    }
+  }
+  if (ifindex != sweep->link->ifindex ||
+      ndp_is_source(sweep->link, &from->sin6_addr))
+    return;
+
+  sweep->stats->replies++;
+  const ndp_send_t *request = &sweep->sends[seq];
+  ndp_host_t *host = ndp_table_add(&sweep->table, &from->sin6_addr);
+  if (!host || host->answered)
+    return;
+  host->answered = 1;
+  host->rtt_us = (uint32_t)((monotonic_ns() - request->sent_ns) / 1000);
+  host->hops = (uint8_t)hops;
+  host->via = request->target == NDP_MULTICAST ? PROBE_VIA_MCAST
+                                            : PROBE_VIA_ICMP;
+}
+
+// Read every reply already queued on fd
+static void ndp_drain_fd(ndp_sweep_t *sweep, int fd) {
+  for (;;) {
+    uint8_t packet[NDP_PACKET_LEN];
+    struct sockaddr_in6 from;
+    alignas(struct cmsghdr) char
+        control[CMSG_SPACE(sizeof(struct in6_pktinfo)) +
+                CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {.iov_base = packet, .iov_len = sizeof(packet)};
+    struct msghdr msg = {.msg_name = &from,
+                         .msg_namelen = sizeof(from),
+                         .msg_iov = &iov,
+                         .msg_iovlen = 1,
+                         .msg_control = control,
+                         .msg_controllen = sizeof(control)};
+
+    ssize_t len = recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    ndp_reply(sweep, packet, (size_t)len, &from, &msg);
+  }
+}
+
+static void ndp_drain(ndp_sweep_t *sweep) {
+  for (int i = 0; i < sweep->link->source_count; ++i) {
+    if (sweep->fds[i] >= 0)
+      ndp_drain_fd(sweep, sweep->fds[i]);
+  }
+}
+
+// Listen for wait_ms; all-nodes replies give no sign of being the last
+static void ndp_collect(ndp_sweep_t *sweep, int wait_ms) {
+  uint64_t deadline = monotonic_ns() + (uint64_t)wait_ms * NS_PER_MS;
+  struct pollfd pfds[NDP_MAX_SOURCES];
+  int count = sweep->link->source_count;
+
+  // Closed sockets are -1, which poll skips
+  for (int i = 0; i < count; ++i)
+    pfds[i] = (struct pollfd){.fd = sweep->fds[i], .events = POLLIN};
+
+  ndp_drain(sweep);
+  for (;;) {
+    uint64_t now = monotonic_ns();
+    if (now >= deadline)
+      break;
+    int left = (int)((deadline - now + NS_PER_MS - 1) / NS_PER_MS);
+    if (poll(pfds, (nfds_t)count, left) < 0 && errno != EINTR)
+      break;
+    ndp_drain(sweep);
+  }
+}
+
+// One neighbour entry: remember an address the kernel knows on this link,
+// and its link-layer address
+static void ndp_neighbor(const struct nlmsghdr *msg, void *ctx) {
+  ndp_sweep_t *sweep = ctx;
+  if (msg->nlmsg_type != RTM_NEWNEIGH)
+    return;
+
+  const struct ndmsg *ndm = NLMSG_DATA(msg);
+  if (ndm->ndm_family != AF_INET6 ||
+      ndm->ndm_ifindex != sweep->link->ifindex ||
+      !(ndm->ndm_state & NDP_NUD_KNOWN))
+    return;
+
+  unsigned int attr_len = (unsigned int)RTM_PAYLOAD(msg);
+  const struct rtattr *dst = NULL;
+  const struct rtattr *lladdr = NULL;
+  for (const struct rtattr *attr = RTM_RTA(ndm); RTA_OK(attr, attr_len);
+       attr = RTA_NEXT(attr, attr_len)) {
+    if (attr->rta_type == NDA_DST &&
+        RTA_PAYLOAD(attr) == sizeof(struct in6_addr))
+      dst = attr;
+    else if (attr->rta_type == NDA_LLADDR && RTA_PAYLOAD(attr) == 6)
+      lladdr = attr;
+  }
+  if (!dst)
+    return;
+
+  struct in6_addr addr;
+  memcpy(&addr, RTA_DATA(dst), sizeof(addr));
+  if (IN6_IS_ADDR_MULTICAST(&addr) || IN6_IS_ADDR_UNSPECIFIED(&addr) ||
+      ndp_is_source(sweep->link, &addr))
+    return;
+
+  ndp_host_t *host = ndp_table_add(&sweep->table, &addr);
+  if (!host)
+    return;
+  host->known = 1;
+  if (ndm->ndm_state & NDP_NUD_ALIVE)
+    host->alive = 1;
+  if (lladdr) {
+    memcpy(host->mac, RTA_DATA(lladdr), 6);
+    host->has_mac = 1;
+  }
+}
+
+static void ndp_read_neighbors(ndp_sweep_t *sweep) {
+  struct ndmsg request = {.ndm_family = AF_INET6};
+  netlink_dump(RTM_GETNEIGH, &request, sizeof(request), ndp_neighbor,
+               sweep);
+}
+
+// Links found so far, with the ones that turn out to be ports of a
+// bridge or bond marked
+typedef struct {
+  const ndp_link_t *links;
+  int count;
+  uint8_t port[NDP_MAX_LINKS];
+} ndp_link_scan_t;
+
+static void ndp_port(const struct nlmsghdr *msg, void *ctx) {
+  ndp_link_scan_t *scan = ctx;
+  if (msg->nlmsg_type != RTM_NEWLINK)
+    return;
+
+  const struct ifinfomsg *ifi = NLMSG_DATA(msg);
+  unsigned int attr_len = (unsigned int)IFLA_PAYLOAD(msg);
+  for (const struct rtattr *attr = IFLA_RTA(ifi); RTA_OK(attr, attr_len);
+       attr = RTA_NEXT(attr, attr_len)) {
+    if (attr->rta_type != IFLA_MASTER)
+      continue;
+    for (int i = 0; i < scan->count; ++i) {
+      if (scan->links[i].ifindex == ifi->ifi_index)
+        scan->port[i] = 1;
+    }
+  }
+}
+
+// Fill links with every interface that is up, does multicast and holds an
+// IPv6 address, skipping loopback and ports whose traffic their bridge or
+// bond receives; only device when one is given. Returns how many were
+// found, -1 after printing a diagnostic.
+int ndp_links(const char *device, ndp_link_t *links, int max) {
+  struct ifaddrs *list;
+  int count = 0;
+
+  if (getifaddrs(&list) != 0) {
+    fprintf(stderr, "Cannot list interfaces: %s\n", strerror(errno));
+    return -1;
+  }
+
+  for (struct ifaddrs *ifa = list; ifa; ifa = ifa->ifa_next) {
+    if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET6 ||
+        !(ifa->ifa_flags & IFF_UP) || !(ifa->ifa_flags & IFF_MULTICAST) ||
+        (ifa->ifa_flags & IFF_LOOPBACK) ||
+        (device && strcmp(ifa->ifa_name, device) != 0))
+      continue;
+
+    ndp_link_t *link = NULL;
+    for (int i = 0; i < count && !link; ++i) {
+      if (strcmp(links[i].name, ifa->ifa_name) == 0)
+        link = &links[i];
+    }
+    if (!link) {
+      if (count == max)
+        continue;
+      link = &links[count++];
+      memset(link, 0, sizeof(*link));
+      snprintf(link->name, sizeof(link->name), "%s", ifa->ifa_name);
+      link->ifindex = (int)if_nametoindex(ifa->ifa_name);
+    }
+    if (link->source_count == NDP_MAX_SOURCES)
+      continue;
+
+    struct in6_addr addr =
+        ((const struct sockaddr_in6 *)(const void *)ifa->ifa_addr)
+            ->sin6_addr;
+    link->sources[link->source_count++] = addr;
+    if (IN6_IS_ADDR_LINKLOCAL(&addr) && link->source_count > 1) {
+      link->sources[link->source_count - 1] = link->sources[0];
+      link->sources[0] = addr;
+    }
+  }
+
+  freeifaddrs(list);
+
+  ndp_link_scan_t scan = {.links = links, .count = count};
+  struct ifinfomsg request = {.ifi_family = AF_UNSPEC};
+  netlink_dump(RTM_GETLINK, &request, sizeof(request), ndp_port, &scan);
+  int kept = 0;
+  for (int i = 0; i < count; ++i) {
+    if (!scan.port[i])
+      links[kept++] = links[i];
+  }
+  return kept;
+}
+
+static void ndp_close(ndp_sweep_t *sweep) {
+  for (int i = 0; i < sweep->link->source_count; ++i) {
+    if (sweep->fds[i] >= 0)
+      close(sweep->fds[i]);
+    sweep->fds[i] = -1;
+  }
+}
+
+// Find the hosts of one link without walking its address space. Every
+// round sends an all-nodes echo from each of our addresses, so hosts
+// answer from their address of the same scope, then a unicast echo to
+// each neighbour entry that has not answered yet, all paced by bucket and
+// followed by wait_ms of listening. The neighbour table, read before and
+// after, supplies link-layer addresses and hosts the kernel confirmed
+// without our help. Each host gets one on_host call. Returns -1 if the
+// link could not be used.
+int ndp_sweep(const ndp_link_t *link, int wait_ms, int rounds,
+              token_bucket_t *bucket, ndp_host_fn on_host, void *ctx,
+              ndp_stats_t *stats) {
+  ndp_sweep_t sweep = {
+      .link = link,
+      .raw = 1,
+      .ident = (uint16_t)((unsigned int)getpid() & 0xffff),
+      .stats = stats};
+  int opened = 0;
+
+  for (int i = 0; i < link->source_count; ++i) {
+    sweep.fds[i] = ndp_open(&sweep, &link->sources[i]);
+    opened += sweep.fds[i] >= 0;
+  }
+  if (opened == 0) {
+    fprintf(stderr, "Cannot open ICMPv6 socket on %s: %s\n", link->name,
+            strerror(errno));
+    return -1;
+  }
+  sweep.sends = calloc(NDP_MAX_SENDS, sizeof(ndp_send_t));
+  if (!sweep.sends) {
+    ndp_close(&sweep);
+    return -1;
+  }
+  if (getrandom(&sweep.cookie, sizeof(sweep.cookie), 0) !=
+      sizeof(sweep.cookie))
+    sweep.cookie = monotonic_ns();
+
+  ndp_read_neighbors(&sweep);
+
+  for (int round = 0; round < rounds; ++round) {
+    for (int i = 0; i < link->source_count; ++i) {
+      if (sweep.fds[i] < 0)
+        continue;
+      if (bucket)
+        token_bucket_acquire(bucket);
+      if (ndp_send_echo(&sweep, sweep.fds[i], &ndp_all_nodes,
+                        NDP_MULTICAST) == 0)
+        stats->solicits++;
+    }
+
+    size_t known = sweep.table.count;
+    for (size_t i = 0; i < known; ++i) {
+      if (!sweep.table.hosts[i].known || sweep.table.hosts[i].answered)
+        continue;
+      struct in6_addr addr = sweep.table.hosts[i].addr;
+      if (bucket)
+        token_bucket_acquire(bucket);
+      if (ndp_send_echo(&sweep, ndp_fd_for(&sweep, &addr), &addr, i) == 0)
+        stats->echoes++;
+      ndp_drain(&sweep);
+    }
+    ndp_collect(&sweep, wait_ms);
+  }
+
+  // Answering us made most hosts resolve our address, which taught the
+  // kernel theirs
+  ndp_read_neighbors(&sweep);
+
+  for (size_t i = 0; i < sweep.table.count; ++i) {
+    ndp_host_t *host = &sweep.table.hosts[i];
+    if (!host->answered && !host->alive)
+      continue;
+    if (!host->answered) {
+      host->via = PROBE_VIA_NEIGH;
+      stats->neighbors++;
+    }
+    stats->hosts++;
+    on_host(ctx, link, host);
+  }
+
+  ndp_table_free(&sweep.table);
+  free(sweep.sends);
+  ndp_close(&sweep);
+  return 0;
+}
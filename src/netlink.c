@@ -0,0 +1,56 @@
+#include "netlink.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Run one rtnetlink dump request: header is the family header (ndmsg,
+// rtmsg, ...) that follows the netlink header. Returns -1 if the dump could
+// not be requested or ended in an error.
+int netlink_dump(uint16_t type, const void *header, size_t header_len,
+                 netlink_msg_fn on_msg, void *ctx) {
+  struct {
+    struct nlmsghdr hdr;
+    uint8_t body[NETLINK_REQUEST_MAX];
+  } request = {.hdr = {.nlmsg_len = (uint32_t)NLMSG_LENGTH(header_len),
+                       .nlmsg_type = type,
+                       .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+                       .nlmsg_seq = 1}};
+  static _Thread_local uint8_t buf[NETLINK_BUF_LEN];
+  int status = -1;
+
+  if (header_len > sizeof(request.body))
+    return -1;
+  memcpy(request.body, header, header_len);
+
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0)
+    return -1;
+  if (send(fd, &request, request.hdr.nlmsg_len, 0) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  for (int finished = 0; !finished;) {
+    ssize_t len = recv(fd, buf, sizeof(buf), 0);
+    if (len <= 0)
+      break;
+
+    for (const struct nlmsghdr *msg = (const struct nlmsghdr *)(void *)buf;
+         NLMSG_OK(msg, (size_t)len); msg = NLMSG_NEXT(msg, len)) {
+      if (msg->nlmsg_type == NLMSG_DONE) {
+        status = 0;
+        finished = 1;
+        break;
+      }
+      if (msg->nlmsg_type == NLMSG_ERROR) {
+        finished = 1;
+        break;
+      }
+      on_msg(msg, ctx);
+    }
+  }
+
+  close(fd);
+  return status;
+}
@@ -0,0 +1,336 @@
+#include "output.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "encode.h"
+
+// Everything the writer owns. Rings are only ever added while running,
+// under registry_mutex, and freed by output_stop(). The writer outlives
+// every scan of a run, so its rings and pending records come from the
+// allocator once per producing thread rather than from a scan's arena.
+static struct {
+  pthread_t writer;
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  pthread_cond_t flushed;
+  uint64_t flush_requested;
+  uint64_t flush_completed;
+  int running;
+  uint64_t flush_ns;
+  output_format_t format;
+  uint64_t realtime_offset_ns; // wall clock minus monotonic clock
+
+  pthread_mutex_t registry_mutex;
+  output_ring_t *_Atomic rings;
+  unsigned int generation;
+
+  char buffer[OUTPUT_BUFFER_LEN];
+  size_t used;
+
+  // Enrichment stage, with --rdns only: records drained from the rings
+  // wait here, in order, until the resolver has their names
+  rdns_t *resolver;
+  output_record_t *pending;
+  uint64_t pending_head;
+  uint64_t pending_tail;
+} output;
+
+// The calling thread's ring, valid while its generation matches
+static _Thread_local output_ring_t *local_ring = NULL;
+static _Thread_local unsigned int local_generation = 0;
+
+static output_ring_t *output_local_ring(void) {
+  if (local_ring && local_generation == output.generation)
+    return local_ring;
+
+  output_ring_t *ring = aligned_alloc(64, sizeof(*ring));
+  if (!ring)
+    return NULL;
+  atomic_store(&ring->head, 0);
+  atomic_store(&ring->tail, 0);
+
+  pthread_mutex_lock(&output.registry_mutex);
+  ring->next = atomic_load(&output.rings);
+  atomic_store(&output.rings, ring);
+  pthread_mutex_unlock(&output.registry_mutex);
+
+  local_ring = ring;
+  local_generation = output.generation;
+  return ring;
+}
+
+static void output_write_buffer(void) {
+  if (output.used > 0) {
+    fwrite(output.buffer, 1, output.used, stdout);
+    output.used = 0;
+  }
+}
+
+static void output_encode(const output_record_t *record) {
+  if (output.used + ENCODE_RECORD_MAX > OUTPUT_BUFFER_LEN)
+    output_write_buffer();
+  output.used += encode_record(
+      output.format, record, record->timestamp_ns + output.realtime_offset_ns,
+      output.buffer + output.used, OUTPUT_BUFFER_LEN - output.used);
+}
+
+// Only records about one host carry its name
+static int output_wants_name(const output_record_t *record) {
+  return record->kind == OUTPUT_HOST || record->kind == OUTPUT_CHANGE;
+}
+
+// Take a record into the enrichment stage and start its lookup. Returns 0
+// when the stage is full.
+static int output_hold(const output_record_t *record) {
+  const char *name;
+
+  if (output.pending_tail - output.pending_head == OUTPUT_PENDING_SIZE)
+    return 0;
+  output.pending[output.pending_tail++ & OUTPUT_PENDING_MASK] = *record;
+  if (output_wants_name(record))
+    rdns_lookup(output.resolver, record->addr, &name);
+  return 1;
+}
+
+// Encode held records from the oldest until one is still waiting for its
+// name, so the output keeps the order it was produced in
+static void output_release(void) {
+  while (output.pending_head != output.pending_tail) {
+    output_record_t *record =
+        &output.pending[output.pending_head & OUTPUT_PENDING_MASK];
+    if (output_wants_name(record)) {
+      const char *name;
+      if (!rdns_result(output.resolver, record->addr, &name))
+        break;
+      record->hostname = name ? name : "";
+    }
+    output_encode(record);
+    output.pending_head++;
+  }
+}
+
+static int output_holding(void) {
+  return output.pending_head != output.pending_tail;
+}
+
+// Drain every ring once. Rings are individually ordered; across rings the
+// oldest pending record goes first so a subnet's banner precedes its hosts
+// and its summary follows them. With a resolver, records pass through the
+// enrichment stage instead of being encoded at once.
+static void output_drain(void) {
+  for (;;) {
+    output_ring_t *oldest = NULL;
+    uint64_t oldest_ns = UINT64_MAX;
+
+    for (output_ring_t *ring = atomic_load(&output.rings); ring;
+         ring = ring->next) {
+      uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+      if (head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+        continue;
+      uint64_t ns = ring->records[head & OUTPUT_RING_MASK].timestamp_ns;
+      if (ns < oldest_ns) {
+        oldest_ns = ns;
+        oldest = ring;
+      }
+    }
+
+    if (!oldest)
+      break;
+
+    uint64_t head = atomic_load_explicit(&oldest->head, memory_order_relaxed);
+    const output_record_t *record = &oldest->records[head & OUTPUT_RING_MASK];
+    if (!output.resolver)
+      output_encode(record);
+    else if (!output_hold(record))
+      break;
+    atomic_store_explicit(&oldest->head, head + 1, memory_order_release);
+  }
+
+  if (output.resolver) {
+    rdns_poll(output.resolver, 0);
+    output_release();
+  }
+
+  output_write_buffer();
+  fflush(stdout);
+}
+
+// Writer thread: wake every flush interval, or sooner when a producer's
+// ring is full or a caller asks for a flush. While records wait for names
+// it waits on the resolver instead, and a flush or stop is only complete
+// once they are written.
+static void *output_writer(void *arg) {
+  (void)arg;
+
+  pthread_mutex_lock(&output.mutex);
+  for (;;) {
+    uint64_t requested = output.flush_requested;
+    int running = output.running;
+    pthread_mutex_unlock(&output.mutex);
+
+    output_drain();
+    int holding = output_holding();
+
+    pthread_mutex_lock(&output.mutex);
+    if (requested > output.flush_completed && !holding) {
+      output.flush_completed = requested;
+      pthread_cond_broadcast(&output.flushed);
+    }
+    if (!running && !holding)
+      break;
+    if (holding) {
+      pthread_mutex_unlock(&output.mutex);
+      rdns_poll(output.resolver, OUTPUT_RDNS_WAIT_MS);
+      pthread_mutex_lock(&output.mutex);
+    } else if (output.flush_requested == requested && output.running) {
+      uint64_t deadline = monotonic_ns() + output.flush_ns;
+      struct timespec until = {.tv_sec = (time_t)(deadline / NS_PER_SEC),
+                               .tv_nsec = (long)(deadline % NS_PER_SEC)};
+      pthread_cond_timedwait(&output.wake, &output.mutex, &until);
+    }
+  }
+  pthread_mutex_unlock(&output.mutex);
+
+  return NULL;
+}
+
+// Start the writer thread; stdout is written in flush_ms intervals using
+// the given encoding. A resolver, if given, is driven by the writer alone
+// until output_stop, and names every host in the output.
+int output_start(int flush_ms, output_format_t format, rdns_t *resolver) {
+  pthread_condattr_t attr;
+  struct timespec wall;
+
+  if (flush_ms < 1)
+    flush_ms = 1;
+  output.flush_ns = (unsigned long long)flush_ms * NS_PER_MS;
+  output.flush_requested = 0;
+  output.flush_completed = 0;
+  output.format = format;
+  clock_gettime(CLOCK_REALTIME, &wall);
+  output.realtime_offset_ns =
+      (uint64_t)wall.tv_sec * NS_PER_SEC + (uint64_t)wall.tv_nsec -
+      monotonic_ns();
+  output.used = encode_header(format, resolver != NULL, output.buffer,
+                              OUTPUT_BUFFER_LEN);
+  output.resolver = resolver;
+  output.pending_head = 0;
+  output.pending_tail = 0;
+  output.pending = NULL;
+  if (resolver) {
+    output.pending = malloc(OUTPUT_PENDING_SIZE * sizeof(output_record_t));
+    if (!output.pending)
+      return -1;
+  }
+  output.running = 1;
+  output.generation++;
+  atomic_store(&output.rings, NULL);
+
+  if (pthread_condattr_init(&attr) != 0) {
+    free(output.pending);
+    output.pending = NULL;
+    return -1;
+  }
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+  if (pthread_mutex_init(&output.mutex, NULL) != 0)
+    goto fail_attr;
+  if (pthread_mutex_init(&output.registry_mutex, NULL) != 0)
+    goto fail_mutex;
+  if (pthread_cond_init(&output.wake, &attr) != 0)
+    goto fail_registry;
+  if (pthread_cond_init(&output.flushed, NULL) != 0)
+    goto fail_wake;
+  if (pthread_create(&output.writer, NULL, output_writer, NULL) != 0)
+    goto fail_flushed;
+
+  pthread_condattr_destroy(&attr);
+  return 0;
+
+fail_flushed:
+  pthread_cond_destroy(&output.flushed);
+fail_wake:
+  pthread_cond_destroy(&output.wake);
+fail_registry:
+  pthread_mutex_destroy(&output.registry_mutex);
+fail_mutex:
+  pthread_mutex_destroy(&output.mutex);
+fail_attr:
+  pthread_condattr_destroy(&attr);
+  free(output.pending);
+  output.pending = NULL;
+  output.running = 0;
+  return -1;
+}
+
+// Drain what is left, stop the writer and free every ring
+void output_stop(void) {
+  pthread_mutex_lock(&output.mutex);
+  if (!output.running) {
+    pthread_mutex_unlock(&output.mutex);
+    return;
+  }
+  output.running = 0;
+  pthread_cond_signal(&output.wake);
+  pthread_mutex_unlock(&output.mutex);
+
+  pthread_join(output.writer, NULL);
+
+  output_ring_t *ring = atomic_load(&output.rings);
+  while (ring) {
+    output_ring_t *next = ring->next;
+    free(ring);
+    ring = next;
+  }
+  atomic_store(&output.rings, NULL);
+  free(output.pending);
+  output.pending = NULL;
+  output.resolver = NULL;
+
+  pthread_cond_destroy(&output.flushed);
+  pthread_cond_destroy(&output.wake);
+  pthread_mutex_destroy(&output.registry_mutex);
+  pthread_mutex_destroy(&output.mutex);
+}
+
+// Queue one record on the calling thread's ring. Never takes a lock on the
+// fast path; a full ring wakes the writer and waits for space.
+void output_emit(const output_record_t *record) {
+  output_ring_t *ring = output_local_ring();
+  if (!ring)
+    return;
+
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) >=
+         OUTPUT_RING_SIZE) {
+    pthread_mutex_lock(&output.mutex);
+    pthread_cond_signal(&output.wake);
+    pthread_mutex_unlock(&output.mutex);
+    sched_yield();
+  }
+
+  output_record_t *slot = &ring->records[tail & OUTPUT_RING_MASK];
+  *slot = *record;
+  slot->timestamp_ns = monotonic_ns();
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// Block until everything emitted before this call has reached stdout
+void output_flush(void) {
+  pthread_mutex_lock(&output.mutex);
+  if (!output.running) {
+    pthread_mutex_unlock(&output.mutex);
+    return;
+  }
+  uint64_t ticket = ++output.flush_requested;
+  pthread_cond_signal(&output.wake);
+  while (output.flush_completed < ticket)
+    pthread_cond_wait(&output.flushed, &output.mutex);
+  pthread_mutex_unlock(&output.mutex);
+}
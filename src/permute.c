@@ -0,0 +1,115 @@
+#include "permute.h"
+
+#include <stddef.h>
+
+// Distinct prime factors of p - 1 for p below 2^33: at most ten
+#define PERMUTE_MAX_FACTORS 16
+
+// a * b mod m for operands below 2^33, in 16-bit halves of b
+static uint64_t mulmod(uint64_t a, uint64_t b, uint64_t m) {
+  uint64_t high = a * (b >> 16) % m;
+  return ((high << 16) + a * (b & 0xffff)) % m;
+}
+
+static uint64_t powmod(uint64_t base, uint64_t exp, uint64_t m) {
+  uint64_t result = 1 % m;
+  for (base %= m; exp; exp >>= 1) {
+    if (exp & 1)
+      result = mulmod(result, base, m);
+    base = mulmod(base, base, m);
+  }
+  return result;
+}
+
+// Trial division by 6k +/- 1; below 2^33 that is at most ~15,000 steps
+static int is_prime(uint64_t n) {
+  if (n < 4)
+    return n >= 2;
+  if (n % 2 == 0 || n % 3 == 0)
+    return 0;
+  for (uint64_t d = 5; d * d <= n; d += 6) {
+    if (n % d == 0 || n % (d + 2) == 0)
+      return 0;
+  }
+  return 1;
+}
+
+static size_t prime_factors(uint64_t n, uint64_t *factors) {
+  size_t count = 0;
+  for (uint64_t d = 2; d * d <= n; d += d == 2 ? 1 : 2) {
+    if (n % d != 0)
+      continue;
+    factors[count++] = d;
+    while (n % d == 0)
+      n /= d;
+  }
+  if (n > 1)
+    factors[count++] = n;
+  return count;
+}
+
+// SplitMix64: turns the seed into the generator and starting point
+static uint64_t splitmix(uint64_t *state) {
+  uint64_t z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+  z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+// g generates (Z/pZ)* when no g^((p-1)/q) is 1 for a prime factor q
+static int is_generator(uint64_t g, uint64_t p, const uint64_t *factors,
+                        size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (powmod(g, (p - 1) / factors[i], p) == 1)
+      return 0;
+  }
+  return 1;
+}
+
+// Random order over [0, size), fixed by the seed. Returns -1 when size is
+// beyond PERMUTE_MAX_SIZE.
+int permute_init(permute_t *perm, uint64_t size, uint64_t seed) {
+  if (size > PERMUTE_MAX_SIZE)
+    return -1;
+
+  uint64_t p = size + 1;
+  while (!is_prime(p))
+    p++;
+
+  uint64_t factors[PERMUTE_MAX_FACTORS];
+  size_t count = prime_factors(p - 1, factors);
+
+  uint64_t rng = seed;
+  uint64_t g = 1;
+  if (p > 3) {
+    do
+      g = 2 + splitmix(&rng) % (p - 3);
+    while (!is_generator(g, p, factors, count));
+  } else if (p == 3) {
+    g = 2;
+  }
+
+  *perm = (permute_t){.size = size,
+                      .seed = seed,
+                      .prime = p,
+                      .generator = g,
+                      .start = 1 + splitmix(&rng) % (p - 1)};
+  return 0;
+}
+
+void permute_sequential(permute_t *perm, uint64_t size) {
+  *perm = (permute_t){.size = size};
+}
+
+// Positions a full walk takes, skipped values included
+uint64_t permute_positions(const permute_t *perm) {
+  return perm->prime ? perm->prime - 1 : perm->size;
+}
+
+// Walk value at a position, to continue from with permute_step
+uint64_t permute_seek(const permute_t *perm, uint64_t position) {
+  if (!perm->prime)
+    return position;
+  return mulmod(perm->start, powmod(perm->generator, position, perm->prime),
+                perm->prime);
+}
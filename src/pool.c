@@ -0,0 +1,304 @@
+#include "pool.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "cpus.h"
+
+// Identity of the pool worker running on this thread, if any
+static _Thread_local const thread_pool_t *current_pool = NULL;
+static _Thread_local int current_worker = -1;
+
+typedef struct {
+  thread_pool_t *pool;
+  int index;
+} pool_worker_arg_t;
+
+static int deque_init(pool_deque_t *deque) {
+  deque->tasks = malloc(POOL_DEQUE_INITIAL * sizeof(pool_task_t));
+  if (!deque->tasks)
+    return -1;
+
+  deque->capacity = POOL_DEQUE_INITIAL;
+  deque->head = 0;
+  deque->count = 0;
+
+  if (pthread_mutex_init(&deque->lock, NULL) != 0) {
+    free(deque->tasks);
+    return -1;
+  }
+  return 0;
+}
+
+static void deque_destroy(pool_deque_t *deque) {
+  pthread_mutex_destroy(&deque->lock);
+  free(deque->tasks);
+  deque->tasks = NULL;
+}
+
+static int deque_push(pool_deque_t *deque, pool_task_t task) {
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->count == deque->capacity) {
+    size_t capacity = deque->capacity * 2;
+    pool_task_t *tasks = malloc(capacity * sizeof(pool_task_t));
+    if (!tasks) {
+      pthread_mutex_unlock(&deque->lock);
+      return -1;
+    }
+    // Unwrap the ring into the new buffer
+    for (size_t i = 0; i < deque->count; ++i)
+      tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->capacity = capacity;
+    deque->head = 0;
+  }
+
+  deque->tasks[(deque->head + deque->count) % deque->capacity] = task;
+  deque->count++;
+
+  pthread_mutex_unlock(&deque->lock);
+  return 0;
+}
+
+// Owner end: most recently pushed task first, for cache locality
+static int deque_pop(pool_deque_t *deque, pool_task_t *task) {
+  int found = 0;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count > 0) {
+    deque->count--;
+    *task = deque->tasks[(deque->head + deque->count) % deque->capacity];
+    found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+
+  return found;
+}
+
+// Thief end: oldest task first
+static int deque_steal(pool_deque_t *deque, pool_task_t *task) {
+  int found = 0;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count > 0) {
+    *task = deque->tasks[deque->head];
+    deque->head = (deque->head + 1) % deque->capacity;
+    deque->count--;
+    found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+
+  return found;
+}
+
+// Take from our own deque first, then scan the others
+static int pool_take(thread_pool_t *pool, int self, pool_task_t *task) {
+  int found = deque_pop(&pool->deques[self], task);
+
+  for (int i = 1; !found && i < pool->thread_count; ++i) {
+    int victim = (self + i) % pool->thread_count;
+    found = deque_steal(&pool->deques[victim], task);
+  }
+
+  if (found)
+    atomic_fetch_sub(&pool->queued, 1);
+  return found;
+}
+
+// Park an idle worker until a task is queued or the pool shuts down.
+// Returns 0 once the pool is shut down and drained. The sleeper count is
+// raised before queued is checked, and submitters count a task before
+// they look for sleepers, so one side always sees the other.
+static int pool_sleep(thread_pool_t *pool) {
+  int running = 1;
+
+  pthread_mutex_lock(&pool->mutex);
+  atomic_fetch_add(&pool->sleeping, 1);
+  while (atomic_load(&pool->queued) == 0 && !pool->shutdown)
+    pthread_cond_wait(&pool->condition, &pool->mutex);
+  atomic_fetch_sub(&pool->sleeping, 1);
+  if (atomic_load(&pool->queued) == 0 && pool->shutdown)
+    running = 0;
+  pthread_mutex_unlock(&pool->mutex);
+
+  return running;
+}
+
+static void *pool_worker(void *arg) {
+  pool_worker_arg_t *worker = arg;
+  thread_pool_t *pool = worker->pool;
+  int self = worker->index;
+  free(worker);
+
+  current_pool = pool;
+  current_worker = self;
+
+  for (;;) {
+    // Only the deques are touched while there is work; the pool mutex is
+    // taken once a full pass over them comes up empty
+    pool_task_t task;
+    if (!pool_take(pool, self, &task)) {
+      if (!pool_sleep(pool))
+        break;
+      continue;
+    }
+
+    task.fn(task.arg);
+
+    if (atomic_fetch_sub(&pool->outstanding, 1) == 1) {
+      pthread_mutex_lock(&pool->mutex);
+      pthread_cond_broadcast(&pool->idle);
+      pthread_mutex_unlock(&pool->mutex);
+    }
+  }
+
+  return NULL;
+}
+
+// Initialize thread pool and start its persistent workers
+int init_thread_pool(thread_pool_t *pool, int max_threads) {
+  int deques = 0;
+
+  if (max_threads < 1)
+    max_threads = 1;
+
+  pool->threads = malloc((size_t)max_threads * sizeof(pthread_t));
+  pool->deques = calloc((size_t)max_threads, sizeof(pool_deque_t));
+  if (!pool->threads || !pool->deques)
+    goto fail_alloc;
+
+  pool->thread_count = max_threads;
+  pool->active_threads = 0;
+  pool->shutdown = 0;
+  atomic_store(&pool->queued, 0);
+  atomic_store(&pool->sleeping, 0);
+  atomic_store(&pool->outstanding, 0);
+  atomic_store(&pool->next_deque, 0);
+
+  if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+    goto fail_alloc;
+  if (pthread_cond_init(&pool->condition, NULL) != 0)
+    goto fail_mutex;
+  if (pthread_cond_init(&pool->idle, NULL) != 0)
+    goto fail_condition;
+
+  for (; deques < max_threads; ++deques) {
+    if (deque_init(&pool->deques[deques]) != 0)
+      goto fail_deques;
+  }
+
+  for (; pool->active_threads < max_threads; ++pool->active_threads) {
+    pool_worker_arg_t *worker = malloc(sizeof(*worker));
+    if (!worker)
+      goto fail_threads;
+    worker->pool = pool;
+    worker->index = pool->active_threads;
+
+    if (pthread_create(&pool->threads[pool->active_threads], NULL, pool_worker,
+                       worker) != 0) {
+      free(worker);
+      goto fail_threads;
+    }
+  }
+
+  return 0;
+
+fail_threads:
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->condition);
+  pthread_mutex_unlock(&pool->mutex);
+  for (int i = 0; i < pool->active_threads; ++i)
+    pthread_join(pool->threads[i], NULL);
+fail_deques:
+  while (deques-- > 0)
+    deque_destroy(&pool->deques[deques]);
+  pthread_cond_destroy(&pool->idle);
+fail_condition:
+  pthread_cond_destroy(&pool->condition);
+fail_mutex:
+  pthread_mutex_destroy(&pool->mutex);
+fail_alloc:
+  free(pool->threads);
+  free(pool->deques);
+  pool->threads = NULL;
+  pool->deques = NULL;
+  return -1;
+}
+
+// Drain outstanding work, stop the workers and release the pool
+void cleanup_thread_pool(thread_pool_t *pool) {
+  if (!pool->threads)
+    return;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->condition);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (int i = 0; i < pool->active_threads; ++i)
+    pthread_join(pool->threads[i], NULL);
+
+  for (int i = 0; i < pool->thread_count; ++i)
+    deque_destroy(&pool->deques[i]);
+
+  free(pool->threads);
+  free(pool->deques);
+  pool->threads = NULL;
+  pool->deques = NULL;
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->condition);
+  pthread_cond_destroy(&pool->idle);
+}
+
+// Queue a task. Workers push onto their own deque; other threads spread
+// submissions round-robin so idle workers have something to steal.
+int thread_pool_submit(thread_pool_t *pool, pool_task_fn fn, void *arg) {
+  int target = thread_pool_worker_id(pool);
+  if (target < 0)
+    target = (int)(atomic_fetch_add(&pool->next_deque, 1) %
+                   (unsigned int)pool->thread_count);
+
+  // Push first and count after, so a counted task is always on a deque;
+  // the mutex is only taken when some worker is asleep
+  atomic_fetch_add(&pool->outstanding, 1);
+  if (deque_push(&pool->deques[target], (pool_task_t){fn, arg}) != 0) {
+    atomic_fetch_sub(&pool->outstanding, 1);
+    return -1;
+  }
+
+  atomic_fetch_add(&pool->queued, 1);
+  if (atomic_load(&pool->sleeping) > 0) {
+    pthread_mutex_lock(&pool->mutex);
+    pthread_cond_signal(&pool->condition);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+
+  return 0;
+}
+
+// Block until every submitted task has finished running
+void thread_pool_wait(thread_pool_t *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  while (atomic_load(&pool->outstanding) > 0)
+    pthread_cond_wait(&pool->idle, &pool->mutex);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+// Index of the calling worker within pool, or -1 for outside threads
+int thread_pool_worker_id(const thread_pool_t *pool) {
+  return current_pool == pool ? current_worker : -1;
+}
+
+// Pin worker i to cpus[i % count], so workers sharing a CPU are spread
+// evenly across the list. Returns -1 with errno set.
+int thread_pool_pin(thread_pool_t *pool, const int *cpus, int count) {
+  for (int i = 0; i < pool->active_threads; ++i) {
+    if (cpus_pin(pool->threads[i], cpus[i % count]) != 0)
+      return -1;
+  }
+  return 0;
+}
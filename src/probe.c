@@ -0,0 +1,688 @@
+#include "probe.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "clock.h"
+#include "cpus.h"
+
+// Sequence numbers carry the slot index in the low bits and a per-slot
+// generation in the rest, so late replies for a recycled slot are rejected
+#define PROBE_SLOT_BITS 14
+#define PROBE_GENERATIONS (1u << (16 - PROBE_SLOT_BITS))
+
+// The AIMD controller starts at this fraction of max_inflight and grows
+#define PROBE_INITIAL_WINDOW_DIV 4
+
+static const probe_backend_t *const probe_backends[] = {
+    &probe_backend_icmp, &probe_backend_icmp_uring, &probe_backend_tcp_connect,
+    &probe_backend_tcp_syn};
+
+static uint64_t monotonic_tick(void) {
+  return monotonic_ns() / (PROBE_WHEEL_TICK_MS * NS_PER_MS);
+}
+
+// Deliver one target's result and wake the job's waiter on the last one
+static void probe_job_complete(probe_job_t *job, size_t index,
+                               const probe_reply_t *reply) {
+  job->on_result(job, index, reply);
+
+  if (atomic_fetch_sub(&job->remaining, 1) == 1) {
+    pthread_mutex_lock(&job->mutex);
+    pthread_cond_broadcast(&job->done);
+    pthread_mutex_unlock(&job->mutex);
+  }
+}
+
+// Take a pending probe out of flight exactly once. Returns 0 when another
+// thread already resolved it.
+static int probe_claim(probe_engine_t *engine, probe_slot_t *slot) {
+  int expected = PROBE_SLOT_PENDING;
+  if (!atomic_compare_exchange_strong(&slot->state, &expected,
+                                      PROBE_SLOT_RESOLVED))
+    return 0;
+
+  if (engine->backend->release)
+    engine->backend->release(engine, (uint32_t)(slot - engine->slots));
+  return 1;
+}
+
+static void probe_wheel_link(probe_engine_t *engine, uint32_t idx,
+                             uint32_t bucket) {
+  probe_slot_t *slot = &engine->slots[idx];
+  slot->wheel_bucket = bucket;
+  slot->wheel_prev = PROBE_NO_SLOT;
+  slot->wheel_next = engine->wheel[bucket];
+  if (slot->wheel_next != PROBE_NO_SLOT)
+    engine->slots[slot->wheel_next].wheel_prev = idx;
+  engine->wheel[bucket] = idx;
+}
+
+static void probe_wheel_unlink(probe_engine_t *engine, uint32_t idx) {
+  probe_slot_t *slot = &engine->slots[idx];
+  if (slot->wheel_prev != PROBE_NO_SLOT)
+    engine->slots[slot->wheel_prev].wheel_next = slot->wheel_next;
+  else
+    engine->wheel[slot->wheel_bucket] = slot->wheel_next;
+  if (slot->wheel_next != PROBE_NO_SLOT)
+    engine->slots[slot->wheel_next].wheel_prev = slot->wheel_prev;
+  slot->wheel_bucket = PROBE_NO_SLOT;
+}
+
+// Return a claimed slot to the back of the free list, so a recycled
+// sequence number is as old as the table allows, and wake a sender that
+// may be waiting for it. Caller holds wheel_mutex.
+static void probe_free_slot(probe_engine_t *engine, uint32_t idx) {
+  probe_slot_t *slot = &engine->slots[idx];
+  if (slot->wheel_bucket != PROBE_NO_SLOT)
+    probe_wheel_unlink(engine, idx);
+
+  atomic_store(&slot->state, PROBE_SLOT_FREE);
+  slot->free_next = PROBE_NO_SLOT;
+  if (engine->free_tail != PROBE_NO_SLOT)
+    engine->slots[engine->free_tail].free_next = idx;
+  else
+    engine->free_head = idx;
+  engine->free_tail = idx;
+
+  atomic_fetch_sub(&engine->inflight, 1);
+  if (engine->window_waiters > 0)
+    pthread_cond_signal(&engine->slot_freed);
+}
+
+// Time out one in-flight probe exactly once and free its slot straight
+// away. Its result is only queued on the expired list: the receiver
+// delivers it once wheel_mutex is dropped, so a slow result callback never
+// holds up senders. Caller holds wheel_mutex.
+static void probe_timeout_locked(probe_engine_t *engine, probe_slot_t *slot) {
+  if (!probe_claim(engine, slot))
+    return;
+
+  engine->expired[engine->expired_count++] =
+      (probe_expired_t){.job = slot->job, .index = slot->index};
+  atomic_fetch_add(&engine->timeouts, 1);
+  probe_free_slot(engine, (uint32_t)(slot - engine->slots));
+}
+
+// Resolve one in-flight probe exactly once, from a thread that does not
+// hold wheel_mutex; the result is delivered after the lock is dropped
+static void probe_resolve(probe_engine_t *engine, probe_slot_t *slot,
+                          const probe_reply_t *reply) {
+  if (!probe_claim(engine, slot))
+    return;
+
+  probe_job_t *job = slot->job;
+  size_t index = slot->index;
+  atomic_fetch_add(reply ? &engine->replies : &engine->timeouts, 1);
+
+  pthread_mutex_lock(&engine->wheel_mutex);
+  probe_free_slot(engine, (uint32_t)(slot - engine->slots));
+  pthread_mutex_unlock(&engine->wheel_mutex);
+
+  probe_job_complete(job, index, reply);
+}
+
+// Set a slot's wheel deadline delay_ns after from_ns, rounded up to the
+// next tick, and return the wheel bucket it belongs in
+static uint32_t probe_arm(probe_slot_t *slot, uint64_t from_ns,
+                          uint64_t delay_ns) {
+  uint64_t tick_ns = PROBE_WHEEL_TICK_MS * NS_PER_MS;
+  slot->deadline_tick = (from_ns + delay_ns + tick_ns - 1) / tick_ns + 1;
+  return (uint32_t)(slot->deadline_tick % PROBE_WHEEL_SLOTS);
+}
+
+// How much longer a pending probe of an adaptive job should wait, or 0 when
+// its deadline has really passed. The wait doubles each time so an
+// unanswered probe is looked at only a handful of times.
+static uint64_t probe_recheck_ns(const probe_engine_t *engine,
+                                 const probe_slot_t *slot, uint64_t now_ns) {
+  const probe_policy_t *policy = slot->job->policy;
+  if (atomic_load(&slot->state) != PROBE_SLOT_PENDING || !policy ||
+      !policy->timeout_us)
+    return 0;
+
+  uint64_t limit = (uint64_t)engine->timeout_ms * NS_PER_MS;
+  uint64_t adaptive =
+      (uint64_t)policy->timeout_us(slot->job, slot->index) * 1000;
+  if (adaptive && adaptive < limit)
+    limit = adaptive;
+
+  uint64_t elapsed = now_ns - slot->sent_ns;
+  if (elapsed >= limit)
+    return 0;
+
+  uint64_t next = elapsed * 2 < limit ? elapsed * 2 : limit;
+  return next - elapsed;
+}
+
+// First wheel deadline of a job's probes. Adaptive jobs get an early first
+// look; their real deadline is decided when the wheel reaches it.
+static uint64_t probe_first_delay_ns(const probe_engine_t *engine,
+                                     const probe_job_t *job) {
+  if (job->policy && job->policy->timeout_us &&
+      PROBE_FIRST_CHECK_MS < engine->timeout_ms)
+    return PROBE_FIRST_CHECK_MS * NS_PER_MS;
+  return (uint64_t)engine->timeout_ms * NS_PER_MS;
+}
+
+// Claim a free table slot for a target, waiting while none is left or the
+// in-flight window is full, or returning PROBE_SLOT_BUSY then unless block
+// is set. The slot is linked into the timer wheel before it becomes
+// visible.
+static uint32_t probe_acquire_slot(probe_engine_t *engine, probe_job_t *job,
+                                   size_t index, in_addr_t addr,
+                                   uint8_t attempt, int block) {
+  pthread_mutex_lock(&engine->wheel_mutex);
+
+  while ((engine->free_head == PROBE_NO_SLOT ||
+          atomic_load(&engine->inflight) >= atomic_load(&engine->window)) &&
+         atomic_load(&engine->running)) {
+    if (!block) {
+      pthread_mutex_unlock(&engine->wheel_mutex);
+      return PROBE_SLOT_BUSY;
+    }
+    engine->window_waiters++;
+    pthread_cond_wait(&engine->slot_freed, &engine->wheel_mutex);
+    engine->window_waiters--;
+  }
+
+  if (!atomic_load(&engine->running)) {
+    pthread_mutex_unlock(&engine->wheel_mutex);
+    return PROBE_NO_SLOT;
+  }
+
+  uint32_t idx = engine->free_head;
+  probe_slot_t *slot = &engine->slots[idx];
+  engine->free_head = slot->free_next;
+  if (engine->free_head == PROBE_NO_SLOT)
+    engine->free_tail = PROBE_NO_SLOT;
+
+  unsigned int generation =
+      ((unsigned int)(slot->seq >> PROBE_SLOT_BITS) + 1) % PROBE_GENERATIONS;
+  slot->seq = (uint16_t)(generation << PROBE_SLOT_BITS | idx);
+  slot->addr = addr;
+  slot->job = job;
+  slot->index = index;
+  slot->attempt = attempt;
+
+  slot->sent_ns = monotonic_ns();
+  probe_wheel_link(engine, idx,
+                   probe_arm(slot, slot->sent_ns,
+                             probe_first_delay_ns(engine, job)));
+
+  atomic_fetch_add(&engine->inflight, 1);
+  atomic_store(&slot->state, PROBE_SLOT_PENDING);
+
+  pthread_mutex_unlock(&engine->wheel_mutex);
+  return idx;
+}
+
+// Let the AIMD controller resize the in-flight window from the counters
+static void probe_adapt(probe_engine_t *engine) {
+  if (!engine->adaptive)
+    return;
+
+  uint64_t replies = atomic_load(&engine->replies);
+  uint64_t resolved = replies + atomic_load(&engine->timeouts);
+  atomic_store(&engine->window,
+               aimd_update(&engine->aimd, monotonic_ns(), replies, resolved));
+}
+
+// Hand an expired probe to the retrier instead of timing it out and free
+// its slot. Returns 1 when the target was queued, 0 when it has no
+// attempts left or was resolved meanwhile. Caller holds wheel_mutex.
+static int probe_requeue(probe_engine_t *engine, probe_slot_t *slot) {
+  const probe_policy_t *policy = slot->job->policy;
+  if (slot->attempt >= engine->retries)
+    return 0;
+  if (policy && policy->should_retry &&
+      !policy->should_retry(slot->job, slot->index))
+    return 0;
+
+  pthread_mutex_lock(&engine->retry_mutex);
+  if (engine->retry_count == PROBE_INFLIGHT_SLOTS ||
+      !probe_claim(engine, slot)) {
+    pthread_mutex_unlock(&engine->retry_mutex);
+    return 0;
+  }
+
+  size_t tail = (engine->retry_head + engine->retry_count) %
+                PROBE_INFLIGHT_SLOTS;
+  engine->retry_queue[tail] = (probe_retry_t){
+      .job = slot->job,
+      .index = slot->index,
+      .addr = slot->addr,
+      .attempt = (uint8_t)(slot->attempt + 1)};
+  engine->retry_count++;
+  pthread_cond_signal(&engine->retry_ready);
+  pthread_mutex_unlock(&engine->retry_mutex);
+
+  probe_free_slot(engine, (uint32_t)(slot - engine->slots));
+  return 1;
+}
+
+// Advance the timer wheel to now, retrying or timing out every probe whose
+// deadline has passed. Probes of adaptive jobs that are not due yet are
+// re-armed instead. Answered probes have already left the wheel; one that
+// another thread resolved but has not freed yet is left for it to free.
+// Timeouts are reported after wheel_mutex is released.
+static void probe_expire(probe_engine_t *engine) {
+  uint64_t now_ns = monotonic_ns();
+  uint64_t now = now_ns / (PROBE_WHEEL_TICK_MS * NS_PER_MS);
+
+  probe_adapt(engine);
+
+  pthread_mutex_lock(&engine->wheel_mutex);
+
+  for (; engine->wheel_tick < now; ++engine->wheel_tick) {
+    uint64_t tick = engine->wheel_tick + 1;
+    uint32_t bucket = (uint32_t)(tick % PROBE_WHEEL_SLOTS);
+    uint32_t idx = engine->wheel[bucket];
+
+    while (idx != PROBE_NO_SLOT) {
+      probe_slot_t *slot = &engine->slots[idx];
+      uint32_t next = slot->wheel_next;
+
+      uint64_t wait;
+      if (slot->deadline_tick > tick) {
+        // Deadline is a later lap of the wheel
+      } else if ((wait = probe_recheck_ns(engine, slot, now_ns)) > 0) {
+        uint32_t later = probe_arm(slot, now_ns, wait);
+        if (later != bucket) {
+          probe_wheel_unlink(engine, idx);
+          probe_wheel_link(engine, idx, later);
+        }
+      } else if (atomic_load(&slot->state) == PROBE_SLOT_PENDING &&
+                 !probe_requeue(engine, slot)) {
+        probe_timeout_locked(engine, slot);
+      }
+      idx = next;
+    }
+  }
+
+  // A growing window lets more probes out without any slot being freed, so
+  // senders parked on it are woken every tick as well
+  if (engine->window_waiters > 0)
+    pthread_cond_broadcast(&engine->slot_freed);
+  pthread_mutex_unlock(&engine->wheel_mutex);
+
+  for (size_t i = 0; i < engine->expired_count; ++i)
+    probe_job_complete(engine->expired[i].job, engine->expired[i].index,
+                       NULL);
+  engine->expired_count = 0;
+}
+
+// Resolve the pending slot an answer belongs to. Answers for a slot that
+// was recycled, or from an address it was not sent to, are dropped.
+void probe_engine_deliver(probe_engine_t *engine, uint16_t seq,
+                          in_addr_t addr, uint64_t now_ns,
+                          probe_reply_t *reply) {
+  probe_slot_t *slot = &engine->slots[seq & PROBE_SLOT_MASK];
+  if (atomic_load(&slot->state) != PROBE_SLOT_PENDING || slot->seq != seq ||
+      slot->addr != addr)
+    return;
+
+  reply->rtt_us = (uint32_t)((now_ns - slot->sent_ns) / 1000);
+  probe_resolve(engine, slot, reply);
+}
+
+// Start a pending probe's clock over from now, send time and wheel
+// deadline alike, for a backend that queues probes and puts them on the
+// wire later. Does nothing once the slot has been resolved or recycled.
+void probe_engine_restart(probe_engine_t *engine, uint16_t seq) {
+  uint32_t idx = seq & PROBE_SLOT_MASK;
+  probe_slot_t *slot = &engine->slots[idx];
+
+  pthread_mutex_lock(&engine->wheel_mutex);
+  if (atomic_load(&slot->state) == PROBE_SLOT_PENDING && slot->seq == seq &&
+      slot->wheel_bucket != PROBE_NO_SLOT) {
+    slot->sent_ns = monotonic_ns();
+    probe_wheel_unlink(engine, idx);
+    probe_wheel_link(engine, idx,
+                     probe_arm(slot, slot->sent_ns,
+                               probe_first_delay_ns(engine, slot->job)));
+  }
+  pthread_mutex_unlock(&engine->wheel_mutex);
+}
+
+// Receiver thread: collect answers from the backend and drive the timer
+// wheel
+static void *probe_receiver(void *arg) {
+  probe_engine_t *engine = arg;
+
+  while (atomic_load(&engine->running)) {
+    engine->backend->poll(engine, PROBE_WHEEL_TICK_MS);
+    probe_expire(engine);
+  }
+
+  return NULL;
+}
+
+// Put one target on the wire: take its rate tokens, claim a slot, send
+static int probe_transmit(probe_engine_t *engine, probe_job_t *job,
+                          size_t index, in_addr_t addr, uint8_t attempt) {
+  int packets = engine->backend->per_port ? engine->port_count : 1;
+  for (int i = 0; i < packets; ++i)
+    token_bucket_acquire(&engine->bucket);
+
+  uint32_t idx = probe_acquire_slot(engine, job, index, addr, attempt, 1);
+  if (idx == PROBE_NO_SLOT) {
+    probe_job_complete(job, index, NULL);
+    return -1;
+  }
+
+  probe_slot_t *slot = &engine->slots[idx];
+  if (engine->backend->send(engine, idx) != 0) {
+    atomic_fetch_add(&engine->send_errors, 1);
+    probe_resolve(engine, slot, NULL);
+    return -1;
+  }
+
+  atomic_fetch_add(attempt > 0 ? &engine->retransmits : &engine->sent, 1);
+  return 0;
+}
+
+// Send claimed slots through the backend's batch call. A slot it could not
+// send fails on its own and the batch goes on after it.
+static void probe_flush(probe_engine_t *engine, const uint32_t *slots,
+                        int count) {
+  while (count > 0) {
+    int sent = engine->backend->send_batch(engine, slots, count);
+    if (sent < 0)
+      sent = 0;
+    atomic_fetch_add(&engine->sent, (uint64_t)sent);
+
+    if (sent < count) {
+      atomic_fetch_add(&engine->send_errors, 1);
+      probe_resolve(engine, &engine->slots[slots[sent]], NULL);
+      sent++;
+    }
+    slots += sent;
+    count -= sent;
+  }
+}
+
+// Put up to one batch of first attempts on the wire: take all their rate
+// tokens at once, claim slots and send them together. Claimed slots are
+// flushed before waiting for more, so none of them sits unsent while the
+// window drains.
+static void probe_transmit_batch(probe_engine_t *engine, probe_job_t *job,
+                                 const size_t *indexes, const in_addr_t *addrs,
+                                 int count) {
+  int packets = engine->backend->per_port ? engine->port_count : 1;
+  token_bucket_acquire_n(&engine->bucket, (unsigned int)(count * packets));
+
+  uint32_t slots[PROBE_SEND_BATCH];
+  int claimed = 0;
+  for (int i = 0; i < count;) {
+    uint32_t idx = probe_acquire_slot(engine, job, indexes[i], addrs[i], 0,
+                                      claimed == 0);
+    if (idx == PROBE_SLOT_BUSY) {
+      probe_flush(engine, slots, claimed);
+      claimed = 0;
+      continue;
+    }
+    if (idx == PROBE_NO_SLOT) {
+      for (; i < count; ++i)
+        probe_job_complete(job, indexes[i], NULL);
+      break;
+    }
+    slots[claimed++] = idx;
+    i++;
+  }
+  probe_flush(engine, slots, claimed);
+}
+
+// Retrier thread: resend queued timeouts through the normal send path
+static void *probe_retrier(void *arg) {
+  probe_engine_t *engine = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&engine->retry_mutex);
+    while (engine->retry_count == 0 && atomic_load(&engine->running))
+      pthread_cond_wait(&engine->retry_ready, &engine->retry_mutex);
+    if (engine->retry_count == 0) {
+      pthread_mutex_unlock(&engine->retry_mutex);
+      break;
+    }
+
+    probe_retry_t retry = engine->retry_queue[engine->retry_head];
+    engine->retry_head = (engine->retry_head + 1) % PROBE_INFLIGHT_SLOTS;
+    engine->retry_count--;
+    pthread_mutex_unlock(&engine->retry_mutex);
+
+    // Once stopping, whatever is left just times out
+    if (!atomic_load(&engine->running))
+      probe_job_complete(retry.job, retry.index, NULL);
+    else
+      probe_transmit(engine, retry.job, retry.index, retry.addr,
+                     retry.attempt);
+  }
+
+  return NULL;
+}
+
+void probe_config_defaults(probe_config_t *config) {
+  config->timeout_ms = PROBE_DEFAULT_TIMEOUT_MS;
+  config->retries = PROBE_DEFAULT_RETRIES;
+  config->max_pps = PROBE_DEFAULT_PPS;
+  config->burst = PROBE_DEFAULT_BURST;
+  config->max_inflight = PROBE_INFLIGHT_SLOTS;
+  config->adaptive = 1;
+  config->backend = &probe_backend_icmp;
+  config->cpu = -1;
+  config->lane = 0;
+
+  static const uint16_t ports[] = PROBE_DEFAULT_PORTS;
+  memcpy(config->ports, ports, sizeof(ports));
+  config->port_count = PROBE_DEFAULT_PORT_COUNT;
+}
+
+// Backend by its command-line name, or NULL
+const probe_backend_t *probe_backend_find(const char *name) {
+  for (size_t i = 0; i < sizeof(probe_backends) / sizeof(probe_backends[0]);
+       ++i) {
+    if (strcmp(name, probe_backends[i]->name) == 0)
+      return probe_backends[i];
+  }
+  return NULL;
+}
+
+// Send and receive a backend socket only through the configured interface,
+// whatever the routing table says. Returns -1 with errno set.
+int probe_bind_device(const probe_engine_t *engine, int fd) {
+  if (!engine->device)
+    return 0;
+  return setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, engine->device,
+                    (socklen_t)strlen(engine->device) + 1);
+}
+
+// Open the configured backend and start the receiver and retrier, pinned
+// to the configured core if there is one. On failure errno is left as the
+// backend's open set it.
+int probe_engine_start(probe_engine_t *engine, const probe_config_t *config) {
+  int max_inflight = config->max_inflight;
+  if (max_inflight <= 0 || max_inflight > PROBE_INFLIGHT_SLOTS)
+    max_inflight = PROBE_INFLIGHT_SLOTS;
+
+  engine->backend = config->backend;
+  engine->port_count = config->port_count;
+  memcpy(engine->ports, config->ports,
+         (size_t)config->port_count * sizeof(config->ports[0]));
+  engine->device = config->device;
+  engine->cpu = config->cpu;
+  engine->lane = config->lane;
+  if (engine->backend->open(engine, &max_inflight) != 0)
+    return -1;
+
+  engine->timeout_ms = config->timeout_ms;
+  engine->retries = config->retries < 0 ? 0
+                    : config->retries > PROBE_MAX_RETRIES
+                        ? PROBE_MAX_RETRIES
+                        : config->retries;
+  token_bucket_init(&engine->bucket, config->max_pps, config->burst);
+  engine->batch = config->max_pps <= 0 || config->burst >= PROBE_SEND_BATCH
+                      ? PROBE_SEND_BATCH
+                  : config->burst > 1 ? config->burst
+                                      : 1;
+  engine->adaptive = config->adaptive;
+  aimd_init(&engine->aimd,
+            config->adaptive ? max_inflight / PROBE_INITIAL_WINDOW_DIV
+                             : max_inflight,
+            max_inflight);
+  atomic_store(&engine->window, engine->aimd.window);
+  engine->free_head = 0;
+  engine->free_tail = PROBE_INFLIGHT_SLOTS - 1;
+  engine->window_waiters = 0;
+  engine->wheel_tick = monotonic_tick();
+  atomic_store(&engine->inflight, 0);
+  engine->expired_count = 0;
+  engine->retry_head = 0;
+  atomic_store(&engine->retry_count, 0);
+  atomic_store(&engine->sent, 0);
+  atomic_store(&engine->retransmits, 0);
+  atomic_store(&engine->replies, 0);
+  atomic_store(&engine->timeouts, 0);
+  atomic_store(&engine->send_errors, 0);
+
+  for (size_t i = 0; i < PROBE_INFLIGHT_SLOTS; ++i) {
+    atomic_store(&engine->slots[i].state, PROBE_SLOT_FREE);
+    engine->slots[i].seq = (uint16_t)i;
+    engine->slots[i].wheel_bucket = PROBE_NO_SLOT;
+    engine->slots[i].free_next =
+        i + 1 < PROBE_INFLIGHT_SLOTS ? (uint32_t)(i + 1) : PROBE_NO_SLOT;
+  }
+  for (size_t i = 0; i < PROBE_WHEEL_SLOTS; ++i)
+    engine->wheel[i] = PROBE_NO_SLOT;
+
+  if (pthread_mutex_init(&engine->wheel_mutex, NULL) != 0)
+    goto fail_backend;
+  if (pthread_cond_init(&engine->slot_freed, NULL) != 0)
+    goto fail_wheel_mutex;
+  if (pthread_mutex_init(&engine->retry_mutex, NULL) != 0)
+    goto fail_slot_freed;
+  if (pthread_cond_init(&engine->retry_ready, NULL) != 0)
+    goto fail_retry_mutex;
+
+  atomic_store(&engine->running, 1);
+  if (pthread_create(&engine->receiver, NULL, probe_receiver, engine) != 0)
+    goto fail_running;
+  if (pthread_create(&engine->retrier, NULL, probe_retrier, engine) != 0)
+    goto fail_receiver;
+  if (engine->cpu >= 0) {
+    cpus_pin(engine->receiver, engine->cpu);
+    cpus_pin(engine->retrier, engine->cpu);
+  }
+
+  return 0;
+
+fail_receiver:
+  atomic_store(&engine->running, 0);
+  pthread_join(engine->receiver, NULL);
+fail_running:
+  atomic_store(&engine->running, 0);
+  pthread_cond_destroy(&engine->retry_ready);
+fail_retry_mutex:
+  pthread_mutex_destroy(&engine->retry_mutex);
+fail_slot_freed:
+  pthread_cond_destroy(&engine->slot_freed);
+fail_wheel_mutex:
+  pthread_mutex_destroy(&engine->wheel_mutex);
+fail_backend:
+  engine->backend->close(engine);
+  return -1;
+}
+
+void probe_engine_stop(probe_engine_t *engine) {
+  if (!atomic_exchange(&engine->running, 0))
+    return;
+
+  pthread_mutex_lock(&engine->wheel_mutex);
+  pthread_cond_broadcast(&engine->slot_freed);
+  pthread_mutex_unlock(&engine->wheel_mutex);
+
+  pthread_mutex_lock(&engine->retry_mutex);
+  pthread_cond_broadcast(&engine->retry_ready);
+  pthread_mutex_unlock(&engine->retry_mutex);
+
+  // The receiver may still queue retries on its way out; the retrier
+  // drains them as timeouts once it sees the engine stopping
+  pthread_join(engine->receiver, NULL);
+  pthread_join(engine->retrier, NULL);
+
+  pthread_cond_destroy(&engine->retry_ready);
+  pthread_mutex_destroy(&engine->retry_mutex);
+  pthread_cond_destroy(&engine->slot_freed);
+  pthread_mutex_destroy(&engine->wheel_mutex);
+  engine->backend->close(engine);
+}
+
+int probe_job_init(probe_job_t *job, size_t count, probe_result_fn on_result,
+                   void *ctx) {
+  job->count = count;
+  job->on_result = on_result;
+  job->ctx = ctx;
+  job->policy = NULL;
+  atomic_store(&job->remaining, count);
+
+  if (pthread_mutex_init(&job->mutex, NULL) != 0)
+    return -1;
+  if (pthread_cond_init(&job->done, NULL) != 0) {
+    pthread_mutex_destroy(&job->mutex);
+    return -1;
+  }
+  return 0;
+}
+
+void probe_job_destroy(probe_job_t *job) {
+  pthread_cond_destroy(&job->done);
+  pthread_mutex_destroy(&job->mutex);
+}
+
+// Send one target of a job. Blocks for a rate token and while the
+// in-flight window is full; the result is delivered later through
+// job->on_result, after any retries.
+int probe_engine_send(probe_engine_t *engine, probe_job_t *job, size_t index,
+                      in_addr_t addr) {
+  return probe_transmit(engine, job, index, addr, 0);
+}
+
+// Send a run of targets of a job, in batches where the backend supports it.
+// Blocks like probe_engine_send; every target's result arrives through
+// job->on_result.
+void probe_engine_send_batch(probe_engine_t *engine, probe_job_t *job,
+                             const size_t *indexes, const in_addr_t *addrs,
+                             size_t count) {
+  if (!engine->backend->send_batch) {
+    for (size_t i = 0; i < count; ++i)
+      probe_transmit(engine, job, indexes[i], addrs[i], 0);
+    return;
+  }
+
+  for (size_t done = 0; done < count;) {
+    size_t n = count - done < (size_t)engine->batch
+                   ? count - done
+                   : (size_t)engine->batch;
+    probe_transmit_batch(engine, job, indexes + done, addrs + done, (int)n);
+    done += n;
+  }
+}
+
+// Settle count targets of a job that will never be sent, as when a scan is
+// stopped early; they get no result
+void probe_job_abandon(probe_job_t *job, size_t count) {
+  if (count && atomic_fetch_sub(&job->remaining, count) == count) {
+    pthread_mutex_lock(&job->mutex);
+    pthread_cond_broadcast(&job->done);
+    pthread_mutex_unlock(&job->mutex);
+  }
+}
+
+// Block until every target in the job has been answered or timed out
+void probe_job_wait(probe_job_t *job) {
+  pthread_mutex_lock(&job->mutex);
+  while (atomic_load(&job->remaining) > 0)
+    pthread_cond_wait(&job->done, &job->mutex);
+  pthread_mutex_unlock(&job->mutex);
+}
@@ -0,0 +1,137 @@
+#include "probe.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include "clock.h"
+#include "icmp.h"
+
+typedef struct {
+  icmp_socket_t sock;
+  icmp_template_t tpl;
+} icmp_backend_t;
+
+static int icmp_backend_open(probe_engine_t *engine, int *max_inflight) {
+  (void)max_inflight;
+
+  icmp_backend_t *state = malloc(sizeof(*state));
+  if (!state)
+    return -1;
+  if (icmp_open(&state->sock, (unsigned int)engine->lane) != 0 ||
+      probe_bind_device(engine, state->sock.sockfd) != 0) {
+    int saved = errno;
+    icmp_close(&state->sock);
+    free(state);
+    errno = saved;
+    return -1;
+  }
+  icmp_template_init(&state->tpl, state->sock.ident);
+
+  engine->backend_state = state;
+  return 0;
+}
+
+static void icmp_backend_close(probe_engine_t *engine) {
+  icmp_backend_t *state = engine->backend_state;
+  icmp_close(&state->sock);
+  free(state);
+  engine->backend_state = NULL;
+}
+
+static int icmp_backend_send(probe_engine_t *engine, uint32_t slot) {
+  const icmp_backend_t *state = engine->backend_state;
+  const probe_slot_t *entry = &engine->slots[slot];
+  return icmp_send_echo(&state->sock, &state->tpl, entry->addr, entry->seq,
+                        entry->sent_ns);
+}
+
+// Patch one packet per slot from the template, back to back, and hand them
+// all to one sendmmsg
+static int icmp_backend_send_batch(probe_engine_t *engine,
+                                   const uint32_t *slots, int count) {
+  const icmp_backend_t *state = engine->backend_state;
+  alignas(8) uint8_t packets[PROBE_SEND_BATCH][ICMP_ECHO_LEN];
+  struct sockaddr_in to[PROBE_SEND_BATCH];
+  struct iovec iov[PROBE_SEND_BATCH];
+  struct mmsghdr msgs[PROBE_SEND_BATCH];
+
+  if (count > PROBE_SEND_BATCH)
+    count = PROBE_SEND_BATCH;
+  for (int i = 0; i < count; ++i) {
+    const probe_slot_t *entry = &engine->slots[slots[i]];
+    icmp_template_fill(&state->tpl, packets[i], entry->seq, entry->sent_ns);
+    to[i] = (struct sockaddr_in){.sin_family = AF_INET,
+                                 .sin_addr.s_addr = entry->addr};
+    iov[i] = (struct iovec){.iov_base = packets[i], .iov_len = ICMP_ECHO_LEN};
+    msgs[i] = (struct mmsghdr){.msg_hdr = {.msg_name = &to[i],
+                                           .msg_namelen = sizeof(to[i]),
+                                           .msg_iov = &iov[i],
+                                           .msg_iovlen = 1}};
+  }
+
+  return sendmmsg(state->sock.sockfd, msgs, (unsigned int)count, 0);
+}
+
+// Drain echo replies in batches
+static void icmp_backend_poll(probe_engine_t *engine, int timeout_ms) {
+  const icmp_backend_t *state = engine->backend_state;
+  const icmp_socket_t *sock = &state->sock;
+  uint8_t bufs[PROBE_RECV_BATCH][ICMP_RECV_LEN];
+  alignas(struct cmsghdr) uint8_t control[PROBE_RECV_BATCH][ICMP_CMSG_LEN];
+  struct mmsghdr msgs[PROBE_RECV_BATCH];
+  struct iovec iov[PROBE_RECV_BATCH];
+  struct sockaddr_in from[PROBE_RECV_BATCH];
+  struct pollfd pfd = {.fd = sock->sockfd, .events = POLLIN};
+
+  if (poll(&pfd, 1, timeout_ms) <= 0)
+    return;
+
+  for (;;) {
+    for (int i = 0; i < PROBE_RECV_BATCH; ++i) {
+      iov[i] = (struct iovec){.iov_base = bufs[i], .iov_len = ICMP_RECV_LEN};
+      msgs[i] = (struct mmsghdr){
+          .msg_hdr = {.msg_name = &from[i],
+                      .msg_namelen = sizeof(from[i]),
+                      .msg_iov = &iov[i],
+                      .msg_iovlen = 1,
+                      .msg_control = control[i],
+                      .msg_controllen = ICMP_CMSG_LEN}};
+    }
+
+    int n = recvmmsg(sock->sockfd, msgs, PROBE_RECV_BATCH, MSG_DONTWAIT,
+                     NULL);
+    if (n <= 0)
+      break;
+
+    uint64_t now = monotonic_ns();
+    for (int i = 0; i < n; ++i) {
+      uint16_t seq;
+      probe_reply_t reply = {.via = PROBE_VIA_ICMP};
+      if (icmp_parse_reply(sock, bufs[i], msgs[i].msg_len, &seq,
+                           &reply.ttl) != 0)
+        continue;
+
+      if (!sock->raw)
+        reply.ttl = icmp_cmsg_ttl(&msgs[i].msg_hdr);
+      probe_engine_deliver(engine, seq, from[i].sin_addr.s_addr, now,
+                           &reply);
+    }
+
+    if (n < PROBE_RECV_BATCH)
+      break;
+  }
+}
+
+// Echo requests on one shared raw or datagram ICMP socket
+const probe_backend_t probe_backend_icmp = {
+    .name = "icmp",
+    .per_port = 0,
+    .open = icmp_backend_open,
+    .close = icmp_backend_close,
+    .send = icmp_backend_send,
+    .send_batch = icmp_backend_send_batch,
+    .poll = icmp_backend_poll,
+    .release = NULL};
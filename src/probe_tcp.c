@@ -0,0 +1,391 @@
+#include "probe.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "tcp.h"
+
+// Descriptors kept back from connect probes for everything else the
+// scanner opens
+#define TCP_RESERVED_FDS 256
+
+// epoll tag of the eventfd senders ring when they queue a slot
+#define TCP_WAKE_TAG UINT64_MAX
+
+// Connect probing: senders only queue the slot, and the receiver opens one
+// non-blocking socket per port and waits for them on epoll. Keeping every
+// descriptor on one thread means a slot's sockets are never closed under
+// a connect still in progress.
+typedef struct {
+  int epfd;
+  int wake;
+  pthread_mutex_t mutex;
+  uint16_t queue[PROBE_INFLIGHT_SLOTS]; // seq of each slot to connect
+  size_t head;
+  size_t count;
+  int *fds; // port_count sockets per slot, -1 when closed
+} tcp_connect_t;
+
+// Let this process hold as many sockets as the hard limit allows, and size
+// the in-flight window so every probe can have all its ports open
+static int tcp_fd_budget(int port_count, int *max_inflight) {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+    return -1;
+  if (limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  rlim_t available = limit.rlim_cur;
+  if (available <= TCP_RESERVED_FDS + (rlim_t)port_count) {
+    errno = EMFILE;
+    return -1;
+  }
+  available = (available - TCP_RESERVED_FDS) / (rlim_t)port_count;
+  if (available < (rlim_t)*max_inflight)
+    *max_inflight = (int)available;
+  return 0;
+}
+
+static int tcp_connect_open(probe_engine_t *engine, int *max_inflight) {
+  if (tcp_fd_budget(engine->port_count, max_inflight) != 0)
+    return -1;
+
+  tcp_connect_t *state = calloc(1, sizeof(*state));
+  if (!state)
+    return -1;
+  state->fds = malloc(PROBE_INFLIGHT_SLOTS * (size_t)engine->port_count *
+                      sizeof(state->fds[0]));
+  if (!state->fds)
+    goto fail_state;
+  for (size_t i = 0; i < PROBE_INFLIGHT_SLOTS * (size_t)engine->port_count;
+       ++i)
+    state->fds[i] = -1;
+
+  state->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (state->epfd < 0)
+    goto fail_fds;
+  state->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (state->wake < 0)
+    goto fail_epoll;
+
+  struct epoll_event event = {.events = EPOLLIN, .data.u64 = TCP_WAKE_TAG};
+  if (epoll_ctl(state->epfd, EPOLL_CTL_ADD, state->wake, &event) != 0)
+    goto fail_wake;
+  if (pthread_mutex_init(&state->mutex, NULL) != 0)
+    goto fail_wake;
+
+  engine->backend_state = state;
+  return 0;
+
+fail_wake:
+  close(state->wake);
+fail_epoll:
+  close(state->epfd);
+fail_fds:
+  free(state->fds);
+fail_state:
+  free(state);
+  return -1;
+}
+
+static void tcp_connect_release(probe_engine_t *engine, uint32_t slot) {
+  tcp_connect_t *state = engine->backend_state;
+  int *fds = &state->fds[(size_t)slot * (size_t)engine->port_count];
+
+  for (int i = 0; i < engine->port_count; ++i) {
+    if (fds[i] >= 0) {
+      close(fds[i]);
+      fds[i] = -1;
+    }
+  }
+}
+
+static void tcp_connect_close(probe_engine_t *engine) {
+  tcp_connect_t *state = engine->backend_state;
+
+  for (uint32_t i = 0; i < PROBE_INFLIGHT_SLOTS; ++i)
+    tcp_connect_release(engine, i);
+  pthread_mutex_destroy(&state->mutex);
+  close(state->wake);
+  close(state->epfd);
+  free(state->fds);
+  free(state);
+  engine->backend_state = NULL;
+}
+
+// Queue the slot for the receiver and wake it
+static int tcp_connect_send(probe_engine_t *engine, uint32_t slot) {
+  tcp_connect_t *state = engine->backend_state;
+
+  pthread_mutex_lock(&state->mutex);
+  if (state->count == PROBE_INFLIGHT_SLOTS) {
+    pthread_mutex_unlock(&state->mutex);
+    return -1;
+  }
+  state->queue[(state->head + state->count) % PROBE_INFLIGHT_SLOTS] =
+      engine->slots[slot].seq;
+  state->count++;
+  pthread_mutex_unlock(&state->mutex);
+
+  uint64_t one = 1;
+  return write(state->wake, &one, sizeof(one)) == sizeof(one) ||
+                 errno == EAGAIN
+             ? 0
+             : -1;
+}
+
+// A finished connect that proves the host is up: accepted, or refused
+// with an RST. Anything else (unreachable, filtered) says nothing.
+static int tcp_connect_alive(int err) {
+  return err == 0 || err == ECONNREFUSED;
+}
+
+static void tcp_connect_answer(probe_engine_t *engine, uint16_t seq,
+                               in_addr_t addr) {
+  probe_reply_t reply = {.via = PROBE_VIA_TCP};
+  probe_engine_deliver(engine, seq, addr, monotonic_ns(), &reply);
+}
+
+// Start a connect to every port of one queued slot. Loopback and other
+// immediate answers resolve here; the rest are watched on epoll.
+static void tcp_connect_start(probe_engine_t *engine, uint16_t seq) {
+  tcp_connect_t *state = engine->backend_state;
+  uint32_t slot = seq & PROBE_SLOT_MASK;
+  probe_slot_t *entry = &engine->slots[slot];
+  int *fds = &state->fds[(size_t)slot * (size_t)engine->port_count];
+
+  // Time the handshake rather than the wait in the queue, and give it the
+  // whole timeout from here
+  probe_engine_restart(engine, seq);
+
+  for (int i = 0; i < engine->port_count; ++i) {
+    if (atomic_load(&entry->state) != PROBE_SLOT_PENDING || entry->seq != seq)
+      return;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      atomic_fetch_add(&engine->send_errors, 1);
+      continue;
+    }
+
+    // Close with an RST rather than a FIN: no TIME_WAIT left behind
+    struct linger linger = {.l_onoff = 1, .l_linger = 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    if (probe_bind_device(engine, fd) != 0) {
+      close(fd);
+      atomic_fetch_add(&engine->send_errors, 1);
+      continue;
+    }
+
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(engine->ports[i]),
+                               .sin_addr.s_addr = entry->addr};
+    int rc = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (rc != 0 && errno != EINPROGRESS) {
+      int err = errno;
+      close(fd);
+      if (tcp_connect_alive(err)) {
+        tcp_connect_answer(engine, seq, entry->addr);
+        return;
+      }
+      continue;
+    }
+    if (rc == 0) {
+      close(fd);
+      tcp_connect_answer(engine, seq, entry->addr);
+      return;
+    }
+
+    struct epoll_event event = {.events = EPOLLOUT,
+                                .data.u64 = (uint64_t)seq << 8 |
+                                            (uint64_t)i};
+    if (epoll_ctl(state->epfd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      atomic_fetch_add(&engine->send_errors, 1);
+      close(fd);
+      continue;
+    }
+    fds[i] = fd;
+  }
+}
+
+// Take one batch of what senders queued and wake up again for the rest, so
+// finished connects are handled between batches rather than left waiting
+// on epoll (and counted into their RTT) behind a long queue
+static void tcp_connect_drain(probe_engine_t *engine) {
+  tcp_connect_t *state = engine->backend_state;
+  uint16_t batch[PROBE_RECV_BATCH];
+  uint64_t count;
+
+  if (read(state->wake, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    return;
+
+  size_t n = 0;
+  pthread_mutex_lock(&state->mutex);
+  while (n < PROBE_RECV_BATCH && state->count > 0) {
+    batch[n++] = state->queue[state->head];
+    state->head = (state->head + 1) % PROBE_INFLIGHT_SLOTS;
+    state->count--;
+  }
+  int more = state->count > 0;
+  pthread_mutex_unlock(&state->mutex);
+
+  for (size_t i = 0; i < n; ++i)
+    tcp_connect_start(engine, batch[i]);
+
+  uint64_t one = 1;
+  if (more && write(state->wake, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    atomic_fetch_add(&engine->send_errors, 1);
+}
+
+// Handle finished connects and start newly queued ones
+static void tcp_connect_poll(probe_engine_t *engine, int timeout_ms) {
+  tcp_connect_t *state = engine->backend_state;
+  struct epoll_event events[PROBE_RECV_BATCH];
+
+  int n = epoll_wait(state->epfd, events, PROBE_RECV_BATCH, timeout_ms);
+  for (int i = 0; i < n; ++i) {
+    if (events[i].data.u64 == TCP_WAKE_TAG) {
+      tcp_connect_drain(engine);
+      continue;
+    }
+
+    uint16_t seq = (uint16_t)(events[i].data.u64 >> 8);
+    int port = (int)(events[i].data.u64 & 0xff);
+    uint32_t slot = seq & PROBE_SLOT_MASK;
+    probe_slot_t *entry = &engine->slots[slot];
+    int *fd = &state->fds[(size_t)slot * (size_t)engine->port_count +
+                          (size_t)port];
+
+    // Earlier events in this batch may already have resolved the slot
+    if (*fd < 0 || entry->seq != seq)
+      continue;
+
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    getsockopt(*fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+    if (tcp_connect_alive(err)) {
+      tcp_connect_answer(engine, seq, entry->addr);
+    } else {
+      close(*fd);
+      *fd = -1;
+    }
+  }
+}
+
+// Non-blocking connect() to each configured port; needs no privileges
+const probe_backend_t probe_backend_tcp_connect = {
+    .name = "tcp",
+    .per_port = 1,
+    .open = tcp_connect_open,
+    .close = tcp_connect_close,
+    .send = tcp_connect_send,
+    .send_batch = NULL,
+    .poll = tcp_connect_poll,
+    .release = tcp_connect_release};
+
+// Raw SYN probing: a handful of bytes per port, no socket state at all.
+// The kernel answers the SYN-ACKs with RSTs because no socket owns them.
+static int tcp_syn_backend_open(probe_engine_t *engine, int *max_inflight) {
+  (void)max_inflight;
+
+  tcp_syn_socket_t *sock = malloc(sizeof(*sock));
+  if (!sock)
+    return -1;
+  if (tcp_syn_open(sock, engine->device, (unsigned int)engine->lane) != 0 ||
+      probe_bind_device(engine, sock->sockfd) != 0) {
+    int saved = errno;
+    tcp_syn_close(sock);
+    free(sock);
+    errno = saved;
+    return -1;
+  }
+
+  engine->backend_state = sock;
+  return 0;
+}
+
+static void tcp_syn_backend_close(probe_engine_t *engine) {
+  tcp_syn_close(engine->backend_state);
+  free(engine->backend_state);
+  engine->backend_state = NULL;
+}
+
+// One SYN per port; the cookie carries the slot's seq and the port index
+static int tcp_syn_backend_send(probe_engine_t *engine, uint32_t slot) {
+  const probe_slot_t *entry = &engine->slots[slot];
+  int sent = 0;
+
+  for (int i = 0; i < engine->port_count; ++i) {
+    uint32_t cookie = (uint32_t)entry->seq << 8 | (uint32_t)i;
+    if (tcp_send_syn(engine->backend_state, entry->addr, engine->ports[i],
+                     cookie) == 0)
+      sent = 1;
+  }
+  return sent ? 0 : -1;
+}
+
+static void tcp_syn_backend_poll(probe_engine_t *engine, int timeout_ms) {
+  const tcp_syn_socket_t *sock = engine->backend_state;
+  uint8_t bufs[PROBE_RECV_BATCH][TCP_RECV_LEN];
+  struct mmsghdr msgs[PROBE_RECV_BATCH];
+  struct iovec iov[PROBE_RECV_BATCH];
+  struct pollfd pfd = {.fd = sock->sockfd, .events = POLLIN};
+
+  if (poll(&pfd, 1, timeout_ms) <= 0)
+    return;
+
+  for (;;) {
+    for (int i = 0; i < PROBE_RECV_BATCH; ++i) {
+      iov[i] = (struct iovec){.iov_base = bufs[i], .iov_len = TCP_RECV_LEN};
+      msgs[i] = (struct mmsghdr){
+          .msg_hdr = {.msg_iov = &iov[i], .msg_iovlen = 1}};
+    }
+
+    int n = recvmmsg(sock->sockfd, msgs, PROBE_RECV_BATCH, MSG_DONTWAIT,
+                     NULL);
+    if (n <= 0)
+      break;
+
+    uint64_t now = monotonic_ns();
+    for (int i = 0; i < n; ++i) {
+      tcp_answer_t answer;
+      if (tcp_parse_answer(sock, bufs[i], msgs[i].msg_len, &answer) != 0)
+        continue;
+
+      // Cookies are 24 bits; a port index past the set is a stray
+      uint32_t port = answer.cookie & 0xff;
+      if (answer.cookie >> 24 || port >= (uint32_t)engine->port_count ||
+          engine->ports[port] != answer.port)
+        continue;
+
+      probe_reply_t reply = {.ttl = answer.ttl, .via = PROBE_VIA_SYN};
+      probe_engine_deliver(engine, (uint16_t)(answer.cookie >> 8),
+                           answer.from, now, &reply);
+    }
+
+    if (n < PROBE_RECV_BATCH)
+      break;
+  }
+}
+
+// Half-open SYN scan on a raw TCP socket; needs CAP_NET_RAW
+const probe_backend_t probe_backend_tcp_syn = {
+    .name = "syn",
+    .per_port = 1,
+    .open = tcp_syn_backend_open,
+    .close = tcp_syn_backend_close,
+    .send = tcp_syn_backend_send,
+    .send_batch = NULL,
+    .poll = tcp_syn_backend_poll,
+    .release = NULL};
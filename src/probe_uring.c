@@ -0,0 +1,298 @@
+#include "probe.h"
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "clock.h"
+#include "icmp.h"
+#include "uring.h"
+
+// Submission ring size and how long its polling thread spins without work
+// before parking
+#define URING_ENTRIES 4096
+#define URING_SQPOLL_IDLE_MS 10
+
+// Provided buffers for the multishot receive. Each holds the recvmsg
+// header, the source address, the TTL cmsg and one reply.
+#define URING_RECV_BUFS 512
+#define URING_RECV_BUF_LEN 2048
+#define URING_BUF_GROUP 0
+
+// user_data of the receive; sends carry their slot number
+#define URING_RECV_TAG UINT64_MAX
+
+// Everything a queued sendmsg points at. One per slot, wired up once, so
+// a send only writes the address and patches the echo request.
+typedef struct {
+  struct msghdr msg;
+  struct iovec iov;
+  struct sockaddr_in to;
+  alignas(8) uint8_t packet[ICMP_ECHO_LEN];
+} uring_send_t;
+
+typedef struct {
+  icmp_socket_t sock;
+  icmp_template_t tpl;
+  uring_t ring;
+  uring_bufs_t bufs;
+  pthread_mutex_t sq_mutex; // senders and the receiver share the SQ
+  struct msghdr recv_msg;   // reserved name and control lengths
+  int recv_armed;           // receiver thread only
+  uring_send_t *sends;
+} icmp_uring_t;
+
+// Queue the multishot receive; it keeps completing until the kernel runs
+// out of buffers or hits an error, then is armed again
+static int uring_arm_recv(icmp_uring_t *state) {
+  pthread_mutex_lock(&state->sq_mutex);
+  struct io_uring_sqe *sqe = uring_get_sqe(&state->ring);
+  if (!sqe) {
+    pthread_mutex_unlock(&state->sq_mutex);
+    return -1;
+  }
+
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = state->sock.sockfd;
+  sqe->addr = (uint64_t)(uintptr_t)&state->recv_msg;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BUF_GROUP;
+  sqe->user_data = URING_RECV_TAG;
+  int rc = uring_submit(&state->ring);
+  pthread_mutex_unlock(&state->sq_mutex);
+
+  state->recv_armed = rc == 0;
+  return rc;
+}
+
+static void uring_free(icmp_uring_t *state) {
+  pthread_mutex_destroy(&state->sq_mutex);
+  free(state->sends);
+  free(state);
+}
+
+// Kernels without multishot recvmsg (before 6.0) reject it at once. Give
+// the first completion a moment to show up and fail the open if so.
+static int uring_check_recv(icmp_uring_t *state) {
+  if (uring_wait(&state->ring, 1) != 0)
+    return 0;
+
+  struct io_uring_cqe *cqe = uring_peek(&state->ring);
+  if (cqe->user_data == URING_RECV_TAG && cqe->res == -EINVAL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+}
+
+static int uring_backend_open(probe_engine_t *engine, int *max_inflight) {
+  (void)max_inflight;
+
+  icmp_uring_t *state = calloc(1, sizeof(*state));
+  if (!state)
+    return -1;
+  state->sends = calloc(PROBE_INFLIGHT_SLOTS, sizeof(state->sends[0]));
+  if (!state->sends || pthread_mutex_init(&state->sq_mutex, NULL) != 0) {
+    free(state->sends);
+    free(state);
+    return -1;
+  }
+
+  for (size_t i = 0; i < PROBE_INFLIGHT_SLOTS; ++i) {
+    uring_send_t *send = &state->sends[i];
+    send->to.sin_family = AF_INET;
+    send->iov = (struct iovec){.iov_base = send->packet,
+                               .iov_len = ICMP_ECHO_LEN};
+    send->msg = (struct msghdr){.msg_name = &send->to,
+                                .msg_namelen = sizeof(send->to),
+                                .msg_iov = &send->iov,
+                                .msg_iovlen = 1};
+  }
+  state->recv_msg = (struct msghdr){.msg_namelen = sizeof(struct sockaddr_in),
+                                    .msg_controllen = ICMP_CMSG_LEN};
+
+  if (icmp_open(&state->sock, (unsigned int)engine->lane) != 0)
+    goto fail_state;
+  if (probe_bind_device(engine, state->sock.sockfd) != 0)
+    goto fail_sock;
+  icmp_template_init(&state->tpl, state->sock.ident);
+  if (uring_open(&state->ring, URING_ENTRIES, URING_SQPOLL_IDLE_MS) != 0)
+    goto fail_sock;
+  if (uring_bufs_register(&state->ring, &state->bufs, URING_BUF_GROUP,
+                          URING_RECV_BUFS, URING_RECV_BUF_LEN) != 0)
+    goto fail_ring;
+  if (uring_arm_recv(state) != 0 || uring_check_recv(state) != 0)
+    goto fail_bufs;
+
+  engine->backend_state = state;
+  return 0;
+
+fail_bufs:
+  uring_bufs_unregister(&state->ring, &state->bufs);
+fail_ring:
+  uring_close(&state->ring);
+fail_sock:
+  icmp_close(&state->sock);
+fail_state:
+  uring_free(state);
+  return -1;
+}
+
+static void uring_backend_close(probe_engine_t *engine) {
+  icmp_uring_t *state = engine->backend_state;
+
+  // Closing the ring cancels the receive still armed on it
+  uring_bufs_unregister(&state->ring, &state->bufs);
+  uring_close(&state->ring);
+  icmp_close(&state->sock);
+  uring_free(state);
+  engine->backend_state = NULL;
+}
+
+// Point a sendmsg SQE at a slot's filled echo request. Successful sends
+// post no completion, and once queued a send is as good as made: a failed
+// submit leaves it in the ring for the next one. Caller holds sq_mutex.
+static int uring_queue_send(icmp_uring_t *state, uint32_t slot) {
+  struct io_uring_sqe *sqe = uring_get_sqe(&state->ring);
+  if (!sqe)
+    return -1;
+
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = state->sock.sockfd;
+  sqe->addr = (uint64_t)(uintptr_t)&state->sends[slot].msg;
+  sqe->len = 1;
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = slot;
+  return 0;
+}
+
+static void uring_fill_send(probe_engine_t *engine, icmp_uring_t *state,
+                            uint32_t slot) {
+  uring_send_t *send = &state->sends[slot];
+  const probe_slot_t *entry = &engine->slots[slot];
+  send->to.sin_addr.s_addr = entry->addr;
+  icmp_template_fill(&state->tpl, send->packet, entry->seq, entry->sent_ns);
+}
+
+// Queue one sendmsg. With a polled ring it costs no syscall, and the
+// kernel thread takes whatever every sender queued since its last pass as
+// one batch.
+static int uring_backend_send(probe_engine_t *engine, uint32_t slot) {
+  icmp_uring_t *state = engine->backend_state;
+  uring_fill_send(engine, state, slot);
+
+  pthread_mutex_lock(&state->sq_mutex);
+  int rc = uring_queue_send(state, slot);
+  if (rc == 0)
+    uring_submit(&state->ring);
+  pthread_mutex_unlock(&state->sq_mutex);
+  return rc;
+}
+
+// Patch every slot's packet outside the lock, then queue them all and
+// submit once
+static int uring_backend_send_batch(probe_engine_t *engine,
+                                    const uint32_t *slots, int count) {
+  icmp_uring_t *state = engine->backend_state;
+  for (int i = 0; i < count; ++i)
+    uring_fill_send(engine, state, slots[i]);
+
+  pthread_mutex_lock(&state->sq_mutex);
+  int queued = 0;
+  while (queued < count &&
+         uring_queue_send(state, slots[queued]) == 0)
+    queued++;
+  if (queued > 0)
+    uring_submit(&state->ring);
+  pthread_mutex_unlock(&state->sq_mutex);
+  return queued;
+}
+
+// Match one received datagram laid out as io_uring_recvmsg_out, name,
+// control and payload
+static void uring_reply(probe_engine_t *engine, icmp_uring_t *state,
+                        const uint8_t *buf, size_t len, uint64_t now) {
+  size_t name_len = state->recv_msg.msg_namelen;
+  size_t control_len = state->recv_msg.msg_controllen;
+  size_t header = sizeof(struct io_uring_recvmsg_out) + name_len +
+                  control_len;
+  if (len < header)
+    return;
+
+  struct io_uring_recvmsg_out out;
+  memcpy(&out, buf, sizeof(out));
+  if (out.namelen < sizeof(struct sockaddr_in))
+    return;
+
+  struct sockaddr_in from;
+  memcpy(&from, buf + sizeof(out), sizeof(from));
+  size_t payload = len - header < out.payloadlen ? len - header
+                                                 : out.payloadlen;
+
+  uint16_t seq;
+  probe_reply_t reply = {.via = PROBE_VIA_ICMP};
+  if (icmp_parse_reply(&state->sock, buf + header, payload, &seq,
+                       &reply.ttl) != 0)
+    return;
+
+  if (!state->sock.raw) {
+    alignas(struct cmsghdr) uint8_t control[ICMP_CMSG_LEN];
+    memcpy(control, buf + sizeof(out) + name_len, control_len);
+    struct msghdr msg = {.msg_control = control,
+                         .msg_controllen = out.controllen < control_len
+                                               ? out.controllen
+                                               : control_len};
+    reply.ttl = icmp_cmsg_ttl(&msg);
+  }
+  probe_engine_deliver(engine, seq, from.sin_addr.s_addr, now, &reply);
+}
+
+// Reap completions straight from the shared ring; only an empty ring
+// costs a syscall, to sleep until the next reply or the tick
+static void uring_backend_poll(probe_engine_t *engine, int timeout_ms) {
+  icmp_uring_t *state = engine->backend_state;
+
+  if (!state->recv_armed)
+    uring_arm_recv(state);
+  if (uring_wait(&state->ring, timeout_ms) != 0)
+    return;
+
+  uint64_t now = monotonic_ns();
+  struct io_uring_cqe *cqe;
+  while ((cqe = uring_peek(&state->ring))) {
+    if (cqe->user_data != URING_RECV_TAG) {
+      // Only failed sends complete
+      atomic_fetch_add(&engine->send_errors, 1);
+    } else {
+      if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uint16_t id = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (cqe->res > 0)
+          uring_reply(engine, state, uring_bufs_get(&state->bufs, id),
+                      (size_t)cqe->res, now);
+        uring_bufs_recycle(&state->bufs, id);
+      }
+      if (!(cqe->flags & IORING_CQE_F_MORE))
+        state->recv_armed = 0;
+    }
+    uring_cqe_seen(&state->ring);
+  }
+
+  if (!state->recv_armed)
+    uring_arm_recv(state);
+}
+
+// ICMP echo over io_uring: batched sendmsg submissions and a multishot
+// receive into provided buffers
+const probe_backend_t probe_backend_icmp_uring = {
+    .name = "icmp-uring",
+    .per_port = 0,
+    .open = uring_backend_open,
+    .close = uring_backend_close,
+    .send = uring_backend_send,
+    .send_batch = uring_backend_send_batch,
+    .poll = uring_backend_poll,
+    .release = NULL};
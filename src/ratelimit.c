@@ -0,0 +1,108 @@
+#include "ratelimit.h"
+
+#include <stdatomic.h>
+
+#include "clock.h"
+
+void token_bucket_init(token_bucket_t *bucket, int pps, int burst) {
+  atomic_store(&bucket->tat_ns, 0);
+  atomic_store(&bucket->stalls, 0);
+  token_bucket_set_rate(bucket, pps, burst);
+}
+
+// Change the rate at runtime; pps <= 0 disables limiting
+void token_bucket_set_rate(token_bucket_t *bucket, int pps, int burst) {
+  uint64_t interval = 0;
+  if (pps > 0)
+    interval = NS_PER_SEC / (unsigned long long)pps;
+  atomic_store(&bucket->interval_ns, interval);
+  atomic_store(&bucket->burst_ns, interval * (uint64_t)(burst > 1 ? burst : 1));
+}
+
+// Take one token, sleeping until it is due
+void token_bucket_acquire(token_bucket_t *bucket) {
+  token_bucket_acquire_n(bucket, 1);
+}
+
+// Take count tokens with one CAS, sleeping until the last is due
+void token_bucket_acquire_n(token_bucket_t *bucket, unsigned int count) {
+  uint64_t interval = atomic_load(&bucket->interval_ns);
+  if (interval == 0 || count == 0)
+    return;
+
+  uint64_t burst = atomic_load(&bucket->burst_ns);
+  uint64_t now = monotonic_ns();
+  uint64_t tat = atomic_load(&bucket->tat_ns);
+  uint64_t due;
+
+  // Unused tokens accumulate for at most one burst
+  do {
+    uint64_t floor = now > burst ? now - burst : 0;
+    due = tat > floor ? tat : floor;
+  } while (!atomic_compare_exchange_weak(&bucket->tat_ns, &tat,
+                                         due + interval * count));
+
+  due += interval * (count - 1);
+  if (due > now + RATELIMIT_SLACK_NS) {
+    atomic_fetch_add(&bucket->stalls, 1);
+    sleep_ns(due - now);
+  }
+}
+
+void aimd_init(aimd_controller_t *aimd, int initial, int max_window) {
+  aimd->max_window = max_window;
+  aimd->min_window =
+      AIMD_MIN_WINDOW < max_window ? AIMD_MIN_WINDOW : max_window;
+  aimd->window = initial < aimd->min_window ? aimd->min_window : initial;
+  if (aimd->window > max_window)
+    aimd->window = max_window;
+  aimd->baseline_ratio = 0.0;
+  aimd->last_replies = 0;
+  aimd->last_resolved = 0;
+  aimd->last_update_ns = monotonic_ns();
+  aimd->decreases = 0;
+}
+
+// Feed cumulative reply/resolution counters once per receiver tick and get
+// back the window to enforce. Periods with no replies at all carry no
+// signal: an empty range looks the same as total loss, so the window holds.
+int aimd_update(aimd_controller_t *aimd, uint64_t now_ns, uint64_t replies,
+                uint64_t resolved) {
+  if (now_ns - aimd->last_update_ns < AIMD_PERIOD_MS * NS_PER_MS)
+    return aimd->window;
+
+  uint64_t period_replies = replies - aimd->last_replies;
+  uint64_t period_resolved = resolved - aimd->last_resolved;
+  if (period_resolved < AIMD_MIN_SAMPLES)
+    return aimd->window;
+
+  aimd->last_replies = replies;
+  aimd->last_resolved = resolved;
+  aimd->last_update_ns = now_ns;
+
+  if (period_replies == 0)
+    return aimd->window;
+
+  double ratio = (double)period_replies / (double)period_resolved;
+
+  if (aimd->baseline_ratio > 0.0 &&
+      ratio < aimd->baseline_ratio * AIMD_LOSS_FACTOR) {
+    aimd->window /= 2;
+    if (aimd->window < aimd->min_window)
+      aimd->window = aimd->min_window;
+    aimd->decreases++;
+  } else {
+    aimd->window += AIMD_INCREASE;
+    if (aimd->window > aimd->max_window)
+      aimd->window = aimd->max_window;
+  }
+
+  // The baseline tracks the reply ratio so a genuinely sparser range stops
+  // looking like loss after a few periods
+  aimd->baseline_ratio = aimd->baseline_ratio > 0.0
+                             ? aimd->baseline_ratio +
+                                   AIMD_BASELINE_WEIGHT *
+                                       (ratio - aimd->baseline_ratio)
+                             : ratio;
+  return aimd->window;
+}
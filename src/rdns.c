@@ -0,0 +1,653 @@
+#include "rdns.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "addr.h"
+#include "clock.h"
+
+#define DNS_PORT 53
+#define DNS_HEADER_LEN 12
+#define DNS_TYPE_PTR 12
+#define DNS_CLASS_IN 1
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_TC 0x0200
+#define DNS_FLAG_RD 0x0100
+#define DNS_RCODE_MASK 0x000f
+#define DNS_RCODE_NXDOMAIN 3
+
+// Plain DNS over UDP without EDNS: replies fit in 512 bytes, and a PTR
+// query for an IPv4 address in well under 64
+#define DNS_PACKET_MAX 512
+#define DNS_QUERY_MAX 64
+
+// Compression pointers followed within one name before it is rejected
+#define DNS_MAX_POINTERS 16
+
+#define RDNS_INITIAL_ENTRIES 1024
+#define RDNS_INITIAL_WAITING 1024
+
+static uint16_t get_be16(const uint8_t *in) {
+  return (uint16_t)(in[0] << 8 | in[1]);
+}
+
+static uint32_t get_be32(const uint8_t *in) {
+  return (uint32_t)get_be16(in) << 16 | get_be16(in + 2);
+}
+
+static void put_be16(uint8_t *out, uint16_t value) {
+  out[0] = (uint8_t)(value >> 8);
+  out[1] = (uint8_t)value;
+}
+
+// xorshift64*, seeded once from getrandom; only used for query IDs
+static uint16_t rdns_random(rdns_t *rdns) {
+  rdns->random ^= rdns->random >> 12;
+  rdns->random ^= rdns->random << 25;
+  rdns->random ^= rdns->random >> 27;
+  return (uint16_t)((rdns->random * 0x2545F4914F6CDD1DULL) >> 48);
+}
+
+static size_t rdns_hash(uint32_t addr, size_t capacity) {
+  return (size_t)(((uint64_t)addr * 0x9E3779B97F4A7C15ULL) >> 32) &
+         (capacity - 1);
+}
+
+static rdns_entry_t *rdns_slot(rdns_entry_t *entries, size_t capacity,
+                               uint32_t addr) {
+  size_t i = rdns_hash(addr, capacity);
+  while (entries[i].state != RDNS_ENTRY_EMPTY && entries[i].addr != addr)
+    i = (i + 1) & (capacity - 1);
+  return &entries[i];
+}
+
+// Double the table once it is half full
+static int rdns_grow(rdns_t *rdns) {
+  size_t capacity = rdns->capacity * 2;
+  rdns_entry_t *entries = calloc(capacity, sizeof(*entries));
+  if (!entries)
+    return -1;
+
+  for (size_t i = 0; i < rdns->capacity; ++i) {
+    if (rdns->entries[i].state != RDNS_ENTRY_EMPTY)
+      *rdns_slot(entries, capacity, rdns->entries[i].addr) =
+          rdns->entries[i];
+  }
+  free(rdns->entries);
+  rdns->entries = entries;
+  rdns->capacity = capacity;
+  return 0;
+}
+
+// An address's entry, created empty if it has none. NULL only when the
+// table cannot grow.
+static rdns_entry_t *rdns_entry(rdns_t *rdns, uint32_t addr) {
+  rdns_entry_t *entry = rdns_slot(rdns->entries, rdns->capacity, addr);
+  if (entry->state != RDNS_ENTRY_EMPTY)
+    return entry;
+
+  if ((rdns->count + 1) * 2 > rdns->capacity) {
+    if (rdns_grow(rdns) != 0)
+      return NULL;
+    entry = rdns_slot(rdns->entries, rdns->capacity, addr);
+  }
+  rdns->count++;
+  *entry = (rdns_entry_t){.addr = addr, .state = RDNS_ENTRY_UNKNOWN};
+  return entry;
+}
+
+// Names go on into logs and CSV cells, so only hostname characters are
+// kept; anything else is treated as having no name
+static int rdns_valid_name(const char *name) {
+  if (!*name)
+    return 0;
+  for (const char *c = name; *c; ++c) {
+    if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+          (*c >= '0' && *c <= '9') || *c == '-' || *c == '_' || *c == '.'))
+      return 0;
+  }
+  return 1;
+}
+
+// Settle an address for ttl_s seconds. Returns the copy of name kept, or
+// NULL if it was not usable.
+static const char *rdns_settle(rdns_t *rdns, uint32_t addr,
+                               const char *name, uint32_t ttl_s,
+                               int persist) {
+  rdns_entry_t *entry = rdns_entry(rdns, addr);
+  if (!entry)
+    return NULL;
+
+  char *copy = NULL;
+  if (name && rdns_valid_name(name)) {
+    copy = arena_alloc(&rdns->names, strlen(name) + 1);
+    if (copy)
+      memcpy(copy, name, strlen(name) + 1);
+  }
+  entry->name = copy;
+  entry->expires_s = (uint32_t)time(NULL) + ttl_s;
+  entry->state = RDNS_ENTRY_DONE;
+  entry->persist = (uint8_t)persist;
+  return copy;
+}
+
+static int rdns_enqueue(rdns_t *rdns, uint32_t addr) {
+  if (rdns->waiting_count == rdns->waiting_capacity) {
+    size_t capacity = rdns->waiting_capacity * 2;
+    uint32_t *waiting = malloc(capacity * sizeof(*waiting));
+    if (!waiting)
+      return -1;
+    for (size_t i = 0; i < rdns->waiting_count; ++i)
+      waiting[i] = rdns->waiting[(rdns->waiting_head + i) %
+                                 rdns->waiting_capacity];
+    free(rdns->waiting);
+    rdns->waiting = waiting;
+    rdns->waiting_capacity = capacity;
+    rdns->waiting_head = 0;
+  }
+  rdns->waiting[(rdns->waiting_head + rdns->waiting_count++) %
+                rdns->waiting_capacity] = addr;
+  return 0;
+}
+
+// The PTR question for addr: d.c.b.a.in-addr.arpa, with the header. Returns
+// the query length.
+static size_t rdns_build_query(uint8_t *out, uint16_t id, uint32_t addr) {
+  static const uint8_t suffix[] = "\7in-addr\4arpa";
+  size_t len = DNS_HEADER_LEN;
+
+  memset(out, 0, DNS_HEADER_LEN);
+  put_be16(out, id);
+  put_be16(out + 2, DNS_FLAG_RD);
+  put_be16(out + 4, 1);
+
+  for (int shift = 0; shift < 32; shift += 8) {
+    int octet = (int)(addr >> shift & 0xff);
+    int digits = snprintf((char *)out + len + 1, 4, "%d", octet);
+    out[len] = (uint8_t)digits;
+    len += 1 + (size_t)digits;
+  }
+  memcpy(out + len, suffix, sizeof(suffix));
+  len += sizeof(suffix);
+  put_be16(out + len, DNS_TYPE_PTR);
+  put_be16(out + len + 2, DNS_CLASS_IN);
+  return len + 4;
+}
+
+// Read the name at off, following compression pointers, into out as
+// dotted text; out may be NULL to skip it. Returns the offset just past
+// the name where it started, 0 if it is malformed or too long.
+static size_t dns_read_name(const uint8_t *msg, size_t len, size_t off,
+                            char *out, size_t cap) {
+  size_t end = 0;
+  size_t used = 0;
+  int pointers = 0;
+
+  for (;;) {
+    if (off >= len)
+      return 0;
+    uint8_t label = msg[off];
+
+    if ((label & 0xc0) == 0xc0) {
+      if (off + 1 >= len || ++pointers > DNS_MAX_POINTERS)
+        return 0;
+      if (!end)
+        end = off + 2;
+      off = (size_t)(label & 0x3f) << 8 | msg[off + 1];
+      continue;
+    }
+    if (label & 0xc0)
+      return 0;
+    if (label == 0) {
+      if (!end)
+        end = off + 1;
+      break;
+    }
+    if (off + 1 + label > len)
+      return 0;
+    if (out) {
+      if (used + label + 2 > cap)
+        return 0;
+      if (used)
+        out[used++] = '.';
+      memcpy(out + used, msg + off + 1, label);
+      used += label;
+    }
+    off += 1 + (size_t)label;
+  }
+
+  if (out)
+    out[used] = '\0';
+  return end;
+}
+
+// Servers echo the question; it must be ours, in any letter case
+static int dns_same_question(const uint8_t *a, const uint8_t *b,
+                             size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    uint8_t x = a[i] >= 'A' && a[i] <= 'Z' ? (uint8_t)(a[i] | 0x20) : a[i];
+    uint8_t y = b[i] >= 'A' && b[i] <= 'Z' ? (uint8_t)(b[i] | 0x20) : b[i];
+    if (x != y)
+      return 0;
+  }
+  return 1;
+}
+
+static void rdns_finish(rdns_t *rdns, rdns_query_t *query, const char *name,
+                        uint32_t ttl_s, int persist) {
+  if (rdns_settle(rdns, query->addr, name, ttl_s, persist))
+    rdns->stats.named++;
+  query->used = 0;
+  rdns->inflight--;
+}
+
+// Send the query again to the next server, or give up on it
+static void rdns_retry(rdns_t *rdns, rdns_query_t *query) {
+  if (query->attempts >= RDNS_ATTEMPTS) {
+    rdns->stats.failed++;
+    rdns_finish(rdns, query, NULL, RDNS_FAILURE_TTL_S, 0);
+    return;
+  }
+  size_t slot = (size_t)(query - rdns->queries);
+  query->server = (uint8_t)((query->server + 1) % rdns->server_count);
+  query->id = (uint16_t)((rdns_random(rdns) & ~(size_t)RDNS_SLOT_MASK) | slot);
+  query->sent_ns = 0;
+}
+
+static uint32_t rdns_clamp_ttl(uint32_t ttl_s) {
+  if (ttl_s < RDNS_MIN_TTL_S)
+    return RDNS_MIN_TTL_S;
+  return ttl_s > RDNS_MAX_TTL_S ? RDNS_MAX_TTL_S : ttl_s;
+}
+
+// Match one datagram to its query and settle the address. The answer may
+// lead through a CNAME (RFC 2317 delegation), so any PTR record counts.
+static void rdns_answer(rdns_t *rdns, const uint8_t *msg, size_t len,
+                        const struct sockaddr_in *from) {
+  if (len < DNS_HEADER_LEN)
+    return;
+
+  uint16_t id = get_be16(msg);
+  uint16_t flags = get_be16(msg + 2);
+  rdns_query_t *query = &rdns->queries[id & RDNS_SLOT_MASK];
+  if (!query->used || query->id != id || query->sent_ns == 0 ||
+      !(flags & DNS_FLAG_QR))
+    return;
+
+  const struct sockaddr_in *server = &rdns->servers[query->server];
+  if (from->sin_addr.s_addr != server->sin_addr.s_addr ||
+      from->sin_port != server->sin_port)
+    return;
+
+  uint8_t question[DNS_QUERY_MAX];
+  size_t question_len = rdns_build_query(question, id, query->addr);
+  if (get_be16(msg + 4) != 1 || len < question_len ||
+      !dns_same_question(msg + DNS_HEADER_LEN, question + DNS_HEADER_LEN,
+                         question_len - DNS_HEADER_LEN))
+    return;
+
+  int rcode = flags & DNS_RCODE_MASK;
+  if (rcode == DNS_RCODE_NXDOMAIN) {
+    rdns_finish(rdns, query, NULL, RDNS_NEGATIVE_TTL_S, 1);
+    return;
+  }
+  if (rcode != 0 || (flags & DNS_FLAG_TC)) {
+    rdns_retry(rdns, query);
+    return;
+  }
+
+  size_t off = question_len;
+  for (int i = get_be16(msg + 6); i > 0; --i) {
+    off = dns_read_name(msg, len, off, NULL, 0);
+    if (!off || off + 10 > len)
+      break;
+    uint16_t type = get_be16(msg + off);
+    uint16_t class = get_be16(msg + off + 2);
+    uint32_t ttl_s = get_be32(msg + off + 4);
+    size_t rdata = off + 10;
+    size_t rdlen = get_be16(msg + off + 8);
+    if (rdata + rdlen > len)
+      break;
+
+    char name[RDNS_NAME_LEN];
+    if (type == DNS_TYPE_PTR && class == DNS_CLASS_IN &&
+        dns_read_name(msg, len, rdata, name, sizeof(name))) {
+      rdns_finish(rdns, query, name, rdns_clamp_ttl(ttl_s), 1);
+      return;
+    }
+    off = rdata + rdlen;
+  }
+
+  // NOERROR without a PTR record: the address has no name
+  rdns_finish(rdns, query, NULL, RDNS_NEGATIVE_TTL_S, 1);
+}
+
+// Move waiting addresses into free slots
+static void rdns_fill(rdns_t *rdns) {
+  for (size_t slot = 0;
+       slot < RDNS_INFLIGHT && rdns->waiting_count > 0 &&
+       rdns->inflight < RDNS_INFLIGHT;
+       ++slot) {
+    rdns_query_t *query = &rdns->queries[slot];
+    if (query->used)
+      continue;
+
+    uint32_t addr = rdns->waiting[rdns->waiting_head];
+    rdns->waiting_head = (rdns->waiting_head + 1) % rdns->waiting_capacity;
+    rdns->waiting_count--;
+    *query = (rdns_query_t){
+        .addr = addr,
+        .id = (uint16_t)((rdns_random(rdns) & ~(size_t)RDNS_SLOT_MASK) | slot),
+        .server = (uint8_t)(slot % (size_t)rdns->server_count),
+        .used = 1};
+    rdns->inflight++;
+  }
+}
+
+// Send every query that is not on the wire, a batch per sendmmsg
+static void rdns_send(rdns_t *rdns) {
+  uint8_t packets[RDNS_BATCH][DNS_QUERY_MAX];
+  struct mmsghdr msgs[RDNS_BATCH];
+  struct iovec iovs[RDNS_BATCH];
+  rdns_query_t *batch[RDNS_BATCH];
+  size_t slot = 0;
+
+  while (slot < RDNS_INFLIGHT) {
+    int count = 0;
+    for (; slot < RDNS_INFLIGHT && count < RDNS_BATCH; ++slot) {
+      rdns_query_t *query = &rdns->queries[slot];
+      if (!query->used || query->sent_ns != 0)
+        continue;
+
+      iovs[count] = (struct iovec){
+          .iov_base = packets[count],
+          .iov_len = rdns_build_query(packets[count], query->id, query->addr)};
+      msgs[count] = (struct mmsghdr){
+          .msg_hdr = {.msg_name = &rdns->servers[query->server],
+                      .msg_namelen = sizeof(struct sockaddr_in),
+                      .msg_iov = &iovs[count],
+                      .msg_iovlen = 1}};
+      batch[count++] = query;
+    }
+    if (count == 0)
+      return;
+
+    int sent = sendmmsg(rdns->fd, msgs, (unsigned int)count, 0);
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    // A query that could not be sent is left to time out and be retried
+    uint64_t now = monotonic_ns();
+    for (int i = 0; i < count; ++i) {
+      batch[i]->sent_ns = now;
+      batch[i]->attempts++;
+      rdns->stats.queries++;
+    }
+  }
+}
+
+static void rdns_receive(rdns_t *rdns) {
+  uint8_t packets[RDNS_BATCH][DNS_PACKET_MAX];
+  struct sockaddr_in from[RDNS_BATCH];
+  struct mmsghdr msgs[RDNS_BATCH];
+  struct iovec iovs[RDNS_BATCH];
+
+  for (;;) {
+    for (int i = 0; i < RDNS_BATCH; ++i) {
+      iovs[i] = (struct iovec){.iov_base = packets[i],
+                               .iov_len = DNS_PACKET_MAX};
+      msgs[i] = (struct mmsghdr){.msg_hdr = {.msg_name = &from[i],
+                                             .msg_namelen = sizeof(from[i]),
+                                             .msg_iov = &iovs[i],
+                                             .msg_iovlen = 1}};
+    }
+
+    int got = recvmmsg(rdns->fd, msgs, RDNS_BATCH, MSG_DONTWAIT, NULL);
+    if (got <= 0)
+      return;
+    for (int i = 0; i < got; ++i)
+      rdns_answer(rdns, packets[i], msgs[i].msg_len, &from[i]);
+    if (got < RDNS_BATCH)
+      return;
+  }
+}
+
+static void rdns_expire(rdns_t *rdns) {
+  uint64_t now = monotonic_ns();
+  for (size_t slot = 0; slot < RDNS_INFLIGHT; ++slot) {
+    rdns_query_t *query = &rdns->queries[slot];
+    if (query->used && query->sent_ns != 0 &&
+        now - query->sent_ns >= (uint64_t)RDNS_TIMEOUT_MS * NS_PER_MS)
+      rdns_retry(rdns, query);
+  }
+}
+
+// Put queued lookups on the wire, wait up to wait_ms for answers if any
+// are outstanding, then take every answer that has arrived and retry the
+// queries that timed out
+void rdns_poll(rdns_t *rdns, int wait_ms) {
+  rdns_fill(rdns);
+  rdns_send(rdns);
+
+  if (rdns->inflight > 0 && wait_ms > 0) {
+    struct pollfd pfd = {.fd = rdns->fd, .events = POLLIN};
+    poll(&pfd, 1, wait_ms);
+  }
+  rdns_receive(rdns);
+  rdns_expire(rdns);
+}
+
+int rdns_busy(const rdns_t *rdns) {
+  return rdns->inflight > 0 || rdns->waiting_count > 0;
+}
+
+// Look up addr. Returns 1 with *name set (NULL for no name) when the cache
+// has a fresh answer, or 0 once the lookup is queued; rdns_result then
+// tells when it is done.
+int rdns_lookup(rdns_t *rdns, uint32_t addr, const char **name) {
+  rdns->stats.lookups++;
+  *name = NULL;
+
+  rdns_entry_t *entry = rdns_entry(rdns, addr);
+  if (!entry)
+    return 1;
+  if (entry->state == RDNS_ENTRY_DONE &&
+      entry->expires_s > (uint32_t)time(NULL)) {
+    rdns->stats.cached++;
+    if (entry->name)
+      rdns->stats.named++;
+    *name = entry->name;
+    return 1;
+  }
+  if (entry->state == RDNS_ENTRY_QUEUED)
+    return 0;
+
+  entry->state = RDNS_ENTRY_QUEUED;
+  if (rdns_enqueue(rdns, addr) != 0) {
+    rdns_settle(rdns, addr, NULL, RDNS_FAILURE_TTL_S, 0);
+    return 1;
+  }
+  return 0;
+}
+
+// Whether a lookup is done, with its name. A stale answer still counts;
+// only rdns_lookup asks again.
+int rdns_result(const rdns_t *rdns, uint32_t addr, const char **name) {
+  const rdns_entry_t *entry =
+      rdns_slot(rdns->entries, rdns->capacity, addr);
+  *name = NULL;
+  if (entry->state == RDNS_ENTRY_QUEUED)
+    return 0;
+  *name = entry->name;
+  return 1;
+}
+
+// Servers from a --resolver ADDR[:PORT], or the nameserver lines of
+// resolv.conf that are IPv4
+static int rdns_servers(rdns_t *rdns, const char *server) {
+  char host[IP_STR_LEN];
+  uint32_t addr;
+
+  if (server) {
+    const char *colon = strchr(server, ':');
+    size_t host_len = colon ? (size_t)(colon - server) : strlen(server);
+    char *end = NULL;
+    long port = colon ? strtol(colon + 1, &end, 10) : DNS_PORT;
+    if (host_len >= sizeof(host) || (colon && (*end || port < 1 ||
+                                               port > 65535))) {
+      fprintf(stderr, "Invalid resolver: %s\n", server);
+      return -1;
+    }
+    memcpy(host, server, host_len);
+    host[host_len] = '\0';
+    if (addr_parse(host, &addr) != 0) {
+      fprintf(stderr, "Invalid resolver: %s\n", server);
+      return -1;
+    }
+    rdns->servers[0] = (struct sockaddr_in){.sin_family = AF_INET,
+                                            .sin_port = htons((uint16_t)port),
+                                            .sin_addr.s_addr =
+                                                addr_to_net(addr)};
+    rdns->server_count = 1;
+    return 0;
+  }
+
+  FILE *file = fopen(RDNS_RESOLV_CONF, "r");
+  char line[256];
+  while (file && rdns->server_count < RDNS_MAX_SERVERS &&
+         fgets(line, sizeof(line), file)) {
+    if (sscanf(line, " nameserver %15s", host) == 1 &&
+        addr_parse(host, &addr) == 0)
+      rdns->servers[rdns->server_count++] =
+          (struct sockaddr_in){.sin_family = AF_INET,
+                               .sin_port = htons(DNS_PORT),
+                               .sin_addr.s_addr = addr_to_net(addr)};
+  }
+  if (file)
+    fclose(file);
+  if (rdns->server_count == 0) {
+    fprintf(stderr, "No IPv4 nameserver in %s; name one with --resolver\n",
+            RDNS_RESOLV_CONF);
+    return -1;
+  }
+  return 0;
+}
+
+// Take the answers of earlier runs that are still fresh. A missing file is
+// an empty cache.
+static void rdns_load(rdns_t *rdns) {
+  FILE *file = fopen(rdns->cache_path, "r");
+  char line[IP_STR_LEN + RDNS_NAME_LEN + 32];
+  uint32_t now = (uint32_t)time(NULL);
+
+  if (!file) {
+    if (errno != ENOENT)
+      fprintf(stderr, "Cannot read DNS cache %s: %s\n", rdns->cache_path,
+              strerror(errno));
+    return;
+  }
+
+  while (fgets(line, sizeof(line), file)) {
+    char host[IP_STR_LEN];
+    char name[RDNS_NAME_LEN];
+    unsigned long expires_s;
+    uint32_t addr;
+
+    if (line[0] == '#' ||
+        sscanf(line, "%15s %lu %255s", host, &expires_s, name) != 3 ||
+        addr_parse(host, &addr) != 0 || expires_s <= now ||
+        expires_s > now + RDNS_MAX_TTL_S)
+      continue;
+    rdns_settle(rdns, addr, strcmp(name, "-") == 0 ? NULL : name,
+                (uint32_t)expires_s - now, 1);
+  }
+  fclose(file);
+}
+
+// Rewrite the cache with every fresh answer, replacing the old file only
+// once the new one is complete
+static void rdns_save(const rdns_t *rdns) {
+  char tmp[4096];
+  char ip[IP_STR_LEN];
+  uint32_t now = (uint32_t)time(NULL);
+
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", rdns->cache_path) >=
+      (int)sizeof(tmp))
+    return;
+  FILE *file = fopen(tmp, "w");
+  if (!file) {
+    fprintf(stderr, "Cannot write DNS cache %s: %s\n", tmp, strerror(errno));
+    return;
+  }
+
+  fprintf(file, "# address, expiry (Unix time), PTR name or -\n");
+  for (size_t i = 0; i < rdns->capacity; ++i) {
+    const rdns_entry_t *entry = &rdns->entries[i];
+    if (entry->state == RDNS_ENTRY_DONE && entry->persist &&
+        entry->expires_s > now)
+      fprintf(file, "%s %u %s\n", addr_format(entry->addr, ip),
+              entry->expires_s, entry->name ? entry->name : "-");
+  }
+
+  if (fclose(file) != 0 || rename(tmp, rdns->cache_path) != 0) {
+    fprintf(stderr, "Cannot write DNS cache %s: %s\n", rdns->cache_path,
+            strerror(errno));
+    unlink(tmp);
+  }
+}
+
+// Open the resolver: server overrides resolv.conf, and cache_path, if
+// set, is read now and rewritten by rdns_close. Returns -1 after printing
+// a diagnostic.
+int rdns_open(rdns_t *rdns, const char *server, const char *cache_path) {
+  *rdns = (rdns_t){.fd = -1, .cache_path = cache_path};
+
+  if (rdns_servers(rdns, server) != 0)
+    return -1;
+
+  rdns->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (rdns->fd < 0) {
+    fprintf(stderr, "Cannot open DNS socket: %s\n", strerror(errno));
+    return -1;
+  }
+
+  rdns->capacity = RDNS_INITIAL_ENTRIES;
+  rdns->entries = calloc(rdns->capacity, sizeof(*rdns->entries));
+  rdns->waiting_capacity = RDNS_INITIAL_WAITING;
+  rdns->waiting = malloc(rdns->waiting_capacity * sizeof(*rdns->waiting));
+  if (!rdns->entries || !rdns->waiting ||
+      arena_init(&rdns->names, RDNS_NAME_SPACE) != 0) {
+    fprintf(stderr, "Memory allocation failed\n");
+    rdns->cache_path = NULL;
+    rdns_close(rdns);
+    return -1;
+  }
+
+  if (getrandom(&rdns->random, sizeof(rdns->random), 0) !=
+          sizeof(rdns->random) ||
+      rdns->random == 0)
+    rdns->random = monotonic_ns() | 1;
+
+  if (cache_path)
+    rdns_load(rdns);
+  return 0;
+}
+
+// Save the cache and release everything; names handed out are invalid
+// after this
+void rdns_close(rdns_t *rdns) {
+  if (rdns->cache_path && rdns->entries)
+    rdns_save(rdns);
+  if (rdns->fd >= 0)
+    close(rdns->fd);
+  free(rdns->entries);
+  free(rdns->waiting);
+  arena_destroy(&rdns->names);
+  *rdns = (rdns_t){.fd = -1};
+}
@@ -0,0 +1,195 @@
+#include "results.h"
+
+#include <stdatomic.h>
+#include <stdbit.h>
+
+#define WORD_BITS 64
+
+#define CHUNK_BYTES                                                          \
+  ((size_t)RESULT_CHUNK_BLOCKS * RESULT_BLOCK_SIZE * sizeof(result_detail_t))
+
+static size_t block_count(size_t bits) {
+  return (bits + RESULT_BLOCK_SIZE - 1) >> RESULT_BLOCK_BITS;
+}
+
+// Chunks enough for a detail block per block of indices, plus one for the
+// blocks lost when two receivers race to fill the same one
+static size_t chunk_count(size_t bits) {
+  return (block_count(bits) + RESULT_CHUNK_BLOCKS - 1) / RESULT_CHUNK_BLOCKS +
+         1;
+}
+
+// Arena bytes a store over bits indices takes
+size_t result_store_span(size_t bits) {
+  size_t words = (bits + WORD_BITS - 1) / WORD_BITS;
+  return arena_span(words * sizeof(uint64_t)) +
+         arena_span(block_count(bits) * sizeof(result_detail_t *)) +
+         arena_span(chunk_count(bits) * sizeof(result_detail_t *));
+}
+
+int result_store_init(result_store_t *store, size_t bits, arena_t *arena) {
+  store->bits = bits;
+  store->words = (bits + WORD_BITS - 1) / WORD_BITS;
+  store->block_count = block_count(bits);
+  store->chunk_count = chunk_count(bits);
+  atomic_init(&store->next_block, 0);
+  store->alive = arena_alloc(arena, store->words * sizeof(uint64_t));
+  store->blocks =
+      arena_alloc(arena, store->block_count * sizeof(result_detail_t *));
+  store->chunks =
+      arena_alloc(arena, store->chunk_count * sizeof(result_detail_t *));
+  return store->alive && store->blocks && store->chunks ? 0 : -1;
+}
+
+// Unmap the detail chunks. The rest of the store goes with its arena.
+void result_store_destroy(result_store_t *store) {
+  if (!store->chunks)
+    return;
+  for (size_t i = 0; i < store->chunk_count; ++i) {
+    arena_t chunk = {.base = (uint8_t *)atomic_load(&store->chunks[i]),
+                     .capacity = arena_span(CHUNK_BYTES)};
+    arena_destroy(&chunk);
+  }
+}
+
+static result_detail_t *detail_at(const result_store_t *store, size_t index) {
+  result_detail_t *block = atomic_load_explicit(
+      &store->blocks[index >> RESULT_BLOCK_BITS], memory_order_acquire);
+  return block ? &block[index & (RESULT_BLOCK_SIZE - 1)] : NULL;
+}
+
+// Forget every result. Only responders have details, so only theirs are
+// wiped, and their blocks stay in place for the next scan over the same
+// indices.
+void result_store_clear(result_store_t *store) {
+  for (size_t i = 0; i < store->words; ++i) {
+    uint64_t bits =
+        atomic_exchange_explicit(&store->alive[i], 0, memory_order_relaxed);
+    while (bits) {
+      result_detail_t *detail =
+          detail_at(store, i * WORD_BITS + stdc_trailing_zeros(bits));
+      if (detail)
+        *detail = (result_detail_t){0};
+      bits &= bits - 1;
+    }
+  }
+}
+
+// Take the next unused detail block, mapping a new chunk for it if it
+// starts one. Returns NULL once every chunk is used or a map fails.
+static result_detail_t *claim_block(result_store_t *store) {
+  size_t next = atomic_fetch_add(&store->next_block, 1);
+  size_t index = next / RESULT_CHUNK_BLOCKS;
+  if (index >= store->chunk_count)
+    return NULL;
+
+  result_detail_t *chunk =
+      atomic_load_explicit(&store->chunks[index], memory_order_acquire);
+  if (!chunk) {
+    arena_t arena;
+    if (arena_init(&arena, CHUNK_BYTES) != 0)
+      return NULL;
+    result_detail_t *mapped = arena_alloc(&arena, CHUNK_BYTES);
+    if (atomic_compare_exchange_strong_explicit(&store->chunks[index], &chunk,
+                                                mapped, memory_order_acq_rel,
+                                                memory_order_acquire))
+      chunk = mapped;
+    else
+      arena_destroy(&arena);
+  }
+
+  return &chunk[(next % RESULT_CHUNK_BLOCKS) * RESULT_BLOCK_SIZE];
+}
+
+// Detail slot for index, giving its block one on its first responder
+static result_detail_t *detail_slot(result_store_t *store, size_t index) {
+  _Atomic(result_detail_t *) *slot = &store->blocks[index >> RESULT_BLOCK_BITS];
+  result_detail_t *block = atomic_load_explicit(slot, memory_order_acquire);
+  if (!block) {
+    result_detail_t *claimed = claim_block(store);
+    if (!claimed)
+      return NULL;
+    if (atomic_compare_exchange_strong_explicit(
+            slot, &block, claimed, memory_order_acq_rel, memory_order_acquire))
+      block = claimed;
+  }
+  return &block[index & (RESULT_BLOCK_SIZE - 1)];
+}
+
+// Record a responder. Only replied probes are marked; the bitmap starts
+// cleared so timeouts need no write at all. A responder whose details
+// cannot be stored is still counted.
+void result_store_mark(result_store_t *store, size_t index,
+                       const probe_reply_t *reply) {
+  if (!reply || index >= store->bits)
+    return;
+
+  result_detail_t *detail = detail_slot(store, index);
+  if (detail) {
+    detail->rtt_us = reply->rtt_us;
+    detail->ttl = reply->ttl;
+    detail->via = reply->via;
+    detail->valid = 1;
+  }
+
+  atomic_fetch_or(&store->alive[index / WORD_BITS],
+                  1ULL << (index % WORD_BITS));
+}
+
+int result_store_alive(const result_store_t *store, size_t index) {
+  uint64_t word = atomic_load(&store->alive[index / WORD_BITS]);
+  return (int)((word >> (index % WORD_BITS)) & 1);
+}
+
+// Bits of word selected by [lo, hi) within that word
+static uint64_t range_mask(size_t lo, size_t hi) {
+  uint64_t upper = hi >= WORD_BITS ? ~0ULL : (1ULL << hi) - 1;
+  return upper & ~((1ULL << lo) - 1);
+}
+
+// Number of responders with index in [lo, hi)
+size_t result_store_count(const result_store_t *store, size_t lo, size_t hi) {
+  size_t count = 0;
+  if (hi > store->bits)
+    hi = store->bits;
+
+  while (lo < hi) {
+    size_t word = lo / WORD_BITS;
+    size_t word_end = (word + 1) * WORD_BITS < hi ? (word + 1) * WORD_BITS : hi;
+    uint64_t bits = atomic_load(&store->alive[word]) &
+                    range_mask(lo % WORD_BITS, word_end - word * WORD_BITS);
+    count += stdc_count_ones(bits);
+    lo = word_end;
+  }
+
+  return count;
+}
+
+// First responder index in [from, hi), or hi if there is none
+size_t result_store_next(const result_store_t *store, size_t from, size_t hi) {
+  if (hi > store->bits)
+    hi = store->bits;
+
+  while (from < hi) {
+    size_t word = from / WORD_BITS;
+    uint64_t bits = atomic_load(&store->alive[word]) &
+                    range_mask(from % WORD_BITS, WORD_BITS);
+    if (bits) {
+      size_t found = word * WORD_BITS + stdc_trailing_zeros(bits);
+      return found < hi ? found : hi;
+    }
+    from = (word + 1) * WORD_BITS;
+  }
+
+  return hi;
+}
+
+// Reply details for a responder, or NULL if none were recorded
+const result_detail_t *result_store_detail(const result_store_t *store,
+                                           size_t index) {
+  if (index >= store->bits)
+    return NULL;
+
+  const result_detail_t *detail = detail_at(store, index);
+  return detail && detail->valid ? detail : NULL;
+}
@@ -0,0 +1,219 @@
+#include "state.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t state_file_len(uint32_t capacity) {
+  return sizeof(state_header_t) + (size_t)capacity * sizeof(state_block_t);
+}
+
+static uint32_t prefix_hash(uint32_t prefix) {
+  return prefix * 2654435761u;
+}
+
+static void index_insert(state_file_t *state, uint32_t prefix,
+                         uint32_t block) {
+  uint32_t i = prefix_hash(prefix) & state->index_mask;
+  while (state->index[i])
+    i = (i + 1) & state->index_mask;
+  state->index[i] = block + 1;
+}
+
+// Size the index for at least twice the blocks the file can hold and
+// insert every block already in it
+static int index_rebuild(state_file_t *state, uint32_t blocks) {
+  uint32_t size = 64;
+  while (size < blocks * 2)
+    size *= 2;
+
+  uint32_t *index = calloc(size, sizeof(uint32_t));
+  if (!index)
+    return -1;
+  free(state->index);
+  state->index = index;
+  state->index_mask = size - 1;
+
+  for (uint32_t b = 0; b < state->header->block_count; ++b)
+    index_insert(state, state_block(state, b)->prefix, b);
+  return 0;
+}
+
+// Extend the file and the mapping by at least one block
+static int state_grow(state_file_t *state) {
+  uint32_t capacity = state->capacity * 2;
+  if (capacity < state->capacity + STATE_GROW_BLOCKS)
+    capacity = state->capacity + STATE_GROW_BLOCKS;
+  size_t len = state_file_len(capacity);
+
+  if (ftruncate(state->fd, (off_t)len) != 0)
+    return -1;
+  void *map = mremap(state->header, state->map_len, len, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED)
+    return -1;
+
+  state->header = map;
+  state->map_len = len;
+  state->capacity = capacity;
+  return index_rebuild(state, capacity);
+}
+
+// Open or create the state file at path and map it. Returns -1 after
+// printing a diagnostic.
+int state_open(state_file_t *state, const char *path) {
+  struct stat st;
+  int created = 0;
+
+  *state = (state_file_t){.fd = -1};
+  state->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (state->fd < 0 || fstat(state->fd, &st) != 0) {
+    fprintf(stderr, "Cannot open state file %s: %s\n", path,
+            strerror(errno));
+    goto fail;
+  }
+
+  if (st.st_size == 0) {
+    state->capacity = STATE_GROW_BLOCKS;
+    if (ftruncate(state->fd, (off_t)state_file_len(state->capacity)) != 0) {
+      fprintf(stderr, "Cannot size state file %s: %s\n", path,
+              strerror(errno));
+      goto fail;
+    }
+    created = 1;
+  } else if ((size_t)st.st_size < sizeof(state_header_t) ||
+             ((size_t)st.st_size - sizeof(state_header_t)) %
+                     sizeof(state_block_t) !=
+                 0) {
+    fprintf(stderr, "%s is not a state file\n", path);
+    goto fail;
+  } else {
+    state->capacity = (uint32_t)(((size_t)st.st_size -
+                                  sizeof(state_header_t)) /
+                                 sizeof(state_block_t));
+  }
+
+  state->map_len = state_file_len(state->capacity);
+  void *map = mmap(NULL, state->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   state->fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Cannot map state file %s: %s\n", path, strerror(errno));
+    goto fail;
+  }
+  state->header = map;
+
+  if (created) {
+    memcpy(state->header->magic, STATE_MAGIC, 4);
+    state->header->version = STATE_VERSION;
+    state->header->header_len = sizeof(state_header_t);
+  } else if (memcmp(state->header->magic, STATE_MAGIC, 4) != 0 ||
+             state->header->version != STATE_VERSION ||
+             state->header->header_len != sizeof(state_header_t) ||
+             state->header->block_count > state->capacity) {
+    fprintf(stderr, "%s is not a version %d state file\n", path,
+            STATE_VERSION);
+    goto fail_map;
+  }
+
+  if (index_rebuild(state, state->capacity) != 0) {
+    fprintf(stderr, "Memory allocation failed\n");
+    goto fail_map;
+  }
+  return 0;
+
+fail_map:
+  munmap(state->header, state->map_len);
+  state->header = NULL;
+fail:
+  if (state->fd >= 0)
+    close(state->fd);
+  state->fd = -1;
+  return -1;
+}
+
+// Unmap and close; the shared mapping has already carried every update
+// into the page cache
+void state_close(state_file_t *state) {
+  if (!state->header)
+    return;
+  munmap(state->header, state->map_len);
+  close(state->fd);
+  free(state->index);
+  *state = (state_file_t){.fd = -1};
+}
+
+// Count a new scan; it moves which long-dead hosts are sampled
+void state_begin_run(state_file_t *state) { state->header->runs++; }
+
+// Block number for a /24, appending an empty block the first time it is
+// seen. May move the mapping, so block pointers are only stable once every
+// prefix of a scan has been reserved. Returns -1 if the file cannot grow.
+int state_reserve(state_file_t *state, uint32_t prefix) {
+  uint32_t i = prefix_hash(prefix) & state->index_mask;
+  for (; state->index[i]; i = (i + 1) & state->index_mask) {
+    uint32_t block = state->index[i] - 1;
+    if (state_block(state, block)->prefix == prefix)
+      return (int)block;
+  }
+
+  if (state->header->block_count == state->capacity &&
+      state_grow(state) != 0) {
+    fprintf(stderr, "Cannot grow state file: %s\n", strerror(errno));
+    return -1;
+  }
+
+  uint32_t block = state->header->block_count;
+  state_block_t *entry = state_block(state, block);
+  memset(entry, 0, sizeof(*entry));
+  entry->prefix = prefix;
+  state->header->block_count = block + 1;
+  index_insert(state, prefix, block);
+  return (int)block;
+}
+
+state_block_t *state_block(const state_file_t *state, uint32_t block) {
+  state_block_t *blocks = (state_block_t *)(state->header + 1);
+  return &blocks[block];
+}
+
+// Whether a rescan should probe this host. New and recently seen hosts
+// always are; long-dead ones only on their turn, spread so each run
+// revisits a different slice of them.
+int state_should_probe(const state_file_t *state, const host_state_t *host,
+                       uint32_t addr, const state_policy_t *policy) {
+  if (!host->last_probed || host->dead_streak < policy->dead_after)
+    return 1;
+  if (policy->dead_sample <= 0)
+    return 0;
+
+  uint32_t turn = (addr * 2654435761u) >> 8;
+  return (turn + state->header->runs) % (uint32_t)policy->dead_sample == 0;
+}
+
+// Fold one probe result into a host's state. Hosts seen for the first time
+// never count as a change.
+state_change_t state_record(host_state_t *host, const probe_reply_t *reply,
+                            uint32_t now) {
+  int known = host->last_probed != 0;
+  int was_up = host->up;
+
+  host->last_probed = now;
+  if (reply) {
+    host->last_alive = now;
+    host->rtt_us = reply->rtt_us;
+    host->dead_streak = 0;
+    host->up = 1;
+  } else {
+    if (host->dead_streak < UINT16_MAX)
+      host->dead_streak++;
+    host->up = 0;
+  }
+
+  if (!known || was_up == host->up)
+    return STATE_SAME;
+  return host->up ? STATE_CAME_UP : STATE_WENT_DOWN;
+}
@@ -0,0 +1,312 @@
+#include "targets.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "addr.h"
+
+void target_set_init(target_set_t *set) {
+  set->arena = (arena_t){0};
+  set->ranges = NULL;
+  set->count = 0;
+  set->capacity = 0;
+}
+
+void target_set_destroy(target_set_t *set) {
+  arena_destroy(&set->arena);
+  target_set_init(set);
+}
+
+// Move the set's ranges into a fresh arena with room for capacity of them.
+// The reservation follows what was actually parsed, so a short list never
+// asks for the worst case even where the kernel would charge it in full.
+static int target_set_reserve(target_set_t *set, size_t capacity) {
+  arena_t arena;
+  size_t size = capacity * sizeof(target_range_t);
+
+  if (arena_init(&arena, size) != 0)
+    return -1;
+  target_range_t *ranges = arena_alloc(&arena, size);
+  if (set->count > 0)
+    memcpy(ranges, set->ranges, set->count * sizeof(target_range_t));
+
+  arena_destroy(&set->arena);
+  set->arena = arena;
+  set->ranges = ranges;
+  set->capacity = capacity;
+  return 0;
+}
+
+// The set's ranges are one run in an arena that doubles whenever it fills,
+// up to TARGET_SET_MAX_RANGES
+int target_set_add(target_set_t *set, uint32_t first, uint32_t last) {
+  if (first > last)
+    return -1;
+
+  if (set->count == set->capacity) {
+    if (set->capacity == TARGET_SET_MAX_RANGES) {
+      errno = ENOMEM;
+      return -1;
+    }
+    size_t capacity = set->capacity ? set->capacity * 2
+                                    : TARGET_SET_INITIAL_RANGES;
+    if (capacity > TARGET_SET_MAX_RANGES)
+      capacity = TARGET_SET_MAX_RANGES;
+    if (target_set_reserve(set, capacity) != 0)
+      return -1;
+  }
+
+  set->ranges[set->count++] = (target_range_t){first, last};
+  return 0;
+}
+
+static int range_compare(const void *a, const void *b) {
+  const target_range_t *ra = a;
+  const target_range_t *rb = b;
+  return (ra->first > rb->first) - (ra->first < rb->first);
+}
+
+// Sort and coalesce overlapping or adjacent ranges in place
+static void target_set_merge(target_set_t *set) {
+  if (set->count < 2)
+    return;
+
+  qsort(set->ranges, set->count, sizeof(target_range_t), range_compare);
+
+  size_t out = 0;
+  for (size_t i = 1; i < set->count; ++i) {
+    target_range_t *cur = &set->ranges[out];
+    const target_range_t *next = &set->ranges[i];
+
+    if (cur->last == UINT32_MAX || next->first <= cur->last + 1) {
+      if (next->last > cur->last)
+        cur->last = next->last;
+    } else {
+      set->ranges[++out] = *next;
+    }
+  }
+  set->count = out + 1;
+}
+
+// Merge the set and remove every address covered by exclude
+int target_set_compile(target_set_t *set, const target_set_t *exclude) {
+  target_set_merge(set);
+  if (!exclude || exclude->count == 0)
+    return 0;
+
+  target_set_t excl;
+  target_set_init(&excl);
+  for (size_t i = 0; i < exclude->count; ++i) {
+    if (target_set_add(&excl, exclude->ranges[i].first,
+                       exclude->ranges[i].last) != 0) {
+      target_set_destroy(&excl);
+      return -1;
+    }
+  }
+  target_set_merge(&excl);
+
+  // Both sides are sorted and disjoint, so one linear sweep suffices
+  target_set_t out;
+  target_set_init(&out);
+  size_t e = 0;
+
+  for (size_t i = 0; i < set->count; ++i) {
+    uint64_t first = set->ranges[i].first;
+    uint64_t last = set->ranges[i].last;
+
+    while (e < excl.count && excl.ranges[e].last < first)
+      e++;
+
+    for (size_t j = e; j < excl.count && excl.ranges[j].first <= last; ++j) {
+      if (excl.ranges[j].first > first &&
+          target_set_add(&out, (uint32_t)first, excl.ranges[j].first - 1) != 0)
+        goto fail;
+      first = (uint64_t)excl.ranges[j].last + 1;
+      if (first > last)
+        break;
+    }
+
+    if (first <= last &&
+        target_set_add(&out, (uint32_t)first, (uint32_t)last) != 0)
+      goto fail;
+  }
+
+  target_set_destroy(&excl);
+  target_set_destroy(set);
+  *set = out;
+  return 0;
+
+fail:
+  target_set_destroy(&excl);
+  target_set_destroy(&out);
+  return -1;
+}
+
+uint64_t target_set_size(const target_set_t *set) {
+  uint64_t size = 0;
+  for (size_t i = 0; i < set->count; ++i)
+    size += (uint64_t)set->ranges[i].last - set->ranges[i].first + 1;
+  return size;
+}
+
+// FNV-1a over the compiled ranges: equal for the same set of addresses
+// however it was written down
+uint64_t target_set_fingerprint(const target_set_t *set) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < set->count; ++i) {
+    uint32_t bounds[2] = {set->ranges[i].first, set->ranges[i].last};
+    const uint8_t *bytes = (const uint8_t *)bounds;
+    for (size_t b = 0; b < sizeof(bounds); ++b)
+      hash = (hash ^ bytes[b]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// With hosts_only set, CIDR blocks of /30 and wider skip their network and
+// broadcast addresses; exclusions pass 0 to remove the whole block
+int target_parse_range(const char *spec, target_range_t *range,
+                       int hosts_only) {
+  char buf[TARGET_SPEC_LEN];
+  if (strlen(spec) >= sizeof(buf))
+    return -1;
+  strcpy(buf, spec);
+
+  char *slash = strchr(buf, '/');
+  char *dash = strchr(buf, '-');
+
+  if (slash) {
+    *slash = '\0';
+    char *end;
+    errno = 0;
+    long prefix = strtol(slash + 1, &end, 10);
+    if (errno || *end || end == slash + 1 || prefix < 0 || prefix > 32)
+      return -1;
+
+    uint32_t base;
+    if (addr_parse(buf, &base) != 0)
+      return -1;
+
+    uint32_t mask = prefix == 0 ? 0 : ~0u << (32 - prefix);
+    range->first = base & mask;
+    range->last = range->first | ~mask;
+    if (hosts_only && prefix <= 30) {
+      range->first++;
+      range->last--;
+    }
+    return 0;
+  }
+
+  if (dash) {
+    *dash = '\0';
+    if (addr_parse(buf, &range->first) != 0 ||
+        addr_parse(dash + 1, &range->last) != 0 || range->first > range->last)
+      return -1;
+    return 0;
+  }
+
+  if (addr_parse(buf, &range->first) != 0)
+    return -1;
+  range->last = range->first;
+  return 0;
+}
+
+static int target_parse_file_at(const char *path, target_set_t *include,
+                                target_set_t *exclude, int depth);
+
+// depth counts the @file includes the entry is read through
+static int target_parse_entry(const char *entry, target_set_t *include,
+                              target_set_t *exclude, int depth) {
+  if (entry[0] == '@')
+    return target_parse_file_at(entry + 1, include, exclude, depth + 1);
+
+  target_set_t *set = include;
+  if (entry[0] == '!') {
+    set = exclude;
+    entry++;
+  }
+
+  target_range_t range;
+  if (target_parse_range(entry, &range, set == include) != 0) {
+    fprintf(stderr, "Invalid target: %s\n", entry);
+    return -1;
+  }
+  return target_set_add(set, range.first, range.last);
+}
+
+static int target_parse_list_at(const char *list, target_set_t *include,
+                                target_set_t *exclude, int depth) {
+  char entry[TARGET_SPEC_LEN];
+
+  while (*list) {
+    while (*list == ',' || isspace((unsigned char)*list))
+      list++;
+    if (!*list || *list == '#')
+      break;
+
+    size_t len = 0;
+    while (list[len] && list[len] != ',' && !isspace((unsigned char)list[len]))
+      len++;
+    if (len >= sizeof(entry)) {
+      fprintf(stderr, "Target spec too long\n");
+      return -1;
+    }
+
+    memcpy(entry, list, len);
+    entry[len] = '\0';
+    list += len;
+
+    if (target_parse_entry(entry, include, exclude, depth) != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+int target_parse_list(const char *list, target_set_t *include,
+                      target_set_t *exclude) {
+  return target_parse_list_at(list, include, exclude, 0);
+}
+
+// One or more specs per line; '#' starts a comment. A file that includes
+// itself, directly or through others, trips the depth limit instead of
+// recursing without end.
+static int target_parse_file_at(const char *path, target_set_t *include,
+                                target_set_t *exclude, int depth) {
+  if (depth > TARGET_MAX_INCLUDE_DEPTH) {
+    fprintf(stderr, "Target files nest more than %d deep at %s; do they "
+                    "include each other?\n",
+            TARGET_MAX_INCLUDE_DEPTH, path);
+    return -1;
+  }
+
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "Cannot open target file %s: %s\n", path,
+            strerror(errno));
+    return -1;
+  }
+
+  // Whole lines, however long, so a spec or comment is never split
+  char *line = NULL;
+  size_t cap = 0;
+  int ret = 0;
+  while (ret == 0 && getline(&line, &cap, file) >= 0)
+    ret = target_parse_list_at(line, include, exclude, depth);
+
+  if (ret == 0 && ferror(file)) {
+    fprintf(stderr, "Cannot read target file %s: %s\n", path,
+            strerror(errno));
+    ret = -1;
+  }
+  free(line);
+  fclose(file);
+  return ret;
+}
+
+int target_parse_file(const char *path, target_set_t *include,
+                      target_set_t *exclude) {
+  return target_parse_file_at(path, include, exclude, 1);
+}
@@ -0,0 +1,198 @@
+#include "tcp.h"
+
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "icmp.h"
+
+// Discard port; connecting a UDP socket to it only runs a route lookup
+#define TCP_ROUTE_PORT 9
+
+// Have the kernel drop every segment not addressed to our source port, so
+// sockets of several engines each see only the answers to their own SYNs
+static void tcp_syn_steer(const tcp_syn_socket_t *sock) {
+  struct sock_filter code[] = {
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0), // X = IP header length
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),  // destination port
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, sock->sport, 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, UINT32_MAX),
+      BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog prog = {.len = sizeof(code) / sizeof(code[0]),
+                            .filter = code};
+
+  // Without the filter tcp_parse_answer still rejects them, just later
+  setsockopt(sock->sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+             sizeof(prog));
+}
+
+// Open the raw socket SYNs go out on. The kernel adds the IP header and
+// would hand us a copy of every inbound TCP segment; a filter keeps only
+// those to our port. Needs CAP_NET_RAW. With a device, source addresses
+// are those the kernel would use on it. Sockets opened with different
+// lanes send from different ports.
+int tcp_syn_open(tcp_syn_socket_t *sock, const char *device,
+                 unsigned int lane) {
+  sock->sockfd = socket(AF_INET, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_TCP);
+  if (sock->sockfd < 0)
+    return -1;
+
+  uint32_t random[2];
+  if (getrandom(random, sizeof(random), 0) != sizeof(random)) {
+    close(sock->sockfd);
+    sock->sockfd = -1;
+    return -1;
+  }
+  int sndbuf = TCP_SYN_SNDBUF;
+  if (setsockopt(sock->sockfd, SOL_SOCKET, SO_SNDBUFFORCE, &sndbuf,
+                 sizeof(sndbuf)) != 0)
+    setsockopt(sock->sockfd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+  sock->device = device;
+  sock->secret = random[0];
+  sock->sport =
+      (uint16_t)(TCP_SYN_PORT_MIN +
+                 (random[1] % TCP_SYN_PORT_SPAN + lane) % TCP_SYN_PORT_SPAN);
+  tcp_syn_steer(sock);
+  return 0;
+}
+
+void tcp_syn_close(tcp_syn_socket_t *sock) {
+  if (sock->sockfd >= 0) {
+    close(sock->sockfd);
+    sock->sockfd = -1;
+  }
+}
+
+// Source addresses already looked up, shared by every sending thread. A
+// slot holds a /24's number plus one in the high word (0 for empty) and
+// its source address in the low one, so it is read and replaced whole.
+// Slots are indexed by the /24's low bits, which map a /8 one to one, so
+// a random send order still looks up each /24 about once. Every probe of
+// a run goes out through the same device, so it is not part of the key.
+static _Atomic uint64_t route_cache[TCP_ROUTE_CACHE_SLOTS];
+
+// The address the kernel would send to dst from, which the TCP checksum
+// covers
+int tcp_route_source(in_addr_t dst, const char *device, in_addr_t *src) {
+  uint32_t net = ntohl(dst) >> 8;
+  _Atomic uint64_t *slot = &route_cache[net & (TCP_ROUTE_CACHE_SLOTS - 1)];
+  uint64_t entry = atomic_load_explicit(slot, memory_order_relaxed);
+
+  if (entry >> 32 == (uint64_t)net + 1) {
+    *src = (in_addr_t)entry;
+    return 0;
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  if (device && setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, device,
+                           (socklen_t)strlen(device) + 1) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_port = htons(TCP_ROUTE_PORT),
+                             .sin_addr.s_addr = dst};
+  socklen_t addr_len = sizeof(addr);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+    close(fd);
+    return -1;
+  }
+  close(fd);
+
+  *src = addr.sin_addr.s_addr;
+  atomic_store_explicit(slot, ((uint64_t)net + 1) << 32 | *src,
+                        memory_order_relaxed);
+  return 0;
+}
+
+// Build a SYN segment, checksummed over the IPv4 pseudo-header, into buf.
+// Returns its length or 0 if it won't fit.
+size_t tcp_build_syn(uint8_t *buf, size_t cap, in_addr_t src, in_addr_t dst,
+                     uint16_t sport, uint16_t dport, uint32_t seq) {
+  if (cap < TCP_SYN_LEN)
+    return 0;
+
+  memset(buf, 0, TCP_SYN_LEN);
+  struct tcphdr *hdr = (struct tcphdr *)buf;
+  hdr->source = htons(sport);
+  hdr->dest = htons(dport);
+  hdr->seq = htonl(seq);
+  hdr->doff = TCP_SYN_LEN / 4;
+  hdr->syn = 1;
+  hdr->window = htons(TCP_SYN_WINDOW);
+
+  buf[20] = TCPOPT_MAXSEG;
+  buf[21] = TCPOLEN_MAXSEG;
+  buf[22] = (uint8_t)(TCP_SYN_MSS >> 8);
+  buf[23] = (uint8_t)TCP_SYN_MSS;
+
+  // Source, destination, zero, protocol, TCP length, then the segment
+  uint8_t pseudo[12 + TCP_SYN_LEN];
+  memcpy(pseudo, &src, 4);
+  memcpy(pseudo + 4, &dst, 4);
+  pseudo[8] = 0;
+  pseudo[9] = IPPROTO_TCP;
+  pseudo[10] = 0;
+  pseudo[11] = TCP_SYN_LEN;
+  memcpy(pseudo + 12, buf, TCP_SYN_LEN);
+  hdr->check = icmp_checksum(pseudo, sizeof(pseudo));
+
+  return TCP_SYN_LEN;
+}
+
+int tcp_send_syn(const tcp_syn_socket_t *sock, in_addr_t dst, uint16_t dport,
+                 uint32_t cookie) {
+  in_addr_t src;
+  if (tcp_route_source(dst, sock->device, &src) != 0)
+    return -1;
+
+  alignas(struct tcphdr) uint8_t segment[TCP_SYN_LEN];
+  size_t len = tcp_build_syn(segment, sizeof(segment), src, dst, sock->sport,
+                             dport, cookie ^ sock->secret);
+
+  struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = dst};
+  ssize_t sent = sendto(sock->sockfd, segment, len, 0,
+                        (struct sockaddr *)&addr, sizeof(addr));
+  return sent == (ssize_t)len ? 0 : -1;
+}
+
+// Validate an inbound segment as a SYN-ACK or RST answering one of our
+// SYNs. Either proves the host is up. Returns 0 and fills answer on a
+// match, -1 otherwise.
+int tcp_parse_answer(const tcp_syn_socket_t *sock, const uint8_t *buf,
+                     size_t len, tcp_answer_t *answer) {
+  if (len < sizeof(struct iphdr))
+    return -1;
+
+  struct iphdr ip;
+  memcpy(&ip, buf, sizeof(ip));
+  size_t offset = (size_t)ip.ihl * 4;
+  if (ip.protocol != IPPROTO_TCP || len < offset + sizeof(struct tcphdr))
+    return -1;
+
+  struct tcphdr hdr;
+  memcpy(&hdr, buf + offset, sizeof(hdr));
+  if (ntohs(hdr.dest) != sock->sport || !hdr.ack ||
+      !(hdr.rst || hdr.syn))
+    return -1;
+
+  answer->from = ip.saddr;
+  answer->port = ntohs(hdr.source);
+  answer->cookie = (ntohl(hdr.ack_seq) - 1) ^ sock->secret;
+  answer->ttl = ip.ttl;
+  return 0;
+}
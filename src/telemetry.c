@@ -0,0 +1,350 @@
+#include "telemetry.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "clock.h"
+
+// Longest host part of a "HOST:PORT" spec
+#define TELEMETRY_HOST_LEN 256
+
+// A scraper gets this long to send its request line
+#define TELEMETRY_REQUEST_TIMEOUT_MS 200
+
+typedef enum { METRIC_COUNTER, METRIC_GAUGE } metric_type_t;
+
+// Every exported series: name, type, help text and where it lives in a
+// sample
+typedef struct {
+  const char *name;
+  metric_type_t type;
+  const char *help;
+  size_t offset;
+  int is_signed;
+} metric_def_t;
+
+#define COUNTER(field, help)                                                   \
+  {#field "_total", METRIC_COUNTER, help,                                      \
+   offsetof(telemetry_sample_t, field), 0}
+#define GAUGE(field, help)                                                     \
+  {#field, METRIC_GAUGE, help, offsetof(telemetry_sample_t, field), 1}
+
+static const metric_def_t metrics[] = {
+    COUNTER(hosts_scanned, "Hosts with a result so far"),
+    COUNTER(responders, "Hosts that answered so far"),
+    COUNTER(subnets_scanned, "Reporting units (/24) completed"),
+    COUNTER(probes_sent, "First-attempt probes sent"),
+    COUNTER(retransmits, "Probes resent after a timeout"),
+    COUNTER(replies, "Probes answered"),
+    COUNTER(timeouts, "Targets that never answered"),
+    COUNTER(send_errors, "Probes the socket refused to send"),
+    COUNTER(rate_stalls, "Sends delayed by the rate limiter"),
+    COUNTER(monitor_cycles, "Daemon cycles completed over the targets"),
+    GAUGE(active_workers, "Stream workers currently sending"),
+    GAUGE(inflight, "Probes awaiting a reply"),
+    GAUGE(window, "In-flight limit set by the congestion controller"),
+    GAUGE(send_queue, "Targets not yet handed to the engine"),
+    GAUGE(retry_queue, "Timed-out targets waiting to be resent"),
+    GAUGE(hosts_up, "Hosts the daemon currently reports up"),
+};
+
+#define METRIC_COUNT (sizeof(metrics) / sizeof(metrics[0]))
+
+static long long metric_value(const telemetry_sample_t *sample,
+                              const metric_def_t *metric) {
+  const char *base = (const char *)sample + metric->offset;
+  if (metric->is_signed) {
+    int64_t value;
+    memcpy(&value, base, sizeof(value));
+    return (long long)value;
+  }
+  uint64_t value;
+  memcpy(&value, base, sizeof(value));
+  return (long long)value;
+}
+
+// Account one snprintf into a buffer of cap bytes, returning the new
+// length; output that did not fit is dropped
+static size_t append(size_t cap, size_t len, int written) {
+  if (written < 0 || len + (size_t)written >= cap)
+    return len;
+  return len + (size_t)written;
+}
+
+// Prometheus text exposition format, version 0.0.4
+size_t telemetry_format_prometheus(const telemetry_sample_t *sample,
+                                   char *buf, size_t cap) {
+  size_t len = 0;
+
+  for (size_t i = 0; i < METRIC_COUNT; ++i) {
+    const metric_def_t *metric = &metrics[i];
+    const char *type = metric->type == METRIC_COUNTER ? "counter" : "gauge";
+
+    len = append(cap, len,
+                 snprintf(buf + len, cap - len,
+                          "# HELP " TELEMETRY_PREFIX "_%s %s\n"
+                          "# TYPE " TELEMETRY_PREFIX "_%s %s\n"
+                          TELEMETRY_PREFIX "_%s %lld\n",
+                          metric->name, metric->help, metric->name, type,
+                          metric->name, metric_value(sample, metric)));
+  }
+
+  return len;
+}
+
+// statsd wants plain names; everything goes out as a gauge of the current
+// value so no deltas need to be kept between pushes
+static size_t format_statsd(const telemetry_sample_t *sample, char *buf,
+                            size_t cap) {
+  size_t len = 0;
+
+  for (size_t i = 0; i < METRIC_COUNT; ++i)
+    len = append(cap, len,
+                 snprintf(buf + len, cap - len,
+                          TELEMETRY_PREFIX ".%s:%lld|g\n", metrics[i].name,
+                          metric_value(sample, &metrics[i])));
+
+  return len;
+}
+
+// Split "[HOST:]PORT"; host falls back to the given default
+static int split_host_port(const char *spec, const char *default_host,
+                           char host[TELEMETRY_HOST_LEN], const char **port) {
+  const char *colon = strrchr(spec, ':');
+
+  if (!colon) {
+    if (!default_host)
+      return -1;
+    snprintf(host, TELEMETRY_HOST_LEN, "%s", default_host);
+    *port = spec;
+    return 0;
+  }
+
+  size_t host_len = (size_t)(colon - spec);
+  if (host_len >= TELEMETRY_HOST_LEN)
+    return -1;
+  if (host_len == 0 && !default_host)
+    return -1;
+
+  if (host_len == 0)
+    snprintf(host, TELEMETRY_HOST_LEN, "%s", default_host);
+  else {
+    memcpy(host, spec, host_len);
+    host[host_len] = '\0';
+  }
+  *port = colon + 1;
+  return 0;
+}
+
+// Open a socket of the given type bound (listen) or connected (statsd) to
+// spec. Returns the descriptor or -1.
+static int open_endpoint(const char *spec, const char *default_host,
+                         int socktype, int passive) {
+  char host[TELEMETRY_HOST_LEN];
+  const char *port;
+  struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = socktype};
+  struct addrinfo *info;
+
+  if (split_host_port(spec, default_host, host, &port) != 0) {
+    fprintf(stderr, "Invalid telemetry endpoint: %s\n", spec);
+    return -1;
+  }
+
+  int rc = getaddrinfo(host, port, &hints, &info);
+  if (rc != 0) {
+    fprintf(stderr, "Cannot resolve %s: %s\n", spec, gai_strerror(rc));
+    return -1;
+  }
+
+  int fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    goto fail;
+
+  if (passive) {
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, info->ai_addr, info->ai_addrlen) != 0 || listen(fd, 16) != 0)
+      goto fail_fd;
+  } else if (connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
+    goto fail_fd;
+  }
+
+  freeaddrinfo(info);
+  return fd;
+
+fail_fd:
+  close(fd);
+fail:
+  fprintf(stderr, "Cannot open telemetry endpoint %s: %s\n", spec,
+          strerror(errno));
+  freeaddrinfo(info);
+  return -1;
+}
+
+// Whether a request line asks for /metrics itself, with or without a
+// query string
+static int is_metrics_request(const char *request) {
+  static const char prefix[] = "GET /metrics";
+  size_t len = sizeof(prefix) - 1;
+  return strncmp(request, prefix, len) == 0 &&
+         (request[len] == ' ' || request[len] == '?');
+}
+
+// Answer one scrape. The request is read only far enough to route it.
+static void serve_scrape(telemetry_t *telemetry, int client) {
+  char request[512];
+  char body[TELEMETRY_BUFFER_LEN];
+  char header[160];
+  struct timeval timeout = {.tv_sec = 0,
+                            .tv_usec = TELEMETRY_REQUEST_TIMEOUT_MS * 1000};
+
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  ssize_t got = recv(client, request, sizeof(request) - 1, 0);
+  if (got <= 0)
+    return;
+  request[got] = '\0';
+
+  if (!is_metrics_request(request)) {
+    static const char not_found[] = "HTTP/1.0 404 Not Found\r\n"
+                                    "Content-Length: 0\r\n"
+                                    "Connection: close\r\n\r\n";
+    send(client, not_found, sizeof(not_found) - 1, MSG_NOSIGNAL);
+    return;
+  }
+
+  telemetry_sample_t sample;
+  telemetry->sample(&sample);
+  size_t body_len = telemetry_format_prometheus(&sample, body, sizeof(body));
+
+  int header_len =
+      snprintf(header, sizeof(header),
+               "HTTP/1.0 200 OK\r\n"
+               "Content-Type: text/plain; version=0.0.4\r\n"
+               "Content-Length: %zu\r\n"
+               "Connection: close\r\n\r\n",
+               body_len);
+  send(client, header, (size_t)header_len, MSG_NOSIGNAL);
+  send(client, body, body_len, MSG_NOSIGNAL);
+}
+
+static void push_statsd(telemetry_t *telemetry) {
+  char datagram[TELEMETRY_BUFFER_LEN];
+  telemetry_sample_t sample;
+
+  telemetry->sample(&sample);
+  size_t len = format_statsd(&sample, datagram, sizeof(datagram));
+  send(telemetry->statsd_fd, datagram, len, MSG_NOSIGNAL);
+}
+
+// Exporter thread: serve scrapes as they come and push to statsd on
+// every interval. Only this thread ever touches the exporter sockets.
+static void *telemetry_thread(void *arg) {
+  telemetry_t *telemetry = arg;
+  uint64_t interval_ns = (uint64_t)telemetry->interval_ms * NS_PER_MS;
+  uint64_t next_push = monotonic_ns() + interval_ns;
+  struct pollfd pfd = {.fd = telemetry->http_fd, .events = POLLIN};
+
+  while (atomic_load(&telemetry->running)) {
+    uint64_t now = monotonic_ns();
+
+    if (telemetry->statsd_fd >= 0 && now >= next_push) {
+      push_statsd(telemetry);
+      next_push = now + interval_ns;
+    }
+
+    // Wake at least every 100ms so stopping is prompt
+    int wait_ms = 100;
+    if (telemetry->statsd_fd >= 0 && next_push > now &&
+        (next_push - now) / NS_PER_MS < (uint64_t)wait_ms)
+      wait_ms = (int)((next_push - now) / NS_PER_MS);
+
+    if (telemetry->http_fd < 0) {
+      sleep_ns((uint64_t)wait_ms * NS_PER_MS);
+      continue;
+    }
+
+    if (poll(&pfd, 1, wait_ms) > 0) {
+      int client = accept4(telemetry->http_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (client >= 0) {
+        serve_scrape(telemetry, client);
+        close(client);
+      }
+    }
+  }
+
+  // Final values, so a short scan still lands on the dashboard
+  if (telemetry->statsd_fd >= 0)
+    push_statsd(telemetry);
+
+  return NULL;
+}
+
+// Start the exporter if config asks for an HTTP listener, a statsd target
+// or both. Returns 0 when there is nothing to do.
+int telemetry_start(telemetry_t *telemetry, const telemetry_config_t *config,
+                    telemetry_sample_fn sample) {
+  telemetry->http_fd = -1;
+  telemetry->statsd_fd = -1;
+  telemetry->sample = sample;
+  telemetry->interval_ms =
+      config->interval_ms > 0 ? config->interval_ms
+                              : TELEMETRY_DEFAULT_INTERVAL_MS;
+  atomic_store(&telemetry->running, 0);
+
+  if (!config->listen && !config->statsd)
+    return 0;
+
+  if (config->listen) {
+    telemetry->http_fd =
+        open_endpoint(config->listen, TELEMETRY_DEFAULT_BIND, SOCK_STREAM, 1);
+    if (telemetry->http_fd < 0)
+      return -1;
+  }
+
+  if (config->statsd) {
+    telemetry->statsd_fd = open_endpoint(config->statsd, NULL, SOCK_DGRAM, 0);
+    if (telemetry->statsd_fd < 0)
+      goto fail_http;
+  }
+
+  atomic_store(&telemetry->running, 1);
+  if (pthread_create(&telemetry->thread, NULL, telemetry_thread, telemetry) !=
+      0)
+    goto fail_statsd;
+
+  return 0;
+
+fail_statsd:
+  atomic_store(&telemetry->running, 0);
+  if (telemetry->statsd_fd >= 0)
+    close(telemetry->statsd_fd);
+  telemetry->statsd_fd = -1;
+fail_http:
+  if (telemetry->http_fd >= 0)
+    close(telemetry->http_fd);
+  telemetry->http_fd = -1;
+  return -1;
+}
+
+void telemetry_stop(telemetry_t *telemetry) {
+  if (!atomic_exchange(&telemetry->running, 0))
+    return;
+
+  pthread_join(telemetry->thread, NULL);
+
+  if (telemetry->http_fd >= 0)
+    close(telemetry->http_fd);
+  if (telemetry->statsd_fd >= 0)
+    close(telemetry->statsd_fd);
+  telemetry->http_fd = -1;
+  telemetry->statsd_fd = -1;
+}
@@ -0,0 +1,33 @@
+#include "timeouts.h"
+
+#include <stdatomic.h>
+
+void rtt_profile_init(rtt_profile_t *profile) {
+  atomic_store(&profile->max_us, 0);
+  atomic_store(&profile->samples, 0);
+}
+
+void rtt_profile_record(rtt_profile_t *profile, uint32_t rtt_us) {
+  uint32_t seen = atomic_load_explicit(&profile->max_us, memory_order_relaxed);
+  while (rtt_us > seen &&
+         !atomic_compare_exchange_weak(&profile->max_us, &seen, rtt_us))
+    ;
+  atomic_fetch_add(&profile->samples, 1);
+}
+
+uint32_t rtt_profile_samples(const rtt_profile_t *profile) {
+  return atomic_load(&profile->samples);
+}
+
+// Deadline learned from the subnet so far: p99 plus the larger of margin
+// and half the p99, or 0 while there are too few replies to trust
+uint32_t rtt_profile_deadline_us(const rtt_profile_t *profile,
+                                 uint32_t margin_us) {
+  if (atomic_load(&profile->samples) < TIMEOUT_MIN_SAMPLES)
+    return 0;
+
+  uint64_t p99 = atomic_load(&profile->max_us);
+  uint64_t slack = p99 / 2 > margin_us ? p99 / 2 : margin_us;
+  uint64_t deadline = p99 + slack;
+  return deadline > UINT32_MAX ? UINT32_MAX : (uint32_t)deadline;
+}
@@ -0,0 +1,233 @@
+#include "uring.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static int uring_setup(uint32_t entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+                       uint32_t flags, const void *arg, size_t arg_len) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                      flags, arg, arg_len);
+}
+
+static int uring_register(int fd, uint32_t opcode, const void *arg,
+                          uint32_t count) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static void *ring_at(void *base, uint32_t offset) {
+  return (uint8_t *)base + offset;
+}
+
+// Set up a ring with at least entries SQEs. With sqpoll_idle_ms > 0 a
+// kernel thread polls the SQ, parking after that long without work;
+// kernels that refuse it get a normal ring. Completion waits need
+// IORING_FEAT_EXT_ARG (5.11).
+int uring_open(uring_t *ring, uint32_t entries, int sqpoll_idle_ms) {
+  struct io_uring_params params;
+
+  memset(ring, 0, sizeof(*ring));
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CLAMP;
+  if (sqpoll_idle_ms > 0) {
+    params.flags |= IORING_SETUP_SQPOLL;
+    params.sq_thread_idle = (uint32_t)sqpoll_idle_ms;
+  }
+
+  ring->fd = uring_setup(entries, &params);
+  if (ring->fd < 0 && sqpoll_idle_ms > 0) {
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    ring->fd = uring_setup(entries, &params);
+  }
+  if (ring->fd < 0)
+    return -1;
+  ring->sqpoll = (params.flags & IORING_SETUP_SQPOLL) != 0;
+
+  if (!(params.features & IORING_FEAT_EXT_ARG) ||
+      !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    close(ring->fd);
+    errno = ENOSYS;
+    return -1;
+  }
+
+  // One mapping holds both rings' indices and the CQE array
+  ring->rings_len = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  size_t cq_len =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (cq_len > ring->rings_len)
+    ring->rings_len = cq_len;
+
+  ring->rings = mmap(NULL, ring->rings_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->rings == MAP_FAILED)
+    goto fail_fd;
+
+  ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+    goto fail_ring;
+
+  ring->sq_head = ring_at(ring->rings, params.sq_off.head);
+  ring->sq_tail = ring_at(ring->rings, params.sq_off.tail);
+  ring->sq_flags = ring_at(ring->rings, params.sq_off.flags);
+  ring->sq_mask = *(uint32_t *)ring_at(ring->rings, params.sq_off.ring_mask);
+  ring->sq_array = ring_at(ring->rings, params.sq_off.array);
+  ring->sq_local_tail = atomic_load(ring->sq_tail);
+
+  ring->cq_head = ring_at(ring->rings, params.cq_off.head);
+  ring->cq_tail = ring_at(ring->rings, params.cq_off.tail);
+  ring->cq_mask = *(uint32_t *)ring_at(ring->rings, params.cq_off.ring_mask);
+  ring->cqes = ring_at(ring->rings, params.cq_off.cqes);
+
+  // SQE slots map 1:1 onto the index array, so it is filled only once
+  for (uint32_t i = 0; i <= ring->sq_mask; ++i)
+    ring->sq_array[i] = i;
+  return 0;
+
+fail_ring:
+  munmap(ring->rings, ring->rings_len);
+fail_fd:
+  close(ring->fd);
+  return -1;
+}
+
+void uring_close(uring_t *ring) {
+  munmap(ring->sqes, ring->sqes_len);
+  munmap(ring->rings, ring->rings_len);
+  close(ring->fd);
+  ring->fd = -1;
+}
+
+// Next free SQE, zeroed, or NULL while the kernel has not consumed enough.
+// Not thread-safe; callers sharing a ring serialise around it and
+// uring_submit.
+struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+  uint32_t head = atomic_load_explicit(ring->sq_head, memory_order_acquire);
+  if (ring->sq_local_tail - head > ring->sq_mask)
+    return NULL;
+
+  struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+  ring->sq_local_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+// Publish every SQE handed out so far. A polled ring only needs a wake-up
+// once its thread has gone idle; otherwise this is one io_uring_enter for
+// the whole batch.
+int uring_submit(uring_t *ring) {
+  uint32_t tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+  uint32_t pending = ring->sq_local_tail - tail;
+  if (pending == 0)
+    return 0;
+  atomic_store_explicit(ring->sq_tail, ring->sq_local_tail,
+                        memory_order_release);
+
+  if (ring->sqpoll) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(ring->sq_flags, memory_order_relaxed) &
+        IORING_SQ_NEED_WAKEUP)
+      return uring_enter(ring->fd, 0, 0, IORING_ENTER_SQ_WAKEUP, NULL, 0) < 0
+                 ? -1
+                 : 0;
+    return 0;
+  }
+
+  // Count from the kernel's head so entries a failed enter left behind go
+  // out with this one
+  uint32_t unconsumed = ring->sq_local_tail -
+                        atomic_load_explicit(ring->sq_head,
+                                             memory_order_acquire);
+  return uring_enter(ring->fd, unconsumed, 0, 0, NULL, 0) < 0 ? -1 : 0;
+}
+
+// Wait up to timeout_ms for a completion. Returns 0 when one is ready,
+// -1 with errno ETIME on timeout.
+int uring_wait(uring_t *ring, int timeout_ms) {
+  if (uring_peek(ring))
+    return 0;
+
+  struct __kernel_timespec ts = {
+      .tv_sec = timeout_ms / 1000,
+      .tv_nsec = (long long)(timeout_ms % 1000) * 1000000};
+  struct io_uring_getevents_arg arg = {.ts = (uint64_t)(uintptr_t)&ts};
+  if (uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                  &arg, sizeof(arg)) < 0)
+    return -1;
+  return uring_peek(ring) ? 0 : -1;
+}
+
+// Oldest unconsumed completion, or NULL. Single consumer only.
+struct io_uring_cqe *uring_peek(uring_t *ring) {
+  uint32_t head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+  return head == tail ? NULL : &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_cqe_seen(uring_t *ring) {
+  uint32_t head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+  atomic_store_explicit(ring->cq_head, head + 1, memory_order_release);
+}
+
+// Register count buffers of buf_len bytes as group, all handed to the
+// kernel straight away (kernel 5.19+)
+int uring_bufs_register(uring_t *ring, uring_bufs_t *bufs, uint16_t group,
+                        uint32_t count, size_t buf_len) {
+  bufs->count = count;
+  bufs->group = group;
+  bufs->buf_len = buf_len;
+  bufs->tail = 0;
+  bufs->ring_len = count * sizeof(struct io_uring_buf);
+
+  bufs->ring = mmap(NULL, bufs->ring_len + count * buf_len,
+                    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                    0);
+  if (bufs->ring == MAP_FAILED)
+    return -1;
+  bufs->bufs = (uint8_t *)bufs->ring + bufs->ring_len;
+
+  struct io_uring_buf_reg reg = {.ring_addr = (uint64_t)(uintptr_t)bufs->ring,
+                                 .ring_entries = count,
+                                 .bgid = group};
+  if (uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+    int saved = errno;
+    munmap(bufs->ring, bufs->ring_len + count * buf_len);
+    errno = saved;
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < count; ++i)
+    uring_bufs_recycle(bufs, (uint16_t)i);
+  return 0;
+}
+
+void uring_bufs_unregister(uring_t *ring, uring_bufs_t *bufs) {
+  struct io_uring_buf_reg reg = {.bgid = bufs->group};
+  uring_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+  munmap(bufs->ring, bufs->ring_len + bufs->count * bufs->buf_len);
+}
+
+uint8_t *uring_bufs_get(const uring_bufs_t *bufs, uint16_t id) {
+  return bufs->bufs + (size_t)id * bufs->buf_len;
+}
+
+// Give a buffer back to the kernel once its completion has been handled
+void uring_bufs_recycle(uring_bufs_t *bufs, uint16_t id) {
+  struct io_uring_buf *buf = &bufs->ring->bufs[bufs->tail & (bufs->count - 1)];
+  buf->addr = (uint64_t)(uintptr_t)uring_bufs_get(bufs, id);
+  buf->len = (uint32_t)bufs->buf_len;
+  buf->bid = id;
+  bufs->tail++;
+  atomic_store_explicit((_Atomic uint16_t *)&bufs->ring->tail, bufs->tail,
+                        memory_order_release);
+}